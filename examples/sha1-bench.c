@@ -0,0 +1,131 @@
+/*
+ * Reports how fast each SHA-1 implementation built into the library
+ * hashes, in MB/s, on large buffers and on object-sized ones, and
+ * how fast many small buffers are hashed at once.
+ *
+ * It calls git__sha1_select(), git_hash_many() and other internal
+ * functions which are not part of the API: a shared library only
+ * makes them visible when it exports every symbol, which the Windows
+ * DLL and builds with -fvisibility=hidden don't do. When the link
+ * fails, build the library with -DBUILD_SHARED_LIBS=OFF and link
+ * this against libgit2.a instead.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <git2/errors.h>
+
+#include "hash.h"
+#include "sha1.h"
+
+#define TOTAL_BYTES (256 * 1024 * 1024)
+#define MANY 1024
+
+/* Elapsed seconds; clock() would count the CPU time instead */
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double bench(size_t chunk)
+{
+	unsigned char *data = malloc(chunk);
+	size_t i, rounds = TOTAL_BYTES / chunk;
+	git_oid oid;
+	double start, secs;
+
+	for (i = 0; i < chunk; i++)
+		data[i] = (unsigned char)(i * 131);
+
+	start = now();
+	for (i = 0; i < rounds; i++)
+		git_hash_buf(&oid, data, chunk);
+	secs = now() - start;
+
+	free(data);
+	return (double)(rounds * chunk) / (1024 * 1024) / secs;
+}
+
+/* MANY buffers of `chunk` bytes each, hashed with git_hash_many() */
+static double bench_many(size_t chunk)
+{
+	unsigned char *data = malloc(MANY * chunk);
+	git_buf_vec vec[MANY];
+	git_oid oids[MANY];
+	size_t i, rounds = TOTAL_BYTES / (MANY * chunk);
+	double start, secs;
+
+	for (i = 0; i < MANY * chunk; i++)
+		data[i] = (unsigned char)(i * 131);
+
+	for (i = 0; i < MANY; i++) {
+		vec[i].data = data + i * chunk;
+		vec[i].len = chunk;
+	}
+
+	start = now();
+	for (i = 0; i < rounds; i++)
+		git_hash_many(oids, vec, 1, MANY);
+	secs = now() - start;
+
+	free(data);
+	return (double)(rounds * MANY * chunk) / (1024 * 1024) / secs;
+}
+
+int main(void)
+{
+	const git__sha1_impl *impl;
+	const git__sha1_lanes_impl *lanes;
+	size_t sizes[] = { 64, 1024, 1024 * 1024 };
+	size_t many_sizes[] = { 64, 256, 1024, 4096 };
+	size_t i;
+
+	printf("%-14s", "");
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		printf("%12lu B", (unsigned long)sizes[i]);
+	printf("\n");
+
+	for (impl = git__sha1_impls; impl->name != NULL; impl++) {
+		printf("%-14s", impl->name);
+
+		if (git__sha1_select(impl->name) < 0) {
+			printf("  not available: %s\n", git_lasterror());
+			continue;
+		}
+
+		for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+			printf("%9.0f MB/s", bench(sizes[i]));
+		printf("\n");
+	}
+
+	git__sha1_select(NULL);
+	printf("default: %s\n\n", git__sha1_selected());
+
+	printf("%d at once, with %-5s", MANY, git__sha1_selected());
+	for (i = 0; i < sizeof(many_sizes) / sizeof(many_sizes[0]); i++)
+		printf("%12lu B", (unsigned long)many_sizes[i]);
+	printf("\n");
+
+	for (lanes = git__sha1_lanes_impls; lanes->name != NULL; lanes++) {
+		printf("%-23s", lanes->name);
+
+		if (git__sha1_select_lanes(lanes->name) < 0) {
+			printf("  not available: %s\n", git_lasterror());
+			continue;
+		}
+
+		for (i = 0; i < sizeof(many_sizes) / sizeof(many_sizes[0]); i++)
+			printf("%9.0f MB/s", bench_many(many_sizes[i]));
+		printf("\n");
+	}
+
+	git__sha1_select_lanes(NULL);
+	printf("default: %s\n", git__sha1_selected_lanes());
+
+	return 0;
+}
@@ -39,6 +39,7 @@
 #include "git2/refspec.h"
 #include "git2/net.h"
 #include "git2/status.h"
+#include "git2/fsmonitor.h"
 #include "git2/indexer.h"
 
 #include "git2/notes.h"
@@ -103,6 +103,28 @@ GIT_EXTERN(size_t) git_blob_rawsize(git_blob *blob);
  */
 GIT_EXTERN(int) git_blob_create_fromfile(git_oid *oid, git_repository *repo, const char *path);
 
+/**
+ * Read many files from the working folder of a repository
+ * and write them to the Object Database as loose blobs
+ *
+ * This gives the same blobs as calling `git_blob_create_fromfile`
+ * on each file, but the files are hashed many at a time, and
+ * only the blobs that aren't in the Object Database yet are
+ * written, which makes importing many small files faster.
+ *
+ * If one of the files can't be read, the blobs for the files
+ * before it may have been written.
+ *
+ * @param oids array of `count` oids, to return the id of each blob
+ * @param repo repository where the blobs will be written.
+ *	this repository cannot be bare
+ * @param paths array of `count` files from which the blobs will be
+ *	created, relative to the repository's working dir
+ * @param count number of files
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_blob_create_fromfiles(git_oid *oids, git_repository *repo, const char **paths, size_t count);
+
 
 /**
  * Write an in-memory buffer to the ODB as a blob
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_git_fsmonitor_h__
+#define INCLUDE_git_fsmonitor_h__
+
+#include "common.h"
+#include "types.h"
+
+/**
+ * @file git2/fsmonitor.h
+ * @brief Git filesystem monitor routines
+ * @defgroup git_fsmonitor Git filesystem monitor routines
+ * @ingroup Git
+ * @{
+ */
+GIT_BEGIN_DECL
+
+/**
+ * Callback for `git_fsmonitor.query`, to be called with each
+ * changed path
+ */
+typedef int (*git_fsmonitor_changed_cb)(const char *path, void *payload);
+
+/**
+ * A filesystem monitor, such as a daemon watching the working
+ * directory for changes.
+ *
+ * Without one, finding the status of the working directory means
+ * looking at every file in it. With one, only the files it reports
+ * as changed are looked at; the index is trusted for the rest.
+ *
+ * Every directory is still read, for the files the index doesn't
+ * have, unless the status is asked with
+ * `GIT_STATUS_OPT_EXCLUDE_IGNORED` and `core.untrackedCache` is set:
+ * then the directories the monitor didn't report are taken to hold
+ * the untracked files they had last time. Even so, each untracked
+ * file and each directory holding tracked files costs an lstat(), so
+ * the status is O(changes) in the directory reads only, not in all
+ * of the system calls.
+ *
+ * The index remembers a token the monitor handed out, which stands
+ * for the point in time the working directory was last looked at.
+ */
+struct git_fsmonitor {
+	/**
+	 * Tell what changed in the working directory since `token`.
+	 *
+	 * Call `changed(path, payload)` with the path, relative to the
+	 * working directory, of each file or directory that was
+	 * created, changed or removed since then. A directory stands
+	 * for everything in it; an empty path stands for the whole
+	 * working directory, for when the monitor can't tell what
+	 * changed (say, it was restarted since). `token` is NULL the
+	 * first time, when everything is taken to have changed anyway.
+	 *
+	 * Then set `*new_token` to a token for the time the query was
+	 * made, allocated with `malloc`; changes made while it runs
+	 * must be reported again on the next query.
+	 *
+	 * On error, the monitor is ignored and every file is looked at.
+	 */
+	int (* query)(
+			git_fsmonitor *,
+			const char *token,
+			git_fsmonitor_changed_cb changed,
+			void *payload,
+			char **new_token);
+
+	void (* free)(git_fsmonitor *);
+};
+
+/**
+ * Have the status and diffs of a repository's working directory
+ * use a filesystem monitor
+ *
+ * The repository takes over the monitor, and frees it once it's
+ * freed itself or given another one.
+ *
+ * @param repo a repository with a working directory
+ * @param fsmonitor the monitor, or NULL to stop using one
+ */
+GIT_EXTERN(void) git_repository_set_fsmonitor(git_repository *repo, git_fsmonitor *fsmonitor);
+
+/** @} */
+GIT_END_DECL
+#endif
@@ -228,6 +228,45 @@ GIT_EXTERN(int) git_index_append(git_index *index, const char *path, int stage);
  */
 GIT_EXTERN(int) git_index_append2(git_index *index, const git_index_entry *source_entry);
 
+/**
+ * Add or update many index entries from in-memory structs
+ *
+ * This works like calling `git_index_add2` on each of the
+ * `count` entries, but the index is only sorted once, after
+ * all of them are in; this is the way to stage many files.
+ *
+ * If one of the entries can't be added, the ones before it
+ * stay in the index.
+ *
+ * @param index an existing index object
+ * @param source_entries array of new entry objects
+ * @param count number of entries in the array
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_index_add_entries(git_index *index, const git_index_entry *source_entries, size_t count);
+
+/**
+ * Add or update index entries from many files in disk
+ *
+ * This works like calling `git_index_add` on each of the
+ * `count` files, but their blobs are created with
+ * `git_blob_create_fromfiles`, and the index is only sorted
+ * once; this is the way to stage many files.
+ *
+ * If one of the files can't be read, none of them is added
+ * to the index, but some of their blobs may have been written.
+ *
+ * This method will fail in bare index instances.
+ *
+ * @param index an existing index object
+ * @param paths array of `count` filenames relative to the
+ *	repository's working folder
+ * @param count number of files
+ * @param stage stage for the entries
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_index_add_all(git_index *index, const char **paths, size_t count, int stage);
+
 /**
  * Remove an entry from the index
  *
@@ -8,6 +8,7 @@
 #define _INCLUDE_git_indexer_h__
 
 #include "common.h"
+#include "types.h"
 #include "oid.h"
 
 GIT_BEGIN_DECL
@@ -23,6 +24,92 @@ typedef struct git_indexer_stats {
 
 
 typedef struct git_indexer git_indexer;
+typedef struct git_indexer_stream git_indexer_stream;
+
+/**
+ * Create a new streaming indexer instance
+ *
+ * The streaming indexer takes the packfile as it is being received
+ * (e.g. from the network), stores it in `path` and inflates and
+ * hashes every object as soon as its bytes are available, so the
+ * pack never has to be read back in full.
+ *
+ * @param out where to store the indexer instance
+ * @param path the directory where the packfile and its index
+ * should be stored, usually `objects/pack` of the repository
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_indexer_stream_new(git_indexer_stream **out, const char *path);
+
+/**
+ * Add data to the packfile being indexed
+ *
+ * @param idx the indexer instance
+ * @param data the next bytes of the packfile
+ * @param size the number of bytes in `data`
+ * @param stats storage for the running state
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_indexer_stream_add(git_indexer_stream *idx, const void *data, size_t size, git_indexer_stats *stats);
+
+/**
+ * Finish indexing the packfile
+ *
+ * Once the whole packfile has been added, resolve the deltas and
+ * write out the index. The packfile and its index are stored as
+ * pack-$hash.pack and pack-$hash.idx in the directory given to
+ * `git_indexer_stream_new`.
+ *
+ * @param idx the indexer instance
+ * @param stats storage for the running state
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_indexer_stream_finalize(git_indexer_stream *idx, git_indexer_stats *stats);
+
+/**
+ * Set the number of threads used to resolve deltas
+ *
+ * @see git_indexer_set_threads
+ *
+ * @param idx the indexer instance
+ * @param threads number of threads; 0 to use one per CPU
+ */
+GIT_EXTERN(void) git_indexer_stream_set_threads(git_indexer_stream *idx, unsigned int threads);
+
+/**
+ * Complete thin packs with objects from `odb`
+ *
+ * A thin pack may contain deltas against objects which are not in
+ * the pack itself but which the sender knows we have. When an odb
+ * is set, those bases are read from it and appended to the pack
+ * when it's finalized, so the stored pack is self-contained.
+ *
+ * The odb is not owned by the indexer and must outlive it.
+ *
+ * @param idx the indexer instance
+ * @param odb the object database to take the missing bases from
+ */
+GIT_EXTERN(void) git_indexer_stream_set_odb(git_indexer_stream *idx, git_odb *odb);
+
+/**
+ * Get the packfile's hash
+ *
+ * A packfile's name is derived from the sorted hashing of all object
+ * names. This is only correct after the index has been finalized.
+ *
+ * @param idx the indexer instance
+ */
+GIT_EXTERN(const git_oid *) git_indexer_stream_hash(git_indexer_stream *idx);
+
+/**
+ * Free the streaming indexer and its resources
+ *
+ * If the indexer was not finalized, the partial packfile is removed.
+ *
+ * @param idx the indexer to free
+ */
+GIT_EXTERN(void) git_indexer_stream_free(git_indexer_stream *idx);
+
 
 /**
  * Create a new indexer instance
@@ -32,6 +119,21 @@ typedef struct git_indexer git_indexer;
  */
 GIT_EXTERN(int) git_indexer_new(git_indexer **out, const char *packname);
 
+/**
+ * Set the number of threads used to resolve deltas
+ *
+ * `git_indexer_run` first walks the packfile once to find the
+ * objects and their delta bases, and then resolves the deltas
+ * hanging from each base object in parallel. By default (or when
+ * set to 0) one thread per online CPU is used.
+ *
+ * This has no effect if libgit2 was built without thread support.
+ *
+ * @param idx the indexer instance
+ * @param threads number of threads; 0 to use one per CPU
+ */
+GIT_EXTERN(void) git_indexer_set_threads(git_indexer *idx, unsigned int threads);
+
 /**
  * Iterate over the objects in the packfile and extract the information
  *
@@ -172,6 +172,58 @@ GIT_EXTERN(int) git_odb_read_header(size_t *len_p, git_otype *type_p, git_odb *d
  */
 GIT_EXTERN(int) git_odb_exists(git_odb *db, const git_oid *id);
 
+/**
+ * Read many objects from the database at once.
+ *
+ * This does what `git_odb_read` does for each one of the `count`
+ * objects in `ids`, but looks the objects up in one go: backends
+ * which support it can find them all before reading any of them,
+ * and read them in the order they're stored in.
+ *
+ * The objects are stored in `out`, in the same order as `ids`;
+ * objects which are not in the database are left as NULL. Each
+ * object that was read must be closed by the user.
+ *
+ * @param out array of `count` pointers where to store the objects
+ * @param db database to search for the objects in.
+ * @param ids identities of the objects to read.
+ * @param count how many objects to read
+ * @return
+ * - GIT_SUCCESS if every object was read;
+ * - GIT_ENOTFOUND if some of the objects are not in the database;
+ * - another error code if the objects couldn't be read, in which
+ *   case no object is returned.
+ */
+GIT_EXTERN(int) git_odb_read_many(git_odb_object **out, git_odb *db, const git_oid *ids, size_t count);
+
+/**
+ * Determine which ones of many objects can be found in the
+ * object database.
+ *
+ * @param found array of `count` flags, each set to 1 if the
+ *	object at the same position in `ids` was found, 0 otherwise
+ * @param db database to be searched for the given objects.
+ * @param ids the objects to search for.
+ * @param count how many objects to search for
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_odb_exists_many(int *found, git_odb *db, const git_oid *ids, size_t count);
+
+/**
+ * Look for objects which have been added to the database from
+ * outside of this instance, such as new packfiles.
+ *
+ * The pack backend looks for new packs by itself when an object
+ * can't be found in the ones it knows about, but no more than once
+ * per refresh interval (see `git_odb_set_pack_refresh_interval`),
+ * and lookups of objects it already has never look at the disk.
+ * Call this to be sure to see packs that were just added.
+ *
+ * @param db database to refresh
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_odb_refresh(git_odb *db);
+
 /**
  * Write an object directly into the ODB
  *
@@ -192,6 +244,23 @@ GIT_EXTERN(int) git_odb_exists(git_odb *db, const git_oid *id);
  */
 GIT_EXTERN(int) git_odb_write(git_oid *oid, git_odb *odb, const void *data, size_t len, git_otype type);
 
+/**
+ * Write a multi-pack-index for the packfiles in the ODB
+ *
+ * The index is written as `objects/pack/multi-pack-index` in the
+ * same format used by `git multi-pack-index write`, and covers all
+ * the packfiles currently found in the ODB. Objects in packs covered
+ * by the index can then be found with a single lookup, no matter
+ * how many packs there are.
+ *
+ * Packfiles added after the index has been written are still searched
+ * on their own. Alternates are never indexed.
+ *
+ * @param odb object database where to write the index
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_odb_write_multi_pack_index(git_odb *odb);
+
 /**
  * Open a stream to write an object into the ODB
  *
@@ -224,16 +293,22 @@ GIT_EXTERN(int) git_odb_open_wstream(git_odb_stream **stream, git_odb *db, size_
 /**
  * Open a stream to read an object from the ODB
  *
- * Note that most backends do *not* support streaming reads
- * because they store their objects as compressed/delta'ed blobs.
+ * The loose and pack backends inflate the object as it is read,
+ * so reading a large blob this way doesn't need the whole object
+ * in memory. A packed delta still needs its base object in memory;
+ * the delta itself is applied as the stream is read. Custom
+ * backends may not support streaming reads at all, in which case
+ * `git_odb_read` is assured to work.
  *
- * It's recommended to use `git_odb_read` instead, which is
- * assured to work on all backends.
+ * The stream gives the object's contents, without its header; use
+ * `git_odb_read_header` to find out its size and type first.
  *
  * The returned stream will be of type `GIT_STREAM_RDONLY` and
  * will have the following methods:
  *
- *		- stream->read: read `n` bytes from the stream
+ *		- stream->read: read up to `n` bytes from the stream;
+ *		  returns how many were read, 0 at the end of the object,
+ *		  or an error code
  *		- stream->free: free the stream
  *
  * The stream must always be free'd or will leak memory.
@@ -261,6 +336,23 @@ GIT_EXTERN(int) git_odb_open_rstream(git_odb_stream **stream, git_odb *db, const
  */
 GIT_EXTERN(int) git_odb_hash(git_oid *id, const void *data, size_t len, git_otype type);
 
+/**
+ * Determine the object-IDs of many data buffers at once
+ *
+ * This gives the same IDs as calling `git_odb_hash` on each
+ * buffer, but small buffers are hashed several at a time where
+ * the CPU allows it, which makes hashing many small objects,
+ * such as the files of a working directory, faster.
+ *
+ * @param ids array of `count` object-IDs to fill
+ * @param data array of `count` buffers to hash
+ * @param len sizes of the buffers
+ * @param count number of buffers
+ * @param type of all the data to hash
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_odb_hash_many(git_oid *ids, const void *const *data, const size_t *len, size_t count, git_otype type);
+
 /**
  * Read a file from disk and fill a git_oid with the object id
  * that the file would have if it were written to the Object
@@ -274,6 +366,93 @@ GIT_EXTERN(int) git_odb_hash(git_oid *id, const void *data, size_t len, git_otyp
  */
 GIT_EXTERN(int) git_odb_hashfile(git_oid *out, const char *path, git_otype type);
 
+/**
+ * Set the maximum number of bytes the object cache of an ODB
+ * may use for the given object type
+ *
+ * Like the object cache of a repository, each object type has
+ * its own budget. A limit of 0 keeps objects of that type out
+ * of the cache. See `git_repository_set_cache_limit`.
+ *
+ * @param db database to configure
+ * @param type One of GIT_OBJ_COMMIT, GIT_OBJ_TREE, GIT_OBJ_BLOB or GIT_OBJ_TAG
+ * @param max_bytes maximum number of bytes to keep for that type
+ * @return GIT_SUCCESS or GIT_EINVALIDTYPE
+ */
+GIT_EXTERN(int) git_odb_set_cache_limit(git_odb *db, git_otype type, size_t max_bytes);
+
+/**
+ * Get the maximum number of bytes the object cache of an ODB
+ * may use for the given object type
+ *
+ * @param max_bytes pointer where to store the limit
+ * @param db database to query
+ * @param type One of GIT_OBJ_COMMIT, GIT_OBJ_TREE, GIT_OBJ_BLOB or GIT_OBJ_TAG
+ * @return GIT_SUCCESS or GIT_EINVALIDTYPE
+ */
+GIT_EXTERN(int) git_odb_get_cache_limit(size_t *max_bytes, git_odb *db, git_otype type);
+
+/**
+ * Get the statistics of the object cache of an ODB
+ *
+ * Every object read from the ODB is kept in an in-memory cache,
+ * bounded by a number of bytes for each object type (see
+ * `git_odb_set_cache_limit`).
+ *
+ * @param stats structure to fill with the cache statistics
+ * @param db database to query
+ */
+GIT_EXTERN(void) git_odb_get_cache_stats(git_cache_stats *stats, git_odb *db);
+
+/**
+ * Statistics for the delta base cache used by the packfile backend
+ */
+typedef struct {
+	size_t limit; /**< maximum number of bytes cached per packfile */
+	unsigned int hits; /**< delta bases served from the cache */
+	unsigned int misses; /**< delta bases that had to be inflated */
+} git_odb_delta_cache_stats;
+
+/**
+ * Set the memory limit of the delta base cache
+ *
+ * When unpacking a deltified object from a packfile, the inflated
+ * base of the delta is kept in a per-packfile cache, so that
+ * resolving objects which share a delta chain does not inflate
+ * the whole chain over and over again.
+ *
+ * The limit applies to each packfile individually. Setting it to
+ * 0 disables the cache. The default limit is 16MiB.
+ *
+ * @param limit maximum number of bytes kept by each packfile's cache
+ */
+GIT_EXTERN(void) git_odb_set_delta_cache_limit(size_t limit);
+
+/**
+ * Set how often the pack backend may look for new packs
+ *
+ * When an object can't be found in the packs a backend knows
+ * about, it checks the pack folder for new ones, unless it already
+ * did so less than this many seconds ago. The default, 0, checks on
+ * every miss. With more, a pack added within that time of the last
+ * check isn't seen until the next one, or `git_odb_refresh`.
+ *
+ * This is a global setting that applies to all the pack backends.
+ *
+ * @param seconds minimum time between two checks of a pack folder
+ */
+GIT_EXTERN(void) git_odb_set_pack_refresh_interval(unsigned int seconds);
+
+/**
+ * Get the current limit and the hit/miss counters of the
+ * delta base cache
+ *
+ * The counters are global to the library and are never reset.
+ *
+ * @param stats structure to fill with the cache statistics
+ */
+GIT_EXTERN(void) git_odb_get_delta_cache_stats(git_odb_delta_cache_stats *stats);
+
 /**
  * Close an ODB object
  *
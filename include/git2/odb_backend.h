@@ -71,6 +71,31 @@ struct git_odb_backend {
 			struct git_odb_backend *,
 			const git_oid *);
 
+	/* Read many objects at once. The types all come
+	 * in as GIT_OBJ_BAD; fill in the objects which
+	 * are found and leave the others alone. Missing
+	 * objects are not an error. Optional. */
+	int (* read_many)(
+			void **, size_t *, git_otype *,
+			struct git_odb_backend *,
+			const git_oid *, size_t);
+
+	/* Set the flag of each object which is found to
+	 * 1 and leave the others alone. Optional. */
+	int (* exists_many)(
+			int *,
+			struct git_odb_backend *,
+			const git_oid *, size_t);
+
+	/* Look again for objects that may have been added
+	 * from outside, such as new packs. Optional. */
+	int (* refresh)(struct git_odb_backend *);
+
+	/* Write an index covering all the packs of the
+	 * backend, so lookups don't have to search each
+	 * one of them. Optional. */
+	int (* writemidx)(struct git_odb_backend *);
+
 	void (* free)(struct git_odb_backend *);
 };
 
@@ -304,6 +304,91 @@ GIT_EXTERN(int) git_reference_reload(git_reference *ref);
  */
 GIT_EXTERN(void) git_reference_free(git_reference *ref);
 
+/**
+ * Create a new reference transaction
+ *
+ * A transaction gathers updates to many references, and applies
+ * them all at once when it is committed. Until then, nothing is
+ * locked and nothing changes on disk.
+ *
+ * @param tx_out Pointer to the new transaction
+ * @param repo Repository where the references live
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_reference_transaction_new(git_reference_transaction **tx_out, git_repository *repo);
+
+/**
+ * Point a reference at an OID when the transaction is committed
+ *
+ * The reference is created if it doesn't exist, and overwritten,
+ * even if it's symbolic, if it does. The OID must exist in the
+ * repository.
+ *
+ * If a transaction updates the same reference more than once,
+ * the last update wins.
+ *
+ * @param tx The transaction
+ * @param name The name of the reference
+ * @param id The OID the reference will point to
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_reference_transaction_set_oid(git_reference_transaction *tx, const char *name, const git_oid *id);
+
+/**
+ * Point a reference at another reference when the transaction is
+ * committed
+ *
+ * The reference is created if it doesn't exist, and overwritten
+ * if it does.
+ *
+ * @param tx The transaction
+ * @param name The name of the reference
+ * @param target The name of the reference it will point to
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_reference_transaction_set_target(git_reference_transaction *tx, const char *name, const char *target);
+
+/**
+ * Delete a reference when the transaction is committed
+ *
+ * The reference must exist when the transaction is committed.
+ *
+ * @param tx The transaction
+ * @param name The name of the reference
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_reference_transaction_delete(git_reference_transaction *tx, const char *name);
+
+/**
+ * Apply all the updates of a transaction
+ *
+ * Every reference which is updated is locked first, as well as
+ * the `packed-refs` file when packed references are deleted. If
+ * any lock can't be taken, a reference name conflicts with an
+ * existing one, or a reference to delete doesn't exist, nothing
+ * is changed.
+ *
+ * Once everything is locked, the new references are written,
+ * `packed-refs` is rewritten only once for all the deletions,
+ * and the locks are released. An error while moving the files
+ * into place at this point (e.g. a full disk) may leave some of
+ * the updates applied.
+ *
+ * The updates are dropped from the transaction, whether it
+ * succeeds or not.
+ *
+ * @param tx The transaction
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_reference_transaction_commit(git_reference_transaction *tx);
+
+/**
+ * Free a transaction, dropping the updates which weren't committed
+ *
+ * @param tx The transaction
+ */
+GIT_EXTERN(void) git_reference_transaction_free(git_reference_transaction *tx);
+
 /** @} */
 GIT_END_DECL
 #endif
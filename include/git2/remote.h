@@ -11,6 +11,7 @@
 #include "repository.h"
 #include "refspec.h"
 #include "net.h"
+#include "indexer.h"
 
 /**
  * @file git2/remote.h
@@ -141,16 +142,17 @@ GIT_EXTERN(int) git_remote_ls(git_remote *remote, git_headlist_cb list_cb, void
  * Download the packfile
  *
  * Negotiate what objects should be downloaded and download the
- * packfile with those objects. The packfile is downloaded with a
- * temporary filename, as it's final name is not known yet. If there
- * was no packfile needed (all the objects were available locally),
- * filename will be NULL and the function will return success.
+ * packfile with those objects. The packfile is indexed while it is
+ * being received, and stored along with its index in the pack folder
+ * of the repository. If there was no packfile needed (all the objects
+ * were available locally), `stats->total` will be 0 and the function
+ * will return success.
  *
  * @param remote the remote to download from
- * @param filename where to store the temproray filename
+ * @param stats storage for the indexing progress
  * @return GIT_SUCCESS or an error code
  */
-GIT_EXTERN(int) git_remote_download(char **filename, git_remote *remote);
+GIT_EXTERN(int) git_remote_download(git_remote *remote, git_indexer_stats *stats);
 
 /**
  * Check whether the remote is connected
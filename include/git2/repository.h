@@ -285,6 +285,56 @@ GIT_EXTERN(int) git_repository_index(git_index **out, git_repository *repo);
  */
 GIT_EXTERN(void) git_repository_set_index(git_repository *repo, git_index *index);
 
+/**
+ * Set the maximum number of bytes the object cache of a
+ * repository may use for the given object type
+ *
+ * Each object type (commits, trees, blobs and tags) has its own
+ * budget in the cache, so that a few big blobs cannot push out
+ * the small commits and trees that get looked up over and over.
+ * The defaults are 8MiB for commits and trees, 2MiB for blobs
+ * and 1MiB for tags.
+ *
+ * Setting a limit of 0 keeps objects of that type out of the
+ * cache altogether. Lowering a limit evicts objects right away.
+ *
+ * This only affects the parsed objects cached by the repository;
+ * the raw objects cached by its ODB are bounded separately with
+ * `git_odb_set_cache_limit`.
+ *
+ * @param repo A repository object
+ * @param type One of GIT_OBJ_COMMIT, GIT_OBJ_TREE, GIT_OBJ_BLOB or GIT_OBJ_TAG
+ * @param max_bytes maximum number of bytes to keep for that type
+ * @return GIT_SUCCESS or GIT_EINVALIDTYPE
+ */
+GIT_EXTERN(int) git_repository_set_cache_limit(git_repository *repo, git_otype type, size_t max_bytes);
+
+/**
+ * Get the maximum number of bytes the object cache of a
+ * repository may use for the given object type
+ *
+ * @param max_bytes pointer where to store the limit
+ * @param repo A repository object
+ * @param type One of GIT_OBJ_COMMIT, GIT_OBJ_TREE, GIT_OBJ_BLOB or GIT_OBJ_TAG
+ * @return GIT_SUCCESS or GIT_EINVALIDTYPE
+ */
+GIT_EXTERN(int) git_repository_get_cache_limit(size_t *max_bytes, git_repository *repo, git_otype type);
+
+/**
+ * Get the statistics of the object cache of a repository
+ *
+ * Every object looked up in the repository is kept in an
+ * in-memory cache, bounded by a number of bytes for each
+ * object type (see `git_repository_set_cache_limit`). Once a
+ * type runs over its budget, objects of that type are evicted
+ * in CLOCK order: an object that was looked up since it was
+ * last considered gets a second chance.
+ *
+ * @param stats structure to fill with the cache statistics
+ * @param repo A repository object
+ */
+GIT_EXTERN(void) git_repository_get_cache_stats(git_cache_stats *stats, git_repository *repo);
+
 /** @} */
 GIT_END_DECL
 #endif
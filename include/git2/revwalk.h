@@ -210,6 +210,60 @@ GIT_EXTERN(void) git_revwalk_free(git_revwalk *walk);
  */
 GIT_EXTERN(git_repository *) git_revwalk_repository(git_revwalk *walk);
 
+/**
+ * Write a commit-graph file for the repository
+ *
+ * The commit-graph is stored in `objects/info/commit-graph` in the
+ * same format git uses. It holds the parents and the commit time of
+ * every commit the walker has come across, which includes the ones
+ * pushed or hidden, and of all their ancestors. Walks can then get
+ * those from a fixed-width table instead of reading each commit.
+ *
+ * The file is used by the walkers created after it's written.
+ *
+ * @param walk the walker with the commits to start from
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_revwalk_write_commit_graph(git_revwalk *walk);
+
+/**
+ * Find a merge-base between two commits
+ *
+ * If there is more than one best common ancestor (after criss-cross
+ * merges), any one of them may be returned.
+ *
+ * The commits which the walker has already parsed are reused, and
+ * the walk stops as soon as the commit-graph's generation numbers
+ * prove that no better ancestor can be found. The commits pushed
+ * or hidden on the walker are left alone.
+ *
+ * @param out the oid of the merge-base
+ * @param walk the walker to use for the lookup
+ * @param one one of the commits
+ * @param two the other commit
+ * @return GIT_SUCCESS, GIT_ENOTFOUND if the commits don't have a
+ *	common ancestor or an error code
+ */
+GIT_EXTERN(int) git_revwalk_merge_base(git_oid *out, git_revwalk *walk, const git_oid *one, const git_oid *two);
+
+/**
+ * Count the unique commits on each side of two commits
+ *
+ * `ahead` is set to the number of commits reachable from `local`
+ * but not from `upstream`, and `behind` to the opposite. Only the
+ * commits down to where both histories meet are read, so the same
+ * walker can be reused cheaply to compare many branches.
+ *
+ * @param ahead number of commits only in `local`
+ * @param behind number of commits only in `upstream`
+ * @param walk the walker to use for the lookup
+ * @param local the commit to count from, e.g. a branch
+ * @param upstream the commit to compare against, e.g. its upstream
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_revwalk_ahead_behind(size_t *ahead, size_t *behind, git_revwalk *walk,
+	const git_oid *local, const git_oid *upstream);
+
 /** @} */
 GIT_END_DECL
 #endif
@@ -46,6 +46,57 @@ GIT_BEGIN_DECL
  */
 GIT_EXTERN(int) git_status_foreach(git_repository *repo, int (*callback)(const char *, unsigned int, void *), void *payload);
 
+/**
+ * Options for git_status_foreach_ext
+ *
+ * Setting all values of the structure to zero, or passing NULL for
+ * the options structure, gives the defaults, which are those of
+ * git_status_foreach.
+ */
+typedef struct {
+	/**
+	 * How many threads look at the working directory, each at a
+	 * different part of it; the top-level directories are shared
+	 * out between them. Defaults to 0, which like 1 looks at it from
+	 * the calling thread only, as does a libgit2 built without
+	 * thread support.
+	 */
+	unsigned int threads;
+
+	/**
+	 * A combination of the GIT_STATUS_OPT_* flags below; defaults
+	 * to 0.
+	 */
+	unsigned int flags;
+} git_status_options;
+
+/**
+ * Leave the ignored files out, rather than report them as
+ * GIT_STATUS_IGNORED. With core.untrackedCache set, the index then
+ * remembers what's untracked in each directory, and the directories
+ * which didn't change since aren't read again: only the files the
+ * index has in them and the untracked ones are looked at.
+ */
+#define GIT_STATUS_OPT_EXCLUDE_IGNORED (1 << 0)
+
+/**
+ * Gather file statuses and run a callback for each one, with options.
+ *
+ * The callback is called as with git_status_foreach: from the calling
+ * thread, once per file and in the order of the paths, whatever the
+ * options.
+ *
+ * @param repo a repository object
+ * @param opts the options, or NULL for the defaults
+ * @param callback the function to call on each file
+ * @return GIT_SUCCESS or the return value of the callback which did not return GIT_SUCCESS
+ */
+GIT_EXTERN(int) git_status_foreach_ext(
+	git_repository *repo,
+	const git_status_options *opts,
+	int (*callback)(const char *, unsigned int, void *),
+	void *payload);
+
 /**
  * Get file status for a single file
  *
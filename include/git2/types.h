@@ -74,6 +74,15 @@ typedef enum {
 	GIT_OBJ_REF_DELTA = 7, /**< A delta, base is given by object id. */
 } git_otype;
 
+/** Statistics of an in-memory object cache */
+typedef struct git_cache_stats {
+	unsigned int hits; /**< lookups served from the cache */
+	unsigned int misses; /**< lookups not found in the cache */
+	unsigned int evictions; /**< objects evicted to make room for new ones */
+	size_t count; /**< number of objects currently cached */
+	size_t size; /**< number of bytes charged for the cached objects */
+} git_cache_stats;
+
 /** An open object database handle. */
 typedef struct git_odb git_odb;
 
@@ -119,6 +128,9 @@ typedef struct git_treebuilder git_treebuilder;
 /** Memory representation of an index file. */
 typedef struct git_index git_index;
 
+/** A monitor of the changes to a working directory */
+typedef struct git_fsmonitor git_fsmonitor;
+
 /** Memory representation of a set of config files */
 typedef struct git_config git_config;
 
@@ -150,6 +162,9 @@ typedef struct git_signature {
 /** In-memory representation of a reference. */
 typedef struct git_reference git_reference;
 
+/** A set of reference updates, applied together */
+typedef struct git_reference_transaction git_reference_transaction;
+
 /** Basic type of any Git reference. */
 typedef enum {
 	GIT_REF_INVALID = 0, /** Invalid reference */
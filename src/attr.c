@@ -225,23 +225,24 @@ int git_attr_cache__lookup_or_create_file(
 	int (*loader)(git_repository *, const char *, git_attr_file *),
 	git_attr_file **file_ptr)
 {
-	int error;
+	int error = GIT_SUCCESS;
 	git_attr_cache *cache = &repo->attrcache;
 	git_attr_file *file = NULL;
 
+	git_mutex_lock(&cache->lock);
+
 	file = git_hashtable_lookup(cache->files, key);
-	if (file) {
+	if (file != NULL ||
+		(loader && git_path_exists(filename) != GIT_SUCCESS)) {
+		git_mutex_unlock(&cache->lock);
 		*file_ptr = file;
 		return GIT_SUCCESS;
 	}
 
-	if (loader && git_path_exists(filename) != GIT_SUCCESS) {
-		*file_ptr = NULL;
-		return GIT_SUCCESS;
-	}
-
-	if ((error = git_attr_file__new(&file)) < GIT_SUCCESS)
+	if ((error = git_attr_file__new(&file)) < GIT_SUCCESS) {
+		git_mutex_unlock(&cache->lock);
 		return error;
+	}
 
 	if (loader)
 		error = loader(repo, filename, file);
@@ -256,6 +257,8 @@ int git_attr_cache__lookup_or_create_file(
 		file = NULL;
 	}
 
+	git_mutex_unlock(&cache->lock);
+
 	*file_ptr = file;
 	return error;
 }
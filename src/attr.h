@@ -13,6 +13,7 @@ typedef struct {
 	int initialized;
 	git_hashtable *files;	/* hash path to git_attr_file of rules */
 	git_hashtable *macros;	/* hash name to vector<git_attr_assignment> */
+	git_mutex lock;		/* for loading files from several threads */
 } git_attr_cache;
 
 extern int git_attr_cache__init(git_repository *repo);
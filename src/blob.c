@@ -229,3 +229,179 @@ cleanup:
 	return error;
 }
 
+
+/* Files bigger than this gain nothing from being hashed with others */
+#define BLOB_BATCH_FILE_MAX (1024 * 1024)
+
+/* How much is read in before it's hashed and written */
+#define BLOB_BATCH_SIZE (16 * 1024 * 1024)
+#define BLOB_BATCH_COUNT 256
+
+typedef struct {
+	git_buf content[BLOB_BATCH_COUNT];
+	const void *data[BLOB_BATCH_COUNT];
+	size_t len[BLOB_BATCH_COUNT];
+	size_t pos[BLOB_BATCH_COUNT]; /* of each file in the caller's arrays */
+	git_oid ids[BLOB_BATCH_COUNT];
+	int found[BLOB_BATCH_COUNT];
+	size_t count, size;
+} blob_batch;
+
+/* What goes into the blob for `path`: the link, or the filtered file */
+static int read_blob_content(
+	git_buf *out,
+	git_repository *repo,
+	const char *full_path,
+	const char *path,
+	const struct stat *st)
+{
+	git_vector filters = GIT_VECTOR_INIT;
+	git_buf source = GIT_BUF_INIT;
+	ssize_t read_len;
+	int error;
+
+	if (S_ISLNK(st->st_mode)) {
+		if ((error = git_buf_grow(out, (size_t)st->st_size + 1)) < GIT_SUCCESS)
+			return error;
+
+		read_len = p_readlink(full_path, out->ptr, (size_t)st->st_size);
+		if (read_len != (ssize_t)st->st_size)
+			return git__throw(GIT_EOSERR, "Failed to create blob. Can't read symlink");
+
+		out->size = (size_t)read_len;
+		out->ptr[out->size] = '\0';
+		return GIT_SUCCESS;
+	}
+
+	error = git_filters_load(&filters, repo, path, GIT_FILTER_TO_ODB);
+	if (error < 0)
+		return error;
+
+	if (error == 0) {
+		error = git_futils_readbuffer(out, full_path);
+	} else if ((error = git_futils_readbuffer(&source, full_path)) == GIT_SUCCESS) {
+		error = git_filters_apply(out, &source, &filters);
+		git_buf_free(&source);
+	}
+
+	git_filters_free(&filters);
+	return error;
+}
+
+/*
+ * Hash everything in the batch in one go, and only write what the
+ * ODB doesn't have yet.
+ */
+static int blob_batch_write(git_oid *oids, blob_batch *batch, git_odb *odb)
+{
+	size_t i;
+	int error;
+
+	if (batch->count == 0)
+		return GIT_SUCCESS;
+
+	for (i = 0; i < batch->count; ++i) {
+		batch->data[i] = batch->content[i].ptr;
+		batch->len[i] = batch->content[i].size;
+	}
+
+	error = git_odb_hash_many(batch->ids, batch->data, batch->len, batch->count, GIT_OBJ_BLOB);
+	if (error == GIT_SUCCESS)
+		error = git_odb_exists_many(batch->found, odb, batch->ids, batch->count);
+
+	for (i = 0; i < batch->count && error == GIT_SUCCESS; ++i) {
+		if (!batch->found[i])
+			error = git_odb_write(&batch->ids[i], odb,
+				batch->data[i], batch->len[i], GIT_OBJ_BLOB);
+
+		git_oid_cpy(&oids[batch->pos[i]], &batch->ids[i]);
+	}
+
+	for (i = 0; i < batch->count; ++i)
+		git_buf_free(&batch->content[i]);
+
+	batch->count = batch->size = 0;
+	return error;
+}
+
+int git_blob__create_fromfiles(
+	git_oid *oids,
+	struct stat *st_out,
+	git_repository *repo,
+	const char **paths,
+	size_t count)
+{
+	int error = GIT_SUCCESS;
+	git_buf full_path = GIT_BUF_INIT;
+	blob_batch *batch = NULL;
+	const char *workdir;
+	git_odb *odb;
+	struct stat st;
+	size_t i;
+
+	assert(oids && repo && (paths || count == 0));
+
+	workdir = git_repository_workdir(repo);
+	if (workdir == NULL)
+		return git__throw(GIT_ENOTFOUND, "Failed to create blobs. (No working directory found)");
+
+	if ((error = git_repository_odb__weakptr(&odb, repo)) < GIT_SUCCESS)
+		return error;
+
+	if ((batch = git__calloc(1, sizeof(blob_batch))) == NULL)
+		return GIT_ENOMEM;
+
+	for (i = 0; i < BLOB_BATCH_COUNT; ++i)
+		git_buf_init(&batch->content[i], 0);
+
+	for (i = 0; i < count && error == GIT_SUCCESS; ++i) {
+		git_buf_clear(&full_path);
+
+		if ((error = git_buf_joinpath(&full_path, workdir, paths[i])) < GIT_SUCCESS)
+			break;
+
+		if (p_lstat(full_path.ptr, &st) < 0) {
+			error = git__throw(GIT_EOSERR, "Failed to stat blob '%s'. %s", paths[i], strerror(errno));
+			break;
+		}
+
+		if (st_out != NULL)
+			st_out[i] = st;
+
+		/* big files are streamed, and not kept around */
+		if (!S_ISLNK(st.st_mode) && st.st_size > BLOB_BATCH_FILE_MAX) {
+			error = git_blob_create_fromfile(&oids[i], repo, paths[i]);
+			continue;
+		}
+
+		error = read_blob_content(&batch->content[batch->count],
+			repo, full_path.ptr, paths[i], &st);
+		if (error < GIT_SUCCESS)
+			break;
+
+		batch->pos[batch->count] = i;
+		batch->size += batch->content[batch->count].size;
+
+		if (++batch->count == BLOB_BATCH_COUNT || batch->size >= BLOB_BATCH_SIZE)
+			error = blob_batch_write(oids, batch, odb);
+	}
+
+	if (error == GIT_SUCCESS)
+		error = blob_batch_write(oids, batch, odb);
+
+	for (i = 0; i < BLOB_BATCH_COUNT; ++i)
+		git_buf_free(&batch->content[i]);
+
+	git__free(batch);
+	git_buf_free(&full_path);
+
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to create blobs");
+
+	return GIT_SUCCESS;
+}
+
+int git_blob_create_fromfiles(git_oid *oids, git_repository *repo, const char **paths, size_t count)
+{
+	return git_blob__create_fromfiles(oids, NULL, repo, paths, count);
+}
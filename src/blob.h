@@ -21,4 +21,15 @@ void git_blob__free(git_blob *blob);
 int git_blob__parse(git_blob *blob, git_odb_object *obj);
 int git_blob__getbuf(git_buf *buffer, git_blob *blob);
 
+/*
+ * Like `git_blob_create_fromfiles`, also giving the `lstat` of each
+ * file, from before it was read, in `st_out` if it isn't NULL.
+ */
+int git_blob__create_fromfiles(
+	git_oid *oids,
+	struct stat *st_out,
+	git_repository *repo,
+	const char **paths,
+	size_t count);
+
 #endif
@@ -11,97 +11,391 @@
 #include "thread-utils.h"
 #include "cache.h"
 
-int git_cache_init(git_cache *cache, size_t size, git_cached_obj_freeptr free_ptr)
-{
-	if (size < 8)
-		size = 8;
-
-	/* round up size to closest power of 2 */
-	size--;
-	size |= size >> 1;
-	size |= size >> 2;
-	size |= size >> 4;
-	size |= size >> 8;
-	size |= size >> 16;
-	size++;
-
-	cache->size_mask = size - 1;
-	cache->lru_count = 0;
-	cache->free_obj = free_ptr;
+#define STRIPE_MIN_BUCKETS 16
 
-	git_mutex_init(&cache->lock);
+GIT_INLINE(uint32_t) cache_hash(const git_oid *oid)
+{
+	uint32_t hash;
+	memcpy(&hash, oid->id, sizeof(hash));
+	return hash;
+}
+
+GIT_INLINE(git_cache_stripe *) cache_stripe(git_cache *cache, const git_oid *oid)
+{
+	/* use a different byte than the bucket hash, so each stripe
+	 * still gets an even spread of buckets */
+	return &cache->stripes[oid->id[sizeof(uint32_t)] & (GIT_CACHE_STRIPES - 1)];
+}
 
-	cache->nodes = git__malloc(size * sizeof(git_cached_obj *));
-	if (cache->nodes == NULL)
+GIT_INLINE(int) cache_type_ok(git_otype type)
+{
+	return type > GIT_OBJ__EXT1 && type < GIT_CACHE_TYPES;
+}
+
+static int stripe_init(git_cache_stripe *stripe)
+{
+	memset(stripe, 0x0, sizeof(git_cache_stripe));
+	git_mutex_init(&stripe->lock);
+
+	stripe->buckets = git__calloc(STRIPE_MIN_BUCKETS, sizeof(git_cached_obj *));
+	if (stripe->buckets == NULL)
 		return GIT_ENOMEM;
 
-	memset(cache->nodes, 0x0, size * sizeof(git_cached_obj *));
+	stripe->bucket_mask = STRIPE_MIN_BUCKETS - 1;
 	return GIT_SUCCESS;
 }
 
-void git_cache_free(git_cache *cache)
+static void stripe_grow(git_cache_stripe *stripe)
 {
-	size_t i;
+	size_t i, new_size = (stripe->bucket_mask + 1) * 2;
+	git_cached_obj **buckets;
+
+	/* if we can't grow, just keep going with longer chains */
+	buckets = git__calloc(new_size, sizeof(git_cached_obj *));
+	if (buckets == NULL)
+		return;
 
-	for (i = 0; i < (cache->size_mask + 1); ++i) {
-		if (cache->nodes[i] != NULL)
-			git_cached_obj_decref(cache->nodes[i], cache->free_obj);
+	for (i = 0; i <= stripe->bucket_mask; ++i) {
+		git_cached_obj *node = stripe->buckets[i], *next;
+
+		for (; node != NULL; node = next) {
+			size_t pos = cache_hash(&node->oid) & (new_size - 1);
+			next = node->hash_next;
+			node->hash_next = buckets[pos];
+			buckets[pos] = node;
+		}
 	}
 
-	git__free(cache->nodes);
+	git__free(stripe->buckets);
+	stripe->buckets = buckets;
+	stripe->bucket_mask = new_size - 1;
 }
 
-void *git_cache_get(git_cache *cache, const git_oid *oid)
+static git_cached_obj **stripe_lookup(git_cache_stripe *stripe, const git_oid *oid)
 {
-	uint32_t hash;
-	git_cached_obj *node = NULL, *result = NULL;
+	git_cached_obj **node = &stripe->buckets[cache_hash(oid) & stripe->bucket_mask];
 
-	memcpy(&hash, oid->id, sizeof(hash));
+	while (*node != NULL && git_oid_cmp(&(*node)->oid, oid) != 0)
+		node = &(*node)->hash_next;
+
+	return node;
+}
 
+static void cache_charge(git_cache *cache, git_otype type, size_t size, int add)
+{
 	git_mutex_lock(&cache->lock);
+	if (add)
+		cache->used[type] += size;
+	else
+		cache->used[type] -= size;
+	git_mutex_unlock(&cache->lock);
+}
+
+/* How many bytes of `type` the whole cache holds over its budget */
+static size_t cache_excess(git_cache *cache, git_otype type)
+{
+	size_t excess = 0;
+
+	git_mutex_lock(&cache->lock);
+	if (cache->used[type] > cache->max_size[type])
+		excess = cache->used[type] - cache->max_size[type];
+	git_mutex_unlock(&cache->lock);
+
+	return excess;
+}
+
+static void stripe_insert(git_cache *cache, git_cache_stripe *stripe, git_cached_obj *entry)
+{
+	git_cached_obj **bucket, **hand = &stripe->clock[entry->type];
+
+	if (stripe->count > stripe->bucket_mask)
+		stripe_grow(stripe);
+
+	bucket = &stripe->buckets[cache_hash(&entry->oid) & stripe->bucket_mask];
+	entry->hash_next = *bucket;
+	*bucket = entry;
+
+	/* new entries go right behind the hand, i.e. they will be
+	 * the last ones to be considered for eviction */
+	if (*hand == NULL) {
+		entry->clock_prev = entry->clock_next = entry;
+		*hand = entry;
+	} else {
+		entry->clock_next = *hand;
+		entry->clock_prev = (*hand)->clock_prev;
+		entry->clock_prev->clock_next = entry;
+		(*hand)->clock_prev = entry;
+	}
+
+	entry->referenced = 0;
+	stripe->used[entry->type] += entry->size;
+	stripe->count++;
+	cache_charge(cache, entry->type, entry->size, 1);
+}
+
+static void stripe_remove(git_cache *cache, git_cache_stripe *stripe, git_cached_obj **node)
+{
+	git_cached_obj *entry = *node, **hand = &stripe->clock[entry->type];
+
+	*node = entry->hash_next;
+	entry->hash_next = NULL;
+
+	if (entry->clock_next == entry) {
+		*hand = NULL;
+	} else {
+		entry->clock_prev->clock_next = entry->clock_next;
+		entry->clock_next->clock_prev = entry->clock_prev;
+		if (*hand == entry)
+			*hand = entry->clock_next;
+	}
+
+	entry->clock_prev = entry->clock_next = NULL;
+	stripe->used[entry->type] -= entry->size;
+	stripe->count--;
+	cache_charge(cache, entry->type, entry->size, 0);
+}
+
+/*
+ * Run the CLOCK for `type` until there's room for `needed` more
+ * bytes in the stripe. Entries that have been hit since the hand
+ * last passed get a second chance. The evicted entries are chained
+ * in `evicted` so they can be released once the lock is dropped.
+ */
+static void stripe_evict(
+	git_cache *cache,
+	git_cache_stripe *stripe,
+	git_otype type,
+	size_t budget,
+	size_t needed,
+	git_cached_obj **evicted)
+{
+	git_cached_obj *hand;
+
+	while (stripe->used[type] + needed > budget &&
+		(hand = stripe->clock[type]) != NULL) {
+
+		if (hand->referenced) {
+			hand->referenced = 0;
+			stripe->clock[type] = hand->clock_next;
+			continue;
+		}
+
+		stripe_remove(cache, stripe, stripe_lookup(stripe, &hand->oid));
+		stripe->evictions++;
+
+		hand->hash_next = *evicted;
+		*evicted = hand;
+	}
+}
+
+/*
+ * Take back what the stripe of `own` borrowed for `type`, by
+ * evicting from the other stripes until the cache fits its budget.
+ * Only called with no stripe locked.
+ */
+static void cache_repay(git_cache *cache, git_otype type, int own, git_cached_obj **evicted)
+{
+	size_t excess;
+	int i;
+
+	for (i = 1; i < GIT_CACHE_STRIPES; ++i) {
+		git_cache_stripe *stripe =
+			&cache->stripes[(own + i) & (GIT_CACHE_STRIPES - 1)];
+
+		if ((excess = cache_excess(cache, type)) == 0)
+			break;
+
+		git_mutex_lock(&stripe->lock);
+		stripe_evict(cache, stripe, type,
+			stripe->used[type] > excess ? stripe->used[type] - excess : 0,
+			0, evicted);
+		git_mutex_unlock(&stripe->lock);
+	}
+}
+
+static void release_evicted(git_cache *cache, git_cached_obj *evicted)
+{
+	while (evicted != NULL) {
+		git_cached_obj *next = evicted->hash_next;
+		evicted->hash_next = NULL;
+		git_cached_obj_decref(evicted, cache->free_obj);
+		evicted = next;
+	}
+}
+
+int git_cache_init(git_cache *cache, git_cached_obj_freeptr free_ptr)
+{
+	int i;
+
+	memset(cache, 0x0, sizeof(git_cache));
+	cache->free_obj = free_ptr;
+	git_mutex_init(&cache->lock);
+
+	cache->max_size[GIT_OBJ_COMMIT] = GIT_CACHE_MAX_COMMIT;
+	cache->max_size[GIT_OBJ_TREE] = GIT_CACHE_MAX_TREE;
+	cache->max_size[GIT_OBJ_BLOB] = GIT_CACHE_MAX_BLOB;
+	cache->max_size[GIT_OBJ_TAG] = GIT_CACHE_MAX_TAG;
+
+	for (i = 0; i < GIT_CACHE_STRIPES; ++i) {
+		if (stripe_init(&cache->stripes[i]) < GIT_SUCCESS) {
+			git_cache_free(cache);
+			return GIT_ENOMEM;
+		}
+	}
+
+	return GIT_SUCCESS;
+}
+
+void git_cache_free(git_cache *cache)
+{
+	int i;
+	size_t j;
+
+	for (i = 0; i < GIT_CACHE_STRIPES; ++i) {
+		git_cache_stripe *stripe = &cache->stripes[i];
+
+		if (stripe->buckets == NULL)
+			continue;
+
+		for (j = 0; j <= stripe->bucket_mask; ++j) {
+			while (stripe->buckets[j] != NULL) {
+				git_cached_obj *node = stripe->buckets[j];
+				stripe_remove(cache, stripe, &stripe->buckets[j]);
+				git_cached_obj_decref(node, cache->free_obj);
+			}
+		}
+
+		git__free(stripe->buckets);
+		stripe->buckets = NULL;
+		git_mutex_free(&stripe->lock);
+	}
+
+	git_mutex_free(&cache->lock);
+}
+
+int git_cache_set_max(git_cache *cache, git_otype type, size_t max_size)
+{
+	int i;
+
+	if (!cache_type_ok(type))
+		return git__throw(GIT_EINVALIDTYPE, "Failed to set cache limit. Invalid object type");
+
+	cache->max_size[type] = max_size;
+
+	for (i = 0; i < GIT_CACHE_STRIPES; ++i) {
+		git_cache_stripe *stripe = &cache->stripes[i];
+		git_cached_obj *evicted = NULL;
+
+		git_mutex_lock(&stripe->lock);
+		stripe_evict(cache, stripe, type, max_size / GIT_CACHE_STRIPES, 0, &evicted);
+		git_mutex_unlock(&stripe->lock);
+
+		release_evicted(cache, evicted);
+	}
+
+	return GIT_SUCCESS;
+}
+
+int git_cache_get_max(size_t *max_size, git_cache *cache, git_otype type)
+{
+	if (!cache_type_ok(type))
+		return git__throw(GIT_EINVALIDTYPE, "Failed to get cache limit. Invalid object type");
+
+	*max_size = cache->max_size[type];
+	return GIT_SUCCESS;
+}
+
+void git_cache_get_stats(git_cache_stats *stats, git_cache *cache)
+{
+	int i, t;
+
+	memset(stats, 0x0, sizeof(git_cache_stats));
+
+	for (i = 0; i < GIT_CACHE_STRIPES; ++i) {
+		git_cache_stripe *stripe = &cache->stripes[i];
+
+		git_mutex_lock(&stripe->lock);
+		stats->hits += stripe->hits;
+		stats->misses += stripe->misses;
+		stats->evictions += stripe->evictions;
+		stats->count += stripe->count;
+		for (t = 0; t < GIT_CACHE_TYPES; ++t)
+			stats->size += stripe->used[t];
+		git_mutex_unlock(&stripe->lock);
+	}
+}
+
+void *git_cache_get(git_cache *cache, const git_oid *oid)
+{
+	git_cache_stripe *stripe = cache_stripe(cache, oid);
+	git_cached_obj *result;
+
+	git_mutex_lock(&stripe->lock);
 	{
-		node = cache->nodes[hash & cache->size_mask];
+		result = *stripe_lookup(stripe, oid);
 
-		if (node != NULL && git_oid_cmp(&node->oid, oid) == 0) {
-			git_cached_obj_incref(node);
-			result = node;
+		if (result != NULL) {
+			result->referenced = 1;
+			git_cached_obj_incref(result);
+			stripe->hits++;
+		} else {
+			stripe->misses++;
 		}
 	}
-	git_mutex_unlock(&cache->lock);
+	git_mutex_unlock(&stripe->lock);
 
 	return result;
 }
 
 void *git_cache_try_store(git_cache *cache, void *_entry)
 {
-	git_cached_obj *entry = _entry;
-	uint32_t hash;
-
-	memcpy(&hash, &entry->oid, sizeof(hash));
+	git_cached_obj *entry = _entry, *node, *evicted = NULL;
+	git_cache_stripe *stripe = cache_stripe(cache, &entry->oid);
+	size_t budget;
 
 	/* increase the refcount on this object, because
-	 * the cache now owns it */
+	 * we are returning it to the user */
 	git_cached_obj_incref(entry);
 
-	git_mutex_lock(&cache->lock);
+	if (!cache_type_ok(entry->type))
+		return entry;
+
+	if (entry->size > cache->max_size[entry->type])
+		return entry;
+
+	/* an object too big for the share of its stripe pushes out
+	 * everything else there, and borrows the rest */
+	budget = cache->max_size[entry->type] / GIT_CACHE_STRIPES;
+	if (entry->size > budget)
+		budget = entry->size;
+
+	git_mutex_lock(&stripe->lock);
 	{
-		git_cached_obj *node = cache->nodes[hash & cache->size_mask];
+		node = *stripe_lookup(stripe, &entry->oid);
 
-		if (node == NULL) {
-			cache->nodes[hash & cache->size_mask] = entry;
-		} else if (git_oid_cmp(&node->oid, &entry->oid) == 0) {
-			git_cached_obj_decref(entry, cache->free_obj);
-			entry = node;
+		if (node != NULL) {
+			/* somebody stored it first; hand out the cached copy */
+			node->referenced = 1;
+			git_cached_obj_incref(node);
 		} else {
-			git_cached_obj_decref(node, cache->free_obj);
-			cache->nodes[hash & cache->size_mask] = entry;
+			stripe_evict(cache, stripe, entry->type, budget, entry->size, &evicted);
+
+			/* the cache now owns a reference as well */
+			git_cached_obj_incref(entry);
+			stripe_insert(cache, stripe, entry);
 		}
 	}
-	git_mutex_unlock(&cache->lock);
+	git_mutex_unlock(&stripe->lock);
 
-	/* increase the refcount again, because we are
-	 * returning it to the user */
-	git_cached_obj_incref(entry);
+	if (node == NULL)
+		cache_repay(cache, entry->type, (int)(stripe - cache->stripes), &evicted);
+
+	release_evicted(cache, evicted);
+
+	if (node != NULL) {
+		git_cached_obj_decref(entry, cache->free_obj);
+		entry = node;
+	}
 
 	return entry;
 }
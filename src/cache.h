@@ -13,27 +13,77 @@
 
 #include "thread-utils.h"
 
-#define GIT_DEFAULT_CACHE_SIZE 128
+/*
+ * The cache is split in stripes, each one of them with its own
+ * lock, so concurrent lookups only contend when they hash to the
+ * same stripe. Must be a power of 2.
+ */
+#define GIT_CACHE_STRIPES 16
+
+/* One budget per object type; indexed by `git_otype` */
+#define GIT_CACHE_TYPES (GIT_OBJ_TAG + 1)
+
+#define GIT_CACHE_MAX_COMMIT (8 * 1024 * 1024)
+#define GIT_CACHE_MAX_TREE (8 * 1024 * 1024)
+#define GIT_CACHE_MAX_BLOB (2 * 1024 * 1024)
+#define GIT_CACHE_MAX_TAG (1 * 1024 * 1024)
 
 typedef void (*git_cached_obj_freeptr)(void *);
 
-typedef struct {
+typedef struct git_cached_obj {
 	git_oid oid;
 	git_atomic refcount;
+
+	/*
+	 * Set by the owner before storing the object: `size` is
+	 * the number of bytes charged against the budget of `type`
+	 */
+	size_t size;
+	git_otype type;
+
+	/* Owned by the cache */
+	int referenced;
+	struct git_cached_obj *hash_next;
+	struct git_cached_obj *clock_prev, *clock_next;
 } git_cached_obj;
 
 typedef struct {
-	git_cached_obj **nodes;
 	git_mutex lock;
 
-	unsigned int lru_count;
-	size_t size_mask;
+	git_cached_obj **buckets;
+	size_t bucket_mask;
+	size_t count;
+
+	/* CLOCK hand for each one of the object types */
+	git_cached_obj *clock[GIT_CACHE_TYPES];
+	size_t used[GIT_CACHE_TYPES];
+
+	unsigned int hits, misses, evictions;
+} git_cache_stripe;
+
+typedef struct {
+	git_cache_stripe stripes[GIT_CACHE_STRIPES];
+	size_t max_size[GIT_CACHE_TYPES];
 	git_cached_obj_freeptr free_obj;
+
+	/*
+	 * Bytes cached for each type over all the stripes. Each stripe
+	 * gets its share of the budget, but one may borrow from the
+	 * others to hold an object too big for its share, as long as
+	 * the whole cache stays under the budget. Taken after the lock
+	 * of a stripe, never before.
+	 */
+	git_mutex lock;
+	size_t used[GIT_CACHE_TYPES];
 } git_cache;
 
-int git_cache_init(git_cache *cache, size_t size, git_cached_obj_freeptr free_ptr);
+int git_cache_init(git_cache *cache, git_cached_obj_freeptr free_ptr);
 void git_cache_free(git_cache *cache);
 
+int git_cache_set_max(git_cache *cache, git_otype type, size_t max_size);
+int git_cache_get_max(size_t *max_size, git_cache *cache, git_otype type);
+void git_cache_get_stats(git_cache_stats *stats, git_cache *cache);
+
 void *git_cache_try_store(git_cache *cache, void *entry);
 void *git_cache_get(git_cache *cache, const git_oid *oid);
 
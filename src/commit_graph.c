@@ -0,0 +1,900 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+#include "commit_graph.h"
+#include "odb.h"
+#include "fileops.h"
+#include "filebuf.h"
+#include "hashtable.h"
+#include "sha1_lookup.h"
+
+#define COMMIT_GRAPH_SIGNATURE 0x43475048	/* "CGPH" */
+#define COMMIT_GRAPH_VERSION 1
+#define COMMIT_GRAPH_OID_VERSION 1
+
+#define COMMIT_GRAPH_HEADER_SIZE 8
+#define COMMIT_GRAPH_CHUNK_TOC_ENTRY_SIZE 12
+#define COMMIT_GRAPH_DATA_SIZE (GIT_OID_RAWSZ + 16)
+
+#define COMMIT_GRAPH_CHUNKID_OIDFANOUT 0x4f494446	/* "OIDF" */
+#define COMMIT_GRAPH_CHUNKID_OIDLOOKUP 0x4f49444c	/* "OIDL" */
+#define COMMIT_GRAPH_CHUNKID_DATA 0x43444154	/* "CDAT" */
+#define COMMIT_GRAPH_CHUNKID_EXTRAEDGELIST 0x45444745	/* "EDGE" */
+
+#define COMMIT_GRAPH_PARENT_NONE 0x70000000
+#define COMMIT_GRAPH_EXTRA_EDGES_NEEDED 0x80000000
+#define COMMIT_GRAPH_LAST_EDGE 0x80000000
+
+#define COMMIT_GRAPH_GENERATION_MAX 0x3FFFFFFF
+
+struct commit_graph_chunk {
+	uint64_t offset;
+	size_t length;
+};
+
+GIT_INLINE(uint32_t) get_be32(const unsigned char *p)
+{
+	uint32_t n;
+	memcpy(&n, p, sizeof(n));
+	return ntohl(n);
+}
+
+GIT_INLINE(uint64_t) get_be64(const unsigned char *p)
+{
+	return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+/***********************************************************
+ *
+ * READING
+ *
+ ***********************************************************/
+
+static int commit_graph_parse_oid_fanout(
+		git_commit_graph_file *file,
+		const unsigned char *data,
+		struct commit_graph_chunk *chunk)
+{
+	uint32_t i, nr = 0;
+
+	if (chunk->offset == 0)
+		return git__throw(GIT_EOBJCORRUPTED, "Missing OID fanout chunk");
+
+	if (chunk->length != 256 * 4)
+		return git__throw(GIT_EOBJCORRUPTED, "Wrong OID fanout size");
+
+	file->oid_fanout = (const uint32_t *)(data + chunk->offset);
+
+	for (i = 0; i < 256; ++i) {
+		uint32_t n = ntohl(file->oid_fanout[i]);
+		if (n < nr)
+			return git__throw(GIT_EOBJCORRUPTED, "Index is non-monotonic");
+		nr = n;
+	}
+
+	file->num_commits = nr;
+	return GIT_SUCCESS;
+}
+
+static int commit_graph_parse_oid_lookup(
+		git_commit_graph_file *file,
+		const unsigned char *data,
+		struct commit_graph_chunk *chunk)
+{
+	uint32_t i;
+	const git_oid *prev = NULL;
+
+	if (chunk->offset == 0)
+		return git__throw(GIT_EOBJCORRUPTED, "Missing OID lookup chunk");
+
+	if (chunk->length != file->num_commits * GIT_OID_RAWSZ)
+		return git__throw(GIT_EOBJCORRUPTED, "Wrong OID lookup size");
+
+	file->oid_lookup = (const git_oid *)(data + chunk->offset);
+
+	for (i = 0; i < file->num_commits; ++i) {
+		if (prev != NULL && git_oid_cmp(prev, &file->oid_lookup[i]) >= 0)
+			return git__throw(GIT_EOBJCORRUPTED, "OID lookup is non-monotonic");
+		prev = &file->oid_lookup[i];
+	}
+
+	return GIT_SUCCESS;
+}
+
+static int commit_graph_parse_commit_data(
+		git_commit_graph_file *file,
+		const unsigned char *data,
+		struct commit_graph_chunk *chunk)
+{
+	if (chunk->offset == 0)
+		return git__throw(GIT_EOBJCORRUPTED, "Missing commit data chunk");
+
+	if (chunk->length != file->num_commits * COMMIT_GRAPH_DATA_SIZE)
+		return git__throw(GIT_EOBJCORRUPTED, "Wrong commit data size");
+
+	file->commit_data = data + chunk->offset;
+	return GIT_SUCCESS;
+}
+
+static int commit_graph_parse_extra_edge_list(
+		git_commit_graph_file *file,
+		const unsigned char *data,
+		struct commit_graph_chunk *chunk)
+{
+	if (chunk->length == 0)
+		return GIT_SUCCESS;
+
+	if (chunk->length % 4 != 0)
+		return git__throw(GIT_EOBJCORRUPTED, "Wrong extra edge list size");
+
+	file->extra_edge_list = data + chunk->offset;
+	file->num_extra_edge_list = chunk->length / 4;
+	return GIT_SUCCESS;
+}
+
+static int commit_graph_parse(git_commit_graph_file *file, const unsigned char *data, size_t size)
+{
+	struct commit_graph_chunk oid_fanout = {0}, oid_lookup = {0},
+		commit_data = {0}, extra_edge_list = {0}, *chunk = NULL;
+	uint32_t num_chunks, i;
+	uint64_t last_offset, trailer_offset;
+	const unsigned char *toc;
+	int error;
+
+	if (size < COMMIT_GRAPH_HEADER_SIZE + GIT_OID_RAWSZ)
+		return git__throw(GIT_EOBJCORRUPTED, "File is too short");
+
+	if (get_be32(data) != COMMIT_GRAPH_SIGNATURE ||
+		data[4] != COMMIT_GRAPH_VERSION ||
+		data[5] != COMMIT_GRAPH_OID_VERSION)
+		return git__throw(GIT_EOBJCORRUPTED, "Unsupported header");
+
+	num_chunks = data[6];
+
+	if (data[7] != 0)
+		return git__throw(GIT_EOBJCORRUPTED, "Chains of commit-graph files are not supported");
+
+	last_offset = COMMIT_GRAPH_HEADER_SIZE + (num_chunks + 1) * COMMIT_GRAPH_CHUNK_TOC_ENTRY_SIZE;
+	trailer_offset = size - GIT_OID_RAWSZ;
+
+	if (last_offset > trailer_offset)
+		return git__throw(GIT_EOBJCORRUPTED, "Wrong chunk table size");
+
+	toc = data + COMMIT_GRAPH_HEADER_SIZE;
+
+	for (i = 0; i <= num_chunks; ++i, toc += COMMIT_GRAPH_CHUNK_TOC_ENTRY_SIZE) {
+		uint64_t offset = get_be64(toc + 4);
+
+		if (offset < last_offset || offset > trailer_offset)
+			return git__throw(GIT_EOBJCORRUPTED, "Chunks are non-monotonic");
+
+		if (chunk != NULL)
+			chunk->length = (size_t)(offset - last_offset);
+
+		last_offset = offset;
+
+		if (i == num_chunks)
+			break;
+
+		switch (get_be32(toc)) {
+		case COMMIT_GRAPH_CHUNKID_OIDFANOUT:
+			chunk = &oid_fanout;
+			break;
+		case COMMIT_GRAPH_CHUNKID_OIDLOOKUP:
+			chunk = &oid_lookup;
+			break;
+		case COMMIT_GRAPH_CHUNKID_DATA:
+			chunk = &commit_data;
+			break;
+		case COMMIT_GRAPH_CHUNKID_EXTRAEDGELIST:
+			chunk = &extra_edge_list;
+			break;
+		default:
+			/* skip the chunks we don't know about */
+			chunk = NULL;
+			continue;
+		}
+
+		chunk->offset = offset;
+	}
+
+	if ((error = commit_graph_parse_oid_fanout(file, data, &oid_fanout)) < GIT_SUCCESS ||
+		(error = commit_graph_parse_oid_lookup(file, data, &oid_lookup)) < GIT_SUCCESS ||
+		(error = commit_graph_parse_commit_data(file, data, &commit_data)) < GIT_SUCCESS ||
+		(error = commit_graph_parse_extra_edge_list(file, data, &extra_edge_list)) < GIT_SUCCESS)
+		return error;
+
+	git_oid_fromraw(&file->checksum, data + trailer_offset);
+	return GIT_SUCCESS;
+}
+
+int git_commit_graph_open(git_commit_graph_file **file_out, const char *path)
+{
+	git_commit_graph_file *file;
+	git_file fd;
+	struct stat st;
+	int error;
+
+	*file_out = NULL;
+
+	if ((fd = p_open(path, O_RDONLY)) < 0)
+		return git__throw(GIT_ENOTFOUND, "Failed to open commit-graph '%s'", path);
+
+	if (p_fstat(fd, &st) < GIT_SUCCESS) {
+		p_close(fd);
+		return git__throw(GIT_EOSERR, "Failed to stat commit-graph '%s'", path);
+	}
+
+	if (!S_ISREG(st.st_mode) || !git__is_sizet(st.st_size)) {
+		p_close(fd);
+		return git__throw(GIT_EOBJCORRUPTED, "Invalid commit-graph '%s'", path);
+	}
+
+	file = git__calloc(1, sizeof(git_commit_graph_file));
+	if (file == NULL) {
+		p_close(fd);
+		return GIT_ENOMEM;
+	}
+
+	error = git_futils_mmap_ro(&file->graph_map, fd, 0, (size_t)st.st_size);
+	p_close(fd);
+
+	if (error < GIT_SUCCESS) {
+		git__free(file);
+		return git__rethrow(error, "Failed to open commit-graph '%s'", path);
+	}
+
+	error = commit_graph_parse(file, file->graph_map.data, file->graph_map.len);
+	if (error < GIT_SUCCESS) {
+		git_commit_graph_free(file);
+		return git__rethrow(error, "Failed to parse commit-graph '%s'", path);
+	}
+
+	*file_out = file;
+	return GIT_SUCCESS;
+}
+
+void git_commit_graph_free(git_commit_graph_file *file)
+{
+	if (file == NULL)
+		return;
+
+	git_futils_mmap_free(&file->graph_map);
+	git__free(file);
+}
+
+int git_commit_graph_entry_get_byindex(
+		git_commit_graph_entry *e,
+		const git_commit_graph_file *file,
+		uint32_t pos)
+{
+	const unsigned char *row;
+	uint32_t parent, generation_and_time;
+
+	assert(e && file);
+
+	if (pos >= file->num_commits)
+		return git__throw(GIT_ENOTFOUND, "Commit-graph position out of range");
+
+	row = file->commit_data + (size_t)pos * COMMIT_GRAPH_DATA_SIZE;
+
+	git_oid_cpy(&e->sha1, &file->oid_lookup[pos]);
+	git_oid_fromraw(&e->tree_oid, row);
+	e->position = pos;
+
+	generation_and_time = get_be32(row + GIT_OID_RAWSZ + 8);
+	e->generation = generation_and_time >> 2;
+	e->commit_time = (git_time_t)(((uint64_t)(generation_and_time & 0x3) << 32) |
+		get_be32(row + GIT_OID_RAWSZ + 12));
+
+	e->parent_count = 0;
+	e->extra_parents_index = 0;
+
+	parent = get_be32(row + GIT_OID_RAWSZ);
+	if (parent == COMMIT_GRAPH_PARENT_NONE)
+		return GIT_SUCCESS;
+
+	if (parent >= file->num_commits)
+		return git__throw(GIT_EOBJCORRUPTED, "Invalid parent in commit-graph");
+
+	e->parent_indices[0] = parent;
+	e->parent_count = 1;
+
+	parent = get_be32(row + GIT_OID_RAWSZ + 4);
+	if (parent == COMMIT_GRAPH_PARENT_NONE)
+		return GIT_SUCCESS;
+
+	if (parent & COMMIT_GRAPH_EXTRA_EDGES_NEEDED) {
+		size_t edge = parent & ~COMMIT_GRAPH_EXTRA_EDGES_NEEDED;
+
+		e->extra_parents_index = edge;
+
+		do {
+			if (edge >= file->num_extra_edge_list)
+				return git__throw(GIT_EOBJCORRUPTED, "Invalid extra edge in commit-graph");
+
+			parent = get_be32(file->extra_edge_list + edge * 4);
+			e->parent_count++;
+			edge++;
+		} while (!(parent & COMMIT_GRAPH_LAST_EDGE));
+
+		parent = get_be32(file->extra_edge_list + e->extra_parents_index * 4) & ~COMMIT_GRAPH_LAST_EDGE;
+	} else {
+		e->parent_count = 2;
+	}
+
+	if (parent >= file->num_commits)
+		return git__throw(GIT_EOBJCORRUPTED, "Invalid parent in commit-graph");
+
+	e->parent_indices[1] = parent;
+	return GIT_SUCCESS;
+}
+
+int git_commit_graph_entry_parent_position(
+		uint32_t *pos_out,
+		const git_commit_graph_file *file,
+		const git_commit_graph_entry *entry,
+		size_t n)
+{
+	uint32_t pos;
+
+	assert(pos_out && file && entry);
+
+	if (n >= entry->parent_count)
+		return git__throw(GIT_ENOTFOUND, "Parent %u does not exist", (unsigned int)n);
+
+	if (n < 2) {
+		*pos_out = entry->parent_indices[n];
+		return GIT_SUCCESS;
+	}
+
+	/* the extra edges start with the second parent */
+	pos = get_be32(file->extra_edge_list + (entry->extra_parents_index + n - 1) * 4);
+	pos &= ~COMMIT_GRAPH_LAST_EDGE;
+
+	if (pos >= file->num_commits)
+		return git__throw(GIT_EOBJCORRUPTED, "Invalid parent in commit-graph");
+
+	*pos_out = pos;
+	return GIT_SUCCESS;
+}
+
+int git_commit_graph_entry_find(
+		git_commit_graph_entry *e,
+		const git_commit_graph_file *file,
+		const git_oid *short_oid,
+		unsigned int len)
+{
+	int pos, found = 0;
+	uint32_t hi, lo;
+	const git_oid *current = NULL;
+
+	assert(e && file);
+
+	hi = ntohl(file->oid_fanout[(int)short_oid->id[0]]);
+	lo = ((short_oid->id[0] == 0x0) ? 0 : ntohl(file->oid_fanout[(int)short_oid->id[0] - 1]));
+
+	pos = sha1_entry_pos(file->oid_lookup, GIT_OID_RAWSZ, 0, lo, hi, file->num_commits, short_oid->id);
+
+	if (pos >= 0) {
+		found = 1;
+		current = file->oid_lookup + pos;
+	} else {
+		/* pos refers to the object with the "closest" oid to short_oid */
+		pos = -1 - pos;
+		if (pos < (int)file->num_commits) {
+			current = file->oid_lookup + pos;
+
+			if (!git_oid_ncmp(short_oid, current, len))
+				found = 1;
+		}
+	}
+
+	if (found && len != GIT_OID_HEXSZ && pos + 1 < (int)file->num_commits) {
+		/* Check for ambiguousity */
+		if (!git_oid_ncmp(short_oid, current + 1, len))
+			found = 2;
+	}
+
+	if (!found)
+		return git__throw(GIT_ENOTFOUND, "Failed to find entry in commit-graph");
+	else if (found > 1)
+		return git__throw(GIT_EAMBIGUOUSOIDPREFIX, "Failed to find entry in commit-graph. Ambiguous sha1 prefix");
+
+	return git_commit_graph_entry_get_byindex(e, file, (uint32_t)pos);
+}
+
+/***********************************************************
+ *
+ * WRITING
+ *
+ ***********************************************************/
+
+struct commit_graph_write_entry {
+	git_oid oid;
+	git_oid tree_oid;
+	git_time_t commit_time;
+	uint32_t generation;
+	uint32_t position;
+
+	size_t parent_count;
+	git_oid *parents;
+	uint32_t *parent_positions;
+};
+
+struct commit_graph_writer {
+	git_odb *odb;
+	git_hashtable *seen;
+	git_vector commits;
+
+	/* commits found but not read yet */
+	git_oid *pending;
+	size_t pending_len, pending_alloc;
+};
+
+static uint32_t commit_graph_oid_hash(const void *key, int hash_id)
+{
+	uint32_t r;
+	const git_oid *id = key;
+
+	memcpy(&r, id->id + (hash_id * sizeof(uint32_t)), sizeof(r));
+	return r;
+}
+
+static int commit_graph_write_entry_cmp(const void *a_, const void *b_)
+{
+	const struct commit_graph_write_entry *a = a_, *b = b_;
+	return git_oid_cmp(&a->oid, &b->oid);
+}
+
+static void commit_graph_write_entry_free(struct commit_graph_write_entry *entry)
+{
+	git__free(entry->parents);
+	git__free(entry->parent_positions);
+	git__free(entry);
+}
+
+static int commit_graph_push_pending(struct commit_graph_writer *w, const git_oid *oid)
+{
+	if (git_hashtable_lookup(w->seen, oid) != NULL)
+		return GIT_SUCCESS;
+
+	if (w->pending_len == w->pending_alloc) {
+		size_t alloc = w->pending_alloc ? w->pending_alloc * 2 : 64;
+		git_oid *pending = git__realloc(w->pending, alloc * sizeof(git_oid));
+
+		if (pending == NULL)
+			return GIT_ENOMEM;
+
+		w->pending = pending;
+		w->pending_alloc = alloc;
+	}
+
+	git_oid_cpy(&w->pending[w->pending_len++], oid);
+	return GIT_SUCCESS;
+}
+
+/* Take the tree, the parents and the committer time out of a commit */
+static int commit_graph_parse_commit(struct commit_graph_write_entry *entry, git_odb_object *obj)
+{
+	const int parent_len = strlen("parent ") + GIT_OID_HEXSZ + 1;
+	const char *buffer = obj->raw.data;
+	const char *buffer_end = buffer + obj->raw.len;
+	const char *parents_start, *line_end;
+	int64_t commit_time;
+	size_t i;
+
+	if (buffer + strlen("tree ") + GIT_OID_HEXSZ + 1 > buffer_end ||
+		memcmp(buffer, "tree ", strlen("tree ")) != 0 ||
+		git_oid_fromstr(&entry->tree_oid, buffer + strlen("tree ")) < GIT_SUCCESS)
+		return git__throw(GIT_EOBJCORRUPTED, "Failed to parse commit. Can't find tree");
+
+	buffer += strlen("tree ") + GIT_OID_HEXSZ + 1;
+
+	parents_start = buffer;
+	while (buffer + parent_len < buffer_end && memcmp(buffer, "parent ", strlen("parent ")) == 0) {
+		entry->parent_count++;
+		buffer += parent_len;
+	}
+
+	if (entry->parent_count > 0) {
+		entry->parents = git__malloc(entry->parent_count * sizeof(git_oid));
+		if (entry->parents == NULL)
+			return GIT_ENOMEM;
+	}
+
+	buffer = parents_start;
+	for (i = 0; i < entry->parent_count; ++i) {
+		if (git_oid_fromstr(&entry->parents[i], buffer + strlen("parent ")) < GIT_SUCCESS)
+			return git__throw(GIT_EOBJCORRUPTED, "Failed to parse commit. Parent object is corrupted");
+
+		buffer += parent_len;
+	}
+
+	/* the committer comes right after the author */
+	while (buffer != NULL && buffer + strlen("committer ") < buffer_end) {
+		if (memcmp(buffer, "committer ", strlen("committer ")) == 0)
+			break;
+
+		if ((buffer = memchr(buffer, '\n', buffer_end - buffer)) != NULL)
+			buffer++;
+	}
+
+	if (buffer == NULL || buffer + strlen("committer ") >= buffer_end)
+		return git__throw(GIT_EOBJCORRUPTED, "Failed to parse commit. Can't find committer");
+
+	line_end = memchr(buffer, '\n', buffer_end - buffer);
+	if (line_end == NULL)
+		line_end = buffer_end;
+
+	buffer = memchr(buffer, '>', line_end - buffer);
+	if (buffer == NULL || buffer + 2 >= line_end)
+		return git__throw(GIT_EOBJCORRUPTED, "Failed to parse commit. Can't find committer");
+
+	if (git__strtol64(&commit_time, buffer + 2, NULL, 10) < GIT_SUCCESS)
+		return git__throw(GIT_EOBJCORRUPTED, "Failed to parse commit. Can't parse commit time");
+
+	entry->commit_time = commit_time;
+	return GIT_SUCCESS;
+}
+
+static int commit_graph_read_commit(struct commit_graph_writer *w, const git_oid *oid)
+{
+	struct commit_graph_write_entry *entry;
+	git_odb_object *obj;
+	size_t i;
+	int error;
+
+	if (git_hashtable_lookup(w->seen, oid) != NULL)
+		return GIT_SUCCESS;
+
+	if ((error = git_odb_read(&obj, w->odb, oid)) < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to read commit");
+
+	if (obj->raw.type != GIT_OBJ_COMMIT) {
+		git_odb_object_free(obj);
+		return git__throw(GIT_EOBJTYPE, "Object is no commit object");
+	}
+
+	entry = git__calloc(1, sizeof(struct commit_graph_write_entry));
+	if (entry == NULL) {
+		git_odb_object_free(obj);
+		return GIT_ENOMEM;
+	}
+
+	git_oid_cpy(&entry->oid, oid);
+	error = commit_graph_parse_commit(entry, obj);
+	git_odb_object_free(obj);
+
+	if (error == GIT_SUCCESS && (error = git_vector_insert(&w->commits, entry)) < GIT_SUCCESS)
+		error = GIT_ENOMEM;
+
+	if (error < GIT_SUCCESS) {
+		commit_graph_write_entry_free(entry);
+		return error;
+	}
+
+	if (git_hashtable_insert(w->seen, &entry->oid, entry) < GIT_SUCCESS)
+		return GIT_ENOMEM;
+
+	for (i = 0; i < entry->parent_count; ++i) {
+		if ((error = commit_graph_push_pending(w, &entry->parents[i])) < GIT_SUCCESS)
+			return error;
+	}
+
+	return GIT_SUCCESS;
+}
+
+/* Turn the parents' oids into positions in the (sorted) list of commits */
+static int commit_graph_resolve_parents(struct commit_graph_writer *w)
+{
+	struct commit_graph_write_entry *entry;
+	unsigned int i;
+	size_t j;
+
+	git_vector_foreach(&w->commits, i, entry) {
+		entry->position = i;
+	}
+
+	git_vector_foreach(&w->commits, i, entry) {
+		if (entry->parent_count == 0)
+			continue;
+
+		entry->parent_positions = git__malloc(entry->parent_count * sizeof(uint32_t));
+		if (entry->parent_positions == NULL)
+			return GIT_ENOMEM;
+
+		for (j = 0; j < entry->parent_count; ++j) {
+			struct commit_graph_write_entry *parent;
+
+			parent = git_hashtable_lookup(w->seen, &entry->parents[j]);
+			assert(parent != NULL);
+			entry->parent_positions[j] = parent->position;
+		}
+	}
+
+	return GIT_SUCCESS;
+}
+
+/*
+ * The generation number of a commit is one more than the largest
+ * one of its parents; compute them depth-first, without recursing.
+ */
+static int commit_graph_compute_generations(struct commit_graph_writer *w)
+{
+	uint32_t *stack = NULL;
+	size_t stack_len = 0, stack_alloc = 0;
+	unsigned int i;
+
+	for (i = 0; i < w->commits.length; ++i) {
+		struct commit_graph_write_entry *entry = git_vector_get(&w->commits, i);
+
+		if (entry->generation)
+			continue;
+
+		stack_len = 0;
+
+		do {
+			struct commit_graph_write_entry *top;
+			uint32_t max = 0;
+			int done = 1;
+			size_t j;
+
+			top = git_vector_get(&w->commits, stack_len ? stack[stack_len - 1] : i);
+
+			for (j = 0; j < top->parent_count; ++j) {
+				struct commit_graph_write_entry *parent;
+
+				parent = git_vector_get(&w->commits, top->parent_positions[j]);
+				if (parent->generation == 0) {
+					if (stack_len == stack_alloc) {
+						size_t alloc = stack_alloc ? stack_alloc * 2 : 64;
+						uint32_t *s = git__realloc(stack, alloc * sizeof(uint32_t));
+
+						if (s == NULL) {
+							git__free(stack);
+							return GIT_ENOMEM;
+						}
+
+						stack = s;
+						stack_alloc = alloc;
+					}
+
+					stack[stack_len++] = parent->position;
+					done = 0;
+					break;
+				}
+
+				if (parent->generation > max)
+					max = parent->generation;
+			}
+
+			if (!done)
+				continue;
+
+			top->generation = max < COMMIT_GRAPH_GENERATION_MAX ? max + 1 : COMMIT_GRAPH_GENERATION_MAX;
+
+			if (stack_len == 0)
+				break;
+
+			stack_len--;
+		} while (1);
+	}
+
+	git__free(stack);
+	return GIT_SUCCESS;
+}
+
+static int write_be32(git_filebuf *file, uint32_t n)
+{
+	n = htonl(n);
+	return git_filebuf_write(file, &n, sizeof(n));
+}
+
+static int write_be64(git_filebuf *file, uint64_t n)
+{
+	int error = write_be32(file, (uint32_t)(n >> 32));
+	if (error < GIT_SUCCESS)
+		return error;
+	return write_be32(file, (uint32_t)n);
+}
+
+static int write_chunk_toc_entry(git_filebuf *file, uint32_t id, uint64_t offset)
+{
+	int error = write_be32(file, id);
+	if (error < GIT_SUCCESS)
+		return error;
+	return write_be64(file, offset);
+}
+
+static int commit_graph_write_file(const char *path, git_vector *commits)
+{
+	git_filebuf file = GIT_FILEBUF_INIT;
+	unsigned char header[COMMIT_GRAPH_HEADER_SIZE];
+	uint32_t fanout[256], num_chunks, num_extra_edges = 0, n;
+	struct commit_graph_write_entry *entry;
+	unsigned int i;
+	size_t j;
+	uint64_t offset;
+	git_oid checksum;
+	int error;
+
+	memset(fanout, 0x0, sizeof(fanout));
+	git_vector_foreach(commits, i, entry) {
+		fanout[entry->oid.id[0]]++;
+		if (entry->parent_count > 2)
+			num_extra_edges += (uint32_t)entry->parent_count - 1;
+	}
+
+	for (i = 1; i < 256; ++i)
+		fanout[i] += fanout[i - 1];
+
+	num_chunks = num_extra_edges ? 4 : 3;
+
+	n = htonl(COMMIT_GRAPH_SIGNATURE);
+	memcpy(header, &n, sizeof(n));
+	header[4] = COMMIT_GRAPH_VERSION;
+	header[5] = COMMIT_GRAPH_OID_VERSION;
+	header[6] = (unsigned char)num_chunks;
+	header[7] = 0;
+
+	if ((error = git_filebuf_open(&file, path, GIT_FILEBUF_HASH_CONTENTS)) < GIT_SUCCESS)
+		return error;
+
+	if ((error = git_filebuf_write(&file, header, sizeof(header))) < GIT_SUCCESS)
+		goto cleanup;
+
+	/* chunk table of contents */
+	offset = COMMIT_GRAPH_HEADER_SIZE + (num_chunks + 1) * COMMIT_GRAPH_CHUNK_TOC_ENTRY_SIZE;
+
+	if ((error = write_chunk_toc_entry(&file, COMMIT_GRAPH_CHUNKID_OIDFANOUT, offset)) < GIT_SUCCESS)
+		goto cleanup;
+	offset += 256 * 4;
+
+	if ((error = write_chunk_toc_entry(&file, COMMIT_GRAPH_CHUNKID_OIDLOOKUP, offset)) < GIT_SUCCESS)
+		goto cleanup;
+	offset += (uint64_t)commits->length * GIT_OID_RAWSZ;
+
+	if ((error = write_chunk_toc_entry(&file, COMMIT_GRAPH_CHUNKID_DATA, offset)) < GIT_SUCCESS)
+		goto cleanup;
+	offset += (uint64_t)commits->length * COMMIT_GRAPH_DATA_SIZE;
+
+	if (num_extra_edges) {
+		if ((error = write_chunk_toc_entry(&file, COMMIT_GRAPH_CHUNKID_EXTRAEDGELIST, offset)) < GIT_SUCCESS)
+			goto cleanup;
+		offset += (uint64_t)num_extra_edges * 4;
+	}
+
+	if ((error = write_chunk_toc_entry(&file, 0, offset)) < GIT_SUCCESS)
+		goto cleanup;
+
+	/* OIDF */
+	for (i = 0; i < 256; ++i) {
+		if ((error = write_be32(&file, fanout[i])) < GIT_SUCCESS)
+			goto cleanup;
+	}
+
+	/* OIDL */
+	git_vector_foreach(commits, i, entry) {
+		if ((error = git_filebuf_write(&file, &entry->oid, GIT_OID_RAWSZ)) < GIT_SUCCESS)
+			goto cleanup;
+	}
+
+	/* CDAT */
+	n = 0;
+	git_vector_foreach(commits, i, entry) {
+		uint32_t parents[2] = { COMMIT_GRAPH_PARENT_NONE, COMMIT_GRAPH_PARENT_NONE };
+		uint64_t commit_time = entry->commit_time < 0 ? 0 : (uint64_t)entry->commit_time;
+
+		if (entry->parent_count > 0)
+			parents[0] = entry->parent_positions[0];
+
+		if (entry->parent_count == 2) {
+			parents[1] = entry->parent_positions[1];
+		} else if (entry->parent_count > 2) {
+			parents[1] = COMMIT_GRAPH_EXTRA_EDGES_NEEDED | n;
+			n += (uint32_t)entry->parent_count - 1;
+		}
+
+		if ((error = git_filebuf_write(&file, &entry->tree_oid, GIT_OID_RAWSZ)) < GIT_SUCCESS ||
+			(error = write_be32(&file, parents[0])) < GIT_SUCCESS ||
+			(error = write_be32(&file, parents[1])) < GIT_SUCCESS ||
+			(error = write_be32(&file, (entry->generation << 2) | (uint32_t)((commit_time >> 32) & 0x3))) < GIT_SUCCESS ||
+			(error = write_be32(&file, (uint32_t)commit_time)) < GIT_SUCCESS)
+			goto cleanup;
+	}
+
+	/* EDGE */
+	git_vector_foreach(commits, i, entry) {
+		if (entry->parent_count <= 2)
+			continue;
+
+		for (j = 1; j < entry->parent_count; ++j) {
+			uint32_t edge = entry->parent_positions[j];
+
+			if (j == entry->parent_count - 1)
+				edge |= COMMIT_GRAPH_LAST_EDGE;
+
+			if ((error = write_be32(&file, edge)) < GIT_SUCCESS)
+				goto cleanup;
+		}
+	}
+
+	if ((error = git_filebuf_hash(&checksum, &file)) < GIT_SUCCESS ||
+		(error = git_filebuf_write(&file, checksum.id, GIT_OID_RAWSZ)) < GIT_SUCCESS)
+		goto cleanup;
+
+	return git_filebuf_commit(&file, GIT_OBJECT_FILE_MODE);
+
+cleanup:
+	git_filebuf_cleanup(&file);
+	return error;
+}
+
+int git_commit_graph_write(const char *path, git_odb *odb, git_vector *tips)
+{
+	struct commit_graph_writer w;
+	struct commit_graph_write_entry *entry;
+	unsigned int i;
+	int error = GIT_SUCCESS;
+
+	assert(path && odb && tips);
+
+	memset(&w, 0x0, sizeof(w));
+	w.odb = odb;
+
+	w.seen = git_hashtable_alloc(tips->length * 4,
+			commit_graph_oid_hash,
+			(git_hash_keyeq_ptr)git_oid_cmp);
+
+	if (w.seen == NULL ||
+		git_vector_init(&w.commits, tips->length * 4, commit_graph_write_entry_cmp) < GIT_SUCCESS) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
+
+	for (i = 0; i < tips->length && error == GIT_SUCCESS; ++i)
+		error = commit_graph_push_pending(&w, git_vector_get(tips, i));
+
+	while (error == GIT_SUCCESS && w.pending_len > 0) {
+		git_oid oid;
+
+		git_oid_cpy(&oid, &w.pending[--w.pending_len]);
+		error = commit_graph_read_commit(&w, &oid);
+	}
+
+	if (error < GIT_SUCCESS)
+		goto cleanup;
+
+	git_vector_sort(&w.commits);
+
+	if (w.commits.length > COMMIT_GRAPH_PARENT_NONE) {
+		error = git__throw(GIT_ERROR, "Too many commits for a commit-graph");
+		goto cleanup;
+	}
+
+	if ((error = commit_graph_resolve_parents(&w)) < GIT_SUCCESS ||
+		(error = commit_graph_compute_generations(&w)) < GIT_SUCCESS)
+		goto cleanup;
+
+	error = commit_graph_write_file(path, &w.commits);
+
+cleanup:
+	git_vector_foreach(&w.commits, i, entry) {
+		commit_graph_write_entry_free(entry);
+	}
+
+	git_vector_free(&w.commits);
+	git_hashtable_free(w.seen);
+	git__free(w.pending);
+
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to write commit-graph");
+
+	return GIT_SUCCESS;
+}
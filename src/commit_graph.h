@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_commit_graph_h__
+#define INCLUDE_commit_graph_h__
+
+#include "git2/types.h"
+#include "git2/oid.h"
+
+#include "common.h"
+#include "map.h"
+#include "vector.h"
+
+#define GIT_COMMIT_GRAPH_FILE "commit-graph"
+
+/*
+ * A commit-graph, as written by `git commit-graph write`: the
+ * parents, root tree, commit time and generation number of a set
+ * of commits, in fixed-width rows sorted by oid. Parents refer to
+ * other rows by their position, so walking the history only needs
+ * the mapped tables and never inflates a commit.
+ *
+ * All the tables point straight into the mapped file.
+ */
+typedef struct git_commit_graph_file {
+	git_map graph_map;
+
+	const uint32_t *oid_fanout;
+	uint32_t num_commits;
+
+	const git_oid *oid_lookup;
+	const unsigned char *commit_data;
+
+	/* the third and later parents of octopus merges */
+	const unsigned char *extra_edge_list;
+	size_t num_extra_edge_list;
+
+	git_oid checksum;
+} git_commit_graph_file;
+
+typedef struct git_commit_graph_entry {
+	git_oid sha1;
+	git_oid tree_oid;
+
+	/* row of this commit in the graph */
+	uint32_t position;
+
+	/* topological level: 1 for root commits, else 1 + the max of the parents' */
+	uint32_t generation;
+	git_time_t commit_time;
+
+	size_t parent_count;
+	/* rows of the first two parents; the rest are in the extra edge list */
+	uint32_t parent_indices[2];
+	size_t extra_parents_index;
+} git_commit_graph_entry;
+
+int git_commit_graph_open(git_commit_graph_file **file_out, const char *path);
+void git_commit_graph_free(git_commit_graph_file *file);
+
+/*
+ * Find the entry for `short_oid`; throws GIT_EAMBIGUOUSOIDPREFIX
+ * if more than one commit matches the first `len` hex digits.
+ */
+int git_commit_graph_entry_find(
+		git_commit_graph_entry *e,
+		const git_commit_graph_file *file,
+		const git_oid *short_oid,
+		unsigned int len);
+
+/* Fill `e` with the commit at row `pos` */
+int git_commit_graph_entry_get_byindex(
+		git_commit_graph_entry *e,
+		const git_commit_graph_file *file,
+		uint32_t pos);
+
+/* Row of the `n`th parent of `entry` */
+int git_commit_graph_entry_parent_position(
+		uint32_t *pos_out,
+		const git_commit_graph_file *file,
+		const git_commit_graph_entry *entry,
+		size_t n);
+
+/*
+ * Write a commit-graph to `path` with every commit reachable from
+ * the `git_oid *` in `tips`, reading them from `odb`.
+ */
+int git_commit_graph_write(const char *path, git_odb *odb, git_vector *tips);
+
+#endif
@@ -52,9 +52,46 @@ static git_cvar_map _cvar_map_autocrlf[] = {
 	{GIT_CVAR_STRING, "input", GIT_AUTO_CRLF_INPUT}
 };
 
+/*
+ *	core.splitIndex
+ *		If true, the split-index feature of the index will be used.
+ *	When unset, an index which is already split stays that way.
+ */
+static git_cvar_map _cvar_map_split_index[] = {
+	{GIT_CVAR_FALSE, NULL, GIT_SPLIT_INDEX_FALSE},
+	{GIT_CVAR_TRUE, NULL, GIT_SPLIT_INDEX_TRUE}
+};
+
+/*
+ *	core.preloadIndex
+ *		Enable parallel scanning of the working directory: the
+ *	directories are read and their entries stat'ed by a few threads
+ *	ahead of the code walking them. Defaults to true.
+ */
+static git_cvar_map _cvar_map_preload_index[] = {
+	{GIT_CVAR_FALSE, NULL, GIT_PRELOAD_INDEX_FALSE},
+	{GIT_CVAR_TRUE, NULL, GIT_PRELOAD_INDEX_TRUE}
+};
+
+/*
+ *	core.untrackedCache
+ *		Whether to keep the untracked cache in the index, with which
+ *	a status that leaves out the ignored files needn't read the
+ *	directories which didn't change. When unset, or "keep", a cache
+ *	git made is used and kept up to date, but none is made.
+ */
+static git_cvar_map _cvar_map_untracked_cache[] = {
+	{GIT_CVAR_FALSE, NULL, GIT_UNTRACKED_CACHE_FALSE},
+	{GIT_CVAR_TRUE, NULL, GIT_UNTRACKED_CACHE_TRUE},
+	{GIT_CVAR_STRING, "keep", GIT_UNTRACKED_CACHE_KEEP}
+};
+
 static struct map_data _cvar_maps[] = {
 	{"core.autocrlf", _cvar_map_autocrlf, ARRAY_SIZE(_cvar_map_autocrlf), GIT_AUTO_CRLF_DEFAULT},
-	{"core.eol", _cvar_map_eol, ARRAY_SIZE(_cvar_map_eol), GIT_EOL_DEFAULT}
+	{"core.eol", _cvar_map_eol, ARRAY_SIZE(_cvar_map_eol), GIT_EOL_DEFAULT},
+	{"core.splitIndex", _cvar_map_split_index, ARRAY_SIZE(_cvar_map_split_index), GIT_SPLIT_INDEX_DEFAULT},
+	{"core.preloadIndex", _cvar_map_preload_index, ARRAY_SIZE(_cvar_map_preload_index), GIT_PRELOAD_INDEX_DEFAULT},
+	{"core.untrackedCache", _cvar_map_untracked_cache, ARRAY_SIZE(_cvar_map_untracked_cache), GIT_UNTRACKED_CACHE_DEFAULT}
 };
 
 int git_repository__cvar(int *out, git_repository *repo, git_cvar_cached cvar)
@@ -8,6 +8,8 @@
 #include "git2/diff.h"
 #include "diff.h"
 #include "fileops.h"
+#include "index.h"
+#include "repository.h"
 
 static void diff_delta__free(git_diff_delta *delta)
 {
@@ -324,8 +326,7 @@ static int maybe_modified(
 {
 	int error = GIT_SUCCESS;
 	git_oid noid, *use_noid = NULL;
-
-	GIT_UNUSED(old);
+	git_index *index = NULL;
 
 	/* support "assume unchanged" & "skip worktree" bits */
 	if ((oitem->flags_extended & GIT_IDXENTRY_INTENT_TO_ADD) != 0 ||
@@ -344,15 +345,16 @@ static int maybe_modified(
 		return GIT_SUCCESS;
 
 	if (git_oid_iszero(&nitem->oid) && new->type == GIT_ITERATOR_WORKDIR) {
+		/* only the index knows what the files looked like */
+		if (old->type == GIT_ITERATOR_INDEX &&
+			(error = git_repository_index__weakptr(&index, diff->repo)) < GIT_SUCCESS)
+			return error;
+
 		/* if they files look exactly alike, then we'll assume the same */
-		if (oitem->file_size == nitem->file_size &&
-			oitem->ctime.seconds == nitem->ctime.seconds &&
-			oitem->mtime.seconds == nitem->mtime.seconds &&
-			oitem->dev == nitem->dev &&
-			oitem->ino == nitem->ino &&
-			oitem->uid == nitem->uid &&
-			oitem->gid == nitem->gid)
+		if (index != NULL && git_index__stat_matches(index, oitem, nitem)) {
+			git_index__fsmonitor_mark_valid(index, (git_index_entry *)oitem);
 			return GIT_SUCCESS;
+		}
 
 		/* TODO: check git attributes so we will not have to read the file
 		 * in if it is marked binary.
@@ -362,8 +364,17 @@ static int maybe_modified(
 			return error;
 
 		if (git_oid_cmp(&oitem->oid, &noid) == 0 &&
-			oitem->mode == nitem->mode)
+			oitem->mode == nitem->mode) {
+			/*
+			 * so we needn't read it next time; the index iterator
+			 * hands out the index's own entries
+			 */
+			if (index != NULL) {
+				git_index__refresh_stat(index, (git_index_entry *)oitem, nitem);
+				git_index__fsmonitor_mark_valid(index, (git_index_entry *)oitem);
+			}
 			return GIT_SUCCESS;
+		}
 
 		/* store calculated oid so we don't have to recalc later */
 		use_noid = &noid;
@@ -515,6 +526,7 @@ int git_diff_workdir_to_index(
 {
 	int error;
 	git_iterator *a = NULL, *b = NULL;
+	git_index *index;
 
 	assert(repo && diff);
 
@@ -522,7 +534,14 @@ int git_diff_workdir_to_index(
 		(error = git_iterator_for_workdir(repo, &b)) < GIT_SUCCESS)
 		return error;
 
-	return diff_from_iterators(repo, opts, a, b, diff);
+	error = diff_from_iterators(repo, opts, a, b, diff);
+
+	/* keep the stat data we refreshed on the way for next time */
+	if (error == GIT_SUCCESS &&
+		git_repository_index__weakptr(&index, repo) == GIT_SUCCESS)
+		git_index__write_refreshed(index);
+
+	return error;
 }
 
 
@@ -0,0 +1,430 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "dirscan.h"
+#include "path.h"
+#include "thread-utils.h"
+
+#ifndef GIT_WIN32
+# include <sys/time.h>
+#endif
+
+/*
+ * The threads mostly wait on the filesystem (think NFS), so there
+ * can be more of them than CPUs
+ */
+#define DIRSCAN_MIN_THREADS 8
+#define DIRSCAN_MAX_THREADS 16
+
+/*
+ * When the filesystem answers from its cache, the threads only get in
+ * the way. Unless told how many threads to use, the caller loads this
+ * many entries itself first, and the threads only start if that took
+ * more than DIRSCAN_SLOW_USEC for each of them (a warm lstat() takes a
+ * microsecond or two, a round trip to an NFS server a hundred or more)
+ */
+#define DIRSCAN_SAMPLE_ENTRIES 256
+#define DIRSCAN_SLOW_USEC 20
+
+/* How many loaded directories may be waiting for the caller */
+#define DIRSCAN_MAX_AHEAD 256
+
+enum {
+	DIRSCAN_QUEUED,
+	DIRSCAN_RUNNING,
+	DIRSCAN_DONE
+};
+
+typedef struct dirscan_job {
+	struct dirscan_job *prev, *next;
+	int state;
+	int cancelled;
+	int error;
+	git_vector entries;
+	char path[GIT_FLEX_ARRAY];
+} dirscan_job;
+
+enum {
+	DIRSCAN_UNDECIDED,
+	DIRSCAN_THREADED,
+	DIRSCAN_UNTHREADED
+};
+
+struct git_dirscan {
+	size_t prefix_len;
+	unsigned int threads, started;
+	git_thread *workers;
+
+	/* whether to use the threads, and what we measured to decide */
+	int mode;
+	size_t sampled;
+	double sample_usec;
+
+	git_mutex lock;
+	git_cond work; /* a job was queued, or we're shutting down */
+	git_cond done; /* a job was loaded */
+
+	/* the jobs which weren't asked for yet, in the order they will be */
+	dirscan_job *head;
+
+	/* how many of them are running or done */
+	unsigned int ahead;
+
+	/* the caller is waiting for the job it asked for */
+	int waiting;
+	int shutdown;
+};
+
+static void free_entries(git_vector *entries)
+{
+	unsigned int i;
+	git_path_with_stat *ps;
+
+	git_vector_foreach(entries, i, ps)
+		git__free(ps);
+	git_vector_free(entries);
+}
+
+static int load_entries(size_t prefix_len, const char *path, git_vector *contents)
+{
+	int error = git_path_dirload_with_stat(path, prefix_len, contents);
+
+	if (error == GIT_SUCCESS)
+		git_vector_sort(contents);
+
+	return error;
+}
+
+static void job_free(dirscan_job *job)
+{
+	free_entries(&job->entries);
+	git__free(job);
+}
+
+static void job_unlink(git_dirscan *scan, dirscan_job *job)
+{
+	if (job->prev != NULL)
+		job->prev->next = job->next;
+	else
+		scan->head = job->next;
+
+	if (job->next != NULL)
+		job->next->prev = job->prev;
+
+	job->prev = job->next = NULL;
+
+	if (job->state != DIRSCAN_QUEUED)
+		scan->ahead--;
+}
+
+/* A running job is freed by its thread once it's done */
+static void job_drop(git_dirscan *scan, dirscan_job *job)
+{
+	job_unlink(scan, job);
+
+	if (job->state == DIRSCAN_RUNNING)
+		job->cancelled = 1;
+	else
+		job_free(job);
+}
+
+#ifdef GIT_THREADS
+
+static double dirscan_usec(void)
+{
+#ifdef GIT_WIN32
+	LARGE_INTEGER freq, now;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (double)now.QuadPart * 1e6 / (double)freq.QuadPart;
+#else
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (double)now.tv_sec * 1e6 + (double)now.tv_usec;
+#endif
+}
+
+static void *dirscan_worker(void *data)
+{
+	git_dirscan *scan = data;
+	dirscan_job *job;
+
+	git_mutex_lock(&scan->lock);
+
+	while (!scan->shutdown) {
+		job = NULL;
+
+		if (scan->ahead < DIRSCAN_MAX_AHEAD) {
+			for (job = scan->head; job != NULL; job = job->next)
+				if (job->state == DIRSCAN_QUEUED)
+					break;
+		}
+
+		if (job == NULL) {
+			git_cond_wait(&scan->work, &scan->lock);
+			continue;
+		}
+
+		job->state = DIRSCAN_RUNNING;
+		scan->ahead++;
+		git_mutex_unlock(&scan->lock);
+
+		job->error = load_entries(scan->prefix_len, job->path, &job->entries);
+
+		git_mutex_lock(&scan->lock);
+
+		if (job->cancelled)
+			job_free(job);
+		else {
+			job->state = DIRSCAN_DONE;
+			if (scan->waiting)
+				git_cond_signal(&scan->done);
+		}
+	}
+
+	git_mutex_unlock(&scan->lock);
+	return NULL;
+}
+
+/* Start up to one thread for each of the `queued` directories */
+static void dirscan_start(git_dirscan *scan, size_t queued)
+{
+	if (scan->workers == NULL &&
+		(scan->workers = git__malloc(scan->threads * sizeof(git_thread))) == NULL) {
+		scan->threads = scan->started;
+		return;
+	}
+
+	while (scan->started < scan->threads && scan->started < queued) {
+		if (git_thread_create(&scan->workers[scan->started], NULL, dirscan_worker, scan) != 0) {
+			/* whatever the threads don't load, the caller will */
+			scan->threads = scan->started;
+			break;
+		}
+
+		scan->started++;
+	}
+}
+
+#endif
+
+int git_dirscan_new(git_dirscan **out, size_t prefix_len, unsigned int threads)
+{
+	git_dirscan *scan;
+
+	assert(out);
+
+	scan = git__calloc(1, sizeof(git_dirscan));
+	if (scan == NULL)
+		return GIT_ENOMEM;
+
+#ifdef GIT_THREADS
+	if (threads == 0) {
+		threads = (unsigned int)git_online_cpus();
+		if (threads < DIRSCAN_MIN_THREADS)
+			threads = DIRSCAN_MIN_THREADS;
+	} else
+		scan->mode = DIRSCAN_THREADED;
+
+	if (threads > DIRSCAN_MAX_THREADS)
+		threads = DIRSCAN_MAX_THREADS;
+#else
+	threads = 0;
+	scan->mode = DIRSCAN_UNTHREADED;
+#endif
+
+	scan->prefix_len = prefix_len;
+	scan->threads = threads;
+
+	git_mutex_init(&scan->lock);
+	git_cond_init(&scan->work, NULL);
+	git_cond_init(&scan->done, NULL);
+
+	*out = scan;
+	return GIT_SUCCESS;
+}
+
+int git_dirscan_queue(git_dirscan *scan, const char **paths, size_t count)
+{
+	dirscan_job *first = NULL, *last = NULL, *job;
+	size_t i;
+
+	assert(scan && (paths || !count));
+
+	if (scan->mode != DIRSCAN_THREADED || scan->threads == 0 || count == 0)
+		return GIT_SUCCESS;
+
+	for (i = 0; i < count; ++i) {
+		size_t path_len = strlen(paths[i]);
+
+		job = git__calloc(1, sizeof(dirscan_job) + path_len + 1);
+		if (job == NULL ||
+			git_vector_init(&job->entries, 0, git_path_with_stat_cmp) < GIT_SUCCESS) {
+			git__free(job);
+			break;
+		}
+
+		memcpy(job->path, paths[i], path_len);
+
+		if (last != NULL) {
+			last->next = job;
+			job->prev = last;
+		} else
+			first = job;
+		last = job;
+	}
+
+	/* the ones we couldn't queue will just be loaded when asked for */
+	if (first == NULL)
+		return GIT_SUCCESS;
+
+	git_mutex_lock(&scan->lock);
+
+#ifdef GIT_THREADS
+	dirscan_start(scan, count);
+#endif
+
+	last->next = scan->head;
+	if (scan->head != NULL)
+		scan->head->prev = last;
+	scan->head = first;
+
+	git_cond_broadcast(&scan->work);
+	git_mutex_unlock(&scan->lock);
+
+	return GIT_SUCCESS;
+}
+
+/* Load `path` on the calling thread, and see how long that takes */
+static int sample_entries(git_dirscan *scan, const char *path, git_vector *contents)
+{
+#ifdef GIT_THREADS
+	double start = dirscan_usec();
+	int error = load_entries(scan->prefix_len, path, contents);
+
+	/* opening the directory counts as one more */
+	scan->sample_usec += dirscan_usec() - start;
+	scan->sampled += contents->length + 1;
+
+	if (scan->sampled >= DIRSCAN_SAMPLE_ENTRIES)
+		scan->mode = (scan->sample_usec >= (double)scan->sampled * DIRSCAN_SLOW_USEC) ?
+			DIRSCAN_THREADED : DIRSCAN_UNTHREADED;
+
+	return error;
+#else
+	return load_entries(scan->prefix_len, path, contents);
+#endif
+}
+
+unsigned int git_dirscan_threads(git_dirscan *scan)
+{
+	unsigned int started;
+
+	assert(scan);
+
+	git_mutex_lock(&scan->lock);
+	started = scan->started;
+	git_mutex_unlock(&scan->lock);
+
+	return started;
+}
+
+int git_dirscan_load(git_dirscan *scan, const char *path, git_vector *contents)
+{
+	dirscan_job *job;
+	int error;
+
+	assert(scan && path && contents);
+
+	git_mutex_lock(&scan->lock);
+
+	for (job = scan->head; job != NULL; job = job->next)
+		if (strcmp(job->path, path) == 0)
+			break;
+
+	if (job != NULL) {
+		int throttled = (scan->ahead >= DIRSCAN_MAX_AHEAD);
+
+		/* the caller went past these without asking for them */
+		while (scan->head != job)
+			job_drop(scan, scan->head);
+
+		job_unlink(scan, job);
+
+		scan->waiting = 1;
+		while (job->state == DIRSCAN_RUNNING)
+			git_cond_wait(&scan->done, &scan->lock);
+		scan->waiting = 0;
+
+		/* there's room for more work */
+		if (throttled)
+			git_cond_broadcast(&scan->work);
+	}
+
+	git_mutex_unlock(&scan->lock);
+
+	/*
+	 * No thread got to it, or it failed; load it from here, which
+	 * also gets the error message in the right place
+	 */
+	if (scan->mode == DIRSCAN_UNDECIDED)
+		error = sample_entries(scan, path, contents);
+	else if (job == NULL || job->state == DIRSCAN_QUEUED || job->error < GIT_SUCCESS)
+		error = load_entries(scan->prefix_len, path, contents);
+	else {
+		git_vector_swap(contents, &job->entries);
+		error = GIT_SUCCESS;
+	}
+
+	if (job != NULL)
+		job_free(job);
+
+	return error;
+}
+
+void git_dirscan_clear(git_dirscan *scan)
+{
+	if (scan == NULL)
+		return;
+
+	git_mutex_lock(&scan->lock);
+
+	while (scan->head != NULL)
+		job_drop(scan, scan->head);
+
+	git_cond_broadcast(&scan->work);
+	git_mutex_unlock(&scan->lock);
+}
+
+void git_dirscan_free(git_dirscan *scan)
+{
+	unsigned int i;
+
+	if (scan == NULL)
+		return;
+
+	git_mutex_lock(&scan->lock);
+	scan->shutdown = 1;
+	git_cond_broadcast(&scan->work);
+	git_mutex_unlock(&scan->lock);
+
+	for (i = 0; i < scan->started; ++i)
+		git_thread_join(scan->workers[i], NULL);
+
+	/* nothing is running anymore */
+	while (scan->head != NULL)
+		job_drop(scan, scan->head);
+
+	git_cond_free(&scan->work);
+	git_cond_free(&scan->done);
+	git_mutex_free(&scan->lock);
+
+	git__free(scan->workers);
+	git__free(scan);
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#ifndef INCLUDE_dirscan_h__
+#define INCLUDE_dirscan_h__
+
+#include "common.h"
+#include "vector.h"
+
+/*
+ * A directory scanner reads directories (and lstats their entries,
+ * like `git_path_dirload_with_stat`) on a few threads, ahead of a
+ * caller that walks a tree depth-first and in order.
+ *
+ * The caller queues the subdirectories of each directory it loads,
+ * in the order it will get to them, and then asks for them one at a
+ * time. Queued directories it walks past without asking for are
+ * dropped. Without thread support, directories are just loaded when
+ * they are asked for.
+ *
+ * Threads only pay off when the filesystem is slow to answer, so
+ * unless told how many to use, the scanner first times a few hundred
+ * entries loaded by the caller and only starts them when those were
+ * slow. It never starts more threads than there are directories
+ * queued at once.
+ */
+typedef struct git_dirscan git_dirscan;
+
+/*
+ * Paths are full paths; entries are loaded relative to `prefix_len`.
+ * A `threads` of 0 picks a default, and only uses them when the
+ * filesystem turns out to be slow.
+ */
+int git_dirscan_new(git_dirscan **out, size_t prefix_len, unsigned int threads);
+
+/* Queue `paths`, to be asked for in this order, before everything else */
+int git_dirscan_queue(git_dirscan *scan, const char **paths, size_t count);
+
+/* Load the sorted `git_path_with_stat` entries of `path` into `contents` */
+int git_dirscan_load(git_dirscan *scan, const char *path, git_vector *contents);
+
+/* How many threads were started so far */
+unsigned int git_dirscan_threads(git_dirscan *scan);
+
+/* Drop everything that was queued */
+void git_dirscan_clear(git_dirscan *scan);
+
+void git_dirscan_free(git_dirscan *scan);
+
+#endif
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+#include "ewah.h"
+
+/*
+ * On disk, a bitmap is its size in bits and in 64-bit words, the
+ * words and the position of the last marker word, all in network
+ * byte order. The words are groups of a marker followed by literal
+ * words; the marker says how many words of all zeroes or all ones
+ * come first (bit 0 is the value, bits 1-32 the count) and how many
+ * literal words follow it (bits 33-63).
+ */
+#define RLW_RUNNING_BITS 32
+#define RLW_LITERAL_BITS 31
+#define RLW_LARGEST_RUNNING_COUNT ((((uint64_t)1) << RLW_RUNNING_BITS) - 1)
+#define RLW_LARGEST_LITERAL_COUNT ((((uint64_t)1) << RLW_LITERAL_BITS) - 1)
+
+#define rlw_running_bit(w) ((w) & 1)
+#define rlw_running_len(w) (((w) >> 1) & RLW_LARGEST_RUNNING_COUNT)
+#define rlw_literal_words(w) ((w) >> (1 + RLW_RUNNING_BITS))
+
+static uint32_t get_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint64_t get_be64(const unsigned char *p)
+{
+	return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+static int put_be32(git_buf *out, uint32_t v)
+{
+	unsigned char p[4];
+
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+
+	return git_buf_put(out, (const char *)p, sizeof(p));
+}
+
+static int put_be64(git_buf *out, uint64_t v)
+{
+	int error = put_be32(out, (uint32_t)(v >> 32));
+	return error < GIT_SUCCESS ? error : put_be32(out, (uint32_t)v);
+}
+
+int git_ewah_read(git_ewah *bitmap, size_t *read,
+	const unsigned char *buffer, size_t buffer_size, size_t max_bits)
+{
+	const unsigned char *words;
+	size_t bit_size, word_count, disk_words, pos, out = 0;
+
+	memset(bitmap, 0x0, sizeof(git_ewah));
+
+	if (buffer_size < 8)
+		return git__throw(GIT_EOBJCORRUPTED, "Corrupt bitmap. It is truncated");
+
+	bit_size = get_be32(buffer);
+	disk_words = get_be32(buffer + 4);
+
+	if (bit_size > max_bits)
+		return git__throw(GIT_EOBJCORRUPTED, "Corrupt bitmap. It is too large");
+
+	if (disk_words > (buffer_size - 12) / 8 || buffer_size < 12)
+		return git__throw(GIT_EOBJCORRUPTED, "Corrupt bitmap. It is truncated");
+
+	word_count = (bit_size + 63) / 64;
+	if (word_count > 0) {
+		bitmap->words = git__calloc(word_count, sizeof(uint64_t));
+		if (bitmap->words == NULL)
+			return GIT_ENOMEM;
+	}
+
+	words = buffer + 8;
+
+	for (pos = 0; pos < disk_words; ) {
+		uint64_t rlw = get_be64(words + pos++ * 8);
+		uint64_t run = rlw_running_len(rlw), literals = rlw_literal_words(rlw);
+
+		if (run > word_count - out || literals > disk_words - pos ||
+			literals > word_count - out - run) {
+			git_ewah_free(bitmap);
+			return git__throw(GIT_EOBJCORRUPTED, "Corrupt bitmap. It holds too many bits");
+		}
+
+		/* the words were zeroed to begin with */
+		if (rlw_running_bit(rlw))
+			memset(bitmap->words + out, 0xff, (size_t)run * sizeof(uint64_t));
+		out += (size_t)run;
+
+		while (literals--)
+			bitmap->words[out++] = get_be64(words + pos++ * 8);
+	}
+
+	/* nothing past the size, even in a run of ones */
+	if (bit_size % 64)
+		bitmap->words[word_count - 1] &= (((uint64_t)1) << (bit_size % 64)) - 1;
+
+	bitmap->word_count = word_count;
+	bitmap->bit_size = bit_size;
+
+	/* and the position of the last marker, which we don't need */
+	*read = 8 + disk_words * 8 + 4;
+	return GIT_SUCCESS;
+}
+
+int git_ewah_write(git_buf *out, const git_ewah *bitmap)
+{
+	size_t word_count = (bitmap->bit_size + 63) / 64;
+	size_t start = out->size, rlw_pos = 0, disk_words = 0, i = 0;
+
+	if (put_be32(out, (uint32_t)bitmap->bit_size) < GIT_SUCCESS ||
+		put_be32(out, 0) < GIT_SUCCESS)
+		return GIT_ENOMEM;
+
+	/*
+	 * Runs of empty words go in the markers, everything else is
+	 * stored literally. There is always at least one marker.
+	 */
+	do {
+		uint64_t run = 0, literals = 0;
+		size_t j;
+
+		while (i < word_count && bitmap->words[i] == 0 &&
+			run < RLW_LARGEST_RUNNING_COUNT) {
+			run++;
+			i++;
+		}
+
+		for (j = i; j < word_count && bitmap->words[j] != 0 &&
+			literals < RLW_LARGEST_LITERAL_COUNT; ++j)
+			literals++;
+
+		rlw_pos = disk_words;
+
+		if (put_be64(out, (run << 1) | (literals << (1 + RLW_RUNNING_BITS))) < GIT_SUCCESS)
+			return GIT_ENOMEM;
+		disk_words++;
+
+		for (; i < j; ++i, ++disk_words)
+			if (put_be64(out, bitmap->words[i]) < GIT_SUCCESS)
+				return GIT_ENOMEM;
+	} while (i < word_count);
+
+	if (put_be32(out, (uint32_t)rlw_pos) < GIT_SUCCESS)
+		return GIT_ENOMEM;
+
+	/* now that we know how many words there are */
+	out->ptr[start + 4] = (char)(disk_words >> 24);
+	out->ptr[start + 5] = (char)(disk_words >> 16);
+	out->ptr[start + 6] = (char)(disk_words >> 8);
+	out->ptr[start + 7] = (char)disk_words;
+
+	return GIT_SUCCESS;
+}
+
+int git_ewah_set(git_ewah *bitmap, size_t pos)
+{
+	size_t word = pos / 64;
+
+	if (word >= bitmap->word_count) {
+		size_t new_count = bitmap->word_count * 2 > word ? bitmap->word_count * 2 : word + 1;
+		uint64_t *words = git__realloc(bitmap->words, new_count * sizeof(uint64_t));
+
+		if (words == NULL)
+			return GIT_ENOMEM;
+
+		memset(words + bitmap->word_count, 0x0,
+			(new_count - bitmap->word_count) * sizeof(uint64_t));
+
+		bitmap->words = words;
+		bitmap->word_count = new_count;
+	}
+
+	bitmap->words[word] |= ((uint64_t)1) << (pos % 64);
+
+	if (pos >= bitmap->bit_size)
+		bitmap->bit_size = pos + 1;
+
+	return GIT_SUCCESS;
+}
+
+void git_ewah_free(git_ewah *bitmap)
+{
+	git__free(bitmap->words);
+	bitmap->words = NULL;
+	bitmap->word_count = 0;
+	bitmap->bit_size = 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_ewah_h__
+#define INCLUDE_ewah_h__
+
+#include "common.h"
+#include "buffer.h"
+
+/*
+ * The EWAH-compressed bitmaps git stores in the index extensions.
+ *
+ * Ours are always kept uncompressed in memory; they are only
+ * run-length encoded on their way to and from the disk. Bit `n`
+ * lives in word `n / 64`, at `1 << (n % 64)`.
+ */
+typedef struct {
+	uint64_t *words;
+	size_t word_count;
+
+	/* one past the last bit which may be set */
+	size_t bit_size;
+} git_ewah;
+
+#define GIT_EWAH_INIT {NULL, 0, 0}
+
+/*
+ * Read a serialized bitmap from `buffer`, rejecting those with more
+ * than `max_bits` bits. `*read` is set to the size of the bitmap on
+ * disk.
+ */
+int git_ewah_read(git_ewah *bitmap, size_t *read,
+	const unsigned char *buffer, size_t buffer_size, size_t max_bits);
+
+/* Append the serialized bitmap to `out` */
+int git_ewah_write(git_buf *out, const git_ewah *bitmap);
+
+int git_ewah_set(git_ewah *bitmap, size_t pos);
+
+GIT_INLINE(int) git_ewah_get(const git_ewah *bitmap, size_t pos)
+{
+	if (pos >= bitmap->bit_size)
+		return 0;
+
+	return (bitmap->words[pos / 64] >> (pos % 64)) & 1;
+}
+
+void git_ewah_free(git_ewah *bitmap);
+
+#endif
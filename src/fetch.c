@@ -43,15 +43,50 @@ static int filter_ref__cb(git_remote_head *head, void *payload)
 			return git__rethrow(error, "Error matching remote ref name");
 	}
 
-	/* If we have the object, mark it so we don't ask for it */
-	if (git_odb_exists(p->odb, &head->oid))
-		head->local = 1;
-	else
-		p->remote->need_pack = 1;
-
 	return git_vector_insert(&p->remote->refs, head);
 }
 
+/* Mark the objects we have, so we don't ask for them */
+static int mark_local(git_remote *remote, git_odb *odb)
+{
+	git_oid *ids;
+	int *found;
+	unsigned int i, count = remote->refs.length;
+	int error;
+
+	if (count == 0)
+		return GIT_SUCCESS;
+
+	ids = git__malloc(count * sizeof(git_oid));
+	found = git__malloc(count * sizeof(int));
+	if (ids == NULL || found == NULL) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
+
+	for (i = 0; i < count; ++i) {
+		git_remote_head *head = git_vector_get(&remote->refs, i);
+		git_oid_cpy(&ids[i], &head->oid);
+	}
+
+	if ((error = git_odb_exists_many(found, odb, ids, count)) < GIT_SUCCESS)
+		goto cleanup;
+
+	for (i = 0; i < count; ++i) {
+		git_remote_head *head = git_vector_get(&remote->refs, i);
+
+		if (found[i])
+			head->local = 1;
+		else
+			remote->need_pack = 1;
+	}
+
+cleanup:
+	git__free(ids);
+	git__free(found);
+	return error;
+}
+
 static int filter_wants(git_remote *remote)
 {
 	int error;
@@ -73,7 +108,11 @@ static int filter_wants(git_remote *remote)
 	if (error < GIT_SUCCESS)
 		return error;
 
-	return remote->transport->ls(remote->transport, &filter_ref__cb, &p);
+	error = remote->transport->ls(remote->transport, &filter_ref__cb, &p);
+	if (error < GIT_SUCCESS)
+		return error;
+
+	return mark_local(remote, p.odb);
 }
 
 /*
@@ -104,29 +143,61 @@ int git_fetch_negotiate(git_remote *remote)
 	return t->negotiate_fetch(t, remote->repo, &remote->refs);
 }
 
-int git_fetch_download_pack(char **out, git_remote *remote)
+int git_fetch_download_pack(git_remote *remote, git_indexer_stats *stats)
 {
-	if(!remote->need_pack) {
-		*out = NULL;
+	git_odb *odb;
+	int error;
+
+	memset(stats, 0x0, sizeof(git_indexer_stats));
+
+	if(!remote->need_pack)
 		return GIT_SUCCESS;
-	}
 
-	return remote->transport->download_pack(out, remote->transport, remote->repo);
+	error = remote->transport->download_pack(remote->transport, remote->repo, stats);
+	if (error < GIT_SUCCESS)
+		return error;
+
+	/* the objects we've just missed are in the new pack */
+	if ((error = git_repository_odb__weakptr(&odb, remote->repo)) < GIT_SUCCESS)
+		return error;
+
+	return git_odb_refresh(odb);
+}
+
+int git_fetch__indexer_new(git_indexer_stream **out, git_repository *repo)
+{
+	git_buf path = GIT_BUF_INIT;
+	git_odb *odb;
+	int error;
+
+	if ((error = git_repository_odb__weakptr(&odb, repo)) < GIT_SUCCESS)
+		return error;
+
+	if ((error = git_buf_joinpath(&path, repo->path_repository, "objects/pack")) < GIT_SUCCESS)
+		return error;
+
+	error = git_indexer_stream_new(out, path.ptr);
+	git_buf_free(&path);
+
+	if (error < GIT_SUCCESS)
+		return error;
+
+	/* we asked for a thin pack; the missing bases come from here */
+	git_indexer_stream_set_odb(*out, odb);
+	return GIT_SUCCESS;
 }
 
-/* Receiving data from a socket and storing it is pretty much the same for git and HTTP */
+/* Receiving data from a socket and indexing it is pretty much the same for git and HTTP */
 int git_fetch__download_pack(
-	char **out,
 	const char *buffered,
 	size_t buffered_size,
 	GIT_SOCKET fd,
-	git_repository *repo)
+	git_repository *repo,
+	git_indexer_stats *stats)
 {
-	git_filebuf file = GIT_FILEBUF_INIT;
+	git_indexer_stream *idx = NULL;
 	int error;
 	char buff[1024];
-	git_buf path = GIT_BUF_INIT;
-	static const char suff[] = "/objects/pack/pack-received";
 	gitno_buffer buf;
 
 	gitno_buffer_setup(&buf, buff, sizeof(buff), fd);
@@ -135,21 +206,17 @@ int git_fetch__download_pack(
 		return git__throw(GIT_ERROR, "The pack doesn't start with the signature");
 	}
 
-	error = git_buf_joinpath(&path, repo->path_repository, suff);
-	if (error < GIT_SUCCESS)
-		goto cleanup;
-
-	error = git_filebuf_open(&file, path.ptr, GIT_FILEBUF_TEMPORARY);
+	error = git_fetch__indexer_new(&idx, repo);
 	if (error < GIT_SUCCESS)
 		goto cleanup;
 
 	/* Part of the packfile has been received, don't loose it */
-	error = git_filebuf_write(&file, buffered, buffered_size);
+	error = git_indexer_stream_add(idx, buffered, buffered_size, stats);
 	if (error < GIT_SUCCESS)
 		goto cleanup;
 
 	while (1) {
-		error = git_filebuf_write(&file, buf.data, buf.offset);
+		error = git_indexer_stream_add(idx, buf.data, buf.offset, stats);
 		if (error < GIT_SUCCESS)
 			goto cleanup;
 
@@ -161,18 +228,10 @@ int git_fetch__download_pack(
 			break;
 	}
 
-	*out = git__strdup(file.path_lock);
-	if (*out == NULL) {
-		error = GIT_ENOMEM;
-		goto cleanup;
-	}
+	error = git_indexer_stream_finalize(idx, stats);
 
-	/* A bit dodgy, but we need to keep the pack at the temporary path */
-	error = git_filebuf_commit_at(&file, file.path_lock, GIT_PACK_FILE_MODE);
 cleanup:
-	if (error < GIT_SUCCESS)
-		git_filebuf_cleanup(&file);
-    git_buf_free(&path);
+	git_indexer_stream_free(idx);
 
 	return error;
 }
@@ -7,12 +7,16 @@
 #ifndef INCLUDE_fetch_h__
 #define INCLUDE_fetch_h__
 
+#include "git2/indexer.h"
 #include "netops.h"
 
 int git_fetch_negotiate(git_remote *remote);
-int git_fetch_download_pack(char **out, git_remote *remote);
+int git_fetch_download_pack(git_remote *remote, git_indexer_stats *stats);
 
-int git_fetch__download_pack(char **out, const char *buffered, size_t buffered_size,
-                             GIT_SOCKET fd, git_repository *repo);
+int git_fetch__download_pack(const char *buffered, size_t buffered_size,
+                             GIT_SOCKET fd, git_repository *repo, git_indexer_stats *stats);
+
+/* An indexer which stores the pack received from a remote in the repository */
+int git_fetch__indexer_new(git_indexer_stream **out, git_repository *repo);
 
 #endif
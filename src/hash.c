@@ -72,3 +72,20 @@ void git_hash_vec(git_oid *out, git_buf_vec *vec, size_t n)
 		SHA1_Update(&c, vec[i].data, vec[i].len);
 	SHA1_Final(out->id, &c);
 }
+
+void git_hash_many(git_oid *out, const git_buf_vec *vec, size_t per, size_t n)
+{
+#if defined(PPC_SHA1)
+	SHA_CTX c;
+	size_t i, j;
+
+	for (i = 0; i < n; i++, vec += per) {
+		SHA1_Init(&c);
+		for (j = 0; j < per; j++)
+			SHA1_Update(&c, vec[j].data, vec[j].len);
+		SHA1_Final(out[i].id, &c);
+	}
+#else
+	git__blk_SHA1_Many(out, vec, per, n);
+#endif
+}
@@ -26,4 +26,11 @@ void git_hash_final(git_oid *out, git_hash_ctx *c);
 void git_hash_buf(git_oid *out, const void *data, size_t len);
 void git_hash_vec(git_oid *out, git_buf_vec *vec, size_t n);
 
+/*
+ * Hash `n` independent messages, message `i` being made of the `per`
+ * buffers starting at `vec[i * per]`, into `out[i]`. Small messages
+ * are hashed several at a time where the CPU allows it.
+ */
+void git_hash_many(git_oid *out, const git_buf_vec *vec, size_t per, size_t n);
+
 #endif /* INCLUDE_hash_h__ */
@@ -170,20 +170,28 @@ int git_hashtable_insert2(git_hashtable *self, const void *key, void *value, voi
 
 	*old_value = NULL;
 
+	/*
+	 * an equal key may sit behind an empty slot if something
+	 * was removed before it; replace that one first
+	 */
 	for (hash_id = 0; hash_id < GIT_HASHTABLE_HASHES; ++hash_id) {
 		node = node_with_hash(self, key, hash_id);
 
-		if (!node->key) {
+		if (node->key && (key == node->key || self->key_equal(key, node->key) == 0)) {
+			*old_value = node->value;
 			node->key = key;
 			node->value = value;
-			self->key_count++;
 			return GIT_SUCCESS;
 		}
+	}
 
-		if (key == node->key || self->key_equal(key, node->key) == 0) {
-			*old_value = node->value;
+	for (hash_id = 0; hash_id < GIT_HASHTABLE_HASHES; ++hash_id) {
+		node = node_with_hash(self, key, hash_id);
+
+		if (!node->key) {
 			node->key = key;
 			node->value = value;
+			self->key_count++;
 			return GIT_SUCCESS;
 		}
 	}
@@ -11,10 +11,13 @@
 #include "repository.h"
 #include "index.h"
 #include "tree.h"
+#include "blob.h"
 #include "tree-cache.h"
+#include "ewah.h"
 #include "hash.h"
 #include "git2/odb.h"
 #include "git2/blob.h"
+#include "git2/config.h"
 
 #define entry_size(type,len) ((offsetof(type, path) + (len) + 8) & ~7)
 #define short_entry_size(len) entry_size(struct entry_short, len)
@@ -29,8 +32,26 @@ static const unsigned int INDEX_VERSION_NUMBER = 2;
 static const unsigned int INDEX_VERSION_NUMBER_EXT = 3;
 
 static const unsigned int INDEX_HEADER_SIG = 0x44495243;
+
+/* share the entries again when more than this many have changed */
+static const size_t SPLIT_INDEX_MAX_PERCENT_CHANGE = 20;
+
+/* splitIndex.sharedIndexExpire, unless set: "2.weeks.ago" */
+static const time_t SHARED_INDEX_EXPIRE_DEFAULT = 2 * 7 * 24 * 60 * 60;
 static const char INDEX_EXT_TREECACHE_SIG[] = {'T', 'R', 'E', 'E'};
 static const char INDEX_EXT_UNMERGED_SIG[] = {'R', 'E', 'U', 'C'};
+static const char INDEX_EXT_UNTRACKED_SIG[] = {'U', 'N', 'T', 'R'};
+static const char INDEX_EXT_LINK_SIG[] = {'l', 'i', 'n', 'k'};
+static const char INDEX_EXT_FSMONITOR_SIG[] = {'F', 'S', 'M', 'N'};
+
+/* the version of the `FSMN` extension with an opaque token */
+static const uint32_t INDEX_FSMONITOR_VERSION = 2;
+
+/* e69de29bb2d1d6434b8b29ae775ad8c2e48c5391, the empty blob */
+static const git_oid EMPTY_BLOB_OID = {{
+	0xe6, 0x9d, 0xe2, 0x9b, 0xb2, 0xd1, 0xd6, 0x43, 0x4b, 0x8b,
+	0x29, 0xae, 0x77, 0x5a, 0xd8, 0xc2, 0xe4, 0x8c, 0x53, 0x91
+}};
 
 #define INDEX_OWNER(idx) ((git_repository *)(GIT_REFCOUNT_OWNER(idx)))
 
@@ -79,16 +100,41 @@ struct entry_long {
 	char path[1]; /* arbitrary length */
 };
 
+/* What a split index file holds besides the shared index */
+struct split_write {
+	/* the replacements, then the new entries */
+	git_vector entries;
+	git_index_entry *replacements;
+	unsigned int replacement_count;
+
+	git_ewah deleted;
+	git_ewah replaced;
+	size_t changes;
+
+	git_buf link;
+};
+
 /* local declarations */
 static size_t read_extension(git_index *index, const char *buffer, size_t buffer_size);
 static size_t read_entry(git_index_entry *dest, const void *buffer, size_t buffer_size);
 static int read_header(struct index_header *dest, const void *buffer);
 
+static int read_entries(git_index_entry **entries_out, unsigned int *count_out,
+	const char **buffer_in, size_t *buffer_size_in);
 static int parse_index(git_index *index, const char *buffer, size_t buffer_size);
-static int is_index_extended(git_index *index);
-static int write_index(git_index *index, git_filebuf *file);
+static int is_index_extended(git_vector *entries);
+static int write_index(git_oid *checksum, git_filebuf *file,
+	git_vector *entries, git_index *index, const git_buf *link);
 
-static void index_entry_free(git_index_entry *entry);
+static void index_entry_free(git_index *index, git_index_entry *entry);
+static void split_free(git_index_split *split);
+static int split_index_wanted(int *split, git_index *index);
+static int prepare_split_write(struct split_write *sw, git_index *index);
+static void split_write_free(struct split_write *sw);
+
+/* Positions in `index->paths`, offset so that none of them is NULL */
+#define POSITION_VALUE(pos) ((void *)(size_t)((pos) + 1))
+#define VALUE_POSITION(value) ((int)((size_t)(value) - 1))
 
 static int index_srch(const void *key, const void *array_member)
 {
@@ -129,6 +175,107 @@ static unsigned int index_create_mode(unsigned int mode)
 	return S_IFREG | ((mode & 0100) ? 0755 : 0644);
 }
 
+static void index_paths_drop(git_index *index)
+{
+	if (index->paths != NULL)
+		git_hashtable_free(index->paths);
+
+	index->paths = NULL;
+}
+
+/* Map the paths of the entries to where they are now */
+static int index_paths_build(git_index *index)
+{
+	git_index_entry *entry;
+	unsigned int i;
+
+	if (index->paths == NULL) {
+		index->paths = git_hashtable_alloc(index->entries.length * 2,
+			git_hash__strhash_cb, git_hash__strcmp_cb);
+
+		if (index->paths == NULL)
+			return GIT_ENOMEM;
+	} else
+		git_hashtable_clear(index->paths);
+
+	git_vector_foreach(&index->entries, i, entry) {
+		if (git_hashtable_insert(index->paths, entry->path, POSITION_VALUE(i)) < GIT_SUCCESS) {
+			index_paths_drop(index);
+			return GIT_ENOMEM;
+		}
+	}
+
+	index->paths_stale = 0;
+	return GIT_SUCCESS;
+}
+
+/* `entry` is now at `position`; without a table, there's nothing to do */
+static void index_paths_set(git_index *index, git_index_entry *entry, unsigned int position)
+{
+	if (index->paths != NULL &&
+		git_hashtable_insert(index->paths, entry->path, POSITION_VALUE(position)) < GIT_SUCCESS)
+		index_paths_drop(index);
+}
+
+/* `entry` was removed from `position`, and the entries after it moved up */
+static void index_paths_removed(git_index *index, git_index_entry *entry, unsigned int position)
+{
+	git_index_entry *other = NULL;
+
+	if (index->paths == NULL)
+		return;
+
+	/* other stages of the path are right next to it */
+	if (position > 0)
+		other = git_vector_get(&index->entries, position - 1);
+	if ((other == NULL || strcmp(other->path, entry->path)) && position < index->entries.length)
+		other = git_vector_get(&index->entries, position);
+
+	if (other != NULL && !strcmp(other->path, entry->path))
+		index_paths_set(index, other, position);
+	else
+		git_hashtable_remove(index->paths, entry->path);
+
+	if (position < index->entries.length)
+		index->paths_stale = 1;
+}
+
+static void index_sort(git_index *index)
+{
+	if (index->entries.sorted)
+		return;
+
+	git_vector_sort(&index->entries);
+
+	/* everything has moved */
+	if (index->paths != NULL)
+		index_paths_build(index);
+}
+
+/*
+ * Where the entry for `path` is in the entries as they are now,
+ * sorted or not.
+ */
+static int index_position(git_index *index, const char *path)
+{
+	void *value;
+
+	if (index->paths == NULL && index_paths_build(index) < GIT_SUCCESS)
+		return git_vector_bsearch2(&index->entries, index_srch, path);
+
+	if ((value = git_hashtable_lookup(index->paths, path)) == NULL)
+		return GIT_ENOTFOUND;
+
+	if (!index->paths_stale)
+		return VALUE_POSITION(value);
+
+	/* the paths are right, but entries were removed since */
+	if (index->entries.sorted || index_paths_build(index) < GIT_SUCCESS)
+		return git_vector_bsearch2(&index->entries, index_srch, path);
+
+	return VALUE_POSITION(git_hashtable_lookup(index->paths, path));
+}
+
 int git_index_open(git_index **index_out, const char *index_path)
 {
 	git_index *index;
@@ -165,11 +312,12 @@ static void index_free(git_index *index)
 
 	git_index_clear(index);
 	git_vector_foreach(&index->entries, i, e) {
-		index_entry_free(e);
+		index_entry_free(index, e);
 	}
 	git_vector_free(&index->entries);
 	git_vector_foreach(&index->unmerged, i, e) {
-		index_entry_free(e);
+		git__free(e->path);
+		git__free(e);
 	}
 	git_vector_free(&index->unmerged);
 
@@ -191,12 +339,8 @@ void git_index_clear(git_index *index)
 
 	assert(index);
 
-	for (i = 0; i < index->entries.length; ++i) {
-		git_index_entry *e;
-		e = git_vector_get(&index->entries, i);
-		git__free(e->path);
-		git__free(e);
-	}
+	for (i = 0; i < index->entries.length; ++i)
+		index_entry_free(index, git_vector_get(&index->entries, i));
 
 	for (i = 0; i < index->unmerged.length; ++i) {
 		git_index_entry_unmerged *e;
@@ -208,15 +352,38 @@ void git_index_clear(git_index *index)
 	git_vector_clear(&index->entries);
 	git_vector_clear(&index->unmerged);
 	index->last_modified = 0;
+	index->dirty = 1;
+
+	index_paths_drop(index);
+
+	git__free(index->disk_entries);
+	git__free(index->disk_buffer);
+	git__free(index->shared_buffer);
+	index->disk_entries = NULL;
+	index->disk_entry_count = 0;
+	index->disk_buffer = NULL;
+	index->shared_buffer = NULL;
 
 	git_tree_cache_free(index->tree);
 	index->tree = NULL;
+
+	git_untracked_cache_free(index->untracked);
+	index->untracked = NULL;
+
+	split_free(index->split);
+	index->split = NULL;
+
+	git__free(index->fsmonitor_token);
+	index->fsmonitor_token = NULL;
+	git_ewah_free(&index->fsmonitor_dirty);
+	index->fsmonitor_pending = 0;
 }
 
 int git_index_read(git_index *index)
 {
 	int error = GIT_SUCCESS, updated;
 	git_buf buffer = GIT_BUF_INIT;
+	size_t size;
 	time_t mtime;
 
 	assert(index->index_file_path);
@@ -235,12 +402,17 @@ int git_index_read(git_index *index)
 
 	if (updated) {
 		git_index_clear(index);
-		error = parse_index(index, buffer.ptr, buffer.size);
 
-		if (error == GIT_SUCCESS)
-			index->last_modified = mtime;
+		/* the entries will point into the buffer, so the index keeps it */
+		size = buffer.size;
+		index->disk_buffer = git_buf_detach(&buffer);
+		error = parse_index(index, index->disk_buffer, size);
 
-		git_buf_free(&buffer);
+		if (error == GIT_SUCCESS) {
+			index->last_modified = mtime;
+			index->dirty = 0;
+			index->stat_refreshed = 0;
+		}
 	}
 
 	if (error < GIT_SUCCESS)
@@ -251,20 +423,41 @@ int git_index_read(git_index *index)
 int git_index_write(git_index *index)
 {
 	git_filebuf file = GIT_FILEBUF_INIT;
+	struct split_write sw;
 	struct stat indexst;
-	int error;
+	int error, split;
 
-	git_vector_sort(&index->entries);
+	index_sort(index);
 
-	if ((error = git_filebuf_open(&file, index->index_file_path, GIT_FILEBUF_HASH_CONTENTS)) < GIT_SUCCESS)
+	if ((error = split_index_wanted(&split, index)) < GIT_SUCCESS)
 		return git__rethrow(error, "Failed to write index");
 
-	if ((error = write_index(index, &file)) < GIT_SUCCESS) {
-		git_filebuf_cleanup(&file);
+	if (!split) {
+		split_free(index->split);
+		index->split = NULL;
+	} else if ((error = prepare_split_write(&sw, index)) < GIT_SUCCESS) {
+		split_write_free(&sw);
 		return git__rethrow(error, "Failed to write index");
 	}
 
-	if ((error = git_filebuf_commit(&file, GIT_INDEX_FILE_MODE)) < GIT_SUCCESS)
+	error = git_filebuf_open(&file, index->index_file_path, GIT_FILEBUF_HASH_CONTENTS);
+
+	if (error == GIT_SUCCESS) {
+		if (split)
+			error = write_index(NULL, &file, &sw.entries, index, &sw.link);
+		else
+			error = write_index(NULL, &file, &index->entries, index, NULL);
+
+		if (error < GIT_SUCCESS)
+			git_filebuf_cleanup(&file);
+		else
+			error = git_filebuf_commit(&file, GIT_INDEX_FILE_MODE);
+	}
+
+	if (split)
+		split_write_free(&sw);
+
+	if (error < GIT_SUCCESS)
 		return git__rethrow(error, "Failed to write index");
 
 	if (p_stat(index->index_file_path, &indexst) == 0) {
@@ -272,6 +465,9 @@ int git_index_write(git_index *index)
 		index->on_disk = 1;
 	}
 
+	index->dirty = 0;
+	index->stat_refreshed = 0;
+
 	return GIT_SUCCESS;
 }
 
@@ -289,251 +485,699 @@ unsigned int git_index_entrycount_unmerged(git_index *index)
 
 git_index_entry *git_index_get(git_index *index, unsigned int n)
 {
-	git_vector_sort(&index->entries);
+	index_sort(index);
 	return git_vector_get(&index->entries, n);
 }
 
-static int index_entry_init(git_index_entry **entry_out, git_index *index, const char *rel_path, int stage)
+void git_index__init_entry_from_stat(git_index_entry *entry, const struct stat *st)
 {
-	git_index_entry *entry = NULL;
-	struct stat st;
-	git_oid oid;
-	const char *workdir;
-	git_buf full_path = GIT_BUF_INIT;
-	int error;
+	entry->ctime.seconds = (git_time_t)st->st_ctime;
+	entry->mtime.seconds = (git_time_t)st->st_mtime;
+	/* entry.mtime.nanoseconds = st->st_mtimensec; */
+	/* entry.ctime.nanoseconds = st->st_ctimensec; */
+	entry->dev = st->st_dev;
+	entry->ino = st->st_ino;
+	entry->uid = st->st_uid;
+	entry->gid = st->st_gid;
+	entry->file_size = st->st_size;
+}
 
-	if (INDEX_OWNER(index) == NULL)
-		return git__throw(GIT_EBAREINDEX,
-			"Failed to initialize entry. Repository is bare");
+/*
+ * An entry is racily clean if its file was changed in the same second
+ * the index was written, or later: the file could have changed again
+ * right after that, within the same second, without the stat data
+ * showing it. Only the contents can tell.
+ */
+static int is_racy_entry(git_index *index, const git_index_entry *entry)
+{
+	return index->last_modified == 0 ||
+		entry->mtime.seconds >= (git_time_t)index->last_modified;
+}
 
-	if (stage < 0 || stage > 3)
-		return git__throw(GIT_ERROR,
-			"Failed to initialize entry. Invalid stage %i", stage);
+/*
+ * Like git, leave out the device number: it isn't stable across
+ * NFS mounts, and a file which moved devices has a new inode anyway
+ */
+int git_index__stat_matches(
+	git_index *index, const git_index_entry *entry, const git_index_entry *wd)
+{
+	if (entry->flags_extended & GIT_IDXENTRY_FSMONITOR_VALID)
+		return 1;
 
-	workdir = git_repository_workdir(INDEX_OWNER(index));
-	if (workdir == NULL)
-		return git__throw(GIT_EBAREINDEX,
-			"Failed to initialize entry. Cannot resolved workdir");
+	/*
+	 * Smudged when written racily clean (see write_disk_entry()):
+	 * a file emptied in the same second would match it otherwise
+	 */
+	if (entry->file_size == 0 && git_oid_cmp(&entry->oid, &EMPTY_BLOB_OID) != 0)
+		return 0;
 
-	error = git_buf_joinpath(&full_path, workdir, rel_path);
-	if (error < GIT_SUCCESS)
-		return error;
+	return entry->mode == wd->mode &&
+		entry->file_size == wd->file_size &&
+		entry->mtime.seconds == wd->mtime.seconds &&
+		entry->ctime.seconds == wd->ctime.seconds &&
+		entry->ino == wd->ino &&
+		entry->uid == wd->uid &&
+		entry->gid == wd->gid &&
+		!is_racy_entry(index, entry);
+}
 
-	if (p_lstat(full_path.ptr, &st) < 0) {
-		error = git__throw(GIT_ENOTFOUND, "Failed to initialize entry. '%s' cannot be opened. %s", full_path.ptr, strerror(errno));
-		git_buf_free(&full_path);
-		return error;
-	}
+void git_index__refresh_stat(
+	git_index *index, git_index_entry *entry, const git_index_entry *wd)
+{
+	entry->ctime = wd->ctime;
+	entry->mtime = wd->mtime;
+	entry->dev = wd->dev;
+	entry->ino = wd->ino;
+	entry->uid = wd->uid;
+	entry->gid = wd->gid;
+	entry->file_size = wd->file_size;
+
+	index->stat_refreshed = 1;
+}
 
-	git_buf_free(&full_path); /* done with full path */
+void git_index__write_refreshed(git_index *index)
+{
+	struct stat st;
 
-	/* There is no need to validate the rel_path here, since it will be
-	 * immediately validated by the call to git_blob_create_fromfile.
-	 */
+	if (index == NULL || !index->stat_refreshed || index->dirty || !index->on_disk)
+		return;
 
-	/* write the blob to disk and get the oid */
-	if ((error = git_blob_create_fromfile(&oid, INDEX_OWNER(index), rel_path)) < GIT_SUCCESS)
-		return git__rethrow(error, "Failed to initialize index entry");
+	/* somebody else wrote it since; ours would undo their changes */
+	if (p_stat(index->index_file_path, &st) < 0 ||
+		st.st_mtime != index->last_modified)
+		return;
 
-	entry = git__calloc(1, sizeof(git_index_entry));
-	if (!entry)
-		return GIT_ENOMEM;
+	/* the stat data is only a cache; if the index is locked, next time */
+	if (git_index_write(index) < GIT_SUCCESS)
+		git_clearerror();
+}
 
-	entry->ctime.seconds = (git_time_t)st.st_ctime;
-	entry->mtime.seconds = (git_time_t)st.st_mtime;
-	/* entry.mtime.nanoseconds = st.st_mtimensec; */
-	/* entry.ctime.nanoseconds = st.st_ctimensec; */
-	entry->dev= st.st_rdev;
-	entry->ino = st.st_ino;
-	entry->mode = index_create_mode(st.st_mode);
-	entry->uid = st.st_uid;
-	entry->gid = st.st_gid;
-	entry->file_size = st.st_size;
-	entry->oid = oid;
+static void fsmonitor_invalidate_all(git_index *index)
+{
+	unsigned int i;
+	git_index_entry *entry;
 
-	entry->flags |= (stage << GIT_IDXENTRY_STAGESHIFT);
-	entry->path = git__strdup(rel_path);
-	if (entry->path == NULL) {
-		git__free(entry);
-		return GIT_ENOMEM;
-	}
+	git_vector_foreach(&index->entries, i, entry)
+		entry->flags_extended &= ~GIT_IDXENTRY_FSMONITOR_VALID;
 
-	*entry_out = entry;
-	return GIT_SUCCESS;
+	/* the directories it knows are trusted while the monitor is */
+	git_untracked_cache_invalidate_all(index->untracked);
 }
 
-static git_index_entry *index_entry_dup(const git_index_entry *source_entry)
+/*
+ * Flag the entries which were known to be unchanged when the index
+ * was written, unless they were moved around since
+ */
+static void fsmonitor_apply_dirty(git_index *index)
 {
+	unsigned int i;
 	git_index_entry *entry;
 
-	entry = git__malloc(sizeof(git_index_entry));
-	if (!entry)
-		return NULL;
-
-	memcpy(entry, source_entry, sizeof(git_index_entry));
-
-	/* duplicate the path string so we own it */
-	entry->path = git__strdup(entry->path);
-	if (!entry->path)
-		return NULL;
+	if (index->fsmonitor_pending && !index->dirty) {
+		git_vector_foreach(&index->entries, i, entry) {
+			if (!git_ewah_get(&index->fsmonitor_dirty, i))
+				entry->flags_extended |= GIT_IDXENTRY_FSMONITOR_VALID;
+		}
+	}
 
-	return entry;
+	git_ewah_free(&index->fsmonitor_dirty);
+	index->fsmonitor_pending = 0;
 }
 
-static void index_entry_free(git_index_entry *entry)
+/* The position of the first entry whose path doesn't sort before `path` */
+static unsigned int index_lower_bound(git_index *index, const char *path, size_t path_len)
 {
-	if (!entry)
-		return;
-	git__free(entry->path);
-	git__free(entry);
-}
+	unsigned int lo = 0, hi = index->entries.length;
 
-static int index_insert(git_index *index, git_index_entry *entry, int replace)
-{
-	size_t path_length;
-	int position;
-	git_index_entry **entry_array;
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		const git_index_entry *entry = git_vector_get(&index->entries, mid);
 
-	assert(index && entry);
+		if (strncmp(entry->path, path, path_len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
 
-	if (entry->path == NULL)
-		return git__throw(GIT_EMISSINGOBJDATA, "Failed to insert into index. Entry has no path");
+	return lo;
+}
 
-	/* make sure that the path length flag is correct */
-	path_length = strlen(entry->path);
+struct fsmonitor_query {
+	git_index *index;
+	git_buf path;
+	int changed;
+	int everything;
+};
 
-	entry->flags &= ~GIT_IDXENTRY_NAMEMASK;
+static int fsmonitor_changed(const char *path, void *payload)
+{
+	struct fsmonitor_query *query = payload;
+	git_index *index = query->index;
+	size_t path_len = strlen(path);
+	unsigned int pos;
+	git_index_entry *entry;
+	git_untracked_dir *dir;
 
-	if (path_length < GIT_IDXENTRY_NAMEMASK)
-		entry->flags |= path_length & GIT_IDXENTRY_NAMEMASK;
-	else
-		entry->flags |= GIT_IDXENTRY_NAMEMASK;;
+	query->changed = 1;
 
-	/*
-	 * replacing is not requested: just insert entry at the end;
-	 * the index is no longer sorted
-	 */
-	if (!replace) {
-		if (git_vector_insert(&index->entries, entry) < GIT_SUCCESS)
-			return GIT_ENOMEM;
+	while (path_len > 0 && path[path_len - 1] == '/')
+		path_len--;
 
+	git_buf_clear(&query->path);
+	if (path_len == 0 || git_buf_put(&query->path, path, path_len) < GIT_SUCCESS) {
+		query->everything = 1;
 		return GIT_SUCCESS;
 	}
 
-	/* look if an entry with this path already exists */
-	position = git_index_find(index, entry->path);
+	/* the file, or everything in the directory */
+	for (pos = index_lower_bound(index, path, path_len);
+		pos < index->entries.length; ++pos) {
+		entry = git_vector_get(&index->entries, pos);
 
-	/*
-	 * if no entry exists add the entry at the end;
-	 * the index is no longer sorted
-	 */
-	if (position == GIT_ENOTFOUND) {
-		if (git_vector_insert(&index->entries, entry) < GIT_SUCCESS)
-			return GIT_ENOMEM;
+		if (strncmp(entry->path, path, path_len) != 0)
+			break;
 
-		return GIT_SUCCESS;
+		if (entry->path[path_len] == '\0' || entry->path[path_len] == '/')
+			entry->flags_extended &= ~GIT_IDXENTRY_FSMONITOR_VALID;
 	}
 
-	/* exists, replace it */
-	entry_array = (git_index_entry **) index->entries.contents;
-	git__free(entry_array[position]->path);
-	git__free(entry_array[position]);
-	entry_array[position] = entry;
+	/* the directory holding it, and everything in it if it's one */
+	git_untracked_cache_invalidate_path(index->untracked, query->path.ptr);
+
+	if (index->untracked != NULL &&
+		(dir = git_untracked_cache_find(index->untracked, query->path.ptr, 0)) != NULL)
+		git_untracked_dir_invalidate(dir);
 
 	return GIT_SUCCESS;
 }
 
-static int index_add(git_index *index, const char *path, int stage, int replace)
+int git_index__fsmonitor_refresh(git_index *index)
 {
-	git_index_entry *entry = NULL;
-	int ret;
-
-	ret = index_entry_init(&entry, index, path, stage);
-	if (ret)
-		goto err;
+	git_repository *repo = INDEX_OWNER(index);
+	git_fsmonitor *fsmonitor = repo ? repo->fsmonitor : NULL;
+	struct fsmonitor_query query;
+	char *token = NULL;
+	int error;
 
-	ret = index_insert(index, entry, replace);
-	if (ret)
-		goto err;
+	assert(index);
 
-	git_tree_cache_invalidate_path(index->tree, entry->path);
+	if (fsmonitor == NULL) {
+		git_index__fsmonitor_clear(index);
+		return 0;
+	}
 
-	return ret;
-err:
-	index_entry_free(entry);
-	return git__rethrow(ret, "Failed to append to index");
-}
+	index_sort(index);
+	fsmonitor_apply_dirty(index);
 
-int git_index_add(git_index *index, const char *path, int stage)
-{
-	return index_add(index, path, stage, 1);
-}
+	memset(&query, 0x0, sizeof(query));
+	query.index = index;
 
-int git_index_append(git_index *index, const char *path, int stage)
-{
-	return index_add(index, path, stage, 0);
-}
+	error = fsmonitor->query(fsmonitor, index->fsmonitor_token,
+		fsmonitor_changed, &query, &token);
 
-static int index_add2(git_index *index, const git_index_entry *source_entry,
-		int replace)
-{
-	git_index_entry *entry = NULL;
-	int ret;
+	git_buf_free(&query.path);
 
-	entry = index_entry_dup(source_entry);
-	if (entry == NULL) {
-		ret = GIT_ENOMEM;
-		goto err;
+	/* the monitor only saves work; without it, everything is looked at */
+	if (error < GIT_SUCCESS || token == NULL) {
+		git_clearerror();
+		git__free(token);
+		git_index__fsmonitor_clear(index);
+		return 0;
 	}
 
-	ret = index_insert(index, entry, replace);
-	if (ret)
-		goto err;
+	if (index->fsmonitor_token == NULL || query.everything)
+		fsmonitor_invalidate_all(index);
 
-	git_tree_cache_invalidate_path(index->tree, entry->path);
+	/* nothing changed since the old token, so it's as good as the new one */
+	if (index->fsmonitor_token != NULL && !query.changed) {
+		git__free(token);
+		return 1;
+	}
 
-	return ret;
-err:
-	index_entry_free(entry);
-	return git__rethrow(ret, "Failed to append to index");
-}
+	git__free(index->fsmonitor_token);
+	index->fsmonitor_token = token;
+	index->stat_refreshed = 1;
 
-int git_index_add2(git_index *index, const git_index_entry *source_entry)
-{
-	return index_add2(index, source_entry, 1);
+	return 1;
 }
 
-int git_index_append2(git_index *index, const git_index_entry *source_entry)
+void git_index__fsmonitor_mark_valid(git_index *index, git_index_entry *entry)
+{
+	/*
+	 * Any change from now on will be reported as one since the
+	 * token, however old it is
+	 */
+	if (index->fsmonitor_token == NULL ||
+		(entry->flags_extended & GIT_IDXENTRY_FSMONITOR_VALID) != 0)
+		return;
+
+	entry->flags_extended |= GIT_IDXENTRY_FSMONITOR_VALID;
+	index->stat_refreshed = 1;
+}
+
+void git_index__fsmonitor_clear(git_index *index)
+{
+	if (index == NULL || index->fsmonitor_token == NULL)
+		return;
+
+	fsmonitor_invalidate_all(index);
+
+	git__free(index->fsmonitor_token);
+	index->fsmonitor_token = NULL;
+	git_ewah_free(&index->fsmonitor_dirty);
+	index->fsmonitor_pending = 0;
+}
+
+/* The hashes of the exclude files which apply everywhere, as git records them */
+static void untracked_global_excludes(git_oid *info_exclude, git_oid *excludes_file, git_repository *repo)
+{
+	git_buf path = GIT_BUF_INIT;
+	git_config *cfg;
+	const char *excludes = NULL;
+
+	if (git_buf_joinpath(&path, repo->path_repository, "info/exclude") == GIT_SUCCESS)
+		git_untracked_cache_hash_exclude(info_exclude, path.ptr);
+	else
+		memset(info_exclude, 0x0, sizeof(git_oid));
+
+	if (git_repository_config__weakptr(&cfg, repo) < GIT_SUCCESS ||
+		git_config_get_string(cfg, "core.excludesfile", &excludes) < GIT_SUCCESS)
+		excludes = NULL;
+
+	git_clearerror();
+	git_untracked_cache_hash_exclude(excludes_file, excludes);
+	git_buf_free(&path);
+}
+
+int git_index__untracked_cache(git_untracked_cache **out, git_index *index, int update)
+{
+	git_repository *repo = INDEX_OWNER(index);
+	git_untracked_cache *cache;
+	git_oid info_exclude, excludes_file;
+	const char *workdir;
+	int setting = GIT_UNTRACKED_CACHE_KEEP, error;
+
+	*out = NULL;
+
+	if (repo == NULL || (workdir = git_repository_workdir(repo)) == NULL)
+		return GIT_SUCCESS;
+
+	if (update &&
+		(error = git_repository__cvar(&setting, repo, GIT_CVAR_UNTRACKED_CACHE)) < GIT_SUCCESS)
+		return error;
+
+	/* made somewhere else, or for another kind of walk */
+	if ((cache = index->untracked) != NULL &&
+		(cache->dir_flags != GIT_UNTRACKED_DIR_FLAGS ||
+		 cache->exclude_per_dir == NULL || strcmp(cache->exclude_per_dir, ".gitignore") != 0 ||
+		 !git_untracked_cache_is_for(cache, workdir))) {
+		if (setting == GIT_UNTRACKED_CACHE_KEEP)
+			return GIT_SUCCESS;
+		cache = NULL;
+	}
+
+	if (setting == GIT_UNTRACKED_CACHE_FALSE)
+		cache = NULL;
+
+	if (cache != index->untracked) {
+		git_untracked_cache_free(index->untracked);
+		index->untracked = NULL;
+		index->stat_refreshed = 1;
+	}
+
+	if (cache == NULL && setting != GIT_UNTRACKED_CACHE_TRUE)
+		return GIT_SUCCESS;
+
+	untracked_global_excludes(&info_exclude, &excludes_file, repo);
+
+	if (cache == NULL) {
+		if ((error = git_untracked_cache_new(&cache, workdir, &info_exclude, &excludes_file)) < GIT_SUCCESS)
+			return git__rethrow(error, "Failed to create the untracked cache");
+
+		index->untracked = cache;
+		index->stat_refreshed = 1;
+	}
+
+	/* nothing that was ignored before can be trusted to still be */
+	if (git_oid_cmp(&cache->info_exclude_oid, &info_exclude) != 0 ||
+		git_oid_cmp(&cache->excludes_file_oid, &excludes_file) != 0) {
+		if (!update)
+			return GIT_SUCCESS;
+
+		git_untracked_cache_invalidate_all(cache);
+		git_oid_cpy(&cache->info_exclude_oid, &info_exclude);
+		git_oid_cpy(&cache->excludes_file_oid, &excludes_file);
+		index->stat_refreshed = 1;
+	}
+
+	*out = cache;
+	return GIT_SUCCESS;
+}
+
+static int index_check_workdir(const char **workdir, git_index *index, int stage)
+{
+	if (INDEX_OWNER(index) == NULL)
+		return git__throw(GIT_EBAREINDEX,
+			"Failed to initialize entry. Repository is bare");
+
+	if (stage < 0 || stage > 3)
+		return git__throw(GIT_ERROR,
+			"Failed to initialize entry. Invalid stage %i", stage);
+
+	*workdir = git_repository_workdir(INDEX_OWNER(index));
+	if (*workdir == NULL)
+		return git__throw(GIT_EBAREINDEX,
+			"Failed to initialize entry. Cannot resolved workdir");
+
+	return GIT_SUCCESS;
+}
+
+static int index_entry_new(git_index_entry **entry_out,
+	const char *rel_path, const struct stat *st, const git_oid *oid, int stage)
+{
+	git_index_entry *entry;
+
+	entry = git__calloc(1, sizeof(git_index_entry));
+	if (!entry)
+		return GIT_ENOMEM;
+
+	git_index__init_entry_from_stat(entry, st);
+	entry->mode = index_create_mode(st->st_mode);
+	entry->oid = *oid;
+
+	entry->flags |= (stage << GIT_IDXENTRY_STAGESHIFT);
+	entry->path = git__strdup(rel_path);
+	if (entry->path == NULL) {
+		git__free(entry);
+		return GIT_ENOMEM;
+	}
+
+	*entry_out = entry;
+	return GIT_SUCCESS;
+}
+
+static int index_entry_init(git_index_entry **entry_out, git_index *index, const char *rel_path, int stage)
+{
+	struct stat st;
+	git_oid oid;
+	const char *workdir;
+	git_buf full_path = GIT_BUF_INIT;
+	int error;
+
+	if ((error = index_check_workdir(&workdir, index, stage)) < GIT_SUCCESS)
+		return error;
+
+	error = git_buf_joinpath(&full_path, workdir, rel_path);
+	if (error < GIT_SUCCESS)
+		return error;
+
+	if (p_lstat(full_path.ptr, &st) < 0) {
+		error = git__throw(GIT_ENOTFOUND, "Failed to initialize entry. '%s' cannot be opened. %s", full_path.ptr, strerror(errno));
+		git_buf_free(&full_path);
+		return error;
+	}
+
+	git_buf_free(&full_path); /* done with full path */
+
+	/* There is no need to validate the rel_path here, since it will be
+	 * immediately validated by the call to git_blob_create_fromfile.
+	 */
+
+	/* write the blob to disk and get the oid */
+	if ((error = git_blob_create_fromfile(&oid, INDEX_OWNER(index), rel_path)) < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to initialize index entry");
+
+	return index_entry_new(entry_out, rel_path, &st, &oid, stage);
+}
+
+static git_index_entry *index_entry_dup(const git_index_entry *source_entry)
+{
+	git_index_entry *entry;
+
+	entry = git__malloc(sizeof(git_index_entry));
+	if (!entry)
+		return NULL;
+
+	memcpy(entry, source_entry, sizeof(git_index_entry));
+
+	/* duplicate the path string so we own it */
+	entry->path = git__strdup(entry->path);
+	if (!entry->path)
+		return NULL;
+
+	return entry;
+}
+
+static void index_entry_free(git_index *index, git_index_entry *entry)
+{
+	if (!entry)
+		return;
+
+	/* read from disk: lives in the index's arrays */
+	if (entry >= index->disk_entries &&
+		entry < index->disk_entries + index->disk_entry_count)
+		return;
+
+	git__free(entry->path);
+	git__free(entry);
+}
+
+static int index_insert(git_index *index, git_index_entry *entry, int replace)
+{
+	size_t path_length;
+	int position;
+	git_index_entry **entry_array;
+
+	assert(index && entry);
+
+	if (entry->path == NULL)
+		return git__throw(GIT_EMISSINGOBJDATA, "Failed to insert into index. Entry has no path");
+
+	/* make sure that the path length flag is correct */
+	path_length = strlen(entry->path);
+
+	entry->flags &= ~GIT_IDXENTRY_NAMEMASK;
+
+	if (path_length < GIT_IDXENTRY_NAMEMASK)
+		entry->flags |= path_length & GIT_IDXENTRY_NAMEMASK;
+	else
+		entry->flags |= GIT_IDXENTRY_NAMEMASK;;
+
+	/* nobody looked at the file since */
+	entry->flags_extended &= ~GIT_IDXENTRY_FSMONITOR_VALID;
+
+	index->dirty = 1;
+
+	/*
+	 * replacing is not requested: just insert entry at the end;
+	 * the index is no longer sorted
+	 */
+	if (!replace) {
+		if (git_vector_insert(&index->entries, entry) < GIT_SUCCESS)
+			return GIT_ENOMEM;
+
+		index_paths_set(index, entry, index->entries.length - 1);
+		return GIT_SUCCESS;
+	}
+
+	/*
+	 * look if an entry with this path already exists; this
+	 * doesn't need the entries sorted
+	 */
+	position = index_position(index, entry->path);
+
+	/*
+	 * if no entry exists add the entry at the end;
+	 * the index is no longer sorted
+	 */
+	if (position == GIT_ENOTFOUND) {
+		if (git_vector_insert(&index->entries, entry) < GIT_SUCCESS)
+			return GIT_ENOMEM;
+
+		index_paths_set(index, entry, index->entries.length - 1);
+		return GIT_SUCCESS;
+	}
+
+	/* exists, replace it; the table holds the old path until then */
+	entry_array = (git_index_entry **) index->entries.contents;
+	index_paths_set(index, entry, position);
+	index_entry_free(index, entry_array[position]);
+	entry_array[position] = entry;
+
+	return GIT_SUCCESS;
+}
+
+static int index_add(git_index *index, const char *path, int stage, int replace)
+{
+	git_index_entry *entry = NULL;
+	int ret;
+
+	ret = index_entry_init(&entry, index, path, stage);
+	if (ret)
+		goto err;
+
+	ret = index_insert(index, entry, replace);
+	if (ret)
+		goto err;
+
+	git_tree_cache_invalidate_path(index->tree, entry->path);
+	git_untracked_cache_invalidate_path(index->untracked, entry->path);
+
+	return ret;
+err:
+	index_entry_free(index, entry);
+	return git__rethrow(ret, "Failed to append to index");
+}
+
+int git_index_add(git_index *index, const char *path, int stage)
+{
+	return index_add(index, path, stage, 1);
+}
+
+int git_index_append(git_index *index, const char *path, int stage)
+{
+	return index_add(index, path, stage, 0);
+}
+
+static int index_add2(git_index *index, const git_index_entry *source_entry,
+		int replace)
+{
+	git_index_entry *entry = NULL;
+	int ret;
+
+	entry = index_entry_dup(source_entry);
+	if (entry == NULL) {
+		ret = GIT_ENOMEM;
+		goto err;
+	}
+
+	ret = index_insert(index, entry, replace);
+	if (ret)
+		goto err;
+
+	git_tree_cache_invalidate_path(index->tree, entry->path);
+	git_untracked_cache_invalidate_path(index->untracked, entry->path);
+
+	return ret;
+err:
+	index_entry_free(index, entry);
+	return git__rethrow(ret, "Failed to append to index");
+}
+
+int git_index_add2(git_index *index, const git_index_entry *source_entry)
+{
+	return index_add2(index, source_entry, 1);
+}
+
+int git_index_append2(git_index *index, const git_index_entry *source_entry)
 {
 	return index_add2(index, source_entry, 1);
 }
 
+int git_index_add_entries(git_index *index, const git_index_entry *source_entries, size_t count)
+{
+	size_t i;
+	int error;
+
+	assert(index && (source_entries || !count));
+
+	for (i = 0; i < count; ++i) {
+		if ((error = index_add2(index, &source_entries[i], 1)) < GIT_SUCCESS)
+			return git__rethrow(error, "Failed to add entries to index");
+	}
+
+	/* the additions went at the end; put them in place in one go */
+	index_sort(index);
+	return GIT_SUCCESS;
+}
+
+int git_index_add_all(git_index *index, const char **paths, size_t count, int stage)
+{
+	git_index_entry *entry;
+	struct stat *st = NULL;
+	git_oid *oids = NULL;
+	const char *workdir;
+	size_t i;
+	int error;
+
+	assert(index && (paths || !count));
+
+	if ((error = index_check_workdir(&workdir, index, stage)) < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to add files to index");
+
+	if (count == 0)
+		return GIT_SUCCESS;
+
+	oids = git__malloc(count * sizeof(git_oid));
+	st = git__malloc(count * sizeof(struct stat));
+	if (oids == NULL || st == NULL) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
+
+	/* all the blobs first, so nothing is added if one of them fails */
+	error = git_blob__create_fromfiles(oids, st, INDEX_OWNER(index), paths, count);
+
+	for (i = 0; i < count && error == GIT_SUCCESS; ++i) {
+		if ((error = index_entry_new(&entry, paths[i], &st[i], &oids[i], stage)) < GIT_SUCCESS)
+			break;
+
+		if ((error = index_insert(index, entry, 1)) < GIT_SUCCESS) {
+			index_entry_free(index, entry);
+			break;
+		}
+
+		git_tree_cache_invalidate_path(index->tree, entry->path);
+		git_untracked_cache_invalidate_path(index->untracked, entry->path);
+	}
+
+	/* the additions went at the end; put them in place in one go */
+	index_sort(index);
+
+cleanup:
+	git__free(oids);
+	git__free(st);
+
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to add files to index");
+
+	return GIT_SUCCESS;
+}
+
 int git_index_remove(git_index *index, int position)
 {
 	int error;
 	git_index_entry *entry;
 
-	git_vector_sort(&index->entries);
+	index_sort(index);
 	entry = git_vector_get(&index->entries, position);
-	if (entry != NULL)
+	if (entry != NULL) {
 		git_tree_cache_invalidate_path(index->tree, entry->path);
+		git_untracked_cache_invalidate_path(index->untracked, entry->path);
+	}
 
 	error = git_vector_remove(&index->entries, (unsigned int)position);
 
-	if (error == GIT_SUCCESS)
-		index_entry_free(entry);
+	if (error == GIT_SUCCESS) {
+		index_paths_removed(index, entry, (unsigned int)position);
+		index_entry_free(index, entry);
+		index->dirty = 1;
+	}
 
 	return error;
 }
 
 int git_index_find(git_index *index, const char *path)
 {
-	return git_vector_bsearch2(&index->entries, index_srch, path);
+	index_sort(index);
+	return index_position(index, path);
 }
 
 void git_index_uniq(git_index *index)
 {
 	git_vector_uniq(&index->entries);
+	index_paths_drop(index);
+	index->dirty = 1;
 }
 
 const git_index_entry_unmerged *git_index_get_unmerged_bypath(git_index *index, const char *path)
@@ -656,41 +1300,284 @@ static size_t read_entry(git_index_entry *dest, const void *buffer, size_t buffe
 	if (path_length == 0xFFF) {
 		const char *path_end;
 
-		path_end = memchr(path_ptr, '\0', buffer_size);
+		path_end = memchr(path_ptr, '\0', buffer_size - (path_ptr - (const char *)buffer));
 		if (path_end == NULL)
 				return 0;
 
-		path_length = path_end - path_ptr;
-	}
+		path_length = path_end - path_ptr;
+	}
+
+	if (dest->flags & GIT_IDXENTRY_EXTENDED)
+		entry_size = long_entry_size(path_length);
+	else
+		entry_size = short_entry_size(path_length);
+
+	if (INDEX_FOOTER_SIZE + entry_size > buffer_size)
+		return 0;
+
+	/* the path is used in place, so it had better be terminated */
+	if (path_ptr[path_length] != '\0')
+		return 0;
+
+	dest->path = (char *)path_ptr;
+
+	return entry_size;
+}
+
+static int read_header(struct index_header *dest, const void *buffer)
+{
+	const struct index_header *source = buffer;
+
+	dest->signature = ntohl(source->signature);
+	if (dest->signature != INDEX_HEADER_SIG)
+		return GIT_EOBJCORRUPTED;
+
+	dest->version = ntohl(source->version);
+	if (dest->version != INDEX_VERSION_NUMBER_EXT &&
+		dest->version != INDEX_VERSION_NUMBER)
+		return GIT_EOBJCORRUPTED;
+
+	dest->entry_count = ntohl(source->entry_count);
+	return GIT_SUCCESS;
+}
+
+static void split_free(git_index_split *split)
+{
+	if (split == NULL)
+		return;
+
+	git__free(split->base_entries);
+	git__free(split->base_buffer);
+	git__free(split);
+}
+
+/* `sharedindex.<oid>` next to the index, or `sharedindex` for no oid */
+static int shared_index_path(git_buf *path, const char *index_path, const git_oid *oid)
+{
+	char hex[GIT_OID_HEXSZ + 1];
+	int error;
+
+	if ((error = git_path_dirname_r(path, index_path)) < GIT_SUCCESS ||
+		(error = git_buf_joinpath(path, path->ptr, "sharedindex")) < GIT_SUCCESS)
+		return error;
+
+	if (oid == NULL)
+		return GIT_SUCCESS;
+
+	git_oid_fmt(hex, oid);
+	hex[GIT_OID_HEXSZ] = '\0';
+
+	git_buf_putc(path, '.');
+	return git_buf_puts(path, hex);
+}
+
+/*
+ * Read the shared index `split->base_oid` into `split`. The entries'
+ * paths point into the file's contents, which go to `buffer_out`.
+ */
+static int read_shared_index(git_index_split *split, char **buffer_out, const char *index_path)
+{
+	git_buf path = GIT_BUF_INIT, contents = GIT_BUF_INIT;
+	const char *buffer;
+	size_t buffer_size;
+	git_oid checksum;
+	int error;
+
+	if ((error = shared_index_path(&path, index_path, &split->base_oid)) < GIT_SUCCESS ||
+		(error = git_futils_readbuffer(&contents, path.ptr)) < GIT_SUCCESS)
+		goto cleanup;
+
+	buffer_size = contents.size;
+	*buffer_out = git_buf_detach(&contents);
+	buffer = *buffer_out;
+
+	error = read_entries(&split->base_entries, &split->base_entry_count, &buffer, &buffer_size);
+	if (error < GIT_SUCCESS)
+		goto cleanup;
+
+	/* we don't need its extensions, but it has to be the right file */
+	git_oid_fromraw(&checksum, (const unsigned char *)buffer + buffer_size - INDEX_FOOTER_SIZE);
+
+	if (git_oid_cmp(&checksum, &split->base_oid) != 0)
+		error = git__throw(GIT_EOBJCORRUPTED, "Shared index '%s' has the wrong checksum", path.ptr);
+
+cleanup:
+	git_buf_free(&path);
+	git_buf_free(&contents);
+	return error;
+}
+
+/*
+ * Put the entries of the shared index in the index: the first ones
+ * read from the index file replace (and are named after) the shared
+ * entries in `replaced`, the rest are added. The shared entries in
+ * `deleted` are left out.
+ */
+static int merge_shared_index(git_index *index, const git_ewah *deleted, const git_ewah *replaced)
+{
+	git_index_split *split = index->split;
+	git_index_entry **own = (git_index_entry **)index->entries.contents;
+	unsigned int own_count = index->entries.length;
+	unsigned int i, replaced_count = 0, deleted_count = 0, n = 0;
+	git_index_entry *merged = NULL;
+	size_t merged_count;
+
+	for (i = 0; i < split->base_entry_count; ++i) {
+		int is_deleted = git_ewah_get(deleted, i);
+		int is_replaced = git_ewah_get(replaced, i);
+
+		if (is_deleted && is_replaced)
+			return git__throw(GIT_EOBJCORRUPTED,
+				"Failed to read split index. Entry %u is both deleted and replaced", i);
+
+		deleted_count += is_deleted;
+		replaced_count += is_replaced;
+	}
+
+	if (replaced_count > own_count)
+		return git__throw(GIT_EOBJCORRUPTED,
+			"Failed to read split index. Too few entries for the replaced ones");
+
+	/* the replacements are nameless, new entries are not */
+	for (i = 0; i < own_count; ++i) {
+		if ((own[i]->path[0] == '\0') != (i < replaced_count))
+			return git__throw(GIT_EOBJCORRUPTED,
+				"Failed to read split index. Misplaced entry %u", i);
+	}
+
+	merged_count = split->base_entry_count - deleted_count + (own_count - replaced_count);
+	if (merged_count > 0) {
+		merged = git__malloc(merged_count * sizeof(git_index_entry));
+		if (merged == NULL)
+			return GIT_ENOMEM;
+	}
+
+	for (i = 0; i < split->base_entry_count; ++i) {
+		const git_index_entry *base = &split->base_entries[i];
+
+		if (git_ewah_get(deleted, i))
+			continue;
+
+		if (git_ewah_get(replaced, i)) {
+			merged[n] = **own++;
+			merged[n].path = base->path;
+			merged[n].flags = (merged[n].flags & ~GIT_IDXENTRY_NAMEMASK) |
+				(base->flags & GIT_IDXENTRY_NAMEMASK);
+		} else
+			merged[n] = *base;
+
+		n++;
+	}
+
+	for (i = replaced_count; i < own_count; ++i)
+		merged[n++] = **own++;
+
+	/* the entries just read from the index file are copied over */
+	git_vector_clear(&index->entries);
+	git__free(index->disk_entries);
+
+	index->disk_entries = merged;
+	index->disk_entry_count = n;
+
+	for (i = 0; i < n; ++i) {
+		if (git_vector_insert(&index->entries, &merged[i]) < GIT_SUCCESS)
+			return GIT_ENOMEM;
+	}
+
+	return GIT_SUCCESS;
+}
+
+static int read_link(git_index *index, const char *buffer, size_t size)
+{
+	git_ewah deleted = GIT_EWAH_INIT, replaced = GIT_EWAH_INIT;
+	size_t read;
+	int error;
+
+	if (index->split != NULL || size < GIT_OID_RAWSZ)
+		return git__throw(GIT_EOBJCORRUPTED, "Failed to read split index. Bad link extension");
+
+	index->split = git__calloc(1, sizeof(git_index_split));
+	if (index->split == NULL)
+		return GIT_ENOMEM;
+
+	git_oid_fromraw(&index->split->base_oid, (const unsigned char *)buffer);
+	buffer += GIT_OID_RAWSZ;
+	size -= GIT_OID_RAWSZ;
+
+	/* the index keeps the file, for the paths of the merged entries */
+	error = read_shared_index(index->split, &index->shared_buffer, index->index_file_path);
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to read split index");
+
+	/* without the bitmaps, the index only adds to the shared one */
+	if (size > 0) {
+		error = git_ewah_read(&deleted, &read, (const unsigned char *)buffer,
+			size, index->split->base_entry_count);
+
+		if (error == GIT_SUCCESS) {
+			buffer += read;
+			size -= read;
+			error = git_ewah_read(&replaced, &read, (const unsigned char *)buffer,
+				size, index->split->base_entry_count);
+		}
 
-	if (dest->flags & GIT_IDXENTRY_EXTENDED)
-		entry_size = long_entry_size(path_length);
-	else
-		entry_size = short_entry_size(path_length);
+		if (error == GIT_SUCCESS && read != size)
+			error = git__throw(GIT_EOBJCORRUPTED, "Failed to read split index. Trailing data in link extension");
+	}
 
-	if (INDEX_FOOTER_SIZE + entry_size > buffer_size)
-		return 0;
+	if (error == GIT_SUCCESS)
+		error = merge_shared_index(index, &deleted, &replaced);
 
-	dest->path = git__strdup(path_ptr);
-	assert(dest->path);
+	git_ewah_free(&deleted);
+	git_ewah_free(&replaced);
 
-	return entry_size;
+	return error == GIT_SUCCESS ? GIT_SUCCESS : git__rethrow(error, "Failed to read split index");
 }
 
-static int read_header(struct index_header *dest, const void *buffer)
+/*
+ * The token of the filesystem monitor, and a bitmap of the entries
+ * which weren't known to be unchanged; the older version, with a
+ * timestamp for a token, is left for git to deal with.
+ */
+static int read_fsmonitor(git_index *index, const char *buffer, size_t size)
 {
-	const struct index_header *source = buffer;
+	uint32_t version, bitmap_size;
+	const char *token_end;
+	size_t read;
 
-	dest->signature = ntohl(source->signature);
-	if (dest->signature != INDEX_HEADER_SIG)
+	if (size < 4)
 		return GIT_EOBJCORRUPTED;
 
-	dest->version = ntohl(source->version);
-	if (dest->version != INDEX_VERSION_NUMBER_EXT &&
-		dest->version != INDEX_VERSION_NUMBER)
+	memcpy(&version, buffer, 4);
+	if (ntohl(version) != INDEX_FSMONITOR_VERSION)
+		return GIT_SUCCESS;
+
+	buffer += 4;
+	size -= 4;
+
+	if ((token_end = memchr(buffer, '\0', size)) == NULL)
 		return GIT_EOBJCORRUPTED;
 
-	dest->entry_count = ntohl(source->entry_count);
+	index->fsmonitor_token = git__strdup(buffer);
+	if (index->fsmonitor_token == NULL)
+		return GIT_ENOMEM;
+
+	size -= token_end + 1 - buffer;
+	buffer = token_end + 1;
+
+	if (size < 4)
+		return GIT_EOBJCORRUPTED;
+
+	memcpy(&bitmap_size, buffer, 4);
+	bitmap_size = ntohl(bitmap_size);
+
+	if (bitmap_size != size - 4 ||
+		git_ewah_read(&index->fsmonitor_dirty, &read, (const unsigned char *)buffer + 4,
+			bitmap_size, index->entries.length) < GIT_SUCCESS ||
+		read != bitmap_size)
+		return GIT_EOBJCORRUPTED;
+
+	index->fsmonitor_pending = 1;
 	return GIT_SUCCESS;
 }
 
@@ -707,7 +1594,7 @@ static size_t read_extension(git_index *index, const char *buffer, size_t buffer
 
 	total_size = dest.extension_size + sizeof(struct index_extension);
 
-	if (buffer_size - total_size < INDEX_FOOTER_SIZE)
+	if (total_size > buffer_size || buffer_size - total_size < INDEX_FOOTER_SIZE)
 		return 0;
 
 	/* optional extension */
@@ -719,27 +1606,52 @@ static size_t read_extension(git_index *index, const char *buffer, size_t buffer
 		} else if (memcmp(dest.signature, INDEX_EXT_UNMERGED_SIG, 4) == 0) {
 			if (read_unmerged(index, buffer + 8, dest.extension_size) < GIT_SUCCESS)
 				return 0;
+		} else if (memcmp(dest.signature, INDEX_EXT_UNTRACKED_SIG, 4) == 0) {
+			/* a cache we can't read is only a cache: do without it */
+			git_untracked_cache_free(index->untracked);
+			if (git_untracked_cache_read(&index->untracked, buffer + 8, dest.extension_size) < GIT_SUCCESS)
+				index->untracked = NULL;
+		} else if (memcmp(dest.signature, INDEX_EXT_FSMONITOR_SIG, 4) == 0) {
+			/* same here: everything will be looked at */
+			git_index__fsmonitor_clear(index);
+			if (read_fsmonitor(index, buffer + 8, dest.extension_size) < GIT_SUCCESS) {
+				git_clearerror();
+				git_index__fsmonitor_clear(index);
+			}
 		}
 		/* else, unsupported extension. We cannot parse this, but we can skip
 		 * it by returning `total_size */
+	} else if (memcmp(dest.signature, INDEX_EXT_LINK_SIG, 4) == 0) {
+		if (read_link(index, buffer + 8, dest.extension_size) < GIT_SUCCESS)
+			return 0;
 	} else {
-		/* we cannot handle non-ignorable extensions;
-		 * in fact they aren't even defined in the standard */
+		/* we cannot handle any other non-ignorable extension */
 		return 0;
 	}
 
 	return total_size;
 }
 
-static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
+/*
+ * Check the checksum and the header of an index file and read its
+ * entries into one array. `buffer` and `buffer_size` are moved past
+ * the entries, to the extensions.
+ */
+static int read_entries(git_index_entry **entries_out, unsigned int *count_out,
+	const char **buffer_in, size_t *buffer_size_in)
 {
+	const char *buffer = *buffer_in;
+	size_t buffer_size = *buffer_size_in;
 	unsigned int i;
 	struct index_header header;
 	git_oid checksum_calculated, checksum_expected;
+	git_index_entry *entries = NULL;
 
 #define seek_forward(_increase) { \
-	if (_increase >= buffer_size) \
+	if (_increase >= buffer_size) { \
+		git__free(entries); \
 		return git__throw(GIT_EOBJCORRUPTED, "Failed to seek forward. Buffer size exceeded"); \
+	} \
 	buffer += _increase; \
 	buffer_size -= _increase;\
 }
@@ -747,9 +1659,13 @@ static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 	if (buffer_size < INDEX_HEADER_SIZE + INDEX_FOOTER_SIZE)
 		return git__throw(GIT_EOBJCORRUPTED, "Failed to parse index. Buffer too small");
 
-	/* Precalculate the SHA1 of the files's contents -- we'll match it to
-	 * the provided SHA1 in the footer */
+	/* 160-bit SHA-1 over the content of the index file before this checksum. */
 	git_hash_buf(&checksum_calculated, buffer, buffer_size - INDEX_FOOTER_SIZE);
+	git_oid_fromraw(&checksum_expected,
+		(const unsigned char *)buffer + buffer_size - INDEX_FOOTER_SIZE);
+
+	if (git_oid_cmp(&checksum_calculated, &checksum_expected) != 0)
+		return git__throw(GIT_EOBJCORRUPTED, "Failed to parse index. Calculated checksum does not match expected checksum");
 
 	/* Parse header */
 	if (read_header(&header, buffer) < GIT_SUCCESS)
@@ -757,31 +1673,60 @@ static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 
 	seek_forward(INDEX_HEADER_SIZE);
 
-	git_vector_clear(&index->entries);
+	if (header.entry_count > buffer_size / minimal_entry_size)
+		return git__throw(GIT_EOBJCORRUPTED, "Failed to parse index. Too many entries for its size");
+
+	/* All the entries go in one array, see `index_entry_free` */
+	if (header.entry_count > 0) {
+		entries = git__malloc(header.entry_count * sizeof(git_index_entry));
+		if (entries == NULL)
+			return GIT_ENOMEM;
+	}
 
 	/* Parse all the entries */
 	for (i = 0; i < header.entry_count && buffer_size > INDEX_FOOTER_SIZE; ++i) {
 		size_t entry_size;
-		git_index_entry *entry;
-
-		entry = git__malloc(sizeof(git_index_entry));
-		if (entry == NULL)
-			return GIT_ENOMEM;
 
-		entry_size = read_entry(entry, buffer, buffer_size);
+		entry_size = read_entry(&entries[i], buffer, buffer_size);
 
 		/* 0 bytes read means an object corruption */
-		if (entry_size == 0)
+		if (entry_size == 0) {
+			git__free(entries);
 			return git__throw(GIT_EOBJCORRUPTED, "Failed to parse index. Entry size is zero");
-
-		if (git_vector_insert(&index->entries, entry) < GIT_SUCCESS)
-			return GIT_ENOMEM;
+		}
 
 		seek_forward(entry_size);
 	}
 
-	if (i != header.entry_count)
+#undef seek_forward
+
+	if (i != header.entry_count) {
+		git__free(entries);
 		return git__throw(GIT_EOBJCORRUPTED, "Failed to parse index. Header entries changed while parsing");
+	}
+
+	*entries_out = entries;
+	*count_out = header.entry_count;
+	*buffer_in = buffer;
+	*buffer_size_in = buffer_size;
+	return GIT_SUCCESS;
+}
+
+static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
+{
+	unsigned int i;
+	int error;
+
+	git_vector_clear(&index->entries);
+
+	error = read_entries(&index->disk_entries, &index->disk_entry_count, &buffer, &buffer_size);
+	if (error < GIT_SUCCESS)
+		return error;
+
+	for (i = 0; i < index->disk_entry_count; ++i) {
+		if (git_vector_insert(&index->entries, &index->disk_entries[i]) < GIT_SUCCESS)
+			return GIT_ENOMEM;
+	}
 
 	/* There's still space for some extensions! */
 	while (buffer_size > INDEX_FOOTER_SIZE) {
@@ -793,35 +1738,33 @@ static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 		if (extension_size == 0)
 			return git__throw(GIT_EOBJCORRUPTED, "Failed to parse index. Extension size is zero");
 
-		seek_forward(extension_size);
+		buffer += extension_size;
+		buffer_size -= extension_size;
 	}
 
 	if (buffer_size != INDEX_FOOTER_SIZE)
 		return git__throw(GIT_EOBJCORRUPTED, "Failed to parse index. Buffer size does not match index footer size");
 
-	/* 160-bit SHA-1 over the content of the index file before this checksum. */
-	git_oid_fromraw(&checksum_expected, (const unsigned char *)buffer);
-
-	if (git_oid_cmp(&checksum_calculated, &checksum_expected) != 0)
-		return git__throw(GIT_EOBJCORRUPTED, "Failed to parse index. Calculated checksum does not match expected checksum");
-
-#undef seek_forward
-
 	/* force sorting in the vector: the entries are
-	 * assured to be sorted on the index */
-	index->entries.sorted = 1;
+	 * assured to be sorted on the index, unless
+	 * they have just been merged with a shared one */
+	if (index->split == NULL)
+		index->entries.sorted = 1;
+	else
+		index_sort(index);
+
 	return GIT_SUCCESS;
 }
 
-static int is_index_extended(git_index *index)
+static int is_index_extended(git_vector *entries)
 {
 	unsigned int i, extended;
 
 	extended = 0;
 
-	for (i = 0; i < index->entries.length; ++i) {
+	for (i = 0; i < entries->length; ++i) {
 		git_index_entry *entry;
-		entry = git_vector_get(&index->entries, i);
+		entry = git_vector_get(entries, i);
 		entry->flags &= ~GIT_IDXENTRY_EXTENDED;
 		if (entry->flags_extended & GIT_IDXENTRY_EXTENDED_FLAGS) {
 			extended++;
@@ -831,7 +1774,7 @@ static int is_index_extended(git_index *index)
 	return extended;
 }
 
-static int write_disk_entry(git_filebuf *file, git_index_entry *entry)
+static int write_disk_entry(git_filebuf *file, git_index_entry *entry, time_t racy_time)
 {
 	void *mem = NULL;
 	struct entry_short *ondisk;
@@ -873,6 +1816,14 @@ static int write_disk_entry(git_filebuf *file, git_index_entry *entry)
 	ondisk->gid = htonl(entry->gid);
 	ondisk->file_size = htonl((uint32_t)entry->file_size);
 
+	/*
+	 * The file could change within the same second this index is
+	 * written in, and nothing would tell once the index is written
+	 * again later; a wrong size makes sure it's looked at.
+	 */
+	if (entry->mtime.seconds >= (git_time_t)racy_time)
+		ondisk->file_size = 0;
+
 	git_oid_cpy(&ondisk->oid, &entry->oid);
 
 	ondisk->flags = htons(entry->flags);
@@ -880,7 +1831,7 @@ static int write_disk_entry(git_filebuf *file, git_index_entry *entry)
 	if (entry->flags & GIT_IDXENTRY_EXTENDED) {
 		struct entry_long *ondisk_ext;
 		ondisk_ext = (struct entry_long *)ondisk;
-		ondisk_ext->flags_extended = htons(entry->flags_extended);
+		ondisk_ext->flags_extended = htons(entry->flags_extended & GIT_IDXENTRY_EXTENDED_FLAGS);
 		path = ondisk_ext->path;
 	}
 	else
@@ -891,21 +1842,89 @@ static int write_disk_entry(git_filebuf *file, git_index_entry *entry)
 	return GIT_SUCCESS;
 }
 
-static int write_entries(git_index *index, git_filebuf *file)
+static int write_entries(git_vector *entries, git_filebuf *file)
 {
 	unsigned int i;
+	struct stat st;
+	time_t racy_time;
 
-	for (i = 0; i < index->entries.length; ++i) {
+	/* the index will be at least as new as its lock file */
+	if (p_fstat(file->fd, &st) == 0)
+		racy_time = st.st_mtime;
+	else
+		racy_time = time(NULL);
+
+	for (i = 0; i < entries->length; ++i) {
 		git_index_entry *entry;
-		entry = git_vector_get(&index->entries, i);
-		if (write_disk_entry(file, entry) < GIT_SUCCESS)
+		entry = git_vector_get(entries, i);
+		if (write_disk_entry(file, entry, racy_time) < GIT_SUCCESS)
 			return GIT_ENOMEM;
 	}
 
 	return GIT_SUCCESS;
 }
 
-static int write_index(git_index *index, git_filebuf *file)
+static void write_extension(git_filebuf *file, const char *signature, const git_buf *data)
+{
+	struct index_extension ext;
+
+	memcpy(ext.signature, signature, 4);
+	ext.extension_size = htonl((uint32_t)data->size);
+
+	git_filebuf_write(file, &ext, sizeof(struct index_extension));
+	git_filebuf_write(file, data->ptr, data->size);
+}
+
+/* The positions of the entries in `index` aren't known to be unchanged */
+static int write_fsmonitor(git_buf *out, git_index *index)
+{
+	git_ewah dirty = GIT_EWAH_INIT;
+	git_buf bitmap = GIT_BUF_INIT;
+	git_index_entry *entry;
+	uint32_t value;
+	unsigned int i;
+	int error = GIT_SUCCESS;
+
+	/*
+	 * The flags read weren't brought up to date yet, and can't be
+	 * kept; everything will be looked at once more instead
+	 */
+	git_ewah_free(&index->fsmonitor_dirty);
+	index->fsmonitor_pending = 0;
+
+	git_vector_foreach(&index->entries, i, entry) {
+		if ((entry->flags_extended & GIT_IDXENTRY_FSMONITOR_VALID) == 0 &&
+			(error = git_ewah_set(&dirty, i)) < GIT_SUCCESS)
+			break;
+	}
+
+	if (error == GIT_SUCCESS)
+		error = git_ewah_write(&bitmap, &dirty);
+
+	if (error == GIT_SUCCESS) {
+		value = htonl(INDEX_FSMONITOR_VERSION);
+		git_buf_put(out, (const char *)&value, 4);
+		git_buf_put(out, index->fsmonitor_token, strlen(index->fsmonitor_token) + 1);
+
+		value = htonl((uint32_t)bitmap.size);
+		git_buf_put(out, (const char *)&value, 4);
+		git_buf_put(out, bitmap.ptr, bitmap.size);
+
+		if (git_buf_oom(out))
+			error = GIT_ENOMEM;
+	}
+
+	git_ewah_free(&dirty);
+	git_buf_free(&bitmap);
+	return error;
+}
+
+/*
+ * Write `entries` and, unless it's NULL, the extensions of `index`
+ * with `link` before them. The file's checksum goes to `checksum`.
+ */
+static int write_index(git_oid *checksum, git_filebuf *file,
+	git_vector *entries, git_index *index, const git_buf *link)
 {
 	int error = GIT_SUCCESS;
 	git_oid hash_final;
@@ -914,21 +1933,61 @@ static int write_index(git_index *index, git_filebuf *file)
 
 	int is_extended;
 
-	assert(index && file);
+	assert(file && entries);
 
-	is_extended = is_index_extended(index);
+	is_extended = is_index_extended(entries);
 
 	header.signature = htonl(INDEX_HEADER_SIG);
 	header.version = htonl(is_extended ? INDEX_VERSION_NUMBER_EXT : INDEX_VERSION_NUMBER);
-	header.entry_count = htonl(index->entries.length);
+	header.entry_count = htonl(entries->length);
 
 	git_filebuf_write(file, &header, sizeof(struct index_header));
 
-	error = write_entries(index, file);
+	error = write_entries(entries, file);
 	if (error < GIT_SUCCESS)
 		return git__rethrow(error, "Failed to write index");
 
-	/* TODO: write extensions (tree cache) */
+	if (link != NULL)
+		write_extension(file, INDEX_EXT_LINK_SIG, link);
+
+	if (index != NULL && index->tree != NULL) {
+		git_buf tree = GIT_BUF_INIT;
+
+		error = git_tree_cache_write(&tree, index->tree);
+		if (error == GIT_SUCCESS)
+			write_extension(file, INDEX_EXT_TREECACHE_SIG, &tree);
+
+		git_buf_free(&tree);
+
+		if (error < GIT_SUCCESS)
+			return git__rethrow(error, "Failed to write index");
+	}
+
+	if (index != NULL && index->untracked != NULL) {
+		git_buf untracked = GIT_BUF_INIT;
+
+		error = git_untracked_cache_write(&untracked, index->untracked);
+		if (error == GIT_SUCCESS)
+			write_extension(file, INDEX_EXT_UNTRACKED_SIG, &untracked);
+
+		git_buf_free(&untracked);
+
+		if (error < GIT_SUCCESS)
+			return git__rethrow(error, "Failed to write index");
+	}
+
+	if (index != NULL && index->fsmonitor_token != NULL) {
+		git_buf fsmonitor = GIT_BUF_INIT;
+
+		error = write_fsmonitor(&fsmonitor, index);
+		if (error == GIT_SUCCESS)
+			write_extension(file, INDEX_EXT_FSMONITOR_SIG, &fsmonitor);
+
+		git_buf_free(&fsmonitor);
+
+		if (error < GIT_SUCCESS)
+			return git__rethrow(error, "Failed to write index");
+	}
 
 	/* get out the hash for all the contents we've appended to the file */
 	git_filebuf_hash(&hash_final, file);
@@ -936,9 +1995,345 @@ static int write_index(git_index *index, git_filebuf *file)
 	/* write it at the end of the file */
 	git_filebuf_write(file, hash_final.id, GIT_OID_RAWSZ);
 
+	if (checksum != NULL)
+		git_oid_cpy(checksum, &hash_final);
+
 	return error == GIT_SUCCESS ? GIT_SUCCESS : git__rethrow(error, "Failed to write index");
 }
 
+static void split_write_free(struct split_write *sw)
+{
+	git_vector_free(&sw->entries);
+	git__free(sw->replacements);
+	git_ewah_free(&sw->deleted);
+	git_ewah_free(&sw->replaced);
+	git_buf_free(&sw->link);
+	memset(sw, 0x0, sizeof(struct split_write));
+}
+
+static int split_entry_cmp(const git_index_entry *a, const git_index_entry *b)
+{
+	int cmp = strcmp(a->path, b->path);
+
+	if (cmp == 0)
+		cmp = git_index_entry_stage(a) - git_index_entry_stage(b);
+
+	return cmp;
+}
+
+/* Whether `entry` would be written the way `base` was */
+static int split_entry_unchanged(const git_index_entry *entry, const git_index_entry *base)
+{
+	const unsigned short flags_mask = ~(GIT_IDXENTRY_NAMEMASK | GIT_IDXENTRY_EXTENDED);
+
+	return (uint32_t)entry->ctime.seconds == (uint32_t)base->ctime.seconds &&
+		entry->ctime.nanoseconds == base->ctime.nanoseconds &&
+		(uint32_t)entry->mtime.seconds == (uint32_t)base->mtime.seconds &&
+		entry->mtime.nanoseconds == base->mtime.nanoseconds &&
+		entry->dev == base->dev &&
+		entry->ino == base->ino &&
+		entry->mode == base->mode &&
+		entry->uid == base->uid &&
+		entry->gid == base->gid &&
+		(uint32_t)entry->file_size == (uint32_t)base->file_size &&
+		git_oid_cmp(&entry->oid, &base->oid) == 0 &&
+		(entry->flags & flags_mask) == (base->flags & flags_mask) &&
+		(entry->flags_extended & GIT_IDXENTRY_EXTENDED_FLAGS) ==
+			(base->flags_extended & GIT_IDXENTRY_EXTENDED_FLAGS);
+}
+
+/* Work out how the (sorted) entries differ from the shared index */
+static int split_diff(struct split_write *sw, git_index *index)
+{
+	git_index_split *split = index->split;
+	git_vector added = GIT_VECTOR_INIT;
+	unsigned int i = 0, j = 0, count = index->entries.length;
+	int error = GIT_SUCCESS;
+
+	memset(sw, 0x0, sizeof(struct split_write));
+
+	if (count > 0) {
+		sw->replacements = git__malloc(count * sizeof(git_index_entry));
+		if (sw->replacements == NULL)
+			return GIT_ENOMEM;
+	}
+
+	while (error == GIT_SUCCESS && (i < count || j < split->base_entry_count)) {
+		git_index_entry *entry = NULL, *copy;
+		const git_index_entry *base = NULL;
+		int cmp;
+
+		if (i < count)
+			entry = git_vector_get(&index->entries, i);
+		if (j < split->base_entry_count)
+			base = &split->base_entries[j];
+
+		cmp = entry == NULL ? 1 : base == NULL ? -1 : split_entry_cmp(entry, base);
+
+		if (cmp < 0) {
+			error = git_vector_insert(&added, entry);
+			i++;
+		} else if (cmp > 0) {
+			error = git_ewah_set(&sw->deleted, j);
+			sw->changes++;
+			j++;
+		} else {
+			if (!split_entry_unchanged(entry, base)) {
+				/* replacements go nameless, the shared entry has the path */
+				copy = &sw->replacements[sw->replacement_count++];
+				*copy = *entry;
+				copy->path = "";
+				copy->flags &= ~GIT_IDXENTRY_NAMEMASK;
+
+				error = git_ewah_set(&sw->replaced, j);
+				sw->changes++;
+			}
+			i++;
+			j++;
+		}
+	}
+
+	if (error == GIT_SUCCESS)
+		error = git_vector_init(&sw->entries, sw->replacement_count + added.length, NULL);
+
+	for (i = 0; error == GIT_SUCCESS && i < sw->replacement_count; ++i)
+		error = git_vector_insert(&sw->entries, &sw->replacements[i]);
+
+	for (i = 0; error == GIT_SUCCESS && i < added.length; ++i)
+		error = git_vector_insert(&sw->entries, git_vector_get(&added, i));
+
+	sw->changes += added.length;
+	git_vector_free(&added);
+
+	return error;
+}
+
+/*
+ * How long a shared index no index uses is kept, from
+ * splitIndex.sharedIndexExpire: "never" (-1), "now" (0), or some
+ * "<n>.<unit>.ago" with a unit of seconds up to weeks
+ */
+static int shared_index_expiry(time_t *expiry, git_index *index)
+{
+	static const struct {
+		const char *name;
+		time_t seconds;
+	} units[] = {
+		{ "second", 1 },
+		{ "minute", 60 },
+		{ "hour", 60 * 60 },
+		{ "day", 24 * 60 * 60 },
+		{ "week", 7 * 24 * 60 * 60 },
+	};
+	git_config *cfg;
+	const char *value, *unit;
+	int32_t count;
+	size_t i, len;
+
+	*expiry = SHARED_INDEX_EXPIRE_DEFAULT;
+
+	if (INDEX_OWNER(index) == NULL ||
+		git_repository_config__weakptr(&cfg, INDEX_OWNER(index)) < GIT_SUCCESS ||
+		git_config_get_string(cfg, "splitIndex.sharedIndexExpire", &value) < GIT_SUCCESS) {
+		git_clearerror();
+		return GIT_SUCCESS;
+	}
+
+	if (strcmp(value, "never") == 0) {
+		*expiry = -1;
+		return GIT_SUCCESS;
+	}
+
+	if (strcmp(value, "now") == 0) {
+		*expiry = 0;
+		return GIT_SUCCESS;
+	}
+
+	if (git__strtol32(&count, value, &unit, 10) == GIT_SUCCESS && count >= 0 && *unit++ == '.') {
+		for (i = 0; i < ARRAY_SIZE(units); ++i) {
+			len = strlen(units[i].name);
+			if (strncmp(unit, units[i].name, len) != 0)
+				continue;
+
+			if (unit[len] == 's')
+				len++;
+
+			if (strcmp(unit + len, ".ago") == 0) {
+				*expiry = count * units[i].seconds;
+				return GIT_SUCCESS;
+			}
+		}
+	}
+
+	return git__throw(GIT_EINVALIDTYPE,
+		"Failed to parse splitIndex.sharedIndexExpire '%s'", value);
+}
+
+struct shared_index_expire {
+	const char *keep;
+	time_t before;
+};
+
+static int expire_shared_index(void *payload, git_buf *path)
+{
+	struct shared_index_expire *expire = payload;
+	const char *name = strrchr(path->ptr, '/');
+	struct stat st;
+	git_oid oid;
+
+	/* only `sharedindex.<oid>`, not the lock of one being written */
+	name = name ? name + 1 : path->ptr;
+	if (git__prefixcmp(name, "sharedindex.") != 0 ||
+		strlen(name) != strlen("sharedindex.") + GIT_OID_HEXSZ ||
+		git_oid_fromstr(&oid, name + strlen("sharedindex.")) < GIT_SUCCESS ||
+		strcmp(path->ptr, expire->keep) == 0) {
+		git_clearerror();
+		return GIT_SUCCESS;
+	}
+
+	/* whatever fails, the file is left for next time */
+	if (p_stat(path->ptr, &st) == 0 && st.st_mtime <= expire->before)
+		(void)p_unlink(path->ptr);
+
+	return GIT_SUCCESS;
+}
+
+/*
+ * Remove the shared indexes but `keep` which no index was written
+ * with for longer than `expiry`, as git does; writing a split index
+ * touches its shared one to keep it.
+ */
+static void clean_shared_indexes(const char *index_path, const char *keep, time_t expiry)
+{
+	struct shared_index_expire expire;
+	git_buf dir = GIT_BUF_INIT;
+
+	if (expiry < 0)
+		return;
+
+	expire.keep = keep;
+	expire.before = time(NULL) - expiry;
+
+	if (git_path_dirname_r(&dir, index_path) < GIT_SUCCESS ||
+		git_path_direach(&dir, expire_shared_index, &expire) < GIT_SUCCESS)
+		git_clearerror();
+
+	git_buf_free(&dir);
+}
+
+/*
+ * Write all the entries to a new shared index, which becomes the
+ * base of the index from now on.
+ */
+static int write_shared_index(git_index *index)
+{
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_buf path = GIT_BUF_INIT;
+	git_index_split *split;
+	time_t expiry;
+	int error;
+
+	if ((error = shared_index_expiry(&expiry, index)) < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to write shared index");
+
+	split = git__calloc(1, sizeof(git_index_split));
+	if (split == NULL)
+		return GIT_ENOMEM;
+
+	if ((error = shared_index_path(&path, index->index_file_path, NULL)) < GIT_SUCCESS ||
+		(error = git_filebuf_open(&file, path.ptr, GIT_FILEBUF_HASH_CONTENTS)) < GIT_SUCCESS)
+		goto cleanup;
+
+	git_buf_clear(&path);
+
+	if ((error = write_index(&split->base_oid, &file, &index->entries, NULL, NULL)) < GIT_SUCCESS ||
+		(error = shared_index_path(&path, index->index_file_path, &split->base_oid)) < GIT_SUCCESS) {
+		git_filebuf_cleanup(&file);
+		goto cleanup;
+	}
+
+	if ((error = git_filebuf_commit_at(&file, path.ptr, GIT_INDEX_FILE_MODE)) < GIT_SUCCESS)
+		goto cleanup;
+
+	/* read it back, so the shared entries are independent of ours */
+	error = read_shared_index(split, &split->base_buffer, index->index_file_path);
+
+	if (error == GIT_SUCCESS)
+		clean_shared_indexes(index->index_file_path, path.ptr, expiry);
+
+cleanup:
+	git_buf_free(&path);
+
+	if (error < GIT_SUCCESS) {
+		split_free(split);
+		return git__rethrow(error, "Failed to write shared index");
+	}
+
+	split_free(index->split);
+	index->split = split;
+	return GIT_SUCCESS;
+}
+
+/*
+ * Get what goes in a split index file ready, writing a new shared
+ * index first if too much has changed since the current one.
+ */
+static int prepare_split_write(struct split_write *sw, git_index *index)
+{
+	int error, reshare = 1;
+
+	memset(sw, 0x0, sizeof(struct split_write));
+
+	if (index->split != NULL) {
+		if ((error = split_diff(sw, index)) < GIT_SUCCESS)
+			return error;
+
+		reshare = sw->changes * 100 >
+			(size_t)index->split->base_entry_count * SPLIT_INDEX_MAX_PERCENT_CHANGE;
+	}
+
+	if (reshare) {
+		split_write_free(sw);
+
+		if ((error = write_shared_index(index)) < GIT_SUCCESS ||
+			(error = split_diff(sw, index)) < GIT_SUCCESS)
+			return error;
+	} else {
+		git_buf path = GIT_BUF_INIT;
+
+		/* still in use, so not to be expired */
+		if (shared_index_path(&path, index->index_file_path, &index->split->base_oid) == GIT_SUCCESS)
+			(void)p_utime(path.ptr, NULL);
+		git_buf_free(&path);
+	}
+
+	git_buf_init(&sw->link, 0);
+	git_buf_put(&sw->link, (const char *)index->split->base_oid.id, GIT_OID_RAWSZ);
+
+	if ((error = git_ewah_write(&sw->link, &sw->deleted)) < GIT_SUCCESS ||
+		(error = git_ewah_write(&sw->link, &sw->replaced)) < GIT_SUCCESS)
+		return error;
+
+	return git_buf_lasterror(&sw->link);
+}
+
+/* core.splitIndex decides, or else the index stays the way it is */
+static int split_index_wanted(int *split, git_index *index)
+{
+	int value = GIT_SPLIT_INDEX_UNSET, error;
+
+	if (INDEX_OWNER(index) != NULL &&
+		(error = git_repository__cvar(&value, INDEX_OWNER(index), GIT_CVAR_SPLIT_INDEX)) < GIT_SUCCESS)
+		return error;
+
+	if (value == GIT_SPLIT_INDEX_UNSET)
+		*split = (index->split != NULL);
+	else
+		*split = (value == GIT_SPLIT_INDEX_TRUE);
+
+	return GIT_SUCCESS;
+}
+
 int git_index_entry_stage(const git_index_entry *entry)
 {
 	return (entry->flags & GIT_IDXENTRY_STAGEMASK) >> GIT_IDXENTRY_STAGESHIFT;
@@ -974,7 +2369,7 @@ exit:
 	git_buf_free(&path);
 
 	if (ret < GIT_SUCCESS)
-		index_entry_free(entry);
+		index_entry_free(index, entry);
 	return ret;
 }
 
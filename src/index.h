@@ -10,13 +10,41 @@
 #include "fileops.h"
 #include "filebuf.h"
 #include "vector.h"
+#include "hashtable.h"
 #include "tree-cache.h"
+#include "untracked-cache.h"
+#include "ewah.h"
 #include "git2/odb.h"
 #include "git2/index.h"
 
 #define GIT_INDEX_FILE "index"
 #define GIT_INDEX_FILE_MODE 0666
 
+/*
+ * In-memory flag (in `flags_extended`) of the entries which were
+ * found unchanged, and which the filesystem monitor hasn't seen
+ * change since
+ */
+#define GIT_IDXENTRY_FSMONITOR_VALID (1 << 10)
+
+/*
+ * A split index keeps most of its entries in a shared index file,
+ * `sharedindex.<sha1>` next to it, and only records in itself what
+ * changed since: entries replaced in or deleted from the shared
+ * index, and new ones.
+ */
+typedef struct {
+	/* the checksum of the shared index, which names its file */
+	git_oid base_oid;
+
+	/* the entries of the shared index, as they are on disk */
+	git_index_entry *base_entries;
+	unsigned int base_entry_count;
+
+	/* the shared index file, unless the index holds on to it */
+	char *base_buffer;
+} git_index_split;
+
 struct git_index {
 	git_refcount rc;
 
@@ -25,10 +53,98 @@ struct git_index {
 	time_t last_modified;
 	git_vector entries;
 
+	/*
+	 * The position in `entries` of each path, so that adding
+	 * entries doesn't need them sorted. It's made on first use.
+	 * Removing entries moves the others, so the positions are
+	 * stale until the entries are sorted again; the paths still
+	 * are right.
+	 */
+	git_hashtable *paths;
+	unsigned int paths_stale:1;
+
+	/*
+	 * The entries read from disk are all in one array, and their
+	 * paths point into the buffers the file and its shared index
+	 * were read into. Only the entries added afterwards are
+	 * allocated one by one.
+	 */
+	git_index_entry *disk_entries;
+	unsigned int disk_entry_count;
+	char *disk_buffer;
+	char *shared_buffer;
+
 	unsigned int on_disk:1;
+
+	/*
+	 * `dirty` is set once the entries were changed since the index
+	 * was read or written; `stat_refreshed` once only the stat data
+	 * of some (or what the filesystem monitor or the untracked cache
+	 * knows) was, which can be written back without asking.
+	 */
+	unsigned int dirty:1,
+		stat_refreshed:1;
+
 	git_tree_cache *tree;
+	git_untracked_cache *untracked;
+
+	/* NULL unless the index is split */
+	git_index_split *split;
+
+	/*
+	 * The token of the filesystem monitor the entries flagged
+	 * GIT_IDXENTRY_FSMONITOR_VALID are good for, NULL if none.
+	 * The flags read from disk stay in `fsmonitor_dirty` until
+	 * the monitor is asked what changed since.
+	 */
+	char *fsmonitor_token;
+	git_ewah fsmonitor_dirty;
+	unsigned int fsmonitor_pending:1;
 
 	git_vector unmerged;
 };
 
+/* Fill in the stat data of `entry`; its mode, oid and path are left alone */
+extern void git_index__init_entry_from_stat(git_index_entry *entry, const struct stat *st);
+
+/*
+ * Whether the file `entry` is for can be taken to be unchanged,
+ * without reading it, from `wd`, its entry in the working directory
+ */
+extern int git_index__stat_matches(
+	git_index *index, const git_index_entry *entry, const git_index_entry *wd);
+
+/* The file was hashed and is what `entry` says; remember its stat data */
+extern void git_index__refresh_stat(
+	git_index *index, git_index_entry *entry, const git_index_entry *wd);
+
+/*
+ * Write the index back if the stat data of some entries was refreshed,
+ * and neither we nor anybody else changed it otherwise
+ */
+extern void git_index__write_refreshed(git_index *index);
+
+/*
+ * Ask the repository's filesystem monitor what changed since the
+ * index last heard from it, and forget that those entries were found
+ * unchanged. Returns whether the monitor is in use; when it isn't,
+ * no entries are flagged GIT_IDXENTRY_FSMONITOR_VALID.
+ */
+extern int git_index__fsmonitor_refresh(git_index *index);
+
+/* The file of `entry` was found unchanged; it needn't be looked at again */
+extern void git_index__fsmonitor_mark_valid(git_index *index, git_index_entry *entry);
+
+/* Forget everything the filesystem monitor told */
+extern void git_index__fsmonitor_clear(git_index *index);
+
+/*
+ * The untracked cache of the index, ready for a walk of the working
+ * directory, or NULL if there's none we can use. With `update`, it's
+ * made or dropped as core.untrackedCache says, and forgets everything
+ * if the global exclude files changed; otherwise it's left alone, and
+ * isn't used then.
+ */
+extern int git_index__untracked_cache(git_untracked_cache **out, git_index *index, int update);
+
 #endif
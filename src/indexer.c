@@ -10,14 +10,20 @@
 #include "git2/indexer.h"
 #include "git2/object.h"
 #include "git2/oid.h"
+#include "git2/odb.h"
 
 #include "common.h"
 #include "pack.h"
+#include "odb.h"
 #include "mwindow.h"
 #include "posix.h"
 #include "pack.h"
 #include "filebuf.h"
 #include "sha1.h"
+#include "hash.h"
+#include "fileops.h"
+#include "delta-apply.h"
+#include "thread-utils.h"
 
 #define UINT31_MAX (0x7FFFFFFF)
 
@@ -26,6 +32,13 @@ struct entry {
 	uint32_t crc;
 	uint32_t offset;
 	uint64_t offset_long;
+
+	/* Filled in by the first pass, to resolve the deltas */
+	off_t data_offset;
+	size_t size;
+	git_otype type;
+	off_t base_offset;
+	git_oid base_oid;
 };
 
 struct git_indexer {
@@ -37,6 +50,33 @@ struct git_indexer {
 	git_filebuf file;
 	unsigned int fanout[256];
 	git_oid hash;
+	unsigned int threads;
+
+	/* where to look for the bases missing from a thin pack */
+	git_odb *odb;
+
+	/* Deltas, sorted by the base they apply on */
+	struct entry **ofs_deltas;
+	size_t nr_ofs_deltas;
+	struct entry **ref_deltas;
+	size_t nr_ref_deltas;
+};
+
+/*
+ * Shared by all the threads resolving deltas: they take the
+ * objects in the pack one by one and resolve all the deltas
+ * that depend on each one of them.
+ */
+struct resolve_ctx {
+	git_indexer *idx;
+	git_indexer_stats *stats;
+	git_atomic next;
+	git_atomic processed;
+	/* protects the fields below, and `stats` */
+	git_mutex lock;
+	int error;
+	/* the error message of the thread which failed first */
+	char message[1024];
 };
 
 const git_oid *git_indexer_hash(git_indexer *idx)
@@ -70,41 +110,45 @@ static int objects_cmp(const void *a, const void *b)
 	return git_oid_cmp(&entrya->oid, &entryb->oid);
 }
 
-static int cache_cmp(const void *a, const void *b)
-{
-	const struct git_pack_entry *ea = a;
-	const struct git_pack_entry *eb = b;
-
-	return git_oid_cmp(&ea->sha1, &eb->sha1);
-}
-
 
-int git_indexer_new(git_indexer **out, const char *packname)
+static git_indexer *indexer_alloc(const char *packname)
 {
 	git_indexer *idx;
 	size_t namelen;
-	int ret, error;
-
-	assert(out && packname);
-
-	if (git_path_root(packname) < 0)
-		return git__throw(GIT_EINVALIDPATH, "Path is not absolute");
 
 	idx = git__malloc(sizeof(git_indexer));
 	if (idx == NULL)
-		return GIT_ENOMEM;
+		return NULL;
 
 	memset(idx, 0x0, sizeof(*idx));
 
 	namelen = strlen(packname);
 	idx->pack = git__malloc(sizeof(struct git_pack_file) + namelen + 1);
 	if (idx->pack == NULL) {
-		error = GIT_ENOMEM;
-		goto cleanup;
+		git__free(idx);
+		return NULL;
 	}
 
 	memset(idx->pack, 0x0, sizeof(struct git_pack_file));
+	git_pack_cache_init(&idx->pack->bases);
 	memcpy(idx->pack->pack_name, packname, namelen + 1);
+	idx->pack->mwf.fd = -1;
+
+	return idx;
+}
+
+int git_indexer_new(git_indexer **out, const char *packname)
+{
+	git_indexer *idx;
+	int ret, error;
+
+	assert(out && packname);
+
+	if (git_path_root(packname) < 0)
+		return git__throw(GIT_EINVALIDPATH, "Path is not absolute");
+
+	if ((idx = indexer_alloc(packname)) == NULL)
+		return GIT_ENOMEM;
 
 	ret = p_stat(packname, &idx->st);
 	if (ret < 0) {
@@ -133,11 +177,6 @@ int git_indexer_new(git_indexer **out, const char *packname)
 
 	idx->nr_objects = ntohl(idx->hdr.hdr_entries);
 
-	error = git_vector_init(&idx->pack->cache, idx->nr_objects, cache_cmp);
-	if (error < GIT_SUCCESS)
-		goto cleanup;
-
-	idx->pack->has_cache = 1;
 	error = git_vector_init(&idx->objects, idx->nr_objects, objects_cmp);
 	if (error < GIT_SUCCESS)
 		goto cleanup;
@@ -152,9 +191,9 @@ cleanup:
 	return error;
 }
 
-static int index_path(git_buf *path, git_indexer *idx)
+static int index_path(git_buf *path, git_indexer *idx, const char *suffix)
 {
-	const char prefix[] = "pack-", suffix[] = ".idx";
+	const char prefix[] = "pack-";
 	size_t slash = (size_t)path->size;
 
 	/* search backwards for '/' */
@@ -174,6 +213,21 @@ static int index_path(git_buf *path, git_indexer *idx)
 	return git_buf_lasterror(path);
 }
 
+/* The name of the pack is the hash of all the sorted object names */
+static void hash_objects(git_indexer *idx)
+{
+	struct entry *entry;
+	unsigned int i;
+	SHA_CTX ctx;
+
+	git_vector_sort(&idx->objects);
+
+	SHA1_Init(&ctx);
+	git_vector_foreach(&idx->objects, i, entry)
+		SHA1_Update(&ctx, &entry->oid, GIT_OID_RAWSZ);
+	SHA1_Final(idx->hash.id, &ctx);
+}
+
 int git_indexer_write(git_indexer *idx)
 {
 	git_mwindow *w = NULL;
@@ -184,15 +238,11 @@ int git_indexer_write(git_indexer *idx)
 	struct entry *entry;
 	void *packfile_hash;
 	git_oid file_hash;
-	SHA_CTX ctx;
 
-	git_vector_sort(&idx->objects);
+	hash_objects(idx);
 
 	git_buf_sets(&filename, idx->pack->pack_name);
-	git_buf_truncate(&filename, filename.size - strlen("pack"));
-	git_buf_puts(&filename, "idx");
-
-	if ((error = git_buf_lasterror(&filename)) < GIT_SUCCESS)
+	if ((error = index_path(&filename, idx, ".idx")) < GIT_SUCCESS)
 		goto cleanup;
 
 	error = git_filebuf_open(&idx->file, filename.ptr, GIT_FILEBUF_HASH_CONTENTS);
@@ -215,14 +265,11 @@ int git_indexer_write(git_indexer *idx)
 	}
 
 	/* Write out the object names (SHA-1 hashes) */
-	SHA1_Init(&ctx);
 	git_vector_foreach(&idx->objects, i, entry) {
 		error = git_filebuf_write(&idx->file, &entry->oid, sizeof(git_oid));
-		SHA1_Update(&ctx, &entry->oid, GIT_OID_RAWSZ);
 		if (error < GIT_SUCCESS)
 			goto cleanup;
 	}
-	SHA1_Final(idx->hash.id, &ctx);
 
 	/* Write out the CRC32 values */
 	git_vector_foreach(&idx->objects, i, entry) {
@@ -262,7 +309,7 @@ int git_indexer_write(git_indexer *idx)
 
 	/* Write out the packfile trailer */
 
-	packfile_hash = git_mwindow_open(&idx->pack->mwf, &w, idx->st.st_size - GIT_OID_RAWSZ, GIT_OID_RAWSZ, &left);
+	packfile_hash = git_mwindow_open(&idx->pack->mwf, &w, idx->pack->mwf.size - GIT_OID_RAWSZ, GIT_OID_RAWSZ, &left);
 	git_mwindow_close(&w);
 	if (packfile_hash == NULL) {
 		error = git__rethrow(GIT_ENOMEM, "Failed to open window to packfile hash");
@@ -284,13 +331,8 @@ int git_indexer_write(git_indexer *idx)
 	if (error < GIT_SUCCESS)
 		goto cleanup;
 
-	/* Figure out what the final name should be */
-	error = index_path(&filename, idx);
-	if (error < GIT_SUCCESS)
-		goto cleanup;
-
 	/* Commit file */
-	error = git_filebuf_commit_at(&idx->file, filename.ptr, GIT_PACK_FILE_MODE);
+	error = git_filebuf_commit(&idx->file, GIT_PACK_FILE_MODE);
 
 cleanup:
 	git_mwindow_free_all(&idx->pack->mwf);
@@ -301,36 +343,122 @@ cleanup:
 	return error;
 }
 
-int git_indexer_run(git_indexer *idx, git_indexer_stats *stats)
+void git_indexer_set_threads(git_indexer *idx, unsigned int threads)
 {
-	git_mwindow_file *mwf;
-	off_t off = sizeof(struct git_pack_header);
-	int error;
-	struct entry *entry;
-	unsigned int left, processed;
+	assert(idx);
+	idx->threads = threads;
+}
 
-	assert(idx && stats);
+GIT_INLINE(off_t) entry_offset(const struct entry *e)
+{
+	return e->offset == UINT32_MAX ? (off_t)e->offset_long : (off_t)e->offset;
+}
 
-	mwf = &idx->pack->mwf;
-	error = git_mwindow_file_register(mwf);
-	if (error < GIT_SUCCESS)
-		return git__rethrow(error, "Failed to register mwindow file");
+static int ofs_delta_cmp(const void *a, const void *b)
+{
+	const struct entry *ea = a, *eb = b;
 
-	stats->total = idx->nr_objects;
-	stats->processed = processed = 0;
+	if (ea->base_offset < eb->base_offset)
+		return -1;
+	return ea->base_offset > eb->base_offset;
+}
+
+static int ref_delta_cmp(const void *a, const void *b)
+{
+	const struct entry *ea = a, *eb = b;
+	return git_oid_cmp(&ea->base_oid, &eb->base_oid);
+}
+
+/*
+ * Inflate the data of an entry starting at `*curpos`, leaving
+ * `*curpos` right after the compressed stream.
+ */
+static int inflate_entry(
+		git_rawobj *obj,
+		git_mwindow_file *mwf,
+		off_t *curpos,
+		size_t size,
+		git_otype type)
+{
+	git_mwindow *w = NULL;
+	z_stream stream;
+	unsigned char *buffer, *in;
+	unsigned int left;
+	int st;
+
+	buffer = git__malloc(size + 1);
+	if (buffer == NULL)
+		return GIT_ENOMEM;
+
+	memset(&stream, 0x0, sizeof(stream));
+	stream.next_out = buffer;
+	stream.avail_out = (uInt)size + 1;
+
+	if (inflateInit(&stream) != Z_OK) {
+		git__free(buffer);
+		return git__throw(GIT_EZLIB, "Failed to inflate object. Error in zlib");
+	}
+
+	do {
+		in = git_mwindow_open(mwf, &w, *curpos, GIT_OID_RAWSZ, &left);
+		if (in == NULL) {
+			st = Z_DATA_ERROR;
+			break;
+		}
+
+		stream.next_in = in;
+		stream.avail_in = left;
+		st = inflate(&stream, Z_FINISH);
+		*curpos += stream.next_in - in;
+
+		if (!stream.avail_out)
+			break; /* the payload is larger than it should be */
+	} while (st == Z_OK || st == Z_BUF_ERROR);
+
+	git_mwindow_close(&w);
+	inflateEnd(&stream);
+
+	if (st != Z_STREAM_END || stream.total_out != size) {
+		git__free(buffer);
+		return git__throw(GIT_EZLIB, "Failed to inflate object. Error in zlib");
+	}
+
+	buffer[size] = '\0';
+	obj->type = type;
+	obj->len = size;
+	obj->data = buffer;
+	return GIT_SUCCESS;
+}
+
+/*
+ * First pass: walk the pack, recording where each object is and
+ * what its delta base is. Non-delta objects are hashed right away;
+ * deltas are only inflated to find out where they end.
+ */
+static int parse_objects(git_indexer *idx, git_indexer_stats *stats)
+{
+	git_mwindow_file *mwf = &idx->pack->mwf;
+	off_t off = sizeof(struct git_pack_header);
+	size_t processed;
+	int error = GIT_SUCCESS;
 
-	while (processed < idx->nr_objects) {
+	for (processed = 0; processed < idx->nr_objects; ++processed) {
 		git_rawobj obj;
-		git_oid oid;
-		struct git_pack_entry *pentry;
 		git_mwindow *w = NULL;
-		int i;
 		off_t entry_start = off;
-		void *packed;
+		unsigned char *packed;
+		unsigned int left;
 		size_t entry_size;
+		struct entry *entry;
+
+		entry = git__calloc(1, sizeof(struct entry));
+		if (entry == NULL)
+			return GIT_ENOMEM;
 
-		entry = git__malloc(sizeof(struct entry));
-		memset(entry, 0x0, sizeof(struct entry));
+		if ((error = git_vector_insert(&idx->objects, entry)) < GIT_SUCCESS) {
+			git__free(entry);
+			return git__rethrow(error, "Failed to add entry to list");
+		}
 
 		if (off > UINT31_MAX) {
 			entry->offset = UINT32_MAX;
@@ -339,82 +467,1161 @@ int git_indexer_run(git_indexer *idx, git_indexer_stats *stats)
 			entry->offset = off;
 		}
 
-		error = git_packfile_unpack(&obj, idx->pack, &off);
+		error = git_packfile_unpack_header(&entry->size, &entry->type, mwf, &w, &off);
 		if (error < GIT_SUCCESS) {
-			error = git__rethrow(error, "Failed to unpack object");
-			goto cleanup;
+			git_mwindow_close(&w);
+			return git__rethrow(error, "Failed to unpack object header");
 		}
 
-		/* FIXME: Parse the object instead of hashing it */
-		error = git_odb__hashobj(&oid, &obj);
-		if (error < GIT_SUCCESS) {
-			error = git__rethrow(error, "Failed to hash object");
-			goto cleanup;
+		if (entry->type == GIT_OBJ_OFS_DELTA) {
+			entry->base_offset = get_delta_base(idx->pack, &w, &off, entry->type, entry_start);
+			if (entry->base_offset <= 0)
+				error = git__throw(GIT_EOBJCORRUPTED, "Failed to parse delta. Invalid base offset");
+		} else if (entry->type == GIT_OBJ_REF_DELTA) {
+			packed = git_mwindow_open(mwf, &w, off, GIT_OID_RAWSZ, &left);
+			if (packed == NULL || left < GIT_OID_RAWSZ) {
+				error = git__throw(GIT_EOBJCORRUPTED, "Failed to parse delta. Missing base");
+			} else {
+				git_oid_fromraw(&entry->base_oid, packed);
+				off += GIT_OID_RAWSZ;
+			}
 		}
 
-		pentry = git__malloc(sizeof(struct git_pack_entry));
-		if (pentry == NULL) {
-			error = GIT_ENOMEM;
-			goto cleanup;
-		}
-		git_oid_cpy(&pentry->sha1, &oid);
-		pentry->offset = entry_start;
-		error = git_vector_insert(&idx->pack->cache, pentry);
+		git_mwindow_close(&w);
 		if (error < GIT_SUCCESS)
-			goto cleanup;
+			return error;
+
+		entry->data_offset = off;
+
+		error = inflate_entry(&obj, mwf, &off, entry->size, entry->type);
+		if (error < GIT_SUCCESS)
+			return git__rethrow(error, "Failed to unpack object");
+
+		if (entry->type == GIT_OBJ_OFS_DELTA || entry->type == GIT_OBJ_REF_DELTA) {
+			/* we'll come back to it once its base is known */
+			git__free(obj.data);
+		} else {
+			/* FIXME: Parse the object instead of hashing it */
+			error = git_odb__hashobj(&entry->oid, &obj);
+			git__free(obj.data);
 
-		git_oid_cpy(&entry->oid, &oid);
-		entry->crc = crc32(0L, Z_NULL, 0);
+			if (error < GIT_SUCCESS)
+				return git__rethrow(error, "Failed to hash object");
+
+			stats->processed++;
+		}
 
 		entry_size = off - entry_start;
 		packed = git_mwindow_open(mwf, &w, entry_start, entry_size, &left);
-		if (packed == NULL) {
-			error = git__rethrow(error, "Failed to open window to read packed data");
-			goto cleanup;
-		}
-		entry->crc = htonl(crc32(entry->crc, packed, entry_size));
+		if (packed == NULL)
+			return git__throw(GIT_ENOMEM, "Failed to open window to read packed data");
+
+		entry->crc = htonl(crc32(crc32(0L, Z_NULL, 0), packed, entry_size));
 		git_mwindow_close(&w);
+	}
 
-		/* Add the object to the list */
-		error = git_vector_insert(&idx->objects, entry);
-		if (error < GIT_SUCCESS) {
-			error = git__rethrow(error, "Failed to add entry to list");
-			goto cleanup;
+	return GIT_SUCCESS;
+}
+
+static int sort_deltas(git_indexer *idx)
+{
+	unsigned int i;
+	struct entry *entry;
+
+	idx->ofs_deltas = git__malloc(idx->nr_objects * sizeof(struct entry *));
+	idx->ref_deltas = git__malloc(idx->nr_objects * sizeof(struct entry *));
+	if (idx->nr_objects && (idx->ofs_deltas == NULL || idx->ref_deltas == NULL))
+		return GIT_ENOMEM;
+
+	git_vector_foreach(&idx->objects, i, entry) {
+		if (entry->type == GIT_OBJ_OFS_DELTA)
+			idx->ofs_deltas[idx->nr_ofs_deltas++] = entry;
+		else if (entry->type == GIT_OBJ_REF_DELTA)
+			idx->ref_deltas[idx->nr_ref_deltas++] = entry;
+	}
+
+	git__tsort((void **)idx->ofs_deltas, idx->nr_ofs_deltas, ofs_delta_cmp);
+	git__tsort((void **)idx->ref_deltas, idx->nr_ref_deltas, ref_delta_cmp);
+
+	return GIT_SUCCESS;
+}
+
+/* Index of the first delta in `deltas` which is not smaller than `key` */
+static size_t find_deltas(
+		struct entry **deltas,
+		size_t nr,
+		const struct entry *key,
+		int (*cmp)(const void *, const void *))
+{
+	size_t lo = 0, hi = nr;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (cmp(deltas[mid], key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void count_processed(struct resolve_ctx *ctx)
+{
+	unsigned int processed = (unsigned int)git_atomic_inc(&ctx->processed);
+
+	/* the threads may get here out of order */
+	git_mutex_lock(&ctx->lock);
+	if (processed > ctx->stats->processed)
+		ctx->stats->processed = processed;
+	git_mutex_unlock(&ctx->lock);
+}
+
+/* Whether a thread failed already, for the others to stop */
+static int resolve_failed(struct resolve_ctx *ctx)
+{
+	int failed;
+
+	git_mutex_lock(&ctx->lock);
+	failed = (ctx->error < GIT_SUCCESS);
+	git_mutex_unlock(&ctx->lock);
+
+	return failed;
+}
+
+/*
+ * An inflated base, and the deltas on top of it which are left to
+ * resolve: `ofs_deltas[ofs_next]` up to `ofs_end`, then the same
+ * in `ref_deltas`.
+ */
+struct resolve_frame {
+	git_rawobj obj;
+	/* whether `obj.data` is ours to free */
+	int owned;
+	size_t ofs_next, ofs_end;
+	size_t ref_next, ref_end;
+};
+
+#define RESOLVE_STACK_PREALLOC 16
+
+struct resolve_stack {
+	struct resolve_frame *frames;
+	size_t length, alloc;
+	struct resolve_frame prealloc[RESOLVE_STACK_PREALLOC];
+};
+
+static struct resolve_frame *resolve_stack_push(struct resolve_stack *stack)
+{
+	if (stack->length == stack->alloc) {
+		size_t new_alloc = stack->alloc * 2;
+		struct resolve_frame *frames;
+
+		if (stack->frames == stack->prealloc) {
+			frames = git__malloc(new_alloc * sizeof(struct resolve_frame));
+			if (frames != NULL)
+				memcpy(frames, stack->prealloc, sizeof(stack->prealloc));
+		} else
+			frames = git__realloc(stack->frames, new_alloc * sizeof(struct resolve_frame));
+
+		if (frames == NULL)
+			return NULL;
+
+		stack->frames = frames;
+		stack->alloc = new_alloc;
+	}
+
+	return &stack->frames[stack->length++];
+}
+
+static void resolve_frame_free(struct resolve_frame *frame)
+{
+	if (frame->owned)
+		git__free(frame->obj.data);
+	frame->obj.data = NULL;
+}
+
+/* Find the deltas on top of `base`; returns whether there are any */
+static int find_children(git_indexer *idx, const struct entry *base, struct resolve_frame *frame)
+{
+	struct entry key;
+
+	key.base_offset = entry_offset(base);
+	frame->ofs_next = find_deltas(idx->ofs_deltas, idx->nr_ofs_deltas, &key, ofs_delta_cmp);
+	frame->ofs_end = frame->ofs_next;
+	while (frame->ofs_end < idx->nr_ofs_deltas &&
+		idx->ofs_deltas[frame->ofs_end]->base_offset == key.base_offset)
+		frame->ofs_end++;
+
+	git_oid_cpy(&key.base_oid, &base->oid);
+	frame->ref_next = find_deltas(idx->ref_deltas, idx->nr_ref_deltas, &key, ref_delta_cmp);
+	frame->ref_end = frame->ref_next;
+	while (frame->ref_end < idx->nr_ref_deltas &&
+		!git_oid_cmp(&idx->ref_deltas[frame->ref_end]->base_oid, &key.base_oid))
+		frame->ref_end++;
+
+	return frame->ofs_next < frame->ofs_end || frame->ref_next < frame->ref_end;
+}
+
+/* Apply the delta stored in `entry` on top of `base` */
+static int apply_delta(
+		git_rawobj *obj,
+		git_mwindow_file *mwf,
+		const struct entry *entry,
+		const git_rawobj *base)
+{
+	git_rawobj delta;
+	off_t pos = entry->data_offset;
+	int error;
+
+	if ((error = inflate_entry(&delta, mwf, &pos, entry->size, entry->type)) < GIT_SUCCESS)
+		return error;
+
+	error = git__delta_apply(obj, base->data, base->len, delta.data, delta.len);
+	git__free(delta.data);
+
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to apply delta");
+
+	obj->type = base->type;
+	return GIT_SUCCESS;
+}
+
+/*
+ * Resolve the whole tree of deltas hanging from `root`, a base
+ * with deltas on top of it (see `find_children()`), which we take
+ * over.
+ *
+ * The tree is walked depth-first without recursing. Each base is
+ * freed as soon as its last delta has been applied, before going
+ * down into that delta's own deltas: only the bases with deltas
+ * still left to resolve are kept, so a chain holds on to a single
+ * one at a time, however long it is.
+ */
+static int resolve_deltas(
+		struct resolve_ctx *ctx,
+		git_mwindow_file *mwf,
+		struct resolve_frame *root)
+{
+	git_indexer *idx = ctx->idx;
+	struct resolve_stack stack;
+	struct resolve_frame *top, child;
+	int error = GIT_SUCCESS;
+
+	stack.frames = stack.prealloc;
+	stack.alloc = RESOLVE_STACK_PREALLOC;
+	stack.frames[0] = *root;
+	stack.length = 1;
+
+	while (stack.length > 0) {
+		struct entry *delta;
+
+		top = &stack.frames[stack.length - 1];
+		if (top->ofs_next < top->ofs_end)
+			delta = idx->ofs_deltas[top->ofs_next++];
+		else
+			delta = idx->ref_deltas[top->ref_next++];
+
+		error = apply_delta(&child.obj, mwf, delta, &top->obj);
+
+		if (top->ofs_next == top->ofs_end && top->ref_next == top->ref_end) {
+			resolve_frame_free(top);
+			stack.length--;
+		}
+
+		if (error < GIT_SUCCESS)
+			break;
+
+		if ((error = git_odb__hashobj(&delta->oid, &child.obj)) < GIT_SUCCESS) {
+			git__free(child.obj.data);
+			break;
 		}
 
-		for (i = oid.id[0]; i < 256; ++i) {
-			idx->fanout[i]++;
+		count_processed(ctx);
+
+		if (!find_children(idx, delta, &child)) {
+			git__free(child.obj.data);
+			continue;
 		}
 
-		git__free(obj.data);
+		if ((top = resolve_stack_push(&stack)) == NULL) {
+			git__free(child.obj.data);
+			error = GIT_ENOMEM;
+			break;
+		}
 
-		stats->processed = ++processed;
+		child.owned = 1;
+		*top = child;
 	}
 
-cleanup:
-	git_mwindow_free_all(mwf);
+	while (stack.length > 0)
+		resolve_frame_free(&stack.frames[--stack.length]);
+
+	if (stack.frames != stack.prealloc)
+		git__free(stack.frames);
 
 	return error;
+}
 
+static void *resolve_worker(void *data)
+{
+	struct resolve_ctx *ctx = data;
+	git_indexer *idx = ctx->idx;
+	git_mwindow_file mwf;
+	int error = GIT_SUCCESS;
+
+	/* each thread maps its own windows of the packfile */
+	memset(&mwf, 0x0, sizeof(mwf));
+	mwf.fd = idx->pack->mwf.fd;
+	mwf.size = idx->pack->mwf.size;
+
+	while (error == GIT_SUCCESS && !resolve_failed(ctx)) {
+		size_t i = (size_t)git_atomic_inc(&ctx->next) - 1;
+		struct entry *base;
+		struct resolve_frame root;
+		off_t pos;
+
+		if (i >= idx->nr_objects)
+			break;
+
+		base = git_vector_get(&idx->objects, i);
+		if (base->type == GIT_OBJ_OFS_DELTA || base->type == GIT_OBJ_REF_DELTA)
+			continue;
+
+		if (!find_children(idx, base, &root))
+			continue;
+
+		pos = base->data_offset;
+		if ((error = inflate_entry(&root.obj, &mwf, &pos, base->size, base->type)) < GIT_SUCCESS)
+			break;
+
+		root.owned = 1;
+		error = resolve_deltas(ctx, &mwf, &root);
+	}
+
+	git_mwindow_free_all(&mwf);
+
+	/*
+	 * The error message is kept per thread; hand it over along
+	 * with the code, for the calling thread to report.
+	 */
+	if (error < GIT_SUCCESS) {
+		git_mutex_lock(&ctx->lock);
+		if (ctx->error == GIT_SUCCESS) {
+			ctx->error = error;
+			strncpy(ctx->message, git_lasterror(), sizeof(ctx->message) - 1);
+		}
+		git_mutex_unlock(&ctx->lock);
+	}
+
+	return NULL;
 }
 
-void git_indexer_free(git_indexer *idx)
+/* Encode a pack object header; `hdr` must have room for 10 bytes */
+static size_t encode_object_header(unsigned char *hdr, size_t size, git_otype type)
 {
-	unsigned int i;
-	struct entry *e;
-	struct git_pack_entry *pe;
+	size_t n = 1;
+	unsigned char c = (unsigned char)((type << 4) | (size & 15));
 
-	if (idx == NULL)
-		return;
+	for (size >>= 4; size; size >>= 7) {
+		*hdr++ = c | 0x80;
+		c = size & 0x7f;
+		n++;
+	}
 
-	p_close(idx->pack->mwf.fd);
-	git_vector_foreach(&idx->objects, i, e)
-		git__free(e);
-	git_vector_free(&idx->objects);
-	git_vector_foreach(&idx->pack->cache, i, pe)
-		git__free(pe);
-	git_vector_free(&idx->pack->cache);
-	git__free(idx->pack);
-	git__free(idx);
+	*hdr = c;
+	return n;
 }
 
+/*
+ * Append `obj` to the pack, over the old trailer, and add it to
+ * the list of objects
+ */
+static int append_object(git_indexer *idx, struct entry **out, const git_oid *oid, git_rawobj *obj)
+{
+	git_mwindow_file *mwf = &idx->pack->mwf;
+	off_t off = mwf->size - GIT_OID_RAWSZ;
+	unsigned char hdr[10];
+	size_t hdr_len;
+	uLongf len;
+	unsigned char *data;
+	struct entry *entry;
+	uLong crc;
+
+	hdr_len = encode_object_header(hdr, obj->len, obj->type);
+
+	len = compressBound((uLong)obj->len);
+	data = git__malloc(len);
+	if (data == NULL)
+		return GIT_ENOMEM;
+
+	if (compress(data, &len, obj->data, (uLong)obj->len) != Z_OK) {
+		git__free(data);
+		return git__throw(GIT_EZLIB, "Failed to deflate object. Error in zlib");
+	}
+
+	if (p_lseek(mwf->fd, off, SEEK_SET) < 0 ||
+		p_write(mwf->fd, hdr, hdr_len) < GIT_SUCCESS ||
+		p_write(mwf->fd, data, len) < GIT_SUCCESS) {
+		git__free(data);
+		return git__throw(GIT_EOSERR, "Failed to append object to the packfile");
+	}
+
+	crc = crc32(crc32(0L, Z_NULL, 0), hdr, hdr_len);
+	crc = crc32(crc, data, len);
+	git__free(data);
+
+	entry = git__calloc(1, sizeof(struct entry));
+	if (entry == NULL)
+		return GIT_ENOMEM;
+
+	if (git_vector_insert(&idx->objects, entry) < GIT_SUCCESS) {
+		git__free(entry);
+		return GIT_ENOMEM;
+	}
+
+	git_oid_cpy(&entry->oid, oid);
+	entry->crc = htonl(crc);
+	if (off > UINT31_MAX) {
+		entry->offset = UINT32_MAX;
+		entry->offset_long = off;
+	} else {
+		entry->offset = (uint32_t)off;
+	}
+	entry->data_offset = off + hdr_len;
+	entry->size = obj->len;
+	entry->type = obj->type;
+
+	idx->nr_objects++;
+	mwf->size = entry->data_offset + len + GIT_OID_RAWSZ;
+
+	*out = entry;
+	return GIT_SUCCESS;
+}
+
+/* Write the new object count and checksum of a completed pack */
+static int rewrite_pack_trailer(git_indexer *idx)
+{
+	git_mwindow_file *mwf = &idx->pack->mwf;
+	struct git_pack_header hdr;
+	unsigned char buf[8192];
+	off_t left = mwf->size - GIT_OID_RAWSZ;
+	git_hash_ctx *ctx;
+	git_oid trailer;
+	int error = GIT_SUCCESS;
+
+	memcpy(&hdr, &idx->hdr, sizeof(hdr));
+	hdr.hdr_entries = htonl((uint32_t)idx->nr_objects);
+
+	if (p_lseek(mwf->fd, 0, SEEK_SET) < 0 ||
+		p_write(mwf->fd, &hdr, sizeof(hdr)) < GIT_SUCCESS ||
+		p_lseek(mwf->fd, 0, SEEK_SET) < 0)
+		return git__throw(GIT_EOSERR, "Failed to update the pack header");
+
+	if ((ctx = git_hash_new_ctx()) == NULL)
+		return GIT_ENOMEM;
+
+	while (left > 0) {
+		size_t n = left > (off_t)sizeof(buf) ? sizeof(buf) : (size_t)left;
+
+		if (p_read(mwf->fd, buf, n) != (int)n) {
+			error = git__throw(GIT_EOSERR, "Failed to read back the packfile");
+			break;
+		}
+
+		git_hash_update(ctx, buf, n);
+		left -= n;
+	}
+
+	git_hash_final(&trailer, ctx);
+	git_hash_free_ctx(ctx);
+
+	if (error == GIT_SUCCESS && p_write(mwf->fd, trailer.id, GIT_OID_RAWSZ) < GIT_SUCCESS)
+		error = git__throw(GIT_EOSERR, "Failed to write the pack trailer");
+
+	return error;
+}
+
+/*
+ * A thin pack has REF_DELTAs against objects the other side knew
+ * we already have. Look those up in the odb and append them to the
+ * pack, so it stands on its own once it's on disk, and resolve the
+ * deltas on top of them as usual.
+ */
+static int fix_thin_pack(struct resolve_ctx *ctx)
+{
+	git_indexer *idx = ctx->idx;
+	size_t i, appended = 0;
+	int error = GIT_SUCCESS;
+
+	for (i = 0; i < idx->nr_ref_deltas && error == GIT_SUCCESS; ++i) {
+		struct entry *delta = idx->ref_deltas[i], *base;
+		git_odb_object *obj;
+
+		/* resolving a base takes care of all the deltas on it */
+		if (!git_oid_iszero(&delta->oid) ||
+			(i > 0 && !git_oid_cmp(&delta->base_oid, &idx->ref_deltas[i - 1]->base_oid)))
+			continue;
+
+		/* if we don't have it either, we complain below */
+		if (!git_odb_exists(idx->odb, &delta->base_oid))
+			continue;
+
+		if ((error = git_odb_read(&obj, idx->odb, &delta->base_oid)) < GIT_SUCCESS)
+			break;
+
+		error = append_object(idx, &base, &delta->base_oid, &obj->raw);
+		if (error == GIT_SUCCESS) {
+			struct resolve_frame root;
+
+			appended++;
+			ctx->stats->total = (unsigned int)idx->nr_objects;
+			count_processed(ctx);
+
+			/* the object keeps the data */
+			if (find_children(idx, base, &root)) {
+				root.obj = obj->raw;
+				root.owned = 0;
+				error = resolve_deltas(ctx, &idx->pack->mwf, &root);
+			}
+		}
+
+		git_odb_object_free(obj);
+	}
+
+	if (error == GIT_SUCCESS && appended > 0)
+		error = rewrite_pack_trailer(idx);
+
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to complete thin pack");
+
+	return GIT_SUCCESS;
+}
+
+/*
+ * Second pass: resolve the delta trees hanging from every base
+ * object, in parallel when we can.
+ */
+static int resolve_objects(git_indexer *idx, git_indexer_stats *stats)
+{
+	struct resolve_ctx ctx;
+
+	memset(&ctx, 0x0, sizeof(ctx));
+	ctx.idx = idx;
+	ctx.stats = stats;
+	git_atomic_set(&ctx.processed, (int)stats->processed);
+	git_mutex_init(&ctx.lock);
+
+#ifdef GIT_THREADS
+	{
+		unsigned int i, started, threads;
+		git_thread *workers;
+
+		threads = idx->threads ? idx->threads : (unsigned int)git_online_cpus();
+
+		workers = git__malloc(threads * sizeof(git_thread));
+		if (workers == NULL) {
+			git_mutex_free(&ctx.lock);
+			return GIT_ENOMEM;
+		}
+
+		/* the calling thread is one of the workers */
+		for (started = 0; started + 1 < threads; ++started) {
+			if (git_thread_create(&workers[started], NULL, resolve_worker, &ctx) != 0)
+				break;
+		}
+
+		resolve_worker(&ctx);
+
+		for (i = 0; i < started; ++i)
+			git_thread_join(workers[i], NULL);
+
+		git__free(workers);
+	}
+#else
+	resolve_worker(&ctx);
+#endif
+
+	if (ctx.error < GIT_SUCCESS)
+		git__throw(ctx.error, "%s", ctx.message);
+	else if (idx->odb != NULL && (size_t)ctx.processed.val != idx->nr_objects)
+		ctx.error = fix_thin_pack(&ctx);
+
+	git_mutex_free(&ctx.lock);
+
+	if (ctx.error < GIT_SUCCESS)
+		return git__rethrow(ctx.error, "Failed to resolve deltas");
+
+	stats->processed = (unsigned int)ctx.processed.val;
+	if (stats->processed != idx->nr_objects)
+		return git__throw(GIT_EOBJCORRUPTED, "Failed to resolve deltas. %u objects have no base in the pack",
+			(unsigned int)idx->nr_objects - stats->processed);
+
+	return GIT_SUCCESS;
+}
+
+/* Once all the objects are known, resolve the deltas and fill the fanout */
+static int index_objects(git_indexer *idx, git_indexer_stats *stats)
+{
+	struct entry *entry;
+	unsigned int i;
+	int error, j;
+
+	if ((error = sort_deltas(idx)) < GIT_SUCCESS ||
+		(error = resolve_objects(idx, stats)) < GIT_SUCCESS)
+		return error;
+
+	git_vector_foreach(&idx->objects, i, entry) {
+		for (j = entry->oid.id[0]; j < 256; ++j)
+			idx->fanout[j]++;
+	}
+
+	return GIT_SUCCESS;
+}
+
+int git_indexer_run(git_indexer *idx, git_indexer_stats *stats)
+{
+	git_mwindow_file *mwf;
+	int error;
+
+	assert(idx && stats);
+
+	mwf = &idx->pack->mwf;
+	error = git_mwindow_file_register(mwf);
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to register mwindow file");
+
+	stats->total = idx->nr_objects;
+	stats->processed = 0;
+
+	if ((error = parse_objects(idx, stats)) == GIT_SUCCESS)
+		error = index_objects(idx, stats);
+
+	git_mwindow_free_all(mwf);
+
+	return error;
+}
+
+void git_indexer_free(git_indexer *idx)
+{
+	unsigned int i;
+	struct entry *e;
+
+	if (idx == NULL)
+		return;
+
+	if (idx->pack->mwf.fd >= 0)
+		p_close(idx->pack->mwf.fd);
+	git_vector_foreach(&idx->objects, i, e)
+		git__free(e);
+	git_vector_free(&idx->objects);
+	git__free(idx->ofs_deltas);
+	git__free(idx->ref_deltas);
+	git_pack_cache_free(&idx->pack->bases);
+	git__free(idx->pack);
+	git__free(idx);
+}
+
+
+/***********************************************************
+ *
+ * STREAMING INDEXER
+ *
+ ***********************************************************/
+
+typedef enum {
+	STREAM_PACK_HEADER,
+	STREAM_OBJECT_HEADER,
+	STREAM_OBJECT_DATA,
+	STREAM_TRAILER,
+	STREAM_DONE,
+} stream_state;
+
+/*
+ * Longest object header: a 64-bit size is 10 bytes, plus the
+ * base reference, which takes 20 bytes at most
+ */
+#define STREAM_HEADER_MAX 32
+
+struct git_indexer_stream {
+	git_indexer *idx;
+	git_buf path;
+
+	stream_state state;
+	off_t off;
+	size_t parsed;
+	/* objects we could hash on arrival, i.e. everything but deltas */
+	unsigned int processed;
+
+	/* bytes of a header or the trailer which we can't parse yet */
+	unsigned char buf[STREAM_HEADER_MAX];
+	size_t buf_len;
+
+	git_hash_ctx *pack_ctx;
+
+	/* the object being received */
+	struct entry *entry;
+	z_stream zstream;
+	git_hash_ctx *obj_ctx;
+	uLong crc;
+	unsigned char inflated[8192];
+
+	unsigned finalized:1;
+};
+
+int git_indexer_stream_new(git_indexer_stream **out, const char *path)
+{
+	git_indexer_stream *s;
+	git_buf tmp = GIT_BUF_INIT;
+	int fd, error;
+
+	assert(out && path);
+
+	if ((error = git_buf_joinpath(&tmp, path, "pack_received")) < GIT_SUCCESS)
+		return error;
+
+	s = git__calloc(1, sizeof(git_indexer_stream));
+	if (s == NULL) {
+		git_buf_free(&tmp);
+		return GIT_ENOMEM;
+	}
+
+	fd = git_futils_mktmp(&s->path, tmp.ptr);
+	git_buf_free(&tmp);
+
+	if (fd < 0) {
+		git_buf_free(&s->path);
+		git__free(s);
+		return git__rethrow(fd, "Failed to create the packfile");
+	}
+
+	s->idx = indexer_alloc(s->path.ptr);
+	s->pack_ctx = git_hash_new_ctx();
+	s->obj_ctx = git_hash_new_ctx();
+
+	if (s->idx == NULL || s->pack_ctx == NULL || s->obj_ctx == NULL) {
+		p_close(fd);
+		git_indexer_stream_free(s);
+		return GIT_ENOMEM;
+	}
+
+	s->idx->pack->mwf.fd = fd;
+	s->state = STREAM_PACK_HEADER;
+
+	*out = s;
+	return GIT_SUCCESS;
+}
+
+void git_indexer_stream_set_threads(git_indexer_stream *s, unsigned int threads)
+{
+	assert(s);
+	git_indexer_set_threads(s->idx, threads);
+}
+
+void git_indexer_stream_set_odb(git_indexer_stream *s, git_odb *odb)
+{
+	assert(s);
+	s->idx->odb = odb;
+}
+
+const git_oid *git_indexer_stream_hash(git_indexer_stream *s)
+{
+	return git_indexer_hash(s->idx);
+}
+
+/*
+ * Move up to `len` bytes into the buffer until it holds `want` of
+ * them; returns how many bytes were taken
+ */
+static size_t stream_buffer(git_indexer_stream *s, const unsigned char *data, size_t len, size_t want)
+{
+	size_t n = want - s->buf_len;
+
+	if (n > len)
+		n = len;
+
+	memcpy(s->buf + s->buf_len, data, n);
+	s->buf_len += n;
+	return n;
+}
+
+static int stream_pack_header(
+		git_indexer_stream *s,
+		const unsigned char *data,
+		size_t len,
+		size_t *used,
+		git_indexer_stats *stats)
+{
+	git_indexer *idx = s->idx;
+
+	*used = stream_buffer(s, data, len, sizeof(struct git_pack_header));
+	if (s->buf_len < sizeof(struct git_pack_header))
+		return GIT_SUCCESS;
+
+	memcpy(&idx->hdr, s->buf, sizeof(struct git_pack_header));
+
+	if (idx->hdr.hdr_signature != ntohl(PACK_SIGNATURE))
+		return git__throw(GIT_EOBJCORRUPTED, "Wrong pack signature");
+
+	if (!pack_version_ok(idx->hdr.hdr_version))
+		return git__throw(GIT_EOBJCORRUPTED, "Wrong pack version");
+
+	idx->nr_objects = ntohl(idx->hdr.hdr_entries);
+	if (git_vector_init(&idx->objects, idx->nr_objects, objects_cmp) < GIT_SUCCESS)
+		return GIT_ENOMEM;
+
+	git_hash_update(s->pack_ctx, s->buf, s->buf_len);
+	s->off += s->buf_len;
+	s->buf_len = 0;
+
+	stats->total = idx->nr_objects;
+	stats->processed = 0;
+	s->state = idx->nr_objects ? STREAM_OBJECT_HEADER : STREAM_TRAILER;
+	return GIT_SUCCESS;
+}
+
+/*
+ * Parse the header of the object at `offset`; returns its length,
+ * or 0 if we need more bytes to tell
+ */
+static int parse_object_header(struct entry *entry, const unsigned char *buf, size_t len, off_t offset)
+{
+	size_t used = 0, size;
+	unsigned shift;
+	unsigned char c;
+
+	c = buf[used++];
+	entry->type = (c >> 4) & 7;
+	size = c & 15;
+	shift = 4;
+
+	while (c & 0x80) {
+		if (used == len)
+			return 0;
+		if (bitsizeof(size_t) <= shift)
+			return git__throw(GIT_EOBJCORRUPTED, "Object header is too long");
+
+		c = buf[used++];
+		size += (size_t)(c & 0x7f) << shift;
+		shift += 7;
+	}
+
+	entry->size = size;
+
+	switch (entry->type) {
+	case GIT_OBJ_COMMIT:
+	case GIT_OBJ_TREE:
+	case GIT_OBJ_BLOB:
+	case GIT_OBJ_TAG:
+		break;
+
+	case GIT_OBJ_OFS_DELTA: {
+		off_t base;
+
+		if (used == len)
+			return 0;
+
+		c = buf[used++];
+		base = c & 127;
+		while (c & 128) {
+			if (used == len)
+				return 0;
+			base += 1;
+			if (!base || MSB(base, 7))
+				return git__throw(GIT_EOBJCORRUPTED, "Delta base offset overflow");
+			c = buf[used++];
+			base = (base << 7) + (c & 127);
+		}
+
+		entry->base_offset = offset - base;
+		if (entry->base_offset <= 0 || entry->base_offset >= offset)
+			return git__throw(GIT_EOBJCORRUPTED, "Delta base offset is out of bounds");
+		break;
+	}
+
+	case GIT_OBJ_REF_DELTA:
+		if (len - used < GIT_OID_RAWSZ)
+			return 0;
+
+		git_oid_fromraw(&entry->base_oid, buf + used);
+		used += GIT_OID_RAWSZ;
+		break;
+
+	default:
+		return git__throw(GIT_EOBJCORRUPTED, "Invalid object type");
+	}
+
+	return (int)used;
+}
+
+static int stream_object_header(
+		git_indexer_stream *s,
+		const unsigned char *data,
+		size_t len,
+		size_t *used)
+{
+	git_indexer *idx = s->idx;
+	struct entry *entry;
+	size_t buffered = s->buf_len;
+	char hdr[64];
+	int n, hdr_len;
+
+	*used = stream_buffer(s, data, len, STREAM_HEADER_MAX);
+
+	entry = git__calloc(1, sizeof(struct entry));
+	if (entry == NULL)
+		return GIT_ENOMEM;
+
+	n = parse_object_header(entry, s->buf, s->buf_len, s->off);
+	if (n <= 0) {
+		git__free(entry);
+
+		if (n == 0 && s->buf_len == STREAM_HEADER_MAX)
+			return git__throw(GIT_EOBJCORRUPTED, "Object header is too long");
+
+		return n;
+	}
+
+	/* hand back what we took beyond the end of the header */
+	*used = (size_t)n - buffered;
+
+	if (git_vector_insert(&idx->objects, entry) < GIT_SUCCESS) {
+		git__free(entry);
+		return GIT_ENOMEM;
+	}
+
+	if (s->off > UINT31_MAX) {
+		entry->offset = UINT32_MAX;
+		entry->offset_long = s->off;
+	} else {
+		entry->offset = (uint32_t)s->off;
+	}
+
+	s->crc = crc32(crc32(0L, Z_NULL, 0), s->buf, n);
+	git_hash_update(s->pack_ctx, s->buf, n);
+	s->off += n;
+	s->buf_len = 0;
+
+	entry->data_offset = s->off;
+	s->entry = entry;
+
+	memset(&s->zstream, 0x0, sizeof(z_stream));
+	if (inflateInit(&s->zstream) != Z_OK)
+		return git__throw(GIT_EZLIB, "Failed to inflate object. Error in zlib");
+
+	if (entry->type != GIT_OBJ_OFS_DELTA && entry->type != GIT_OBJ_REF_DELTA) {
+		if ((hdr_len = git_odb__format_object_header(hdr, sizeof(hdr), entry->size, entry->type)) < 0)
+			return hdr_len;
+
+		git_hash_init(s->obj_ctx);
+		git_hash_update(s->obj_ctx, hdr, hdr_len);
+	}
+
+	s->state = STREAM_OBJECT_DATA;
+	return GIT_SUCCESS;
+}
+
+static int stream_object_data(
+		git_indexer_stream *s,
+		const unsigned char *data,
+		size_t len,
+		size_t *used,
+		git_indexer_stats *stats)
+{
+	struct entry *entry = s->entry;
+	z_stream *zs = &s->zstream;
+	int is_delta = (entry->type == GIT_OBJ_OFS_DELTA || entry->type == GIT_OBJ_REF_DELTA);
+	int st;
+
+	zs->next_in = (Bytef *)data;
+	zs->avail_in = (uInt)len;
+
+	do {
+		zs->next_out = s->inflated;
+		zs->avail_out = sizeof(s->inflated);
+
+		st = inflate(zs, Z_NO_FLUSH);
+
+		if (st != Z_OK && st != Z_STREAM_END && st != Z_BUF_ERROR)
+			return git__throw(GIT_EZLIB, "Failed to inflate object. Error in zlib");
+
+		if (zs->total_out > entry->size)
+			return git__throw(GIT_EOBJCORRUPTED, "Object is larger than it should be");
+
+		/* deltas are only hashed once we resolve them */
+		if (!is_delta)
+			git_hash_update(s->obj_ctx, s->inflated, sizeof(s->inflated) - zs->avail_out);
+	} while (st != Z_STREAM_END && (zs->avail_in > 0 || zs->avail_out == 0));
+
+	*used = len - zs->avail_in;
+
+	s->crc = crc32(s->crc, data, *used);
+	git_hash_update(s->pack_ctx, data, *used);
+	s->off += *used;
+
+	if (st != Z_STREAM_END)
+		return GIT_SUCCESS;
+
+	inflateEnd(zs);
+
+	if (zs->total_out != entry->size)
+		return git__throw(GIT_EOBJCORRUPTED, "Object is smaller than it should be");
+
+	entry->crc = htonl(s->crc);
+
+	if (!is_delta) {
+		git_hash_final(&entry->oid, s->obj_ctx);
+		stats->processed = ++s->processed;
+	}
+
+	s->entry = NULL;
+	s->state = ++s->parsed < s->idx->nr_objects ? STREAM_OBJECT_HEADER : STREAM_TRAILER;
+	return GIT_SUCCESS;
+}
+
+static int stream_trailer(git_indexer_stream *s, const unsigned char *data, size_t len, size_t *used)
+{
+	git_oid checksum;
+
+	*used = stream_buffer(s, data, len, GIT_OID_RAWSZ);
+	if (s->buf_len < GIT_OID_RAWSZ)
+		return GIT_SUCCESS;
+
+	git_hash_final(&checksum, s->pack_ctx);
+	if (memcmp(checksum.id, s->buf, GIT_OID_RAWSZ) != 0)
+		return git__throw(GIT_EOBJCORRUPTED, "Packfile checksum mismatch");
+
+	s->off += GIT_OID_RAWSZ;
+	s->buf_len = 0;
+	s->state = STREAM_DONE;
+	return GIT_SUCCESS;
+}
+
+int git_indexer_stream_add(git_indexer_stream *s, const void *data, size_t size, git_indexer_stats *stats)
+{
+	const unsigned char *ptr = data;
+	int error = GIT_SUCCESS;
+
+	assert(s && stats);
+
+	if (size == 0)
+		return GIT_SUCCESS;
+
+	/* keep everything; the whole pack is read back once it's complete */
+	if (p_write(s->idx->pack->mwf.fd, data, size) < GIT_SUCCESS)
+		return git__throw(GIT_EOSERR, "Failed to write the packfile");
+
+	while (size > 0 && error == GIT_SUCCESS) {
+		size_t used = 0;
+
+		switch (s->state) {
+		case STREAM_PACK_HEADER:
+			error = stream_pack_header(s, ptr, size, &used, stats);
+			break;
+		case STREAM_OBJECT_HEADER:
+			error = stream_object_header(s, ptr, size, &used);
+			break;
+		case STREAM_OBJECT_DATA:
+			error = stream_object_data(s, ptr, size, &used, stats);
+			break;
+		case STREAM_TRAILER:
+			error = stream_trailer(s, ptr, size, &used);
+			break;
+		default:
+			error = git__throw(GIT_EOBJCORRUPTED, "Unexpected data after the end of the pack");
+			break;
+		}
+
+		ptr += used;
+		size -= used;
+	}
+
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to index the packfile");
+
+	return GIT_SUCCESS;
+}
+
+int git_indexer_stream_finalize(git_indexer_stream *s, git_indexer_stats *stats)
+{
+	git_indexer *idx;
+	git_buf pack_path = GIT_BUF_INIT;
+	int error;
+
+	assert(s && stats);
+
+	idx = s->idx;
+
+	if (s->state != STREAM_DONE)
+		return git__throw(GIT_EOBJCORRUPTED, "Failed to finalize the packfile. The pack is incomplete");
+
+	idx->pack->mwf.size = s->off;
+	stats->total = idx->nr_objects;
+	stats->processed = s->processed;
+
+	if ((error = git_mwindow_file_register(&idx->pack->mwf)) < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to register mwindow file");
+
+	error = index_objects(idx, stats);
+	git_mwindow_free_all(&idx->pack->mwf);
+
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to finalize the packfile");
+
+	/*
+	 * Move the pack in place first, so the index never points to
+	 * nothing. Nothing may have the file open while we rename it on
+	 * Windows, so we open it again afterwards, to read the trailer.
+	 */
+	hash_objects(idx);
+
+	git_buf_sets(&pack_path, s->path.ptr);
+	if ((error = index_path(&pack_path, idx, ".pack")) < GIT_SUCCESS)
+		goto cleanup;
+
+	p_close(idx->pack->mwf.fd);
+	idx->pack->mwf.fd = -1;
+
+	if (p_rename(s->path.ptr, pack_path.ptr) < 0 ||
+		p_chmod(pack_path.ptr, GIT_PACK_FILE_MODE) < 0) {
+		error = git__throw(GIT_EOSERR, "Failed to move the packfile in place");
+		goto cleanup;
+	}
+
+	if ((idx->pack->mwf.fd = p_open(pack_path.ptr, O_RDONLY)) < 0)
+		error = git__throw(GIT_EOSERR, "Failed to open the packfile");
+	else
+		error = git_indexer_write(idx);
+
+	/* a pack without its index is of no use to anybody */
+	if (error < GIT_SUCCESS)
+		p_unlink(pack_path.ptr);
+	else
+		s->finalized = 1;
+
+cleanup:
+	git_buf_free(&pack_path);
+
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to finalize the packfile");
+
+	return GIT_SUCCESS;
+}
+
+void git_indexer_stream_free(git_indexer_stream *s)
+{
+	if (s == NULL)
+		return;
+
+	if (s->state == STREAM_OBJECT_DATA)
+		inflateEnd(&s->zstream);
+
+	if (!s->finalized)
+		p_unlink(s->path.ptr);
+
+	git_indexer_free(s->idx);
+	git_hash_free_ctx(s->pack_ctx);
+	git_hash_free_ctx(s->obj_ctx);
+	git_buf_free(&s->path);
+	git__free(s);
+}
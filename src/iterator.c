@@ -9,6 +9,10 @@
 #include "tree.h"
 #include "ignore.h"
 #include "buffer.h"
+#include "dirscan.h"
+#include "repository.h"
+#include "index.h"
+#include "untracked-cache.h"
 
 typedef struct tree_iterator_frame tree_iterator_frame;
 struct tree_iterator_frame {
@@ -22,7 +26,8 @@ typedef struct {
 	git_repository *repo;
 	tree_iterator_frame *stack;
 	git_index_entry entry;
-	git_buf path;
+	git_buf path; /* of the tree on top of the stack */
+	git_buf entry_path;
 } tree_iterator;
 
 static const git_tree_entry *tree_iterator__tree_entry(tree_iterator *ti)
@@ -45,10 +50,10 @@ static int tree_iterator__current(
 
 	ti->entry.mode = te->attr;
 	git_oid_cpy(&ti->entry.oid, &te->oid);
-	error = git_buf_joinpath(&ti->path, ti->path.ptr, te->filename);
+	error = git_buf_joinpath(&ti->entry_path, ti->path.ptr, te->filename);
 	if (error < GIT_SUCCESS)
 		return error;
-	ti->entry.path = ti->path.ptr;
+	ti->entry.path = ti->entry_path.ptr;
 
 	*entry = &ti->entry;
 
@@ -115,13 +120,11 @@ static int tree_iterator__advance(
 		*entry = NULL;
 
 	while (ti->stack != NULL) {
-		/* remove old entry filename */
-		git_buf_rtruncate_at_char(&ti->path, '/');
-
 		te = git_tree_entry_byindex(ti->stack->tree, ++ti->stack->index);
 		if (te != NULL)
 			break;
 
+		/* remove the name of the tree we're done with */
 		tree_iterator__pop_frame(ti);
 		git_buf_rtruncate_at_char(&ti->path, '/');
 	}
@@ -141,6 +144,7 @@ static void tree_iterator__free(git_iterator *self)
 	while (ti->stack != NULL)
 		tree_iterator__pop_frame(ti);
 	git_buf_free(&ti->path);
+	git_buf_free(&ti->entry_path);
 }
 
 static int tree_iterator__reset(git_iterator *self)
@@ -150,6 +154,7 @@ static int tree_iterator__reset(git_iterator *self)
 		tree_iterator__pop_frame(ti);
 	if (ti->stack)
 		ti->stack->index = 0;
+	git_buf_clear(&ti->path);
 	return tree_iterator__expand_tree(ti);
 }
 
@@ -183,20 +188,30 @@ typedef struct {
 	git_iterator base;
 	git_index *index;
 	unsigned int current;
+	unsigned int first;
+	char *end;
 } index_iterator;
 
+static git_index_entry *index_iterator__entry(index_iterator *ii)
+{
+	git_index_entry *ie = git_index_get(ii->index, ii->current);
+
+	if (ie != NULL && ii->end != NULL && strcmp(ie->path, ii->end) >= 0)
+		return NULL;
+
+	return ie;
+}
+
 static int index_iterator__current(
 	git_iterator *self, const git_index_entry **entry)
 {
-	index_iterator *ii = (index_iterator *)self;
-	*entry = git_index_get(ii->index, ii->current);
+	*entry = index_iterator__entry((index_iterator *)self);
 	return GIT_SUCCESS;
 }
 
 static int index_iterator__at_end(git_iterator *self)
 {
-	index_iterator *ii = (index_iterator *)self;
-	return (ii->current >= git_index_entrycount(ii->index));
+	return (index_iterator__entry((index_iterator *)self) == NULL);
 }
 
 static int index_iterator__advance(
@@ -206,14 +221,14 @@ static int index_iterator__advance(
 	if (ii->current < git_index_entrycount(ii->index))
 		ii->current++;
 	if (entry)
-		*entry = git_index_get(ii->index, ii->current);
+		*entry = index_iterator__entry(ii);
 	return GIT_SUCCESS;
 }
 
 static int index_iterator__reset(git_iterator *self)
 {
 	index_iterator *ii = (index_iterator *)self;
-	ii->current = 0;
+	ii->current = ii->first;
 	return GIT_SUCCESS;
 }
 
@@ -222,9 +237,34 @@ static void index_iterator__free(git_iterator *self)
 	index_iterator *ii = (index_iterator *)self;
 	git_index_free(ii->index);
 	ii->index = NULL;
+	git__free(ii->end);
+}
+
+/* The first entry that isn't before `start` */
+static unsigned int index_iterator__seek(git_index *index, const char *start)
+{
+	unsigned int lo = 0, hi = git_index_entrycount(index);
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (strcmp(git_index_get(index, mid)->path, start) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
 }
 
 int git_iterator_for_index(git_repository *repo, git_iterator **iter)
+{
+	return git_iterator_for_index_range(repo, NULL, NULL, iter);
+}
+
+int git_iterator_for_index_range(
+	git_repository *repo, const char *start, const char *end,
+	git_iterator **iter)
 {
 	int error;
 	index_iterator *ii = git__calloc(1, sizeof(index_iterator));
@@ -237,13 +277,23 @@ int git_iterator_for_index(git_repository *repo, git_iterator **iter)
 	ii->base.advance = index_iterator__advance;
 	ii->base.reset   = index_iterator__reset;
 	ii->base.free    = index_iterator__free;
-	ii->current      = 0;
 
-	if ((error = git_repository_index(&ii->index, repo)) < GIT_SUCCESS)
+	if ((error = git_repository_index(&ii->index, repo)) < GIT_SUCCESS) {
 		git__free(ii);
-	else
-		*iter = (git_iterator *)ii;
-	return error;
+		return error;
+	}
+
+	if (end != NULL && (ii->end = git__strdup(end)) == NULL) {
+		git_iterator_free((git_iterator *)ii);
+		return GIT_ENOMEM;
+	}
+
+	if (start != NULL)
+		ii->first = index_iterator__seek(ii->index, start);
+	ii->current = ii->first;
+
+	*iter = (git_iterator *)ii;
+	return GIT_SUCCESS;
 }
 
 
@@ -252,6 +302,35 @@ struct workdir_iterator_frame {
 	workdir_iterator_frame *next;
 	git_vector entries;
 	unsigned int index;
+
+	/*
+	 * For GIT_ITERATOR_SKIP_IGNORED: whether the directory, or one
+	 * above it, is ignored, and whether the index has nothing in it
+	 */
+	unsigned int in_ignored:1,
+		is_untracked:1;
+
+	/*
+	 * For the untracked cache: `cached` once the entries came from
+	 * it; `excludes_match` while the .gitignore files up to here are
+	 * the ones it was made with. When recording, `complete` while
+	 * every untracked directory in it was walked into, `pending`
+	 * while the current entry is one which wasn't yet, and
+	 * `has_untracked` once something untracked was seen.
+	 */
+	unsigned int cached:1,
+		excludes_match:1,
+		recordable:1,
+		complete:1,
+		pending:1,
+		has_untracked:1;
+
+	/* the stat data of the directory before it was read, and of its .gitignore */
+	struct stat st;
+	git_oid exclude_oid;
+
+	/* what's untracked in it, to be recorded */
+	git_vector untracked;
 };
 
 typedef struct {
@@ -263,6 +342,22 @@ typedef struct {
 	git_index_entry entry;
 	git_buf path;
 	int is_ignored;
+	git_dirscan *scan;
+	char *start;
+	char *end;
+
+	/* set when the filesystem monitor says which files are unchanged */
+	git_index *index;
+
+	/*
+	 * With GIT_ITERATOR_SKIP_IGNORED, the index to tell what's
+	 * untracked, and its untracked cache if there's one to use;
+	 * `record` when what's untracked is to be recorded in it
+	 */
+	git_index *tracked;
+	git_untracked_cache *untracked;
+	int record;
+	git_buf scratch;
 } workdir_iterator;
 
 static workdir_iterator_frame *workdir_iterator__alloc_frame(void)
@@ -281,29 +376,413 @@ static void workdir_iterator__free_frame(workdir_iterator_frame *wf)
 {
 	unsigned int i;
 	git_path_with_stat *path;
+	char *name;
 
 	git_vector_foreach(&wf->entries, i, path)
 		git__free(path);
 	git_vector_free(&wf->entries);
+
+	git_vector_foreach(&wf->untracked, i, name)
+		git__free(name);
+	git_vector_free(&wf->untracked);
+
 	git__free(wf);
 }
 
-static int workdir_iterator__update_entry(workdir_iterator *wi);
+static int workdir_iterator__update_entry(workdir_iterator *wi, int *skip);
+static int workdir_iterator__advance(git_iterator *self, const git_index_entry **entry);
 
-static int workdir_iterator__expand_dir(workdir_iterator *wi)
+/*
+ * Have the scanner read the subdirectories of the new frame that we
+ * may walk into, while we walk the ones before them; the ignored ones
+ * are left alone, as they are rarely walked into
+ */
+static void workdir_iterator__prefetch(workdir_iterator *wi, workdir_iterator_frame *wf)
+{
+	git_path_with_stat *ps, **dirs;
+	const char **paths;
+	char *buffer, *dst;
+	size_t count = 0, size = 0, i;
+	unsigned int j;
+	int ignored;
+
+	if (wi->scan == NULL)
+		return;
+
+	dirs = git__malloc(wf->entries.length * (sizeof(git_path_with_stat *) + sizeof(char *)));
+	if (dirs == NULL)
+		return;
+	paths = (const char **)&dirs[wf->entries.length];
+
+	git_vector_foreach(&wf->entries, j, ps) {
+		if (!S_ISDIR(ps->st.st_mode) ||
+			strcmp(ps->path, DOT_GIT "/") == 0 ||
+			git__suffixcmp(ps->path, "/" DOT_GIT "/") == 0)
+			continue;
+
+		if (git_ignore__lookup(&wi->ignores, ps->path, &ignored) < GIT_SUCCESS || ignored)
+			continue;
+
+		dirs[count++] = ps;
+		size += wi->root_len + ps->path_len + 1;
+	}
+
+	/* the paths are the ones `expand_dir` will have, without the slash */
+	if (count > 0 && (buffer = git__malloc(size)) != NULL) {
+		for (i = 0, dst = buffer; i < count; ++i) {
+			memcpy(dst, wi->path.ptr, wi->root_len);
+			memcpy(dst + wi->root_len, dirs[i]->path, dirs[i]->path_len);
+			dst[wi->root_len + dirs[i]->path_len] = '\0';
+
+			paths[i] = dst;
+			dst += wi->root_len + dirs[i]->path_len + 1;
+		}
+
+		/* it's only a hint; anything not queued is read when needed */
+		(void)git_dirscan_queue(wi->scan, paths, count);
+		git__free(buffer);
+	}
+
+	git__free(dirs);
+}
+
+/* A file the filesystem monitor vouches for is as the index has it */
+static int workdir_iterator__known_stat(void *payload, const char *path, struct stat *st)
+{
+	git_index *index = payload;
+	git_index_entry *entry;
+	int pos;
+
+	if ((pos = git_index_find(index, path)) < 0)
+		return 0;
+
+	entry = git_index_get(index, pos);
+	if ((entry->flags_extended & GIT_IDXENTRY_FSMONITOR_VALID) == 0 ||
+		git_index_entry_stage(entry) != 0 || S_ISGITLINK(entry->mode))
+		return 0;
+
+	memset(st, 0x0, sizeof(struct stat));
+	st->st_mode = entry->mode;
+	st->st_ctime = (time_t)entry->ctime.seconds;
+	st->st_mtime = (time_t)entry->mtime.seconds;
+	st->st_dev = entry->dev;
+	st->st_ino = entry->ino;
+	st->st_uid = entry->uid;
+	st->st_gid = entry->gid;
+	st->st_size = entry->file_size;
+
+	return 1;
+}
+
+/* Whether the entry, and whatever is in it, comes before the range */
+static int workdir_iterator__before_start(
+	workdir_iterator *wi, const git_path_with_stat *ps)
+{
+	if (wi->start == NULL || strcmp(ps->path, wi->start) >= 0)
+		return 0;
+
+	return !S_ISDIR(ps->st.st_mode) || git__prefixcmp(wi->start, ps->path) != 0;
+}
+
+/* Whether the index has anything in the directory `path` (with its trailing slash) */
+static int workdir_iterator__tracked_dir(workdir_iterator *wi, const char *path)
+{
+	unsigned int pos = index_iterator__seek(wi->tracked, path);
+	git_index_entry *entry = git_index_get(wi->tracked, pos);
+
+	return (entry != NULL && git__prefixcmp(entry->path, path) == 0);
+}
+
+/* The name of `ps` in its directory, with the trailing slash of a directory */
+static const char *workdir_iterator__basename(const git_path_with_stat *ps)
+{
+	const char *name = ps->path + ps->path_len;
+
+	while (name > ps->path && name[-1] != '/')
+		name--;
+
+	return name;
+}
+
+/* Note `name` as untracked in the directory of `wf` */
+static int workdir_iterator__note_untracked(workdir_iterator_frame *wf, const char *name)
+{
+	char *copy;
+
+	wf->has_untracked = 1;
+
+	if (!wf->recordable)
+		return GIT_SUCCESS;
+
+	if ((copy = git__strdup(name)) == NULL)
+		return GIT_ENOMEM;
+
+	if (git_vector_insert(&wf->untracked, copy) < GIT_SUCCESS) {
+		git__free(copy);
+		return GIT_ENOMEM;
+	}
+
+	return GIT_SUCCESS;
+}
+
+/*
+ * Done with `wf`, whose directory is the current entry of `parent`:
+ * record what's untracked in it if it was all seen, and tell the
+ * parent whether an untracked directory had anything in it
+ */
+static int workdir_iterator__leave_frame(
+	workdir_iterator *wi, workdir_iterator_frame *wf, workdir_iterator_frame *parent)
+{
+	git_path_with_stat *ps = NULL;
+	git_untracked_dir *dir;
+	int known = wf->cached;
+
+	if (!wi->record)
+		return GIT_SUCCESS;
+
+	if (parent != NULL)
+		ps = git_vector_get(&parent->entries, parent->index);
+
+	if (wf->recordable && wf->complete && !wf->cached) {
+		if ((dir = git_untracked_cache_find(wi->untracked, ps ? ps->path : "", 1)) == NULL)
+			return GIT_ENOMEM;
+
+		git_untracked_dir_set(dir, &wf->st, &wf->untracked);
+		git_oid_cpy(&dir->exclude_oid, &wf->exclude_oid);
+		wi->tracked->stat_refreshed = 1;
+		known = 1;
+	}
+
+	if (parent == NULL || !wf->is_untracked)
+		return GIT_SUCCESS;
+
+	/* like git, list an untracked directory as a whole */
+	if (wf->has_untracked)
+		return workdir_iterator__note_untracked(parent, workdir_iterator__basename(ps));
+
+	/* else the parent only walks into it again if the cache has it */
+	if (!known)
+		parent->complete = 0;
+
+	return GIT_SUCCESS;
+}
+
+/* Add the entry `prefix` + the `len` first bytes of `name`, if it's still there */
+static int workdir_iterator__add_entry(
+	workdir_iterator *wi, workdir_iterator_frame *wf,
+	const git_buf *prefix, const char *name, size_t len)
+{
+	git_path_with_stat *ps;
+	size_t path_len;
+	int error;
+
+	if (len > 0 && name[len - 1] == '/')
+		len--;
+	path_len = prefix->size + len;
+
+	if ((ps = git__malloc(sizeof(git_path_with_stat) + path_len + 2)) == NULL)
+		return GIT_ENOMEM;
+
+	memcpy(ps->path, prefix->ptr, prefix->size);
+	memcpy(ps->path + prefix->size, name, len);
+	ps->path[path_len] = '\0';
+	ps->path_len = path_len;
+
+	if (wi->index == NULL || !workdir_iterator__known_stat(wi->index, ps->path, &ps->st)) {
+		git_buf_truncate(&wi->scratch, 0);
+		if ((error = git_buf_put(&wi->scratch, wi->path.ptr, wi->root_len)) < GIT_SUCCESS ||
+			(error = git_buf_put(&wi->scratch, ps->path, path_len)) < GIT_SUCCESS) {
+			git__free(ps);
+			return error;
+		}
+
+		if (p_lstat(wi->scratch.ptr, &ps->st) < 0) {
+			git__free(ps);
+			return GIT_SUCCESS;
+		}
+	}
+
+	if (S_ISDIR(ps->st.st_mode)) {
+		ps->path[path_len] = '/';
+		ps->path[path_len + 1] = '\0';
+	}
+
+	if ((error = git_vector_insert(&wf->entries, ps)) < GIT_SUCCESS)
+		git__free(ps);
+
+	return error;
+}
+
+/*
+ * The entries of a directory the untracked cache knows, without
+ * reading it: what the index has in it, what's untracked, and the
+ * directories the cache has below it, which were walked into last
+ * time. Only what's ignored and not in the index is left out.
+ */
+static int workdir_iterator__load_cached(
+	workdir_iterator *wi, workdir_iterator_frame *wf, git_untracked_dir *dir)
+{
+	git_buf prefix = GIT_BUF_INIT;
+	git_index_entry *entry;
+	git_untracked_dir *child;
+	const char *name, *slash, *last = NULL;
+	size_t len, last_len = 0;
+	unsigned int pos, count = git_index_entrycount(wi->tracked), i, j;
+	int error;
+
+	error = git_buf_sets(&prefix, wi->path.ptr + wi->root_len);
+	if (error == GIT_SUCCESS && prefix.size > 0)
+		error = git_buf_putc(&prefix, '/');
+
+	/* what's in a directory is together in the index */
+	for (pos = index_iterator__seek(wi->tracked, prefix.ptr);
+		error == GIT_SUCCESS && pos < count; ++pos) {
+		entry = git_index_get(wi->tracked, pos);
+		if (git__prefixcmp(entry->path, prefix.ptr) != 0)
+			break;
+
+		name = entry->path + prefix.size;
+		len = (slash = strchr(name, '/')) != NULL ? (size_t)(slash - name) : strlen(name);
+		if (last != NULL && len == last_len && memcmp(name, last, len) == 0)
+			continue;
+
+		last = name;
+		last_len = len;
+		error = workdir_iterator__add_entry(wi, wf, &prefix, name, len);
+	}
+
+	for (i = 0; error == GIT_SUCCESS && i < dir->untracked.length; ++i) {
+		name = git_vector_get(&dir->untracked, i);
+		error = workdir_iterator__add_entry(wi, wf, &prefix, name, strlen(name));
+	}
+
+	for (i = 0; error == GIT_SUCCESS && i < dir->dirs.length; ++i) {
+		child = git_vector_get(&dir->dirs, i);
+		error = workdir_iterator__add_entry(wi, wf, &prefix, child->name, strlen(child->name));
+	}
+
+	git_buf_free(&prefix);
+	if (error < GIT_SUCCESS)
+		return error;
+
+	/* the same name may come from more than one of them */
+	git_vector_sort(&wf->entries);
+	for (i = 1, j = 0; i < wf->entries.length; ++i) {
+		if (git_path_with_stat_cmp(wf->entries.contents[j], wf->entries.contents[i]) == 0)
+			git__free(wf->entries.contents[i]);
+		else
+			wf->entries.contents[++j] = wf->entries.contents[i];
+	}
+	if (wf->entries.length > 0)
+		wf->entries.length = j + 1;
+
+	wf->cached = 1;
+	wf->complete = 1;
+	wf->has_untracked = (dir->untracked.length > 0);
+
+	return GIT_SUCCESS;
+}
+
+static int workdir_iterator__load(workdir_iterator *wi, workdir_iterator_frame *wf)
+{
+	if (wi->scan != NULL)
+		return git_dirscan_load(wi->scan, wi->path.ptr, &wf->entries);
+
+	if (wi->index != NULL)
+		return git_path_dirload_with_known_stat(wi->path.ptr, wi->root_len,
+			&wf->entries, workdir_iterator__known_stat, wi->index);
+
+	return git_path_dirload_with_stat(wi->path.ptr, wi->root_len, &wf->entries);
+}
+
+/*
+ * Load the directory from the untracked cache if it's as the cache
+ * has it, and the .gitignore files are the same; else read it, to be
+ * recorded once walked. With a monitor, that's whether it reported
+ * the directory; without one, the directory's stat and the hash of
+ * its .gitignore tell.
+ */
+static int workdir_iterator__load_untracked(
+	workdir_iterator *wi, workdir_iterator_frame *parent, workdir_iterator_frame *wf)
 {
+	git_untracked_dir *dir;
+	time_t now = time(NULL);
 	int error;
+
+	wf->excludes_match = (parent == NULL || parent->excludes_match);
+
+	dir = git_untracked_cache_find(wi->untracked, wi->path.ptr + wi->root_len, 0);
+
+	/*
+	 * The monitor reports changes to a directory, and to its
+	 * .gitignore, by invalidating it; nothing to check on the rest
+	 */
+	if (wi->index != NULL && dir != NULL && dir->valid && !dir->check_only && wf->excludes_match)
+		return workdir_iterator__load_cached(wi, wf, dir);
+
+	if (p_lstat(wi->path.ptr, &wf->st) < 0)
+		return workdir_iterator__load(wi, wf);
+
+	if ((error = git_buf_joinpath(&wi->scratch, wi->path.ptr, ".gitignore")) < GIT_SUCCESS)
+		return error;
+	git_untracked_cache_hash_exclude(&wf->exclude_oid, wi->scratch.ptr);
+
+	if (dir != NULL && git_oid_cmp(&dir->exclude_oid, &wf->exclude_oid) != 0) {
+		if (wi->record) {
+			git_untracked_dir_invalidate(dir);
+			git_oid_cpy(&dir->exclude_oid, &wf->exclude_oid);
+			wi->tracked->stat_refreshed = 1;
+		} else
+			wf->excludes_match = 0;
+	}
+
+	if (dir != NULL && wf->excludes_match && git_untracked_dir_uptodate(dir, &wf->st))
+		return workdir_iterator__load_cached(wi, wf, dir);
+
+	/* a change within the same second wouldn't show in the stat data */
+	wf->recordable = (wi->record && wf->st.st_mtime < now);
+	wf->complete = 1;
+
+	return workdir_iterator__load(wi, wf);
+}
+
+static int workdir_iterator__expand_dir(workdir_iterator *wi)
+{
+	int error, skip;
+	git_path_with_stat *ps;
+	workdir_iterator_frame *parent = wi->stack;
 	workdir_iterator_frame *wf = workdir_iterator__alloc_frame();
 	if (wf == NULL)
 		return GIT_ENOMEM;
 
-	error = git_path_dirload_with_stat(wi->path.ptr, wi->root_len, &wf->entries);
-	if (error < GIT_SUCCESS || wf->entries.length == 0) {
+	/* the directory is the current entry of the parent */
+	if (wi->tracked != NULL && parent != NULL) {
+		wf->in_ignored = (parent->in_ignored || wi->is_ignored);
+		wf->is_untracked = parent->pending;
+		parent->pending = 0;
+	}
+
+	if (wi->untracked != NULL)
+		error = workdir_iterator__load_untracked(wi, parent, wf);
+	else
+		error = workdir_iterator__load(wi, wf);
+
+	if (error == GIT_SUCCESS) {
+		git_vector_sort(&wf->entries);
+
+		while ((ps = git_vector_get(&wf->entries, wf->index)) != NULL &&
+			workdir_iterator__before_start(wi, ps))
+			wf->index++;
+	}
+
+	if (error < GIT_SUCCESS || wf->index >= wf->entries.length) {
+		if (error < GIT_SUCCESS)
+			wf->complete = 0;
+		error = workdir_iterator__leave_frame(wi, wf, parent);
 		workdir_iterator__free_frame(wf);
-		return GIT_ENOTFOUND;
+		return (error < GIT_SUCCESS) ? error : GIT_ENOTFOUND;
 	}
 
-	git_vector_sort(&wf->entries);
 	wf->next  = wi->stack;
 	wi->stack = wf;
 
@@ -313,7 +792,13 @@ static int workdir_iterator__expand_dir(workdir_iterator *wi)
 		(void)git_ignore__push_dir(&wi->ignores, &wi->path.ptr[slash_pos + 1]);
 	}
 
-	return workdir_iterator__update_entry(wi);
+	workdir_iterator__prefetch(wi, wf);
+
+	error = workdir_iterator__update_entry(wi, &skip);
+	if (error == GIT_SUCCESS && skip)
+		error = workdir_iterator__advance((git_iterator *)wi, NULL);
+
+	return error;
 }
 
 static int workdir_iterator__current(
@@ -332,7 +817,7 @@ static int workdir_iterator__at_end(git_iterator *self)
 static int workdir_iterator__advance(
 	git_iterator *self, const git_index_entry **entry)
 {
-	int error;
+	int error = GIT_SUCCESS, skip = 1;
 	workdir_iterator *wi = (workdir_iterator *)self;
 	workdir_iterator_frame *wf;
 	git_path_with_stat *next;
@@ -343,29 +828,42 @@ static int workdir_iterator__advance(
 	if (wi->entry.path == NULL)
 		return GIT_SUCCESS;
 
-	while ((wf = wi->stack) != NULL) {
-		next = git_vector_get(&wf->entries, ++wf->index);
-		if (next != NULL) {
-			if (strcmp(next->path, DOT_GIT "/") == 0)
-				continue;
-			/* else found a good entry */
-			break;
+	while (skip) {
+		/* a directory not walked into could have had anything in it */
+		if (wi->stack->pending) {
+			wi->stack->pending = 0;
+			wi->stack->complete = 0;
 		}
 
-		/* pop workdir directory stack */
-		wi->stack = wf->next;
-		workdir_iterator__free_frame(wf);
-		git_ignore__pop_dir(&wi->ignores);
-
-		if (wi->stack == NULL) {
-			memset(&wi->entry, 0, sizeof(wi->entry));
-			return GIT_SUCCESS;
+		while ((wf = wi->stack) != NULL) {
+			next = git_vector_get(&wf->entries, ++wf->index);
+			if (next != NULL) {
+				if (strcmp(next->path, DOT_GIT "/") == 0)
+					continue;
+				/* else found a good entry */
+				break;
+			}
+
+			/* pop workdir directory stack */
+			error = workdir_iterator__leave_frame(wi, wf, wf->next);
+			wi->stack = wf->next;
+			workdir_iterator__free_frame(wf);
+			git_ignore__pop_dir(&wi->ignores);
+
+			if (error < GIT_SUCCESS)
+				return error;
+
+			if (wi->stack == NULL) {
+				memset(&wi->entry, 0, sizeof(wi->entry));
+				return GIT_SUCCESS;
+			}
 		}
-	}
 
-	error = workdir_iterator__update_entry(wi);
+		if ((error = workdir_iterator__update_entry(wi, &skip)) < GIT_SUCCESS)
+			return error;
+	}
 
-	if (error == GIT_SUCCESS && entry != NULL)
+	if (entry != NULL)
 		error = workdir_iterator__current(self, entry);
 
 	return error;
@@ -380,8 +878,19 @@ static int workdir_iterator__reset(git_iterator *self)
 		workdir_iterator__free_frame(wf);
 		git_ignore__pop_dir(&wi->ignores);
 	}
-	if (wi->stack)
+	if (wi->stack) {
+		git_path_with_stat *ps;
+
+		/* it would be seen twice */
+		wi->stack->recordable = 0;
+		wi->stack->pending = 0;
+
 		wi->stack->index = 0;
+		while ((ps = git_vector_get(&wi->stack->entries, wi->stack->index)) != NULL &&
+			workdir_iterator__before_start(wi, ps))
+			wi->stack->index++;
+	}
+	git_dirscan_clear(wi->scan);
 	return GIT_SUCCESS;
 }
 
@@ -395,15 +904,61 @@ static void workdir_iterator__free(git_iterator *self)
 		workdir_iterator__free_frame(wf);
 	}
 
+	git_dirscan_free(wi->scan);
 	git_ignore__free(&wi->ignores);
 	git_buf_free(&wi->path);
+	git_buf_free(&wi->scratch);
+	git__free(wi->start);
+	git__free(wi->end);
+}
+
+/*
+ * With GIT_ITERATOR_SKIP_IGNORED, whether the current entry is to be
+ * left out, being ignored with nothing in the index; what's untracked
+ * is noted for the untracked cache
+ */
+static int workdir_iterator__untracked_entry(
+	workdir_iterator *wi, const git_path_with_stat *ps, int *skip)
+{
+	workdir_iterator_frame *wf = wi->stack;
+
+	/* `wi->path` has no trailing slash */
+	if (!wf->is_untracked &&
+		(git_index_find(wi->tracked, wi->path.ptr + wi->root_len) >= 0 ||
+		 (S_ISDIR(ps->st.st_mode) && workdir_iterator__tracked_dir(wi, ps->path))))
+		return GIT_SUCCESS;
+
+	if (wi->is_ignored || wf->in_ignored) {
+		*skip = 1;
+		return GIT_SUCCESS;
+	}
+
+	/* whether there's anything untracked in it is known once walked into */
+	if (S_ISDIR(wi->entry.mode)) {
+		wf->pending = 1;
+		return GIT_SUCCESS;
+	}
+
+	if (!wi->record)
+		return GIT_SUCCESS;
+
+	return workdir_iterator__note_untracked(wf, workdir_iterator__basename(ps));
 }
 
-static int workdir_iterator__update_entry(workdir_iterator *wi)
+/* Make the current entry the one the top frame is at; `skip` if it's to be left out */
+static int workdir_iterator__update_entry(workdir_iterator *wi, int *skip)
 {
 	int error;
 	git_path_with_stat *ps = git_vector_get(&wi->stack->entries, wi->stack->index);
 
+	*skip = 0;
+
+	/* past the range; the frames are left for `free` */
+	if (wi->end != NULL && strcmp(ps->path, wi->end) >= 0) {
+		memset(&wi->entry, 0, sizeof(wi->entry));
+		return GIT_SUCCESS;
+	}
+
 	git_buf_truncate(&wi->path, wi->root_len);
 	error = git_buf_put(&wi->path, ps->path, ps->path_len);
 	if (error < GIT_SUCCESS)
@@ -413,42 +968,49 @@ static int workdir_iterator__update_entry(workdir_iterator *wi)
 	wi->entry.path = ps->path;
 
 	/* skip over .git directory */
-	if (strcmp(ps->path, DOT_GIT "/") == 0)
-		return workdir_iterator__advance((git_iterator *)wi, NULL);
+	if (strcmp(ps->path, DOT_GIT "/") == 0) {
+		*skip = 1;
+		return GIT_SUCCESS;
+	}
 
 	/* if there is an error processing the entry, treat as ignored */
 	wi->is_ignored = 1;
 
-	/* TODO: remove shared code for struct stat conversion with index.c */
-	wi->entry.ctime.seconds = (git_time_t)ps->st.st_ctime;
-	wi->entry.mtime.seconds = (git_time_t)ps->st.st_mtime;
-	wi->entry.dev  = ps->st.st_rdev;
-	wi->entry.ino  = ps->st.st_ino;
+	git_index__init_entry_from_stat(&wi->entry, &ps->st);
 	wi->entry.mode = git_futils_canonical_mode(ps->st.st_mode);
-	wi->entry.uid  = ps->st.st_uid;
-	wi->entry.gid  = ps->st.st_gid;
-	wi->entry.file_size = ps->st.st_size;
 
 	/* if this is a file type we don't handle, treat as ignored */
 	if (wi->entry.mode == 0)
-		return GIT_SUCCESS;
+		goto done;
 
 	/* okay, we are far enough along to look up real ignore rule */
 	error = git_ignore__lookup(&wi->ignores, wi->entry.path, &wi->is_ignored);
 	if (error != GIT_SUCCESS)
-		return GIT_SUCCESS;
+		goto done;
 
 	/* detect submodules */
 	if (S_ISDIR(wi->entry.mode) &&
 		git_path_contains(&wi->path, DOT_GIT) == GIT_SUCCESS)
 		wi->entry.mode = S_IFGITLINK;
 
-	return GIT_SUCCESS;
+done:
+	if (wi->tracked == NULL)
+		return GIT_SUCCESS;
+
+	return workdir_iterator__untracked_entry(wi, ps, skip);
 }
 
 int git_iterator_for_workdir(git_repository *repo, git_iterator **iter)
 {
-	int error;
+	return git_iterator_for_workdir_range(repo, NULL, NULL, 0, iter);
+}
+
+int git_iterator_for_workdir_range(
+	git_repository *repo, const char *start, const char *end,
+	unsigned int flags, git_iterator **iter)
+{
+	int error, preload, is_range = (start != NULL || end != NULL);
+	git_index *index;
 	workdir_iterator *wi = git__calloc(1, sizeof(workdir_iterator));
 	if (!wi)
 		return GIT_ENOMEM;
@@ -461,19 +1023,55 @@ int git_iterator_for_workdir(git_repository *repo, git_iterator **iter)
 	wi->base.free    = workdir_iterator__free;
 	wi->repo         = repo;
 
-	error = git_buf_sets(&wi->path, git_repository_workdir(repo));
+	if ((start != NULL && (wi->start = git__strdup(start)) == NULL) ||
+		(end != NULL && (wi->end = git__strdup(end)) == NULL))
+		error = GIT_ENOMEM;
+	else
+		error = git_buf_sets(&wi->path, git_repository_workdir(repo));
 	if (error == GIT_SUCCESS)
 		error = git_path_to_dir(&wi->path);
 	if (error == GIT_SUCCESS)
 		error = git_ignore__for_path(repo, "", &wi->ignores);
 	if (error != GIT_SUCCESS) {
+		git__free(wi->start);
+		git__free(wi->end);
+		git_buf_free(&wi->path);
 		git__free(wi);
 		return error;
 	}
 
 	wi->root_len = wi->path.size;
 
-	if ((error = workdir_iterator__expand_dir(wi)) < GIT_SUCCESS)
+	if (repo->fsmonitor != NULL) {
+		if (git_repository_index__weakptr(&index, repo) < GIT_SUCCESS)
+			git_clearerror();
+		else if (is_range ? index->fsmonitor_token != NULL :
+			git_index__fsmonitor_refresh(index))
+			wi->index = index;
+	}
+
+	if (flags & GIT_ITERATOR_SKIP_IGNORED) {
+		error = git_repository_index__weakptr(&wi->tracked, repo);
+
+		/* the cache only knows about the ignore files */
+		if (error == GIT_SUCCESS && wi->ignores.ign_internal->rules.length == 0)
+			error = git_index__untracked_cache(&wi->untracked, wi->tracked, !is_range);
+
+		wi->record = (wi->untracked != NULL && !is_range);
+	}
+
+	/* with a monitor or the cache, there's little left to scan ahead for */
+	if (error == GIT_SUCCESS && wi->index == NULL && wi->untracked == NULL && !is_range &&
+		git_repository__cvar(&preload, repo, GIT_CVAR_PRELOAD_INDEX) == GIT_SUCCESS &&
+		preload == GIT_PRELOAD_INDEX_TRUE)
+		error = git_dirscan_new(&wi->scan, wi->root_len, 0);
+
+	/* nothing in the range is no error */
+	if (error == GIT_SUCCESS &&
+		(error = workdir_iterator__expand_dir(wi)) == GIT_ENOTFOUND && is_range)
+		error = GIT_SUCCESS;
+
+	if (error < GIT_SUCCESS)
 		git_iterator_free((git_iterator *)wi);
 	else
 		*iter = (git_iterator *)wi;
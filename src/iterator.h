@@ -36,6 +36,35 @@ int git_iterator_for_index(
 int git_iterator_for_workdir(
 	git_repository *repo, git_iterator **iter);
 
+/*
+ * Only the entries from `start` (included) to `end` (excluded); either
+ * may be NULL for no bound. A workdir iterator still gives out the
+ * directories that `start` is in, to be walked into.
+ *
+ * A workdir range is taken to be one part of a walk split between
+ * threads: it doesn't scan ahead of itself, and whoever split the
+ * walk asks the filesystem monitor for changes beforehand.
+ */
+int git_iterator_for_index_range(
+	git_repository *repo, const char *start, const char *end,
+	git_iterator **iter);
+
+/*
+ * Leave out of a workdir walk what's ignored and has nothing in the
+ * index, as git's untracked cache does. With the cache, a directory
+ * which is as it has it isn't read: only the files the index and the
+ * cache know in it are lstat()ed, the ones the index has being left
+ * to the filesystem monitor when there's one. A directory the monitor
+ * didn't report isn't even lstat()ed. A walk of the whole working
+ * directory records what it finds in the cache, for the caller to
+ * write with the index; the directories it doesn't walk into aren't.
+ */
+#define GIT_ITERATOR_SKIP_IGNORED (1 << 0)
+
+int git_iterator_for_workdir_range(
+	git_repository *repo, const char *start, const char *end,
+	unsigned int flags, git_iterator **iter);
+
 /* Entry is not guaranteed to be fully populated.  For a tree iterator,
  * we will only populate the mode, oid and path, for example.  For a workdir
  * iterator, we will not populate the oid.
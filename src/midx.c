@@ -0,0 +1,725 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+#include "midx.h"
+#include "pack.h"
+#include "fileops.h"
+#include "filebuf.h"
+#include "sha1_lookup.h"
+#include "hash.h"
+
+#define MIDX_SIGNATURE 0x4d494458	/* "MIDX" */
+#define MIDX_VERSION 1
+#define MIDX_OID_VERSION 1
+
+#define MIDX_HEADER_SIZE 12
+#define MIDX_CHUNK_TOC_ENTRY_SIZE 12
+
+#define MIDX_CHUNKID_PACKNAMES 0x504e414d	/* "PNAM" */
+#define MIDX_CHUNKID_OIDFANOUT 0x4f494446	/* "OIDF" */
+#define MIDX_CHUNKID_OIDLOOKUP 0x4f49444c	/* "OIDL" */
+#define MIDX_CHUNKID_OBJECTOFFSETS 0x4f4f4646	/* "OOFF" */
+#define MIDX_CHUNKID_LARGEOFFSETS 0x4c4f4646	/* "LOFF" */
+
+#define MIDX_LARGE_OFFSET_FLAG 0x80000000
+
+struct midx_chunk {
+	uint64_t offset;
+	size_t length;
+};
+
+GIT_INLINE(uint32_t) get_be32(const unsigned char *p)
+{
+	uint32_t n;
+	memcpy(&n, p, sizeof(n));
+	return ntohl(n);
+}
+
+GIT_INLINE(uint64_t) get_be64(const unsigned char *p)
+{
+	return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+/***********************************************************
+ *
+ * READING
+ *
+ ***********************************************************/
+
+static int midx_parse_packfile_names(
+		git_midx_file *idx,
+		const unsigned char *data,
+		uint32_t num_packs,
+		struct midx_chunk *chunk)
+{
+	const char *name = (const char *)(data + chunk->offset);
+	const char *end = name + chunk->length;
+	const char *prev = NULL;
+	uint32_t i;
+
+	if (chunk->offset == 0)
+		return git__throw(GIT_EOBJCORRUPTED, "Missing packfile names chunk");
+
+	/* every name takes at least two bytes */
+	if (num_packs > chunk->length / 2)
+		return git__throw(GIT_EOBJCORRUPTED, "Wrong packfile names size");
+
+	if (git_vector_init(&idx->packfile_names, num_packs, NULL) < GIT_SUCCESS)
+		return GIT_ENOMEM;
+
+	for (i = 0; i < num_packs; ++i) {
+		size_t len = 0;
+
+		while (name + len < end && name[len] != '\0')
+			len++;
+
+		if (len == 0 || name + len == end)
+			return git__throw(GIT_EOBJCORRUPTED, "Invalid packfile name");
+
+		if (prev != NULL && strcmp(prev, name) >= 0)
+			return git__throw(GIT_EOBJCORRUPTED, "Packfile names are not sorted");
+
+		if (git_vector_insert(&idx->packfile_names, (void *)name) < GIT_SUCCESS)
+			return GIT_ENOMEM;
+
+		prev = name;
+		name += len + 1;
+	}
+
+	return GIT_SUCCESS;
+}
+
+static int midx_parse_oid_fanout(
+		git_midx_file *idx,
+		const unsigned char *data,
+		struct midx_chunk *chunk)
+{
+	uint32_t i, nr = 0;
+
+	if (chunk->offset == 0)
+		return git__throw(GIT_EOBJCORRUPTED, "Missing OID fanout chunk");
+
+	if (chunk->length != 256 * 4)
+		return git__throw(GIT_EOBJCORRUPTED, "Wrong OID fanout size");
+
+	idx->oid_fanout = (const uint32_t *)(data + chunk->offset);
+
+	for (i = 0; i < 256; ++i) {
+		uint32_t n = ntohl(idx->oid_fanout[i]);
+		if (n < nr)
+			return git__throw(GIT_EOBJCORRUPTED, "Index is non-monotonic");
+		nr = n;
+	}
+
+	idx->num_objects = nr;
+	return GIT_SUCCESS;
+}
+
+static int midx_parse_oid_lookup(
+		git_midx_file *idx,
+		const unsigned char *data,
+		struct midx_chunk *chunk)
+{
+	uint32_t i;
+	const git_oid *prev = NULL;
+
+	if (chunk->offset == 0)
+		return git__throw(GIT_EOBJCORRUPTED, "Missing OID lookup chunk");
+
+	/* in 64 bits, so a corrupt object count can't wrap around to the length */
+	if ((uint64_t)chunk->length != (uint64_t)idx->num_objects * GIT_OID_RAWSZ)
+		return git__throw(GIT_EOBJCORRUPTED, "Wrong OID lookup size");
+
+	idx->oid_lookup = (const git_oid *)(data + chunk->offset);
+
+	for (i = 0; i < idx->num_objects; ++i) {
+		if (prev != NULL && git_oid_cmp(prev, &idx->oid_lookup[i]) >= 0)
+			return git__throw(GIT_EOBJCORRUPTED, "OID lookup is non-monotonic");
+		prev = &idx->oid_lookup[i];
+	}
+
+	return GIT_SUCCESS;
+}
+
+static int midx_parse_object_offsets(
+		git_midx_file *idx,
+		const unsigned char *data,
+		struct midx_chunk *chunk)
+{
+	if (chunk->offset == 0)
+		return git__throw(GIT_EOBJCORRUPTED, "Missing object offsets chunk");
+
+	if ((uint64_t)chunk->length != (uint64_t)idx->num_objects * 8)
+		return git__throw(GIT_EOBJCORRUPTED, "Wrong object offsets size");
+
+	idx->object_offsets = data + chunk->offset;
+	return GIT_SUCCESS;
+}
+
+static int midx_parse_object_large_offsets(
+		git_midx_file *idx,
+		const unsigned char *data,
+		struct midx_chunk *chunk)
+{
+	if (chunk->length == 0)
+		return GIT_SUCCESS;
+
+	if (chunk->length % 8 != 0)
+		return git__throw(GIT_EOBJCORRUPTED, "Wrong object large offsets size");
+
+	idx->object_large_offsets = data + chunk->offset;
+	idx->num_object_large_offsets = chunk->length / 8;
+	return GIT_SUCCESS;
+}
+
+static int midx_parse(git_midx_file *idx, const unsigned char *data, size_t size)
+{
+	struct midx_chunk packfile_names = {0}, oid_fanout = {0}, oid_lookup = {0},
+		object_offsets = {0}, object_large_offsets = {0}, *chunk = NULL;
+	uint32_t num_packs, num_chunks, i;
+	uint64_t last_offset, trailer_offset;
+	const unsigned char *toc;
+	git_oid checksum;
+	int error;
+
+	if (size < MIDX_HEADER_SIZE + GIT_OID_RAWSZ)
+		return git__throw(GIT_EOBJCORRUPTED, "File is too short");
+
+	/*
+	 * The lookups trust the offsets and object ids in the file, so
+	 * make sure it's the file that was written before using them
+	 */
+	git_hash_buf(&checksum, data, size - GIT_OID_RAWSZ);
+	if (memcmp(checksum.id, data + size - GIT_OID_RAWSZ, GIT_OID_RAWSZ) != 0)
+		return git__throw(GIT_EOBJCORRUPTED, "Checksum mismatch");
+
+	if (get_be32(data) != MIDX_SIGNATURE ||
+		data[4] != MIDX_VERSION ||
+		data[5] != MIDX_OID_VERSION)
+		return git__throw(GIT_EOBJCORRUPTED, "Unsupported header");
+
+	num_chunks = data[6];
+	num_packs = get_be32(data + 8);
+
+	if (data[7] != 0)
+		return git__throw(GIT_EOBJCORRUPTED, "Base multi-pack-index files are not supported");
+
+	last_offset = MIDX_HEADER_SIZE + (num_chunks + 1) * MIDX_CHUNK_TOC_ENTRY_SIZE;
+	trailer_offset = size - GIT_OID_RAWSZ;
+
+	if (last_offset > trailer_offset)
+		return git__throw(GIT_EOBJCORRUPTED, "Wrong chunk table size");
+
+	toc = data + MIDX_HEADER_SIZE;
+
+	for (i = 0; i <= num_chunks; ++i, toc += MIDX_CHUNK_TOC_ENTRY_SIZE) {
+		uint64_t offset = get_be64(toc + 4);
+
+		if (offset < last_offset || offset > trailer_offset)
+			return git__throw(GIT_EOBJCORRUPTED, "Chunks are non-monotonic");
+
+		if (chunk != NULL)
+			chunk->length = (size_t)(offset - last_offset);
+
+		last_offset = offset;
+
+		if (i == num_chunks)
+			break;
+
+		switch (get_be32(toc)) {
+		case MIDX_CHUNKID_PACKNAMES:
+			chunk = &packfile_names;
+			break;
+		case MIDX_CHUNKID_OIDFANOUT:
+			chunk = &oid_fanout;
+			break;
+		case MIDX_CHUNKID_OIDLOOKUP:
+			chunk = &oid_lookup;
+			break;
+		case MIDX_CHUNKID_OBJECTOFFSETS:
+			chunk = &object_offsets;
+			break;
+		case MIDX_CHUNKID_LARGEOFFSETS:
+			chunk = &object_large_offsets;
+			break;
+		default:
+			/* skip the chunks we don't know about */
+			chunk = NULL;
+			continue;
+		}
+
+		chunk->offset = offset;
+	}
+
+	if ((error = midx_parse_packfile_names(idx, data, num_packs, &packfile_names)) < GIT_SUCCESS ||
+		(error = midx_parse_oid_fanout(idx, data, &oid_fanout)) < GIT_SUCCESS ||
+		(error = midx_parse_oid_lookup(idx, data, &oid_lookup)) < GIT_SUCCESS ||
+		(error = midx_parse_object_offsets(idx, data, &object_offsets)) < GIT_SUCCESS ||
+		(error = midx_parse_object_large_offsets(idx, data, &object_large_offsets)) < GIT_SUCCESS)
+		return error;
+
+	git_oid_cpy(&idx->checksum, &checksum);
+	return GIT_SUCCESS;
+}
+
+int git_midx_open(git_midx_file **idx_out, const char *path)
+{
+	git_midx_file *idx;
+	git_file fd;
+	struct stat st;
+	int error;
+
+	*idx_out = NULL;
+
+	if ((fd = p_open(path, O_RDONLY)) < 0)
+		return git__throw(GIT_ENOTFOUND, "Failed to open multi-pack-index '%s'", path);
+
+	if (p_fstat(fd, &st) < GIT_SUCCESS) {
+		p_close(fd);
+		return git__throw(GIT_EOSERR, "Failed to stat multi-pack-index '%s'", path);
+	}
+
+	if (!S_ISREG(st.st_mode) || !git__is_sizet(st.st_size)) {
+		p_close(fd);
+		return git__throw(GIT_EOBJCORRUPTED, "Invalid multi-pack-index '%s'", path);
+	}
+
+	idx = git__calloc(1, sizeof(git_midx_file));
+	if (idx == NULL) {
+		p_close(fd);
+		return GIT_ENOMEM;
+	}
+
+	error = git_futils_mmap_ro(&idx->index_map, fd, 0, (size_t)st.st_size);
+	p_close(fd);
+
+	if (error < GIT_SUCCESS) {
+		git__free(idx);
+		return git__rethrow(error, "Failed to open multi-pack-index '%s'", path);
+	}
+
+	error = midx_parse(idx, idx->index_map.data, idx->index_map.len);
+	if (error < GIT_SUCCESS) {
+		git_midx_free(idx);
+		return git__rethrow(error, "Failed to parse multi-pack-index '%s'", path);
+	}
+
+	*idx_out = idx;
+	return GIT_SUCCESS;
+}
+
+void git_midx_free(git_midx_file *idx)
+{
+	if (idx == NULL)
+		return;
+
+	git_vector_free(&idx->packfile_names);
+	git_futils_mmap_free(&idx->index_map);
+	git__free(idx);
+}
+
+static int midx_entry_offset(git_midx_entry *e, git_midx_file *idx, uint32_t pos)
+{
+	const unsigned char *object_offset = idx->object_offsets + pos * 8;
+	uint32_t offset;
+
+	e->pack_index = get_be32(object_offset);
+	if (e->pack_index >= idx->packfile_names.length)
+		return git__throw(GIT_EOBJCORRUPTED, "Invalid pack index in multi-pack-index");
+
+	offset = get_be32(object_offset + 4);
+
+	if (offset & MIDX_LARGE_OFFSET_FLAG) {
+		if (idx->object_large_offsets == NULL)
+			return git__throw(GIT_EOBJCORRUPTED, "Unexpected large offset in multi-pack-index");
+
+		offset &= ~MIDX_LARGE_OFFSET_FLAG;
+		if (offset >= idx->num_object_large_offsets)
+			return git__throw(GIT_EOBJCORRUPTED, "Invalid large offset in multi-pack-index");
+
+		e->offset = (off_t)get_be64(idx->object_large_offsets + offset * 8);
+	} else {
+		e->offset = (off_t)offset;
+	}
+
+	return GIT_SUCCESS;
+}
+
+int git_midx_entry_find(
+		git_midx_entry *e,
+		git_midx_file *idx,
+		const git_oid *short_oid,
+		unsigned int len)
+{
+	int pos, found = 0;
+	uint32_t hi, lo;
+	const git_oid *current = NULL;
+
+	assert(idx);
+
+	hi = ntohl(idx->oid_fanout[(int)short_oid->id[0]]);
+	lo = ((short_oid->id[0] == 0x0) ? 0 : ntohl(idx->oid_fanout[(int)short_oid->id[0] - 1]));
+
+	pos = sha1_entry_pos(idx->oid_lookup, GIT_OID_RAWSZ, 0, lo, hi, idx->num_objects, short_oid->id);
+
+	if (pos >= 0) {
+		found = 1;
+		current = idx->oid_lookup + pos;
+	} else {
+		/* pos refers to the object with the "closest" oid to short_oid */
+		pos = -1 - pos;
+		if (pos < (int)idx->num_objects) {
+			current = idx->oid_lookup + pos;
+
+			if (!git_oid_ncmp(short_oid, current, len))
+				found = 1;
+		}
+	}
+
+	if (found && len != GIT_OID_HEXSZ && pos + 1 < (int)idx->num_objects) {
+		/* Check for ambiguousity */
+		if (!git_oid_ncmp(short_oid, current + 1, len))
+			found = 2;
+	}
+
+	if (!found)
+		return git__throw(GIT_ENOTFOUND, "Failed to find entry in multi-pack-index");
+	else if (found > 1)
+		return git__throw(GIT_EAMBIGUOUSOIDPREFIX, "Failed to find entry in multi-pack-index. Ambiguous sha1 prefix");
+
+	if (midx_entry_offset(e, idx, (uint32_t)pos) < GIT_SUCCESS)
+		return git__rethrow(GIT_EOBJCORRUPTED, "Failed to find entry in multi-pack-index");
+
+	git_oid_cpy(&e->sha1, current);
+	return GIT_SUCCESS;
+}
+
+/***********************************************************
+ *
+ * WRITING
+ *
+ ***********************************************************/
+
+struct midx_write_pack {
+	struct git_pack_file *pack;
+	char name[GIT_FLEX_ARRAY];
+};
+
+struct midx_write_entry {
+	git_oid oid;
+	off_t offset;
+	git_time_t mtime;
+	uint32_t pack_index;
+};
+
+struct midx_writer {
+	struct midx_write_entry *entries;
+	size_t length, alloc;
+
+	/* the pack being read */
+	uint32_t pack_index;
+	git_time_t mtime;
+};
+
+static int midx_write_pack_cmp(const void *a_, const void *b_)
+{
+	const struct midx_write_pack *a = a_, *b = b_;
+	return strcmp(a->name, b->name);
+}
+
+static int midx_write_entry_cmp(const void *a_, const void *b_)
+{
+	const struct midx_write_entry *a = a_, *b = b_;
+	int cmp = git_oid_cmp(&a->oid, &b->oid);
+
+	if (cmp)
+		return cmp;
+
+	/* duplicates: the most recent pack goes first, and wins */
+	if (a->mtime != b->mtime)
+		return a->mtime > b->mtime ? -1 : 1;
+
+	return (int)a->pack_index - (int)b->pack_index;
+}
+
+static int midx_write_add_entry(const git_oid *oid, off_t offset, void *data)
+{
+	struct midx_writer *w = data;
+	struct midx_write_entry *entry;
+
+	if (w->length == w->alloc) {
+		size_t alloc = w->alloc ? w->alloc * 2 : 1024;
+		void *entries = git__realloc(w->entries, alloc * sizeof(struct midx_write_entry));
+
+		if (entries == NULL)
+			return GIT_ENOMEM;
+
+		w->entries = entries;
+		w->alloc = alloc;
+	}
+
+	entry = &w->entries[w->length++];
+	git_oid_cpy(&entry->oid, oid);
+	entry->offset = offset;
+	entry->mtime = w->mtime;
+	entry->pack_index = w->pack_index;
+
+	return GIT_SUCCESS;
+}
+
+static int midx_write_packs_init(git_vector *out, git_vector *packs)
+{
+	unsigned int i;
+
+	if (git_vector_init(out, packs->length, midx_write_pack_cmp) < GIT_SUCCESS)
+		return GIT_ENOMEM;
+
+	for (i = 0; i < packs->length; ++i) {
+		struct git_pack_file *p = git_vector_get(packs, i);
+		struct midx_write_pack *wp;
+		const char *base;
+		size_t len;
+
+		base = strrchr(p->pack_name, '/');
+		base = base ? base + 1 : p->pack_name;
+		len = strlen(base);
+
+		if (git__suffixcmp(base, ".pack") != 0)
+			return git__throw(GIT_EINVALIDPATH, "Invalid packfile name '%s'", p->pack_name);
+
+		wp = git__malloc(sizeof(struct midx_write_pack) + len);
+		if (wp == NULL)
+			return GIT_ENOMEM;
+
+		wp->pack = p;
+		memcpy(wp->name, base, len - strlen(".pack"));
+		strcpy(wp->name + len - strlen(".pack"), ".idx");
+
+		if (git_vector_insert(out, wp) < GIT_SUCCESS) {
+			git__free(wp);
+			return GIT_ENOMEM;
+		}
+	}
+
+	git_vector_sort(out);
+	return GIT_SUCCESS;
+}
+
+static int write_be32(git_filebuf *file, uint32_t n)
+{
+	n = htonl(n);
+	return git_filebuf_write(file, &n, sizeof(n));
+}
+
+static int write_be64(git_filebuf *file, uint64_t n)
+{
+	int error = write_be32(file, (uint32_t)(n >> 32));
+	if (error < GIT_SUCCESS)
+		return error;
+	return write_be32(file, (uint32_t)n);
+}
+
+static int write_chunk_toc_entry(git_filebuf *file, uint32_t id, uint64_t offset)
+{
+	int error = write_be32(file, id);
+	if (error < GIT_SUCCESS)
+		return error;
+	return write_be64(file, offset);
+}
+
+static int midx_write_file(
+		const char *path,
+		git_vector *packs,
+		struct midx_write_entry **entries,
+		size_t num_entries)
+{
+	static const char padding[4] = {0};
+	git_filebuf file = GIT_FILEBUF_INIT;
+	unsigned char header[MIDX_HEADER_SIZE];
+	uint32_t fanout[256], num_chunks, num_large = 0, n;
+	size_t names_len = 0, i;
+	uint64_t offset;
+	git_oid checksum;
+	int error;
+
+	for (i = 0; i < packs->length; ++i) {
+		struct midx_write_pack *wp = git_vector_get(packs, i);
+		names_len += strlen(wp->name) + 1;
+	}
+
+	memset(fanout, 0x0, sizeof(fanout));
+	for (i = 0; i < num_entries; ++i) {
+		fanout[entries[i]->oid.id[0]]++;
+		if ((uint64_t)entries[i]->offset > 0x7fffffff)
+			num_large++;
+	}
+
+	for (i = 1; i < 256; ++i)
+		fanout[i] += fanout[i - 1];
+
+	num_chunks = num_large ? 5 : 4;
+
+	n = htonl(MIDX_SIGNATURE);
+	memcpy(header, &n, sizeof(n));
+	header[4] = MIDX_VERSION;
+	header[5] = MIDX_OID_VERSION;
+	header[6] = (unsigned char)num_chunks;
+	header[7] = 0;
+	n = htonl(packs->length);
+	memcpy(header + 8, &n, sizeof(n));
+
+	if ((error = git_filebuf_open(&file, path, GIT_FILEBUF_HASH_CONTENTS)) < GIT_SUCCESS)
+		return error;
+
+	if ((error = git_filebuf_write(&file, header, sizeof(header))) < GIT_SUCCESS)
+		goto cleanup;
+
+	/* chunk table of contents */
+	offset = MIDX_HEADER_SIZE + (num_chunks + 1) * MIDX_CHUNK_TOC_ENTRY_SIZE;
+
+	if ((error = write_chunk_toc_entry(&file, MIDX_CHUNKID_PACKNAMES, offset)) < GIT_SUCCESS)
+		goto cleanup;
+	offset += (names_len + 3) & ~3;
+
+	if ((error = write_chunk_toc_entry(&file, MIDX_CHUNKID_OIDFANOUT, offset)) < GIT_SUCCESS)
+		goto cleanup;
+	offset += 256 * 4;
+
+	if ((error = write_chunk_toc_entry(&file, MIDX_CHUNKID_OIDLOOKUP, offset)) < GIT_SUCCESS)
+		goto cleanup;
+	offset += (uint64_t)num_entries * GIT_OID_RAWSZ;
+
+	if ((error = write_chunk_toc_entry(&file, MIDX_CHUNKID_OBJECTOFFSETS, offset)) < GIT_SUCCESS)
+		goto cleanup;
+	offset += (uint64_t)num_entries * 8;
+
+	if (num_large) {
+		if ((error = write_chunk_toc_entry(&file, MIDX_CHUNKID_LARGEOFFSETS, offset)) < GIT_SUCCESS)
+			goto cleanup;
+		offset += (uint64_t)num_large * 8;
+	}
+
+	if ((error = write_chunk_toc_entry(&file, 0, offset)) < GIT_SUCCESS)
+		goto cleanup;
+
+	/* PNAM */
+	for (i = 0; i < packs->length; ++i) {
+		struct midx_write_pack *wp = git_vector_get(packs, i);
+		if ((error = git_filebuf_write(&file, wp->name, strlen(wp->name) + 1)) < GIT_SUCCESS)
+			goto cleanup;
+	}
+
+	if (names_len & 3 &&
+		(error = git_filebuf_write(&file, padding, 4 - (names_len & 3))) < GIT_SUCCESS)
+		goto cleanup;
+
+	/* OIDF */
+	for (i = 0; i < 256; ++i) {
+		if ((error = write_be32(&file, fanout[i])) < GIT_SUCCESS)
+			goto cleanup;
+	}
+
+	/* OIDL */
+	for (i = 0; i < num_entries; ++i) {
+		if ((error = git_filebuf_write(&file, &entries[i]->oid, GIT_OID_RAWSZ)) < GIT_SUCCESS)
+			goto cleanup;
+	}
+
+	/* OOFF */
+	for (i = 0, n = 0; i < num_entries; ++i) {
+		uint32_t ofs;
+
+		if ((uint64_t)entries[i]->offset > 0x7fffffff)
+			ofs = MIDX_LARGE_OFFSET_FLAG | n++;
+		else
+			ofs = (uint32_t)entries[i]->offset;
+
+		if ((error = write_be32(&file, entries[i]->pack_index)) < GIT_SUCCESS ||
+			(error = write_be32(&file, ofs)) < GIT_SUCCESS)
+			goto cleanup;
+	}
+
+	/* LOFF */
+	for (i = 0; num_large && i < num_entries; ++i) {
+		if ((uint64_t)entries[i]->offset <= 0x7fffffff)
+			continue;
+
+		if ((error = write_be64(&file, (uint64_t)entries[i]->offset)) < GIT_SUCCESS)
+			goto cleanup;
+	}
+
+	if ((error = git_filebuf_hash(&checksum, &file)) < GIT_SUCCESS ||
+		(error = git_filebuf_write(&file, checksum.id, GIT_OID_RAWSZ)) < GIT_SUCCESS)
+		goto cleanup;
+
+	return git_filebuf_commit(&file, GIT_PACK_FILE_MODE);
+
+cleanup:
+	git_filebuf_cleanup(&file);
+	return error;
+}
+
+int git_midx_write(const char *path, git_vector *packs)
+{
+	git_vector write_packs = GIT_VECTOR_INIT;
+	struct midx_writer w;
+	struct midx_write_entry **sorted = NULL;
+	size_t i, num_entries = 0;
+	int error;
+
+	memset(&w, 0x0, sizeof(w));
+
+	if ((error = midx_write_packs_init(&write_packs, packs)) < GIT_SUCCESS)
+		goto cleanup;
+
+	for (i = 0; i < write_packs.length; ++i) {
+		struct midx_write_pack *wp = git_vector_get(&write_packs, i);
+
+		w.pack_index = (uint32_t)i;
+		w.mtime = wp->pack->mtime;
+
+		error = git_pack_foreach_entry(wp->pack, midx_write_add_entry, &w);
+		if (error < GIT_SUCCESS)
+			goto cleanup;
+	}
+
+	if (w.length > 0) {
+		sorted = git__malloc(w.length * sizeof(struct midx_write_entry *));
+		if (sorted == NULL) {
+			error = GIT_ENOMEM;
+			goto cleanup;
+		}
+
+		for (i = 0; i < w.length; ++i)
+			sorted[i] = &w.entries[i];
+
+		git__tsort((void **)sorted, w.length, midx_write_entry_cmp);
+
+		/* drop the duplicates, keeping the first (newest) copy */
+		for (i = 0; i < w.length; ++i) {
+			if (num_entries > 0 &&
+				git_oid_cmp(&sorted[num_entries - 1]->oid, &sorted[i]->oid) == 0)
+				continue;
+			sorted[num_entries++] = sorted[i];
+		}
+	}
+
+	error = midx_write_file(path, &write_packs, sorted, num_entries);
+
+cleanup:
+	for (i = 0; i < write_packs.length; ++i)
+		git__free(git_vector_get(&write_packs, i));
+	git_vector_free(&write_packs);
+	git__free(sorted);
+	git__free(w.entries);
+
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to write multi-pack-index");
+
+	return GIT_SUCCESS;
+}
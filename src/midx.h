@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_midx_h__
+#define INCLUDE_midx_h__
+
+#include "git2/oid.h"
+
+#include "common.h"
+#include "map.h"
+#include "vector.h"
+
+#define GIT_MIDX_FILE "multi-pack-index"
+
+/*
+ * A multi-pack-index, as written by `git multi-pack-index write`:
+ * a single sorted table with every object in a set of packfiles, so
+ * lookups need one fanout + bsearch instead of one per pack.
+ *
+ * All the tables point straight into the mapped file.
+ */
+typedef struct git_midx_file {
+	git_map index_map;
+
+	/* names of the indexed packs (".idx"), in pack-int-id order */
+	git_vector packfile_names;
+
+	const uint32_t *oid_fanout;
+	uint32_t num_objects;
+
+	const git_oid *oid_lookup;
+	const unsigned char *object_offsets;
+
+	const unsigned char *object_large_offsets;
+	size_t num_object_large_offsets;
+
+	git_oid checksum;
+} git_midx_file;
+
+typedef struct git_midx_entry {
+	off_t offset;
+	size_t pack_index;
+	git_oid sha1;
+} git_midx_entry;
+
+int git_midx_open(git_midx_file **idx_out, const char *path);
+void git_midx_free(git_midx_file *idx);
+
+/*
+ * Find the entry for `short_oid`; throws GIT_EAMBIGUOUSOIDPREFIX
+ * if more than one object matches the first `len` hex digits.
+ */
+int git_midx_entry_find(
+		git_midx_entry *e,
+		git_midx_file *idx,
+		const git_oid *short_oid,
+		unsigned int len);
+
+/*
+ * Write a multi-pack-index to `path` covering all the
+ * `struct git_pack_file` in `packs`. Objects found in more
+ * than one pack are taken from the most recent one.
+ */
+int git_midx_write(const char *path, git_vector *packs);
+
+#endif
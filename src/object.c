@@ -162,6 +162,8 @@ int git_object_lookup_prefix(
 
 	/* Initialize parent object */
 	git_oid_cpy(&object->cached.oid, &odb_obj->cached.oid);
+	object->cached.type = type;
+	object->cached.size = git_object__size(type) + odb_obj->raw.len;
 	object->repo = repo;
 
 	switch (type) {
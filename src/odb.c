@@ -28,7 +28,7 @@ typedef struct
 	int is_alternate;
 } backend_internal;
 
-static int format_object_header(char *hdr, size_t n, size_t obj_len, git_otype obj_type)
+int git_odb__format_object_header(char *hdr, size_t n, size_t obj_len, git_otype obj_type)
 {
 	const char *type_str = git_object_type2string(obj_type);
 	int len = p_snprintf(hdr, n, "%s %"PRIuZ, type_str, obj_len);
@@ -53,7 +53,7 @@ int git_odb__hashobj(git_oid *id, git_rawobj *obj)
 	if (!obj->data && obj->len != 0)
 		return git__throw(GIT_ERROR, "Failed to hash object. No data given");
 
-	if ((hdrlen = format_object_header(header, sizeof(header), obj->len, obj->type)) < 0)
+	if ((hdrlen = git_odb__format_object_header(header, sizeof(header), obj->len, obj->type)) < 0)
 		return git__rethrow(hdrlen, "Failed to hash object");
 
 	vec[0].data = header;
@@ -75,6 +75,9 @@ static git_odb_object *new_odb_object(const git_oid *oid, git_rawobj *source)
 	git_oid_cpy(&object->cached.oid, oid);
 	memcpy(&object->raw, source, sizeof(git_rawobj));
 
+	object->cached.type = source->type;
+	object->cached.size = sizeof(git_odb_object) + source->len;
+
 	return object;
 }
 
@@ -108,6 +111,24 @@ git_otype git_odb_object_type(git_odb_object *object)
 	return object->raw.type;
 }
 
+int git_odb_set_cache_limit(git_odb *db, git_otype type, size_t max_bytes)
+{
+	assert(db);
+	return git_cache_set_max(&db->cache, type, max_bytes);
+}
+
+int git_odb_get_cache_limit(size_t *max_bytes, git_odb *db, git_otype type)
+{
+	assert(max_bytes && db);
+	return git_cache_get_max(max_bytes, &db->cache, type);
+}
+
+void git_odb_get_cache_stats(git_cache_stats *stats, git_odb *db)
+{
+	assert(stats && db);
+	git_cache_get_stats(stats, &db->cache);
+}
+
 void git_odb_object_free(git_odb_object *object)
 {
 	git_cached_obj_decref((git_cached_obj *)object, &free_odb_object);
@@ -119,7 +140,7 @@ int git_odb__hashfd(git_oid *out, git_file fd, size_t size, git_otype type)
 	char hdr[64], buffer[2048];
 	git_hash_ctx *ctx;
 
-	hdr_len = format_object_header(hdr, sizeof(hdr), size, type);
+	hdr_len = git_odb__format_object_header(hdr, sizeof(hdr), size, type);
 	if (hdr_len < 0)
 		return git__throw(GIT_ERROR, "Failed to format blob header. Length is out of bounds");
 
@@ -220,6 +241,54 @@ int git_odb_hash(git_oid *id, const void *data, size_t len, git_otype type)
 	return git_odb__hashobj(id, &raw);
 }
 
+int git_odb_hash_many(git_oid *ids, const void *const *data, const size_t *len, size_t count, git_otype type)
+{
+	git_buf_vec *vec;
+	char (*headers)[64];
+	size_t i;
+	int hdrlen, error = GIT_SUCCESS;
+
+	assert(ids && ((data && len) || count == 0));
+
+	if (!git_object_typeisloose(type))
+		return git__throw(GIT_ERROR, "Failed to hash objects. Wrong object type");
+
+	if (count == 0)
+		return GIT_SUCCESS;
+
+	vec = git__malloc(2 * count * sizeof(git_buf_vec));
+	headers = git__malloc(count * sizeof(*headers));
+	if (vec == NULL || headers == NULL) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
+
+	for (i = 0; i < count; ++i) {
+		if (!data[i] && len[i] != 0) {
+			error = git__throw(GIT_ERROR, "Failed to hash objects. No data given");
+			goto cleanup;
+		}
+
+		hdrlen = git_odb__format_object_header(headers[i], sizeof(headers[i]), len[i], type);
+		if (hdrlen < 0) {
+			error = git__rethrow(hdrlen, "Failed to hash objects");
+			goto cleanup;
+		}
+
+		vec[2 * i].data = headers[i];
+		vec[2 * i].len = hdrlen;
+		vec[2 * i + 1].data = (void *)data[i];
+		vec[2 * i + 1].len = len[i];
+	}
+
+	git_hash_many(ids, vec, 2, count);
+
+cleanup:
+	git__free(vec);
+	git__free(headers);
+	return error;
+}
+
 /**
  * FAKE WSTREAM
  */
@@ -311,13 +380,14 @@ int git_odb_new(git_odb **out)
 	if (!db)
 		return GIT_ENOMEM;
 
-	error = git_cache_init(&db->cache, GIT_DEFAULT_CACHE_SIZE, &free_odb_object);
+	error = git_cache_init(&db->cache, &free_odb_object);
 	if (error < GIT_SUCCESS) {
 		git__free(db);
 		return git__rethrow(error, "Failed to create object database");
 	}
 
 	if ((error = git_vector_init(&db->backends, 4, backend_sort_cmp)) < GIT_SUCCESS) {
+		git_cache_free(&db->cache);
 		git__free(db);
 		return git__rethrow(error, "Failed to create object database");
 	}
@@ -587,6 +657,235 @@ int git_odb_read(git_odb_object **out, git_odb *db, const git_oid *id)
 	return git__rethrow(error, "Failed to read object");
 }
 
+/*
+ * What's left to look for in a batch: the ids, and where each one
+ * goes in the caller's arrays. Each backend is only asked for the
+ * objects that the ones before it didn't have.
+ */
+typedef struct {
+	git_oid *ids;
+	size_t *pos;
+	size_t count;
+} odb_pending;
+
+static int pending_init(odb_pending *pending, size_t count)
+{
+	pending->ids = git__malloc(count * sizeof(git_oid));
+	pending->pos = git__malloc(count * sizeof(size_t));
+	pending->count = 0;
+
+	if (pending->ids == NULL || pending->pos == NULL)
+		return GIT_ENOMEM;
+
+	return GIT_SUCCESS;
+}
+
+static void pending_add(odb_pending *pending, const git_oid *id, size_t pos)
+{
+	git_oid_cpy(&pending->ids[pending->count], id);
+	pending->pos[pending->count++] = pos;
+}
+
+/* Move the object at `from` down to `to`, to go on looking for it */
+static void pending_keep(odb_pending *pending, size_t to, size_t from)
+{
+	if (to == from)
+		return;
+
+	git_oid_cpy(&pending->ids[to], &pending->ids[from]);
+	pending->pos[to] = pending->pos[from];
+}
+
+static void pending_free(odb_pending *pending)
+{
+	git__free(pending->ids);
+	git__free(pending->pos);
+}
+
+static int backend_read_many(
+	void **data, size_t *len, git_otype *type,
+	git_odb_backend *b, const git_oid *ids, size_t count)
+{
+	size_t i;
+
+	if (b->read_many != NULL)
+		return b->read_many(data, len, type, b, ids, count);
+
+	/* as in `git_odb_read`, a backend that fails to read
+	 * an object just doesn't have it */
+	for (i = 0; i < count && b->read != NULL; ++i) {
+		if (b->read(&data[i], &len[i], &type[i], b, &ids[i]) < GIT_SUCCESS)
+			type[i] = GIT_OBJ_BAD;
+	}
+
+	return GIT_SUCCESS;
+}
+
+static int backend_exists_many(int *found, git_odb_backend *b, const git_oid *ids, size_t count)
+{
+	size_t i;
+
+	if (b->exists_many != NULL)
+		return b->exists_many(found, b, ids, count);
+
+	for (i = 0; i < count && b->exists != NULL; ++i)
+		found[i] = b->exists(b, &ids[i]);
+
+	return GIT_SUCCESS;
+}
+
+int git_odb_read_many(git_odb_object **out, git_odb *db, const git_oid *ids, size_t count)
+{
+	odb_pending pending;
+	void **data;
+	size_t *len;
+	git_otype *type;
+	unsigned int i;
+	size_t j, left;
+	int error;
+
+	assert(out && db && ids);
+
+	if (count == 0)
+		return GIT_SUCCESS;
+
+	memset(out, 0x0, count * sizeof(git_odb_object *));
+
+	error = pending_init(&pending, count);
+	data = git__malloc(count * sizeof(void *));
+	len = git__malloc(count * sizeof(size_t));
+	type = git__malloc(count * sizeof(git_otype));
+
+	if (error < GIT_SUCCESS || data == NULL || len == NULL || type == NULL) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
+
+	for (j = 0; j < count; ++j) {
+		out[j] = git_cache_get(&db->cache, &ids[j]);
+		if (out[j] == NULL)
+			pending_add(&pending, &ids[j], j);
+	}
+
+	for (i = 0; i < db->backends.length && pending.count > 0; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+		git_odb_backend *b = internal->backend;
+
+		for (j = 0; j < pending.count; ++j)
+			type[j] = GIT_OBJ_BAD;
+
+		error = backend_read_many(data, len, type, b, pending.ids, pending.count);
+
+		for (j = 0, left = 0; j < pending.count; ++j) {
+			git_rawobj raw;
+
+			if (type[j] == GIT_OBJ_BAD) {
+				pending_keep(&pending, left++, j);
+				continue;
+			}
+
+			if (error < GIT_SUCCESS) {
+				git__free(data[j]);
+				continue;
+			}
+
+			raw.data = data[j];
+			raw.len = len[j];
+			raw.type = type[j];
+
+			out[pending.pos[j]] = git_cache_try_store(
+				&db->cache, new_odb_object(&pending.ids[j], &raw));
+		}
+
+		if (error < GIT_SUCCESS)
+			goto cleanup;
+
+		pending.count = left;
+	}
+
+	if (pending.count > 0)
+		error = git__throw(GIT_ENOTFOUND, "Failed to read objects. %u objects not found",
+			(unsigned int)pending.count);
+
+cleanup:
+	if (error < GIT_SUCCESS && error != GIT_ENOTFOUND) {
+		for (j = 0; j < count; ++j) {
+			git_odb_object_free(out[j]);
+			out[j] = NULL;
+		}
+
+		error = git__rethrow(error, "Failed to read objects");
+	}
+
+	git__free(data);
+	git__free(len);
+	git__free(type);
+	pending_free(&pending);
+
+	return error;
+}
+
+int git_odb_exists_many(int *found, git_odb *db, const git_oid *ids, size_t count)
+{
+	odb_pending pending;
+	int *backend_found;
+	unsigned int i;
+	size_t j, left;
+	int error;
+
+	assert(found && db && ids);
+
+	if (count == 0)
+		return GIT_SUCCESS;
+
+	error = pending_init(&pending, count);
+	backend_found = git__malloc(count * sizeof(int));
+
+	if (error < GIT_SUCCESS || backend_found == NULL) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
+
+	for (j = 0; j < count; ++j) {
+		git_odb_object *object = git_cache_get(&db->cache, &ids[j]);
+
+		found[j] = (object != NULL);
+		if (object != NULL)
+			git_odb_object_free(object);
+		else
+			pending_add(&pending, &ids[j], j);
+	}
+
+	for (i = 0; i < db->backends.length && pending.count > 0; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+		git_odb_backend *b = internal->backend;
+
+		memset(backend_found, 0x0, pending.count * sizeof(int));
+
+		error = backend_exists_many(backend_found, b, pending.ids, pending.count);
+		if (error < GIT_SUCCESS)
+			goto cleanup;
+
+		for (j = 0, left = 0; j < pending.count; ++j) {
+			if (backend_found[j]) {
+				found[pending.pos[j]] = 1;
+				continue;
+			}
+
+			pending_keep(&pending, left++, j);
+		}
+
+		pending.count = left;
+	}
+
+cleanup:
+	git__free(backend_found);
+	pending_free(&pending);
+
+	return error == GIT_SUCCESS ? GIT_SUCCESS :
+		git__rethrow(error, "Failed to look up objects");
+}
+
 int git_odb_read_prefix(git_odb_object **out, git_odb *db, const git_oid *short_id, unsigned int len)
 {
 	unsigned int i;
@@ -678,6 +977,46 @@ int git_odb_write(git_oid *oid, git_odb *db, const void *data, size_t len, git_o
 	return git__rethrow(error, "Failed to write object");
 }
 
+int git_odb_write_multi_pack_index(git_odb *db)
+{
+	unsigned int i;
+	int error = GIT_SUCCESS;
+
+	assert(db);
+
+	for (i = 0; i < db->backends.length && error == GIT_SUCCESS; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+		git_odb_backend *b = internal->backend;
+
+		/* we don't write in alternates! */
+		if (internal->is_alternate)
+			continue;
+
+		if (b->writemidx != NULL)
+			error = b->writemidx(b);
+	}
+
+	return error == GIT_SUCCESS ? GIT_SUCCESS : git__rethrow(error, "Failed to write multi-pack-index");
+}
+
+int git_odb_refresh(git_odb *db)
+{
+	unsigned int i;
+	int error = GIT_SUCCESS;
+
+	assert(db);
+
+	for (i = 0; i < db->backends.length && error == GIT_SUCCESS; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+		git_odb_backend *b = internal->backend;
+
+		if (b->refresh != NULL)
+			error = b->refresh(b);
+	}
+
+	return error == GIT_SUCCESS ? GIT_SUCCESS : git__rethrow(error, "Failed to refresh the object database");
+}
+
 int git_odb_open_wstream(git_odb_stream **stream, git_odb *db, size_t size, git_otype type)
 {
 	unsigned int i;
@@ -39,6 +39,12 @@ struct git_odb {
 	git_cache cache;
 };
 
+/*
+ * Format the "<type> <size>" header of an object, with its trailing
+ * NUL; returns the length of the header, NUL included.
+ */
+int git_odb__format_object_header(char *hdr, size_t n, size_t obj_len, git_otype obj_type);
+
 /*
  * Hash a git_rawobj internally.
  * The `git_rawobj` is supposed to be previously initialized
@@ -28,6 +28,20 @@ typedef struct {
 	git_filebuf fbuf;
 } loose_writestream;
 
+typedef struct {
+	git_odb_stream stream;
+	git_file fd;
+	z_stream zs;
+	obj_hdr hdr;
+	size_t read;
+
+	/* what was inflated along with the header */
+	unsigned char head[64];
+	size_t head_pos, head_len;
+
+	unsigned char in[16384];
+} loose_readstream;
+
 typedef struct loose_backend {
 	git_odb_backend parent;
 
@@ -75,13 +89,12 @@ static int object_file_name(git_buf *name, const char *dir, const git_oid *id)
 }
 
 
-static size_t get_binary_object_header(obj_hdr *hdr, git_buf *obj)
+static size_t get_binary_object_header(obj_hdr *hdr, const unsigned char *data, size_t len)
 {
 	unsigned char c;
-	unsigned char *data = (unsigned char *)obj->ptr;
 	size_t shift, size, used = 0;
 
-	if (obj->size == 0)
+	if (len == 0)
 		return 0;
 
 	c = data[used++];
@@ -90,7 +103,7 @@ static size_t get_binary_object_header(obj_hdr *hdr, git_buf *obj)
 	size = c & 15;
 	shift = 4;
 	while (c & 0x80) {
-		if (obj->size <= used)
+		if (len <= used)
 			return 0;
 		if (sizeof(size_t) * 8 <= shift)
 			return 0;
@@ -297,7 +310,7 @@ static int inflate_packlike_loose_disk_obj(git_rawobj *out, git_buf *obj)
 	 * read the object header, which is an (uncompressed)
 	 * binary encoding of the object type and size.
 	 */
-	if ((used = get_binary_object_header(&hdr, obj)) == 0)
+	if ((used = get_binary_object_header(&hdr, (unsigned char *)obj->ptr, obj->size)) == 0)
 		return git__throw(GIT_ERROR, "Failed to inflate loose object. Object has no header");
 
 	if (!git_object_typeisloose(hdr.type))
@@ -691,6 +704,178 @@ static int loose_backend__exists(git_odb_backend *backend, const git_oid *oid)
 	return (error == GIT_SUCCESS);
 }
 
+/*
+ * Read streams inflate the object file a chunk at a time, straight
+ * into the caller's buffer; only the start of the file, where the
+ * header is, goes through our own buffer.
+ */
+static int loose_readstream_fill(loose_readstream *stream)
+{
+	ssize_t read_bytes;
+
+	if (stream->zs.avail_in > 0)
+		return GIT_SUCCESS;
+
+	read_bytes = p_read(stream->fd, stream->in, sizeof(stream->in));
+	if (read_bytes < 0)
+		return git__throw(GIT_EOSERR, "Failed to read loose object");
+	if (read_bytes == 0)
+		return git__throw(GIT_EOBJCORRUPTED, "Failed to read loose object. Object is truncated");
+
+	set_stream_input(&stream->zs, stream->in, (size_t)read_bytes);
+	return GIT_SUCCESS;
+}
+
+/* Inflate into the stream's output until it's full or the object ends */
+static int loose_readstream_inflate(loose_readstream *stream)
+{
+	while (stream->zs.avail_out > 0) {
+		uInt avail_out = stream->zs.avail_out;
+		int error, status;
+
+		if ((error = loose_readstream_fill(stream)) < GIT_SUCCESS)
+			return error;
+
+		status = inflate(&stream->zs, Z_NO_FLUSH);
+
+		if (status == Z_STREAM_END)
+			break;
+
+		if (status != Z_OK && !(status == Z_BUF_ERROR && stream->zs.avail_out < avail_out))
+			return git__throw(GIT_EZLIB, "Failed to inflate loose object");
+	}
+
+	return GIT_SUCCESS;
+}
+
+static int loose_readstream_open(loose_readstream *stream, const char *path)
+{
+	ssize_t read_bytes;
+	size_t used;
+	int error;
+
+	if ((stream->fd = p_open(path, O_RDONLY)) < 0)
+		return git__throw(GIT_ENOTFOUND, "Failed to open loose object. File not found");
+
+	read_bytes = p_read(stream->fd, stream->in, sizeof(stream->in));
+	if (read_bytes < 2)
+		return git__throw(GIT_EOBJCORRUPTED, "Failed to read loose object. Object has no header");
+
+	init_stream(&stream->zs, NULL, 0);
+
+	/* the header of a pack-like object isn't compressed */
+	if (!is_zlib_compressed_data(stream->in)) {
+		used = get_binary_object_header(&stream->hdr, stream->in, (size_t)read_bytes);
+		if (used == 0)
+			return git__throw(GIT_EOBJCORRUPTED, "Failed to read loose object. Object has no header");
+
+		set_stream_input(&stream->zs, stream->in + used, (size_t)read_bytes - used);
+		if (inflateInit(&stream->zs) < Z_OK)
+			return git__throw(GIT_EZLIB, "Failed to read loose object");
+	} else {
+		set_stream_input(&stream->zs, stream->in, (size_t)read_bytes);
+		if (inflateInit(&stream->zs) < Z_OK)
+			return git__throw(GIT_EZLIB, "Failed to read loose object");
+
+		/* the header is small, and so are some objects */
+		set_stream_output(&stream->zs, stream->head, sizeof(stream->head));
+		error = loose_readstream_inflate(stream);
+
+		stream->head_len = sizeof(stream->head) - stream->zs.avail_out;
+
+		if (error < GIT_SUCCESS ||
+			memchr(stream->head, '\0', stream->head_len) == NULL ||
+			(used = get_object_header(&stream->hdr, stream->head)) == 0)
+			return git__throw(GIT_EOBJCORRUPTED, "Failed to read loose object. Object has no header");
+
+		stream->head_pos = used;
+	}
+
+	if (!git_object_typeisloose(stream->hdr.type))
+		return git__throw(GIT_EOBJCORRUPTED, "Failed to read loose object. Wrong object type");
+
+	return GIT_SUCCESS;
+}
+
+static int loose_backend__readstream_read(git_odb_stream *_stream, char *buffer, size_t len)
+{
+	loose_readstream *stream = (loose_readstream *)_stream;
+	size_t from_head;
+	int error;
+
+	/* we report how much we read as an int */
+	if (len > INT_MAX)
+		len = INT_MAX;
+
+	if (len > stream->hdr.size - stream->read)
+		len = stream->hdr.size - stream->read;
+
+	if (len == 0)
+		return 0;
+
+	from_head = min(len, stream->head_len - stream->head_pos);
+	memcpy(buffer, stream->head + stream->head_pos, from_head);
+	stream->head_pos += from_head;
+
+	set_stream_output(&stream->zs, buffer + from_head, len - from_head);
+	if ((error = loose_readstream_inflate(stream)) < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to read from loose object stream");
+
+	if (stream->zs.avail_out > 0)
+		return git__throw(GIT_EOBJCORRUPTED,
+			"Failed to read loose object. It is shorter than its header says");
+
+	stream->read += len;
+	return (int)len;
+}
+
+static void loose_backend__readstream_free(git_odb_stream *_stream)
+{
+	loose_readstream *stream = (loose_readstream *)_stream;
+
+	inflateEnd(&stream->zs);
+	if (stream->fd >= 0)
+		p_close(stream->fd);
+	git__free(stream);
+}
+
+static int loose_backend__readstream(git_odb_stream **stream_out, git_odb_backend *backend, const git_oid *oid)
+{
+	git_buf object_path = GIT_BUF_INIT;
+	loose_readstream *stream;
+	int error;
+
+	assert(backend && oid);
+
+	if (locate_object(&object_path, (loose_backend *)backend, oid) < 0) {
+		git_buf_free(&object_path);
+		return git__throw(GIT_ENOTFOUND, "Failed to open loose backend stream. Object not found");
+	}
+
+	stream = git__calloc(1, sizeof(loose_readstream));
+	if (stream == NULL) {
+		git_buf_free(&object_path);
+		return GIT_ENOMEM;
+	}
+
+	stream->fd = -1;
+	stream->stream.backend = backend;
+	stream->stream.mode = GIT_STREAM_RDONLY;
+	stream->stream.read = &loose_backend__readstream_read;
+	stream->stream.free = &loose_backend__readstream_free;
+
+	error = loose_readstream_open(stream, object_path.ptr);
+	git_buf_free(&object_path);
+
+	if (error < GIT_SUCCESS) {
+		loose_backend__readstream_free((git_odb_stream *)stream);
+		return git__rethrow(error, "Failed to open loose backend stream");
+	}
+
+	*stream_out = (git_odb_stream *)stream;
+	return GIT_SUCCESS;
+}
+
 static int loose_backend__stream_fwrite(git_oid *oid, git_odb_stream *_stream)
 {
 	loose_writestream *stream = (loose_writestream *)_stream;
@@ -903,6 +1088,7 @@ int git_odb_backend_loose(
 	backend->parent.write = &loose_backend__write;
 	backend->parent.read_prefix = &loose_backend__read_prefix;
 	backend->parent.read_header = &loose_backend__read_header;
+	backend->parent.readstream = &loose_backend__readstream;
 	backend->parent.writestream = &loose_backend__stream;
 	backend->parent.exists = &loose_backend__exists;
 	backend->parent.free = &loose_backend__free;
@@ -16,6 +16,7 @@
 #include "sha1_lookup.h"
 #include "mwindow.h"
 #include "pack.h"
+#include "midx.h"
 
 #include "git2/odb_backend.h"
 
@@ -25,8 +26,19 @@ struct pack_backend {
 	struct git_pack_file *last_found;
 	char *pack_folder;
 	time_t pack_folder_mtime;
+	time_t pack_folder_checked;
+
+	/* multi-pack-index of the pack folder, if any, and
+	 * the packs it covers, in pack-int-id order */
+	git_midx_file *midx;
+	struct git_pack_file **midx_packs;
 };
 
+typedef struct {
+	git_odb_stream stream;
+	git_packfile_stream obj;
+} pack_readstream;
+
 /**
  * The wonderful tale of a Packed Object lookup query
  * ===================================================
@@ -72,6 +84,14 @@ struct pack_backend {
  *
  *
  *
+ *	|-# midx_reload
+ *		If the pack folder has a `multi-pack-index`, load it and
+ *		match its packs against the ones we've just loaded. All
+ *		the objects in those packs can then be found with a single
+ *		lookup, instead of one lookup per pack.
+ *
+ *
+ *
  *	Chapter 2: To be, or not to be...
  *	A standard packed `exist` query for an OID
  *	--------------------------------------------------
@@ -81,9 +101,11 @@ struct pack_backend {
  * | that have been loaded for our ODB.
  * |
  * |-# pack_entry_find
- *	| Iterate through all the packs that have been preloaded
- *	| (starting by the pack where the latest object was found)
- *	| to try to find the OID in one of them.
+ *	| Look for the OID in the multi-pack-index first, if there's one.
+ *	| Otherwise iterate through all the packs that have been preloaded
+ *	| and aren't covered by the multi-pack-index (starting by the pack
+ *	| where the latest object was found) to try to find the OID in
+ *	| one of them.
  *	|
  *	|-# pack_entry_find1
  *		| Check the index of an individual pack to see if the SHA1
@@ -135,6 +157,10 @@ static int packfile_sort__cb(const void *a_, const void *b_);
 
 static int packfile_load__cb(void *_data, git_buf *path);
 static int packfile_refresh_all(struct pack_backend *backend);
+static int packfile_refresh_after_miss(struct pack_backend *backend);
+
+static void midx_free(struct pack_backend *backend);
+static int midx_reload(struct pack_backend *backend);
 
 static int pack_entry_find(struct git_pack_entry *e,
 		struct pack_backend *backend, const git_oid *oid);
@@ -246,6 +272,8 @@ static int packfile_refresh_all(struct pack_backend *backend)
 	if (backend->pack_folder == NULL)
 		return GIT_SUCCESS;
 
+	backend->pack_folder_checked = time(NULL);
+
 	if (p_stat(backend->pack_folder, &st) < 0 || !S_ISDIR(st.st_mode))
 		return git__throw(GIT_ENOTFOUND, "Failed to refresh packfiles. Backend not found");
 
@@ -262,18 +290,159 @@ static int packfile_refresh_all(struct pack_backend *backend)
 
 		git_vector_sort(&backend->packs);
 		backend->pack_folder_mtime = st.st_mtime;
+
+		if ((error = midx_reload(backend)) < GIT_SUCCESS)
+			return git__rethrow(error, "Failed to refresh packfiles");
 	}
 
 	return GIT_SUCCESS;
 }
 
-static int pack_entry_find(struct git_pack_entry *e, struct pack_backend *backend, const git_oid *oid)
+
+
+/*
+ * We look for new packs when an object can't be found in the ones
+ * we know about, but no more than once every this many seconds.
+ */
+static unsigned int _refresh_interval = 0;
+
+void git_odb_set_pack_refresh_interval(unsigned int seconds)
+{
+	_refresh_interval = seconds;
+}
+
+/* Returns GIT_SUCCESS if there may be new packs to look in */
+static int packfile_refresh_after_miss(struct pack_backend *backend)
+{
+	if (backend->pack_folder == NULL)
+		return GIT_ENOTFOUND;
+
+	if (backend->pack_folder_checked != 0 &&
+		time(NULL) - backend->pack_folder_checked < (time_t)_refresh_interval)
+		return GIT_ENOTFOUND;
+
+	return packfile_refresh_all(backend);
+}
+
+
+
+/***********************************************************
+ *
+ * MULTI-PACK-INDEX
+ *
+ ***********************************************************/
+
+static void midx_free(struct pack_backend *backend)
+{
+	size_t i;
+
+	for (i = 0; i < backend->packs.length; ++i) {
+		struct git_pack_file *p = git_vector_get(&backend->packs, i);
+		p->in_midx = 0;
+	}
+
+	git_midx_free(backend->midx);
+	git__free(backend->midx_packs);
+
+	backend->midx = NULL;
+	backend->midx_packs = NULL;
+	backend->last_found = NULL;
+}
+
+static struct git_pack_file *midx_find_pack(struct pack_backend *backend, const char *idx_name)
+{
+	size_t i, len = strlen(idx_name) - strlen(".idx");
+
+	for (i = 0; i < backend->packs.length; ++i) {
+		struct git_pack_file *p = git_vector_get(&backend->packs, i);
+		const char *base = strrchr(p->pack_name, '/');
+
+		base = base ? base + 1 : p->pack_name;
+
+		if (strncmp(base, idx_name, len) == 0 && strcmp(base + len, ".pack") == 0)
+			return p;
+	}
+
+	return NULL;
+}
+
+static int midx_reload(struct pack_backend *backend)
+{
+	git_buf path = GIT_BUF_INIT;
+	git_midx_file *midx;
+	size_t i;
+	int error;
+
+	midx_free(backend);
+
+	if ((error = git_buf_joinpath(&path, backend->pack_folder, GIT_MIDX_FILE)) < GIT_SUCCESS)
+		return error;
+
+	if (git_path_exists(path.ptr) < GIT_SUCCESS) {
+		git_buf_free(&path);
+		return GIT_SUCCESS;
+	}
+
+	/* like git, we ignore a broken multi-pack-index and
+	 * fall back to the individual packs */
+	error = git_midx_open(&midx, path.ptr);
+	git_buf_free(&path);
+
+	if (error < GIT_SUCCESS)
+		return GIT_SUCCESS;
+
+	backend->midx_packs = git__calloc(midx->packfile_names.length + 1, sizeof(struct git_pack_file *));
+	if (backend->midx_packs == NULL) {
+		git_midx_free(midx);
+		return GIT_ENOMEM;
+	}
+
+	for (i = 0; i < midx->packfile_names.length; ++i) {
+		const char *name = git_vector_get(&midx->packfile_names, i);
+		struct git_pack_file *p = NULL;
+
+		if (git__suffixcmp(name, ".idx") == 0)
+			p = midx_find_pack(backend, name);
+
+		/* the index is stale; we can't trust it */
+		if (p == NULL) {
+			git_midx_free(midx);
+			midx_free(backend);
+			return GIT_SUCCESS;
+		}
+
+		backend->midx_packs[i] = p;
+	}
+
+	for (i = 0; i < midx->packfile_names.length; ++i)
+		backend->midx_packs[i]->in_midx = 1;
+
+	backend->midx = midx;
+	return GIT_SUCCESS;
+}
+
+static int midx_entry_find(
+	struct git_pack_entry *e,
+	struct pack_backend *backend,
+	const git_oid *short_oid,
+	unsigned int len)
 {
+	git_midx_entry entry;
 	int error;
+
+	if ((error = git_midx_entry_find(&entry, backend->midx, short_oid, len)) < GIT_SUCCESS)
+		return error;
+
+	return git_pack_entry_at(e, backend->midx_packs[entry.pack_index], &entry.sha1, entry.offset);
+}
+
+/* Look for an object in the packs we know about, without refreshing them */
+static int pack_entry_find_loaded(struct git_pack_entry *e, struct pack_backend *backend, const git_oid *oid)
+{
 	size_t i;
 
-	if ((error = packfile_refresh_all(backend)) < GIT_SUCCESS)
-		return git__rethrow(error, "Failed to find pack entry");
+	if (backend->midx && midx_entry_find(e, backend, oid, GIT_OID_HEXSZ) == GIT_SUCCESS)
+		return GIT_SUCCESS;
 
 	if (backend->last_found &&
 		git_pack_entry_find(e, backend->last_found, oid, GIT_OID_HEXSZ) == GIT_SUCCESS)
@@ -283,7 +452,7 @@ static int pack_entry_find(struct git_pack_entry *e, struct pack_backend *backen
 		struct git_pack_file *p;
 
 		p = git_vector_get(&backend->packs, i);
-		if (p == backend->last_found)
+		if (p == backend->last_found || p->in_midx)
 			continue;
 
 		if (git_pack_entry_find(e, p, oid, GIT_OID_HEXSZ) == GIT_SUCCESS) {
@@ -292,10 +461,27 @@ static int pack_entry_find(struct git_pack_entry *e, struct pack_backend *backen
 		}
 	}
 
+	return GIT_ENOTFOUND;
+}
+
+static int pack_entry_find(struct git_pack_entry *e, struct pack_backend *backend, const git_oid *oid)
+{
+	int error;
+
+	if (pack_entry_find_loaded(e, backend, oid) == GIT_SUCCESS)
+		return GIT_SUCCESS;
+
+	if ((error = packfile_refresh_after_miss(backend)) == GIT_SUCCESS &&
+		pack_entry_find_loaded(e, backend, oid) == GIT_SUCCESS)
+		return GIT_SUCCESS;
+
+	if (error < GIT_SUCCESS && error != GIT_ENOTFOUND)
+		return git__rethrow(error, "Failed to find pack entry");
+
 	return git__throw(GIT_ENOTFOUND, "Failed to find pack entry");
 }
 
-static int pack_entry_find_prefix(
+static int pack_entry_find_prefix_loaded(
 	struct git_pack_entry *e,
 	struct pack_backend *backend,
 	const git_oid *short_oid,
@@ -305,23 +491,29 @@ static int pack_entry_find_prefix(
 	size_t i;
 	unsigned found = 0;
 
-	if ((error = packfile_refresh_all(backend)) < GIT_SUCCESS)
-		return git__rethrow(error, "Failed to find pack entry");
+	if (backend->midx) {
+		error = midx_entry_find(e, backend, short_oid, len);
+		if (error == GIT_EAMBIGUOUSOIDPREFIX) {
+			return git__rethrow(error, "Failed to find pack entry. Ambiguous sha1 prefix");
+		} else if (error == GIT_SUCCESS) {
+			found = 1;
+		}
+	}
 
 	if (backend->last_found) {
 		error = git_pack_entry_find(e, backend->last_found, short_oid, len);
 		if (error == GIT_EAMBIGUOUSOIDPREFIX) {
 			return git__rethrow(error, "Failed to find pack entry. Ambiguous sha1 prefix");
 		} else if (error == GIT_SUCCESS) {
-			found = 1;
+			found++;
 		}
 	}
 
-	for (i = 0; i < backend->packs.length; ++i) {
+	for (i = 0; i < backend->packs.length && found <= 1; ++i) {
 		struct git_pack_file *p;
 
 		p = git_vector_get(&backend->packs, i);
-		if (p == backend->last_found)
+		if (p == backend->last_found || p->in_midx)
 			continue;
 
 		error = git_pack_entry_find(e, p, short_oid, len);
@@ -345,6 +537,28 @@ static int pack_entry_find_prefix(
 
 }
 
+static int pack_entry_find_prefix(
+	struct git_pack_entry *e,
+	struct pack_backend *backend,
+	const git_oid *short_oid,
+	unsigned int len)
+{
+	int error;
+
+	error = pack_entry_find_prefix_loaded(e, backend, short_oid, len);
+	if (error != GIT_ENOTFOUND)
+		return error;
+
+	if ((error = packfile_refresh_after_miss(backend)) < GIT_SUCCESS) {
+		if (error != GIT_ENOTFOUND)
+			return git__rethrow(error, "Failed to find pack entry");
+
+		return git__throw(GIT_ENOTFOUND, "Failed to find pack entry");
+	}
+
+	return pack_entry_find_prefix_loaded(e, backend, short_oid, len);
+}
+
 
 /***********************************************************
  *
@@ -354,19 +568,17 @@ static int pack_entry_find_prefix(
  *
  ***********************************************************/
 
-/*
-int pack_backend__read_header(git_rawobj *obj, git_odb_backend *backend, const git_oid *oid)
+static int pack_backend__read_header(size_t *len_p, git_otype *type_p, git_odb_backend *backend, const git_oid *oid)
 {
-	pack_location location;
-
-	assert(obj && backend && oid);
+	struct git_pack_entry e;
+	int error;
 
-	if (locate_packfile(&location, (struct pack_backend *)backend, oid) < 0)
-		return GIT_ENOTFOUND;
+	if ((error = pack_entry_find(&e, (struct pack_backend *)backend, oid)) < GIT_SUCCESS ||
+		(error = git_packfile_resolve_header(len_p, type_p, e.p, e.offset)) < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to read header from pack backend");
 
-	return read_header_packed(obj, &location);
+	return GIT_SUCCESS;
 }
-*/
 
 static int pack_backend__read(void **buffer_p, size_t *len_p, git_otype *type_p, git_odb_backend *backend, const git_oid *oid)
 {
@@ -387,6 +599,124 @@ static int pack_backend__read(void **buffer_p, size_t *len_p, git_otype *type_p,
 	return GIT_SUCCESS;
 }
 
+/* An object of a batch, and where it goes in the caller's arrays */
+typedef struct {
+	struct git_pack_entry e;
+	size_t pos;
+} pack_request;
+
+static int pack_request_cmp(const void *a_, const void *b_)
+{
+	const pack_request *a = a_, *b = b_;
+
+	if (a->e.p != b->e.p)
+		return a->e.p < b->e.p ? -1 : 1;
+
+	if (a->e.offset != b->e.offset)
+		return a->e.offset < b->e.offset ? -1 : 1;
+
+	return 0;
+}
+
+/*
+ * Find the entries of a batch of objects, looking for new packs at
+ * most once for the whole batch. The objects which are found are
+ * stored at the start of `requests`.
+ */
+static int pack_entry_find_many(
+	pack_request *requests, size_t *found_out,
+	struct pack_backend *backend,
+	const git_oid *ids, size_t count)
+{
+	size_t i, known, found = 0;
+	int error;
+
+	for (i = 0; i < count; ++i) {
+		requests[found].pos = i;
+		if (pack_entry_find_loaded(&requests[found].e, backend, &ids[i]) == GIT_SUCCESS)
+			found++;
+	}
+
+	*found_out = found;
+
+	if (found == count)
+		return GIT_SUCCESS;
+
+	if ((error = packfile_refresh_after_miss(backend)) < GIT_SUCCESS)
+		return error == GIT_ENOTFOUND ? GIT_SUCCESS : error;
+
+	/* the ones we know are in the order of `ids` */
+	for (i = 0, known = 0; i < count; ++i) {
+		if (known < *found_out && requests[known].pos == i) {
+			known++;
+			continue;
+		}
+
+		requests[found].pos = i;
+		if (pack_entry_find_loaded(&requests[found].e, backend, &ids[i]) == GIT_SUCCESS)
+			found++;
+	}
+
+	*found_out = found;
+	return GIT_SUCCESS;
+}
+
+/*
+ * Find all the objects before reading any of them, and read them
+ * pack by pack, in the order they are stored in, so we go through
+ * each pack's windows once instead of hopping back and forth.
+ */
+static int pack_backend__read_many(
+	void **data, size_t *len, git_otype *type,
+	git_odb_backend *_backend,
+	const git_oid *ids, size_t count)
+{
+	struct pack_backend *backend = (struct pack_backend *)_backend;
+	pack_request *requests, **sorted;
+	size_t i, found = 0;
+	int error;
+
+	requests = git__malloc(count * sizeof(pack_request));
+	sorted = git__malloc(count * sizeof(pack_request *));
+	if (requests == NULL || sorted == NULL) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
+
+	if ((error = pack_entry_find_many(requests, &found, backend, ids, count)) < GIT_SUCCESS)
+		goto cleanup;
+
+	for (i = 0; i < found; ++i)
+		sorted[i] = &requests[i];
+
+	git__tsort((void **)sorted, found, pack_request_cmp);
+
+	for (i = 0; i < found; ++i) {
+		pack_request *req = sorted[i];
+		git_rawobj raw;
+
+		if ((error = git_packfile_unpack(&raw, req->e.p, &req->e.offset)) < GIT_SUCCESS) {
+			/* take back what we've read so far */
+			while (i-- > 0) {
+				git__free(data[sorted[i]->pos]);
+				type[sorted[i]->pos] = GIT_OBJ_BAD;
+			}
+			break;
+		}
+
+		data[req->pos] = raw.data;
+		len[req->pos] = raw.len;
+		type[req->pos] = raw.type;
+	}
+
+cleanup:
+	git__free(requests);
+	git__free(sorted);
+
+	return error == GIT_SUCCESS ? GIT_SUCCESS :
+		git__rethrow(error, "Failed to read from pack backend");
+}
+
 static int pack_backend__read_prefix(
 	git_oid *out_oid,
 	void **buffer_p,
@@ -426,12 +756,120 @@ static int pack_backend__read_prefix(
 	return GIT_SUCCESS;
 }
 
+static int pack_backend__stream_read(git_odb_stream *_stream, char *buffer, size_t len)
+{
+	pack_readstream *stream = (pack_readstream *)_stream;
+	return git_packfile_stream_read(&stream->obj, buffer, len);
+}
+
+static void pack_backend__stream_free(git_odb_stream *_stream)
+{
+	pack_readstream *stream = (pack_readstream *)_stream;
+
+	git_packfile_stream_free(&stream->obj);
+	git__free(stream);
+}
+
+static int pack_backend__readstream(git_odb_stream **stream_out, git_odb_backend *backend, const git_oid *oid)
+{
+	struct git_pack_entry e;
+	pack_readstream *stream;
+	int error;
+
+	if ((error = pack_entry_find(&e, (struct pack_backend *)backend, oid)) < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to open read stream on pack backend");
+
+	stream = git__calloc(1, sizeof(pack_readstream));
+	if (stream == NULL)
+		return GIT_ENOMEM;
+
+	if ((error = git_packfile_stream_open(&stream->obj, e.p, e.offset)) < GIT_SUCCESS) {
+		git__free(stream);
+		return git__rethrow(error, "Failed to open read stream on pack backend");
+	}
+
+	stream->stream.backend = backend;
+	stream->stream.mode = GIT_STREAM_RDONLY;
+	stream->stream.read = &pack_backend__stream_read;
+	stream->stream.free = &pack_backend__stream_free;
+
+	*stream_out = (git_odb_stream *)stream;
+	return GIT_SUCCESS;
+}
+
 static int pack_backend__exists(git_odb_backend *backend, const git_oid *oid)
 {
 	struct git_pack_entry e;
 	return pack_entry_find(&e, (struct pack_backend *)backend, oid) == GIT_SUCCESS;
 }
 
+static int pack_backend__exists_many(int *found, git_odb_backend *_backend, const git_oid *ids, size_t count)
+{
+	struct pack_backend *backend = (struct pack_backend *)_backend;
+	pack_request *requests;
+	size_t i, found_count;
+	int error;
+
+	requests = git__malloc(count * sizeof(pack_request));
+	if (requests == NULL)
+		return GIT_ENOMEM;
+
+	error = pack_entry_find_many(requests, &found_count, backend, ids, count);
+
+	for (i = 0; error == GIT_SUCCESS && i < found_count; ++i)
+		found[requests[i].pos] = 1;
+
+	git__free(requests);
+
+	return error == GIT_SUCCESS ? GIT_SUCCESS :
+		git__rethrow(error, "Failed to look up objects in pack backend");
+}
+
+static int pack_backend__refresh(git_odb_backend *_backend)
+{
+	struct pack_backend *backend = (struct pack_backend *)_backend;
+	int error;
+
+	if (backend->pack_folder == NULL)
+		return GIT_SUCCESS;
+
+	/* the folder may have changed within the second we last saw */
+	backend->pack_folder_mtime = 0;
+
+	if ((error = packfile_refresh_all(backend)) < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to refresh pack backend");
+
+	return GIT_SUCCESS;
+}
+
+static int pack_backend__writemidx(git_odb_backend *_backend)
+{
+	struct pack_backend *backend = (struct pack_backend *)_backend;
+	git_buf path = GIT_BUF_INIT;
+	int error;
+
+	if (backend->pack_folder == NULL)
+		return GIT_SUCCESS;
+
+	if ((error = packfile_refresh_all(backend)) < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to write multi-pack-index");
+
+	if ((error = git_buf_joinpath(&path, backend->pack_folder, GIT_MIDX_FILE)) < GIT_SUCCESS)
+		return error;
+
+	/* drop the current index first; it's mapped and about to be replaced */
+	midx_free(backend);
+
+	error = git_midx_write(path.ptr, &backend->packs);
+	git_buf_free(&path);
+
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to write multi-pack-index");
+
+	/* the folder mtime may not have changed, so load it ourselves */
+	return midx_reload(backend);
+}
+
 static void pack_backend__free(git_odb_backend *_backend)
 {
 	struct pack_backend *backend;
@@ -441,6 +879,8 @@ static void pack_backend__free(git_odb_backend *_backend)
 
 	backend = (struct pack_backend *)_backend;
 
+	midx_free(backend);
+
 	for (i = 0; i < backend->packs.length; ++i) {
 		struct git_pack_file *p = git_vector_get(&backend->packs, i);
 		packfile_free(p);
@@ -476,8 +916,13 @@ int git_odb_backend_pack(git_odb_backend **backend_out, const char *objects_dir)
 
 	backend->parent.read = &pack_backend__read;
 	backend->parent.read_prefix = &pack_backend__read_prefix;
-	backend->parent.read_header = NULL;
+	backend->parent.read_header = &pack_backend__read_header;
+	backend->parent.readstream = &pack_backend__readstream;
 	backend->parent.exists = &pack_backend__exists;
+	backend->parent.read_many = &pack_backend__read_many;
+	backend->parent.exists_many = &pack_backend__exists_many;
+	backend->parent.refresh = &pack_backend__refresh;
+	backend->parent.writemidx = &pack_backend__writemidx;
 	backend->parent.free = &pack_backend__free;
 
 	*backend_out = (git_odb_backend *)backend;
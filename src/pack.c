@@ -40,6 +40,155 @@ static int pack_entry_find_offset(
 		const git_oid *short_oid,
 		unsigned int len);
 
+/*
+ * Global options for the delta base cache
+ */
+static struct {
+	size_t limit;
+	git_atomic hits;
+	git_atomic misses;
+} _cache_options = {
+	GIT_PACK_CACHE_LIMIT,
+	{0},
+	{0},
+};
+
+/***********************************************************
+ *
+ * DELTA BASE CACHE
+ *
+ ***********************************************************/
+
+void git_odb_set_delta_cache_limit(size_t limit)
+{
+	_cache_options.limit = limit;
+}
+
+void git_odb_get_delta_cache_stats(git_odb_delta_cache_stats *stats)
+{
+	assert(stats);
+
+	stats->limit = _cache_options.limit;
+	stats->hits = (unsigned int)_cache_options.hits.val;
+	stats->misses = (unsigned int)_cache_options.misses.val;
+}
+
+GIT_INLINE(size_t) cache_slot(git_off_t offset)
+{
+	uint64_t hash = (uint64_t)offset;
+	hash += (hash >> 8) + (hash >> 16);
+	return (size_t)(hash % GIT_PACK_CACHE_SLOTS);
+}
+
+static void cache_unlink(git_pack_cache *cache, git_pack_cache_entry *entry)
+{
+	if (entry->lru_prev)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		cache->lru_head = entry->lru_next;
+
+	if (entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		cache->lru_tail = entry->lru_prev;
+
+	entry->lru_prev = entry->lru_next = NULL;
+	cache->slots[cache_slot(entry->offset)] = NULL;
+	cache->memory_used -= entry->raw.len;
+}
+
+static void cache_evict(git_pack_cache *cache, git_pack_cache_entry *entry)
+{
+	cache_unlink(cache, entry);
+	git__free(entry->raw.data);
+	git__free(entry);
+}
+
+void git_pack_cache_init(git_pack_cache *cache)
+{
+	memset(cache, 0x0, sizeof(git_pack_cache));
+	git_mutex_init(&cache->lock);
+}
+
+void git_pack_cache_free(git_pack_cache *cache)
+{
+	while (cache->lru_head != NULL)
+		cache_evict(cache, cache->lru_head);
+
+	git_mutex_free(&cache->lock);
+}
+
+/*
+ * Take the base at `offset` out of the cache. On success the
+ * caller owns `base->data` and must either free it or give it
+ * back with `cache_add`.
+ */
+static int cache_take(git_rawobj *base, struct git_pack_file *p, git_off_t offset)
+{
+	git_pack_cache *cache = &p->bases;
+	git_pack_cache_entry *entry;
+
+	git_mutex_lock(&cache->lock);
+	entry = cache->slots[cache_slot(offset)];
+	if (entry != NULL && entry->offset == offset)
+		cache_unlink(cache, entry);
+	else
+		entry = NULL;
+	git_mutex_unlock(&cache->lock);
+
+	if (entry == NULL) {
+		git_atomic_inc(&_cache_options.misses);
+		return GIT_ENOTFOUND;
+	}
+
+	git_atomic_inc(&_cache_options.hits);
+	memcpy(base, &entry->raw, sizeof(git_rawobj));
+	git__free(entry);
+
+	return GIT_SUCCESS;
+}
+
+/*
+ * Give ownership of `base` to the cache. The base is freed right
+ * away if it doesn't fit under the memory limit.
+ */
+static void cache_add(struct git_pack_file *p, git_off_t offset, git_rawobj *base)
+{
+	git_pack_cache *cache = &p->bases;
+	git_pack_cache_entry *entry, *old;
+	size_t limit = _cache_options.limit;
+
+	if (base->len > limit ||
+		(entry = git__malloc(sizeof(git_pack_cache_entry))) == NULL) {
+		git__free(base->data);
+		return;
+	}
+
+	entry->offset = offset;
+	memcpy(&entry->raw, base, sizeof(git_rawobj));
+	entry->lru_next = NULL;
+
+	git_mutex_lock(&cache->lock);
+
+	if ((old = cache->slots[cache_slot(offset)]) != NULL)
+		cache_evict(cache, old);
+
+	while (cache->lru_head != NULL && cache->memory_used + base->len > limit)
+		cache_evict(cache, cache->lru_head);
+
+	entry->lru_prev = cache->lru_tail;
+	if (cache->lru_tail)
+		cache->lru_tail->lru_next = entry;
+	else
+		cache->lru_head = entry;
+	cache->lru_tail = entry;
+
+	cache->slots[cache_slot(offset)] = entry;
+	cache->memory_used += base->len;
+
+	git_mutex_unlock(&cache->lock);
+}
+
 /***********************************************************
  *
  * PACK INDEX METHODS
@@ -259,68 +408,151 @@ int git_packfile_unpack_header(
 	return GIT_SUCCESS;
 }
 
-static int packfile_unpack_delta(
-		git_rawobj *obj,
+/*
+ * One link in a delta chain: the delta stored at `data_pos`,
+ * which applies on top of the object stored at `base_offset`.
+ */
+struct delta_link {
+	off_t base_offset;
+	off_t data_pos;
+	size_t size;
+	git_otype type;
+};
+
+#define DELTA_CHAIN_PREALLOC 64
+
+struct delta_chain {
+	struct delta_link *links;
+	size_t length, alloc;
+	struct delta_link prealloc[DELTA_CHAIN_PREALLOC];
+};
+
+static struct delta_link *delta_chain_push(struct delta_chain *chain)
+{
+	if (chain->length == chain->alloc) {
+		size_t new_alloc = chain->alloc * 2;
+		struct delta_link *links;
+
+		if (chain->links == chain->prealloc) {
+			links = git__malloc(new_alloc * sizeof(struct delta_link));
+			if (links != NULL)
+				memcpy(links, chain->prealloc, sizeof(chain->prealloc));
+		} else
+			links = git__realloc(chain->links, new_alloc * sizeof(struct delta_link));
+
+		if (links == NULL)
+			return NULL;
+
+		chain->links = links;
+		chain->alloc = new_alloc;
+	}
+
+	return &chain->links[chain->length++];
+}
+
+/*
+ * Walk down the delta chain starting at `obj_offset`, recording
+ * every link until we either find a base in the delta base cache
+ * or reach a plain object, which is then inflated into `base`.
+ */
+static int delta_chain_resolve_base(
+		git_rawobj *base,
+		struct delta_chain *chain,
 		struct git_pack_file *p,
-		git_mwindow **w_curs,
-		off_t *curpos,
-		size_t delta_size,
-		git_otype delta_type,
-		off_t obj_offset)
+		off_t obj_offset,
+		off_t *end_pos)
 {
-	off_t base_offset;
-	git_rawobj base, delta;
+	git_mwindow *w_curs = NULL;
+	off_t curpos = obj_offset;
+	size_t size;
+	git_otype type;
 	int error;
 
-	base_offset = get_delta_base(p, w_curs, curpos, delta_type, obj_offset);
-	if (base_offset == 0)
-		return git__throw(GIT_EOBJCORRUPTED, "Delta offset is zero");
-	if (base_offset < 0)
-		return git__rethrow(base_offset, "Failed to get delta base");
+	for (;;) {
+		struct delta_link *link;
+		off_t base_offset;
 
-	git_mwindow_close(w_curs);
-	error = git_packfile_unpack(&base, p, &base_offset);
+		curpos = obj_offset;
+		error = git_packfile_unpack_header(&size, &type, &p->mwf, &w_curs, &curpos);
+		if (error < GIT_SUCCESS)
+			break;
 
-	/*
-	 * TODO: git.git tries to load the base from other packfiles
-	 * or loose objects.
-	 *
-	 * We'll need to do this in order to support thin packs.
-	 */
-	if (error < GIT_SUCCESS)
-		return git__rethrow(error, "Corrupted delta");
+		if (type != GIT_OBJ_OFS_DELTA && type != GIT_OBJ_REF_DELTA)
+			break;
 
-	error = packfile_unpack_compressed(&delta, p, w_curs, curpos, delta_size, delta_type);
-	if (error < GIT_SUCCESS) {
-		git__free(base.data);
-		return git__rethrow(error, "Corrupted delta");
+		base_offset = get_delta_base(p, &w_curs, &curpos, type, obj_offset);
+		git_mwindow_close(&w_curs);
+
+		if (base_offset == 0)
+			return git__throw(GIT_EOBJCORRUPTED, "Delta offset is zero");
+
+		/*
+		 * Thin packs are completed with their missing bases when
+		 * they're indexed, so the base of a REF_DELTA which is not
+		 * in this pack means the pack is broken.
+		 */
+		if (base_offset < 0)
+			return git__rethrow((int)base_offset, "Failed to get delta base");
+
+		if ((link = delta_chain_push(chain)) == NULL)
+			return GIT_ENOMEM;
+
+		link->base_offset = base_offset;
+		link->data_pos = curpos;
+		link->size = size;
+		link->type = type;
+
+		if (cache_take(base, p, base_offset) == GIT_SUCCESS)
+			return GIT_SUCCESS;
+
+		obj_offset = base_offset;
+	}
+
+	if (error == GIT_SUCCESS) {
+		switch (type) {
+		case GIT_OBJ_COMMIT:
+		case GIT_OBJ_TREE:
+		case GIT_OBJ_BLOB:
+		case GIT_OBJ_TAG:
+			error = packfile_unpack_compressed(
+					base, p, &w_curs, &curpos,
+					size, type);
+			break;
+
+		default:
+			error = git__throw(GIT_EOBJCORRUPTED, "Invalid object type in packfile");
+			break;
+		}
 	}
 
-	obj->type = base.type;
-	error = git__delta_apply(obj,
-			base.data, base.len,
-			delta.data, delta.len);
+	git_mwindow_close(&w_curs);
 
-	git__free(base.data);
-	git__free(delta.data);
+	/* a plain object: it is where the requested object ends */
+	if (error == GIT_SUCCESS && chain->length == 0)
+		*end_pos = curpos;
 
-	/* TODO: we might want to cache this shit. eventually */
-	//add_delta_base_cache(p, base_offset, base, base_size, *type);
-	return error; /* error set by git__delta_apply */
+	return error;
 }
 
+/*
+ * Unpack an object without recursing through its delta chain.
+ *
+ * The offsets of the whole chain are collected first, and then
+ * the deltas are applied bottom-up. At any time we hold at most
+ * one base, one result and one delta in memory; the intermediate
+ * bases are handed to the delta base cache as soon as they have
+ * been used.
+ */
 int git_packfile_unpack(
 		git_rawobj *obj,
 		struct git_pack_file *p,
 		off_t *obj_offset)
 {
-	git_mwindow *w_curs = NULL;
-	off_t curpos = *obj_offset;
+	struct delta_chain chain;
+	git_rawobj base, delta, result;
+	off_t end_pos = 0;
 	int error;
 
-	size_t size = 0;
-	git_otype type;
-
 	/*
 	 * TODO: optionally check the CRC on the packfile
 	 */
@@ -329,38 +561,56 @@ int git_packfile_unpack(
 	obj->len = 0;
 	obj->type = GIT_OBJ_BAD;
 
-	error = git_packfile_unpack_header(&size, &type, &p->mwf, &w_curs, &curpos);
-	if (error < GIT_SUCCESS)
-		return git__rethrow(error, "Failed to unpack packfile");
+	chain.links = chain.prealloc;
+	chain.length = 0;
+	chain.alloc = DELTA_CHAIN_PREALLOC;
 
-	switch (type) {
-	case GIT_OBJ_OFS_DELTA:
-	case GIT_OBJ_REF_DELTA:
-		error = packfile_unpack_delta(
-				obj, p, &w_curs, &curpos,
-				size, type, *obj_offset);
-		break;
+	base.data = NULL;
+
+	error = delta_chain_resolve_base(&base, &chain, p, *obj_offset, &end_pos);
+
+	while (error == GIT_SUCCESS && chain.length > 0) {
+		struct delta_link *link = &chain.links[--chain.length];
+		git_mwindow *w_curs = NULL;
+		off_t curpos = link->data_pos;
 
-	case GIT_OBJ_COMMIT:
-	case GIT_OBJ_TREE:
-	case GIT_OBJ_BLOB:
-	case GIT_OBJ_TAG:
 		error = packfile_unpack_compressed(
-				obj, p, &w_curs, &curpos,
-				size, type);
-		break;
+				&delta, p, &w_curs, &curpos,
+				link->size, link->type);
+		git_mwindow_close(&w_curs);
 
-	default:
-		error = GIT_EOBJCORRUPTED;
-		break;
+		if (error < GIT_SUCCESS)
+			break;
+
+		result.type = base.type;
+		error = git__delta_apply(&result,
+				base.data, base.len,
+				delta.data, delta.len);
+
+		git__free(delta.data);
+		cache_add(p, link->base_offset, &base);
+		base.data = NULL;
+
+		if (error < GIT_SUCCESS)
+			break;
+
+		memcpy(&base, &result, sizeof(git_rawobj));
+
+		/* the top of the chain is the object we were asked for */
+		if (chain.length == 0)
+			end_pos = curpos;
 	}
 
-	git_mwindow_close(&w_curs);
+	if (chain.links != chain.prealloc)
+		git__free(chain.links);
 
-	if (error < GIT_SUCCESS)
+	if (error < GIT_SUCCESS) {
+		git__free(base.data);
 		return git__rethrow(error, "Failed to unpack object");
+	}
 
-	*obj_offset = curpos;
+	memcpy(obj, &base, sizeof(git_rawobj));
+	*obj_offset = end_pos;
 	return GIT_SUCCESS;
 }
 
@@ -472,6 +722,403 @@ off_t get_delta_base(
 	return base_offset;
 }
 
+/***********************************************************
+ *
+ * STREAMING READS
+ *
+ ***********************************************************/
+
+/* Room for the delta instructions being applied; one never takes more than 8 bytes */
+#define PACK_STREAM_DELTA_BUF 16384
+
+static int stream_init(git_packfile_stream *obj, struct git_pack_file *p, off_t curpos)
+{
+	memset(obj, 0x0, sizeof(git_packfile_stream));
+
+	obj->p = p;
+	obj->curpos = curpos;
+
+	if (inflateInit(&obj->zstream) != Z_OK)
+		return git__throw(GIT_EZLIB, "Failed to init packfile stream");
+
+	return GIT_SUCCESS;
+}
+
+/*
+ * Inflate up to `len` bytes into `out`, from wherever we are in the
+ * pack. Fewer bytes come out only at the end of the zlib stream.
+ */
+static int stream_inflate(git_packfile_stream *obj, unsigned char *out, size_t len, size_t *out_len)
+{
+	git_mwindow *w_curs = NULL;
+	int error = GIT_SUCCESS;
+
+	obj->zstream.next_out = out;
+	obj->zstream.avail_out = (uInt)len;
+
+	while (obj->zstream.avail_out > 0 && !obj->zstream_end) {
+		uInt avail_out = obj->zstream.avail_out;
+		unsigned char *in;
+		int st;
+
+		in = pack_window_open(obj->p, &w_curs, obj->curpos, &obj->zstream.avail_in);
+		if (in == NULL) {
+			error = git__throw(GIT_EOBJCORRUPTED,
+				"Failed to read packed object. It goes past the end of the pack");
+			break;
+		}
+
+		obj->zstream.next_in = in;
+		st = inflate(&obj->zstream, Z_NO_FLUSH);
+		obj->curpos += obj->zstream.next_in - in;
+
+		if (st == Z_STREAM_END)
+			obj->zstream_end = 1;
+		else if (st != Z_OK && !(st == Z_BUF_ERROR && obj->zstream.avail_out < avail_out)) {
+			error = git__throw(GIT_EZLIB, "Failed to inflate packed object");
+			break;
+		}
+	}
+
+	git_mwindow_close(&w_curs);
+
+	*out_len = len - obj->zstream.avail_out;
+	return error;
+}
+
+/* Make sure there are `need` bytes of delta instructions at hand */
+static int delta_fill(git_packfile_stream *obj, size_t need)
+{
+	size_t left = obj->delta_len - obj->delta_pos;
+
+	if (left >= need)
+		return GIT_SUCCESS;
+
+	memmove(obj->delta_buf, obj->delta_buf + obj->delta_pos, left);
+	obj->delta_pos = 0;
+	obj->delta_len = left;
+
+	while (obj->delta_len < need) {
+		size_t inflated;
+		int error;
+
+		if (obj->zstream_end)
+			return git__throw(GIT_EOBJCORRUPTED, "Failed to apply delta. The delta is truncated");
+
+		error = stream_inflate(obj, obj->delta_buf + obj->delta_len,
+			PACK_STREAM_DELTA_BUF - obj->delta_len, &inflated);
+		if (error < GIT_SUCCESS)
+			return error;
+
+		obj->delta_len += inflated;
+	}
+
+	return GIT_SUCCESS;
+}
+
+static int delta_hdr_sz(git_packfile_stream *obj, size_t *size)
+{
+	size_t r = 0;
+	unsigned int c, shift = 0;
+	int error;
+
+	do {
+		if ((error = delta_fill(obj, 1)) < GIT_SUCCESS)
+			return error;
+
+		c = obj->delta_buf[obj->delta_pos++];
+		r |= (c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+
+	*size = r;
+	return GIT_SUCCESS;
+}
+
+/* Read the base and result sizes at the start of a delta */
+static int delta_open(git_packfile_stream *obj, size_t *base_size, size_t *result_size)
+{
+	int error;
+
+	obj->delta_buf = git__malloc(PACK_STREAM_DELTA_BUF);
+	if (obj->delta_buf == NULL)
+		return GIT_ENOMEM;
+
+	if ((error = delta_hdr_sz(obj, base_size)) < GIT_SUCCESS ||
+		(error = delta_hdr_sz(obj, result_size)) < GIT_SUCCESS)
+		return error;
+
+	return GIT_SUCCESS;
+}
+
+/* Decode the next instruction; see git__delta_apply */
+static int delta_next_op(git_packfile_stream *obj)
+{
+	const unsigned char *delta;
+	unsigned char cmd;
+	size_t left = obj->size - obj->read;
+	int error;
+
+	if ((error = delta_fill(obj, 1)) < GIT_SUCCESS)
+		return error;
+
+	cmd = obj->delta_buf[obj->delta_pos];
+
+	if (cmd & 0x80) {
+		/* cmd is a copy instruction; copy from the base */
+		size_t off = 0, len = 0, need = 1;
+		unsigned char bits;
+
+		for (bits = cmd & 0x7f; bits; bits >>= 1)
+			need += bits & 1;
+
+		if ((error = delta_fill(obj, need)) < GIT_SUCCESS)
+			return error;
+
+		delta = obj->delta_buf + obj->delta_pos + 1;
+		obj->delta_pos += need;
+
+		if (cmd & 0x01) off = *delta++;
+		if (cmd & 0x02) off |= *delta++ << 8;
+		if (cmd & 0x04) off |= *delta++ << 16;
+		if (cmd & 0x08) off |= *delta++ << 24;
+
+		if (cmd & 0x10) len = *delta++;
+		if (cmd & 0x20) len |= *delta++ << 8;
+		if (cmd & 0x40) len |= *delta++ << 16;
+		if (!len)		len = 0x10000;
+
+		if (obj->base.len < off + len || left < len)
+			return git__throw(GIT_ERROR, "Failed to apply delta");
+
+		obj->copy_from = (const unsigned char *)obj->base.data + off;
+		obj->copy_left = len;
+
+	} else if (cmd) {
+		/* cmd is a literal insert instruction; copy from the delta */
+		if (left < cmd)
+			return git__throw(GIT_ERROR, "Failed to apply delta");
+
+		obj->delta_pos++;
+		obj->insert_left = cmd;
+
+	} else {
+		/* cmd == 0 is reserved for future encodings */
+		return git__throw(GIT_ERROR, "Failed to apply delta");
+	}
+
+	return GIT_SUCCESS;
+}
+
+static int delta_stream_read(git_packfile_stream *obj, unsigned char *out, size_t len)
+{
+	size_t done = 0;
+	int error;
+
+	while (done < len && obj->read < obj->size) {
+		size_t n;
+
+		if (obj->copy_left > 0) {
+			n = min(obj->copy_left, len - done);
+			memcpy(out + done, obj->copy_from, n);
+			obj->copy_from += n;
+			obj->copy_left -= n;
+		} else if (obj->insert_left > 0) {
+			if ((error = delta_fill(obj, 1)) < GIT_SUCCESS)
+				return error;
+
+			n = min(obj->insert_left, len - done);
+			n = min(n, obj->delta_len - obj->delta_pos);
+			memcpy(out + done, obj->delta_buf + obj->delta_pos, n);
+			obj->delta_pos += n;
+			obj->insert_left -= n;
+		} else {
+			if ((error = delta_next_op(obj)) < GIT_SUCCESS)
+				return error;
+			continue;
+		}
+
+		done += n;
+		obj->read += n;
+	}
+
+	return (int)done;
+}
+
+int git_packfile_stream_open(git_packfile_stream *obj, struct git_pack_file *p, off_t offset)
+{
+	git_mwindow *w_curs = NULL;
+	off_t curpos = offset, base_offset = 0;
+	size_t size, base_size;
+	git_otype type;
+	int error;
+
+	memset(obj, 0x0, sizeof(git_packfile_stream));
+
+	error = git_packfile_unpack_header(&size, &type, &p->mwf, &w_curs, &curpos);
+	if (error == GIT_SUCCESS && (type == GIT_OBJ_OFS_DELTA || type == GIT_OBJ_REF_DELTA)) {
+		base_offset = get_delta_base(p, &w_curs, &curpos, type, offset);
+		if (base_offset == 0)
+			error = git__throw(GIT_EOBJCORRUPTED, "Delta offset is zero");
+		else if (base_offset < 0)
+			error = git__rethrow((int)base_offset, "Failed to get delta base");
+	}
+	git_mwindow_close(&w_curs);
+
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to open packfile stream");
+
+	if ((error = stream_init(obj, p, curpos)) < GIT_SUCCESS)
+		return error;
+
+	switch (type) {
+	case GIT_OBJ_COMMIT:
+	case GIT_OBJ_TREE:
+	case GIT_OBJ_BLOB:
+	case GIT_OBJ_TAG:
+		obj->type = type;
+		obj->size = size;
+		return GIT_SUCCESS;
+
+	case GIT_OBJ_OFS_DELTA:
+	case GIT_OBJ_REF_DELTA:
+		break;
+
+	default:
+		git_packfile_stream_free(obj);
+		return git__throw(GIT_EOBJCORRUPTED, "Invalid object type in packfile");
+	}
+
+	/* the base is random access, so it has to be in memory */
+	obj->base_offset = base_offset;
+	error = git_packfile_unpack(&obj->base, p, &base_offset);
+
+	if (error == GIT_SUCCESS)
+		error = delta_open(obj, &base_size, &obj->size);
+
+	if (error == GIT_SUCCESS && base_size != obj->base.len)
+		error = git__throw(GIT_ERROR,
+			"Failed to apply delta. Base size does not match given data");
+
+	if (error < GIT_SUCCESS) {
+		git_packfile_stream_free(obj);
+		return git__rethrow(error, "Failed to open packfile stream");
+	}
+
+	obj->type = obj->base.type;
+	return GIT_SUCCESS;
+}
+
+int git_packfile_stream_read(git_packfile_stream *obj, void *buffer, size_t len)
+{
+	size_t inflated;
+	int error;
+
+	/* we report how much we read as an int */
+	if (len > INT_MAX)
+		len = INT_MAX;
+
+	if (len > obj->size - obj->read)
+		len = obj->size - obj->read;
+
+	if (len == 0)
+		return 0;
+
+	if (obj->delta_buf != NULL)
+		error = delta_stream_read(obj, buffer, len);
+	else {
+		error = stream_inflate(obj, buffer, len, &inflated);
+
+		if (error == GIT_SUCCESS && inflated < len)
+			error = git__throw(GIT_EOBJCORRUPTED,
+				"Failed to read packed object. It is shorter than its header says");
+
+		if (error == GIT_SUCCESS) {
+			obj->read += inflated;
+			error = (int)inflated;
+		}
+	}
+
+	return error < GIT_SUCCESS ?
+		git__rethrow(error, "Failed to read from packfile stream") :
+		error;
+}
+
+void git_packfile_stream_free(git_packfile_stream *obj)
+{
+	inflateEnd(&obj->zstream);
+
+	/* someone may well read the next version of this object too */
+	if (obj->base.data != NULL)
+		cache_add(obj->p, obj->base_offset, &obj->base);
+
+	git__free(obj->delta_buf);
+	memset(obj, 0x0, sizeof(git_packfile_stream));
+}
+
+int git_packfile_resolve_header(
+		size_t *size_p,
+		git_otype *type_p,
+		struct git_pack_file *p,
+		off_t offset)
+{
+	git_mwindow *w_curs = NULL;
+	off_t curpos = offset, base_offset;
+	size_t size;
+	git_otype type;
+	int error;
+
+	error = git_packfile_unpack_header(&size, &type, &p->mwf, &w_curs, &curpos);
+	git_mwindow_close(&w_curs);
+	if (error < GIT_SUCCESS)
+		return error;
+
+	*size_p = size;
+
+	/* the size of a delta's result is at the start of the delta */
+	if (type == GIT_OBJ_OFS_DELTA || type == GIT_OBJ_REF_DELTA) {
+		git_packfile_stream delta;
+		size_t base_size;
+
+		base_offset = get_delta_base(p, &w_curs, &curpos, type, offset);
+		git_mwindow_close(&w_curs);
+
+		if (base_offset <= 0)
+			return git__throw(GIT_EOBJCORRUPTED, "Failed to get delta base");
+
+		if ((error = stream_init(&delta, p, curpos)) < GIT_SUCCESS)
+			return error;
+
+		error = delta_open(&delta, &base_size, size_p);
+
+		inflateEnd(&delta.zstream);
+		git__free(delta.delta_buf);
+
+		if (error < GIT_SUCCESS)
+			return error;
+	}
+
+	/* and its type is the one of the plain object at the bottom of the chain */
+	while (type == GIT_OBJ_OFS_DELTA || type == GIT_OBJ_REF_DELTA) {
+		offset = base_offset;
+		curpos = offset;
+
+		error = git_packfile_unpack_header(&size, &type, &p->mwf, &w_curs, &curpos);
+		if (error == GIT_SUCCESS && (type == GIT_OBJ_OFS_DELTA || type == GIT_OBJ_REF_DELTA)) {
+			base_offset = get_delta_base(p, &w_curs, &curpos, type, offset);
+			if (base_offset <= 0)
+				error = git__throw(GIT_EOBJCORRUPTED, "Failed to get delta base");
+		}
+		git_mwindow_close(&w_curs);
+
+		if (error < GIT_SUCCESS)
+			return error;
+	}
+
+	*type_p = type;
+	return GIT_SUCCESS;
+}
+
 /***********************************************************
  *
  * PACKFILE METHODS
@@ -483,6 +1130,7 @@ static struct git_pack_file *packfile_alloc(int extra)
 	struct git_pack_file *p = git__malloc(sizeof(*p) + extra);
 	memset(p, 0, sizeof(*p));
 	p->mwf.fd = -1;
+	git_pack_cache_init(&p->bases);
 	return p;
 }
 
@@ -491,7 +1139,7 @@ void packfile_free(struct git_pack_file *p)
 {
 	assert(p);
 
-	/* clear_delta_base_cache(); */
+	git_pack_cache_free(&p->bases);
 	git_mwindow_free_all(&p->mwf);
 
 	if (p->mwf.fd != -1)
@@ -779,3 +1427,56 @@ int git_pack_entry_find(
 	git_oid_cpy(&e->sha1, &found_oid);
 	return GIT_SUCCESS;
 }
+
+int git_pack_entry_at(
+		struct git_pack_entry *e,
+		struct git_pack_file *p,
+		const git_oid *oid,
+		off_t offset)
+{
+	assert(p);
+
+	if (p->mwf.fd == -1 && packfile_open(p) < GIT_SUCCESS)
+		return git__throw(GIT_EOSERR, "Failed to find pack entry. Packfile doesn't exist on disk");
+
+	e->offset = offset;
+	e->p = p;
+
+	git_oid_cpy(&e->sha1, oid);
+	return GIT_SUCCESS;
+}
+
+int git_pack_foreach_entry(
+		struct git_pack_file *p,
+		int (*cb)(const git_oid *oid, off_t offset, void *data),
+		void *data)
+{
+	const unsigned char *index;
+	unsigned stride;
+	uint32_t i;
+	int error;
+
+	if ((error = pack_index_open(p)) < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to iterate pack entries");
+
+	index = p->index_map.data;
+	index += 4 * 256;
+
+	if (p->index_version > 1) {
+		stride = 20;
+		index += 8;
+	} else {
+		stride = 24;
+		index += 4;
+	}
+
+	for (i = 0; i < p->num_objects; ++i) {
+		error = cb((const git_oid *)(index + i * stride),
+			nth_packed_object_offset(p, i), data);
+
+		if (error < GIT_SUCCESS)
+			return git__rethrow(error, "Failed to iterate pack entries");
+	}
+
+	return GIT_SUCCESS;
+}
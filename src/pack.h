@@ -9,6 +9,7 @@
 #define INCLUDE_pack_h__
 
 #include "git2/oid.h"
+#include <zlib.h>
 
 #include "common.h"
 #include "map.h"
@@ -51,6 +52,31 @@ struct git_pack_idx_header {
 	uint32_t idx_version;
 };
 
+/*
+ * Cache of inflated delta bases, keyed by their offset in the
+ * packfile. This is the same direct-mapped scheme used by git.git:
+ * a fixed table of slots, plus an LRU list so we can evict the
+ * oldest bases once the memory limit has been reached.
+ *
+ * Lookups take the base out of the cache, so the caller owns it
+ * while applying a delta and hands it back afterwards.
+ */
+#define GIT_PACK_CACHE_SLOTS 256
+#define GIT_PACK_CACHE_LIMIT (16 * 1024 * 1024)
+
+typedef struct git_pack_cache_entry {
+	git_off_t offset;
+	git_rawobj raw;
+	struct git_pack_cache_entry *lru_prev, *lru_next;
+} git_pack_cache_entry;
+
+typedef struct {
+	git_pack_cache_entry *slots[GIT_PACK_CACHE_SLOTS];
+	git_pack_cache_entry *lru_head, *lru_tail;
+	size_t memory_used;
+	git_mutex lock;
+} git_pack_cache;
+
 struct git_pack_file {
 	git_mwindow_file mwf;
 	git_map index_map;
@@ -61,9 +87,10 @@ struct git_pack_file {
 
 	int index_version;
 	git_time_t mtime;
-	unsigned pack_local:1, pack_keep:1, has_cache:1;
+	unsigned pack_local:1, pack_keep:1, has_cache:1, in_midx:1;
 	git_oid sha1;
 	git_vector cache;
+	git_pack_cache bases;
 
 	/* something like ".git/objects/pack/xxxxx.pack" */
 	char pack_name[GIT_FLEX_ARRAY]; /* more */
@@ -84,10 +111,54 @@ int git_packfile_unpack_header(
 
 int git_packfile_unpack(git_rawobj *obj, struct git_pack_file *p, off_t *obj_offset);
 
+/*
+ * The size and type of the object at `offset`, without inflating
+ * it; for a delta, only its header and those of its bases are read.
+ */
+int git_packfile_resolve_header(
+		size_t *size_p,
+		git_otype *type_p,
+		struct git_pack_file *p,
+		off_t offset);
+
+/*
+ * Read an object out of a pack a chunk at a time. A plain object
+ * is inflated straight into the caller's buffer. A delta is applied
+ * as its instructions are inflated, on top of its base, which is
+ * the only thing that's kept in memory whole.
+ */
+typedef struct {
+	struct git_pack_file *p;
+	off_t curpos;
+	z_stream zstream;
+	int zstream_end;
+
+	git_otype type;
+	size_t size, read;
+
+	/* for a delta: its base, and the instructions being applied */
+	git_rawobj base;
+	off_t base_offset;
+	unsigned char *delta_buf;
+	size_t delta_pos, delta_len;
+	const unsigned char *copy_from;
+	size_t copy_left, insert_left;
+} git_packfile_stream;
+
+int git_packfile_stream_open(git_packfile_stream *obj, struct git_pack_file *p, off_t offset);
+
+/* Returns how many bytes were read into `buffer`, 0 at the end of the object */
+int git_packfile_stream_read(git_packfile_stream *obj, void *buffer, size_t len);
+
+void git_packfile_stream_free(git_packfile_stream *obj);
+
 off_t get_delta_base(struct git_pack_file *p, git_mwindow **w_curs,
 		off_t *curpos, git_otype type,
 		off_t delta_obj_offset);
 
+void git_pack_cache_init(git_pack_cache *cache);
+void git_pack_cache_free(git_pack_cache *cache);
+
 void packfile_free(struct git_pack_file *p);
 int git_packfile_check(struct git_pack_file **pack_out, const char *path);
 int git_pack_entry_find(
@@ -96,4 +167,20 @@ int git_pack_entry_find(
 		const git_oid *short_oid,
 		unsigned int len);
 
+/*
+ * Fill `e` for an object whose location is already known (e.g.
+ * from a multi-pack-index), making sure the packfile is open.
+ */
+int git_pack_entry_at(
+		struct git_pack_entry *e,
+		struct git_pack_file *p,
+		const git_oid *oid,
+		off_t offset);
+
+/* Call `cb` for every object in the index of the pack, in oid order */
+int git_pack_foreach_entry(
+		struct git_pack_file *p,
+		int (*cb)(const git_oid *oid, off_t offset, void *data),
+		void *data);
+
 #endif
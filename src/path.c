@@ -593,6 +593,16 @@ int git_path_dirload_with_stat(
 	const char *path,
 	size_t prefix_len,
 	git_vector *contents)
+{
+	return git_path_dirload_with_known_stat(path, prefix_len, contents, NULL, NULL);
+}
+
+int git_path_dirload_with_known_stat(
+	const char *path,
+	size_t prefix_len,
+	git_vector *contents,
+	int (*known_stat)(void *payload, const char *path, struct stat *st),
+	void *payload)
 {
 	int error;
 	unsigned int i;
@@ -614,9 +624,11 @@ int git_path_dirload_with_stat(
 		memmove(ps->path, ps, path_len + 1);
 		ps->path_len = path_len;
 
-		git_buf_joinpath(&full, full.ptr, ps->path);
-		p_lstat(full.ptr, &ps->st);
-		git_buf_truncate(&full, prefix_len);
+		if (known_stat == NULL || !known_stat(payload, ps->path, &ps->st)) {
+			git_buf_joinpath(&full, full.ptr, ps->path);
+			p_lstat(full.ptr, &ps->st);
+			git_buf_truncate(&full, prefix_len);
+		}
 
 		if (S_ISDIR(ps->st.st_mode)) {
 			ps->path[path_len] = '/';
@@ -268,4 +268,16 @@ extern int git_path_dirload_with_stat(
 	size_t prefix_len,
 	git_vector *contents);
 
+/**
+ * Like git_path_dirload_with_stat, but `known_stat` is asked for the
+ * stat info of each entry first; only the entries it doesn't fill in
+ * (returning 0) are lstat()ed.
+ */
+extern int git_path_dirload_with_known_stat(
+	const char *path,
+	size_t prefix_len,
+	git_vector *contents,
+	int (*known_stat)(void *payload, const char *path, struct stat *st),
+	void *payload);
+
 #endif
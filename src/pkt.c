@@ -279,13 +279,20 @@ int git_pkt_send_flush(int s)
 
 static int buffer_want_with_caps(git_remote_head *head, git_transport_caps *caps, git_buf *buf)
 {
-	char capstr[20];
+	char capstr[32] = {0};
 	char oid[GIT_OID_HEXSZ +1] = {0};
 	int len;
 
 	if (caps->ofs_delta)
 		strcpy(capstr, GIT_CAP_OFS_DELTA);
 
+	/* we can complete thin packs with the objects we already have */
+	if (caps->thin_pack) {
+		if (capstr[0])
+			strcat(capstr, " ");
+		strcat(capstr, GIT_CAP_THIN_PACK);
+	}
+
 	len = strlen("XXXXwant ") + GIT_OID_HEXSZ + 1 /* NUL */ + strlen(capstr) + 1 /* LF */;
 	git_buf_grow(buf, buf->size + len);
 
@@ -48,3 +48,46 @@ int git_protocol_store_refs(git_protocol *p, const char *data, size_t len)
 
 	return error;
 }
+
+/* The capabilities come after the first ref the server sends */
+int git_protocol_detect_caps(git_vector *refs, git_transport_caps *caps)
+{
+	git_pkt_ref *pkt = NULL;
+	const char *ptr;
+	unsigned int i;
+
+	for (i = 0; i < refs->length; ++i) {
+		pkt = git_vector_get(refs, i);
+		if (pkt->type == GIT_PKT_REF)
+			break;
+
+		pkt = NULL;
+	}
+
+	/* No refs or capabilites, odd but not a problem */
+	if (pkt == NULL || pkt->capabilities == NULL)
+		return GIT_SUCCESS;
+
+	ptr = pkt->capabilities;
+	while (ptr != NULL && *ptr != '\0') {
+		if (*ptr == ' ')
+			ptr++;
+
+		if(!git__prefixcmp(ptr, GIT_CAP_OFS_DELTA)) {
+			caps->common = caps->ofs_delta = 1;
+			ptr += strlen(GIT_CAP_OFS_DELTA);
+			continue;
+		}
+
+		if(!git__prefixcmp(ptr, GIT_CAP_THIN_PACK)) {
+			caps->common = caps->thin_pack = 1;
+			ptr += strlen(GIT_CAP_THIN_PACK);
+			continue;
+		}
+
+		/* We don't know this capability, so skip it */
+		ptr = strchr(ptr, ' ');
+	}
+
+	return GIT_SUCCESS;
+}
@@ -511,6 +511,302 @@ cleanup:
 	return git__rethrow(error, "Failed to load packed references");
 }
 
+/*
+ * Looking up a single reference doesn't need all of them in memory:
+ * a sorted packed-refs file is mapped and binary searched in place,
+ * and only the record that was asked for is parsed. An unsorted one
+ * is loaded whole, like for iteration.
+ *
+ * The file is only mapped for the length of a lookup: Windows can't
+ * replace a file somebody has mapped, and that would keep other
+ * processes from packing refs for as long as the repository is open.
+ * Whether it is sorted is remembered until it changes on disk.
+ */
+enum {
+	PACKMAP_NONE = 0,
+	PACKMAP_SORTED,
+	PACKMAP_UNSORTED
+};
+
+/* Done with the mapping until the next lookup */
+static void packed_release(git_refcache *ref_cache)
+{
+	if (ref_cache->packmap.data != NULL)
+		git_futils_mmap_free(&ref_cache->packmap);
+
+	memset(&ref_cache->packmap, 0x0, sizeof(git_map));
+}
+
+/* Forget about the file altogether */
+static void packed_unmap(git_refcache *ref_cache)
+{
+	packed_release(ref_cache);
+	ref_cache->packmap_state = PACKMAP_NONE;
+	ref_cache->packmap_mtime = 0;
+	ref_cache->packmap_size = 0;
+	ref_cache->packmap_ino = 0;
+}
+
+/* The name of the record at `record`, which ends before `end` */
+static int packed_record_name(
+	const char **name_out,
+	size_t *len_out,
+	const char *record,
+	const char *end)
+{
+	const char *name = record + GIT_OID_HEXSZ + 1, *eol;
+
+	if (name >= end || name[-1] != ' ')
+		return GIT_EPACKEDREFSCORRUPTED;
+
+	eol = memchr(name, '\n', end - name);
+	if (eol == NULL)
+		return GIT_EPACKEDREFSCORRUPTED;
+
+	if (eol > name && eol[-1] == '\r')
+		eol--;
+
+	*name_out = name;
+	*len_out = eol - name;
+	return GIT_SUCCESS;
+}
+
+/* The record after the one at `record`, skipping its peel */
+static const char *packed_record_next(const char *record, const char *end)
+{
+	const char *eol = memchr(record, '\n', end - record);
+
+	if (eol == NULL)
+		return end;
+
+	record = eol + 1;
+	if (record < end && *record == '^') {
+		eol = memchr(record, '\n', end - record);
+		record = (eol == NULL) ? end : eol + 1;
+	}
+
+	return record;
+}
+
+static int packed_name_cmp(
+	const char *a, size_t a_len, const char *b, size_t b_len)
+{
+	int cmp = memcmp(a, b, min(a_len, b_len));
+
+	if (cmp == 0 && a_len != b_len)
+		cmp = (a_len < b_len) ? -1 : 1;
+
+	return cmp;
+}
+
+static const char *packed_records(git_refcache *ref_cache, const char **end_out)
+{
+	const char *records = ref_cache->packmap.data;
+	const char *end = records + ref_cache->packmap.len;
+
+	while (records < end && *records == '#') {
+		const char *eol = memchr(records, '\n', end - records);
+		records = (eol == NULL) ? end : eol + 1;
+	}
+
+	*end_out = end;
+	return records;
+}
+
+static int packed_header_is_sorted(const char *data, size_t len)
+{
+	static const char with[] = "# pack-refs with:";
+	static const char sorted[] = " sorted ";
+	const char *eol, *trait;
+
+	if (len == 0 || (eol = memchr(data, '\n', len)) == NULL || len < sizeof(with) - 1 ||
+		memcmp(data, with, sizeof(with) - 1) != 0)
+		return 0;
+
+	/* the traits are separated, and followed, by spaces */
+	for (trait = data + sizeof(with) - 1; trait + sizeof(sorted) - 1 <= eol; ++trait)
+		if (memcmp(trait, sorted, sizeof(sorted) - 1) == 0)
+			return 1;
+
+	return 0;
+}
+
+/*
+ * Files which don't say they're sorted usually are anyway; checking
+ * that is still much cheaper than loading them.
+ */
+static int packed_records_are_sorted(git_refcache *ref_cache)
+{
+	const char *end, *record = packed_records(ref_cache, &end);
+	const char *prev_name = NULL, *name;
+	size_t prev_len = 0, len;
+
+	for (; record < end; record = packed_record_next(record, end)) {
+		if (packed_record_name(&name, &len, record, end) < GIT_SUCCESS)
+			return 0;
+
+		if (prev_name != NULL &&
+			packed_name_cmp(prev_name, prev_len, name, len) >= 0)
+			return 0;
+
+		prev_name = name;
+		prev_len = len;
+	}
+
+	return 1;
+}
+
+/* Map packed-refs, if it's there; `packed_release()` when done with it */
+static int packed_map(git_repository *repo)
+{
+	git_refcache *ref_cache = &repo->references;
+	git_buf path = GIT_BUF_INIT;
+	struct stat st;
+	git_file fd;
+	int error, known;
+
+	error = git_buf_joinpath(&path, repo->path_repository, GIT_PACKEDREFS_FILE);
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to map packed refs");
+
+	fd = p_open(path.ptr, O_RDONLY);
+	git_buf_free(&path);
+
+	/* no packed refs, nothing to look up */
+	if (fd < 0) {
+		packed_unmap(ref_cache);
+		return GIT_SUCCESS;
+	}
+
+	if (p_fstat(fd, &st) < GIT_SUCCESS || !S_ISREG(st.st_mode) ||
+		!git__is_sizet(st.st_size)) {
+		p_close(fd);
+		packed_unmap(ref_cache);
+		return git__throw(GIT_EOSERR, "Failed to stat packed refs");
+	}
+
+	/* packed-refs is replaced, not rewritten, so this catches every update */
+	known = ref_cache->packmap_state != PACKMAP_NONE &&
+		ref_cache->packmap_mtime == st.st_mtime &&
+		ref_cache->packmap_size == (git_off_t)st.st_size &&
+		ref_cache->packmap_ino == (unsigned int)st.st_ino;
+
+	if (known && (ref_cache->packmap.data != NULL || st.st_size == 0)) {
+		p_close(fd);
+		return GIT_SUCCESS;
+	}
+
+	if (!known)
+		packed_unmap(ref_cache);
+
+	if (st.st_size > 0) {
+		error = git_futils_mmap_ro(&ref_cache->packmap, fd, 0, (size_t)st.st_size);
+		if (error < GIT_SUCCESS) {
+			p_close(fd);
+			memset(&ref_cache->packmap, 0x0, sizeof(git_map));
+			return git__rethrow(error, "Failed to map packed refs");
+		}
+	}
+
+	p_close(fd);
+
+	if (known)
+		return GIT_SUCCESS;
+
+	if (packed_header_is_sorted(ref_cache->packmap.data, ref_cache->packmap.len) ||
+		packed_records_are_sorted(ref_cache))
+		ref_cache->packmap_state = PACKMAP_SORTED;
+	else
+		ref_cache->packmap_state = PACKMAP_UNSORTED;
+
+	ref_cache->packmap_mtime = st.st_mtime;
+	ref_cache->packmap_size = (git_off_t)st.st_size;
+	ref_cache->packmap_ino = (unsigned int)st.st_ino;
+
+	return GIT_SUCCESS;
+}
+
+static int packed_search(git_oid *oid_out, git_refcache *ref_cache, const char *name)
+{
+	const char *end, *lo = packed_records(ref_cache, &end), *hi = end;
+	size_t name_len = strlen(name);
+
+	while (lo < hi) {
+		const char *record = lo + (hi - lo) / 2;
+		const char *record_name;
+		size_t record_len;
+		int cmp;
+
+		/* back up to the start of the line, and of the record */
+		while (record > lo && record[-1] != '\n')
+			record--;
+
+		if (*record == '^') {
+			if (record == lo)
+				return GIT_EPACKEDREFSCORRUPTED;
+
+			record--;
+			while (record > lo && record[-1] != '\n')
+				record--;
+		}
+
+		if (packed_record_name(&record_name, &record_len, record, end) < GIT_SUCCESS)
+			return GIT_EPACKEDREFSCORRUPTED;
+
+		cmp = packed_name_cmp(name, name_len, record_name, record_len);
+
+		if (cmp == 0)
+			return git_oid_fromstr(oid_out, record) < GIT_SUCCESS ?
+				GIT_EPACKEDREFSCORRUPTED : GIT_SUCCESS;
+
+		if (cmp < 0)
+			hi = record;
+		else
+			lo = packed_record_next(record, end);
+	}
+
+	return GIT_ENOTFOUND;
+}
+
+/*
+ * Find the target of a single packed reference, without loading
+ * the others when we can help it
+ */
+static int packed_find(git_oid *oid_out, git_repository *repo, const char *name)
+{
+	git_refcache *ref_cache = &repo->references;
+	struct packref *pack_ref;
+	int error;
+
+	if ((error = packed_map(repo)) < GIT_SUCCESS)
+		return error;
+
+	if (ref_cache->packmap_state == PACKMAP_NONE)
+		return GIT_ENOTFOUND;
+
+	if (ref_cache->packmap_state == PACKMAP_SORTED) {
+		error = packed_search(oid_out, ref_cache, name);
+		packed_release(ref_cache);
+
+		if (error == GIT_EPACKEDREFSCORRUPTED)
+			return git__throw(error, "Failed to parse packed reference");
+
+		return error;
+	}
+
+	packed_release(ref_cache);
+
+	if ((error = packed_load(repo)) < GIT_SUCCESS)
+		return error;
+
+	pack_ref = git_hashtable_lookup(ref_cache->packfile, name);
+	if (pack_ref == NULL)
+		return GIT_ENOTFOUND;
+
+	git_oid_cpy(oid_out, &pack_ref->oid);
+	return GIT_SUCCESS;
+}
+
 
 struct dirent_list_data {
 	git_repository *repo;
@@ -751,12 +1047,28 @@ static int packed_sort(const void *a, const void *b)
 	return strcmp(ref_a->name, ref_b->name);
 }
 
+static int packed_lock(git_filebuf *pack_file, git_repository *repo)
+{
+	git_buf pack_file_path = GIT_BUF_INIT;
+	int error;
+
+	error = git_buf_joinpath(&pack_file_path, repo->path_repository, GIT_PACKEDREFS_FILE);
+	if (error == GIT_SUCCESS)
+		error = git_filebuf_open(pack_file, pack_file_path.ptr, 0);
+
+	git_buf_free(&pack_file_path);
+
+	return error == GIT_SUCCESS ?
+		GIT_SUCCESS :
+		git__rethrow(error, "Failed to open packed references file");
+}
+
 /*
- * Write all the contents in the in-memory packfile to disk.
+ * Write all the contents in the in-memory packfile to `pack_file`,
+ * which has been locked already, and commit it.
  */
-static int packed_write(git_repository *repo)
+static int packed_write_locked(git_repository *repo, git_filebuf *pack_file)
 {
-	git_filebuf pack_file = GIT_FILEBUF_INIT;
 	int error;
 	const char *errmsg = "Failed to write packed references file";
 	unsigned int i;
@@ -768,8 +1080,10 @@ static int packed_write(git_repository *repo)
 
 	total_refs = repo->references.packfile->key_count;
 	if ((error =
-		git_vector_init(&packing_list, total_refs, packed_sort)) < GIT_SUCCESS)
+		git_vector_init(&packing_list, total_refs, packed_sort)) < GIT_SUCCESS) {
+		git_filebuf_cleanup(pack_file);
 		return git__rethrow(error, "Failed to init packed references list");
+	}
 
 	/* Load all the packfile into a vector */
 	{
@@ -784,21 +1098,15 @@ static int packed_write(git_repository *repo)
 	/* sort the vector so the entries appear sorted on the packfile */
 	git_vector_sort(&packing_list);
 
-	/* Now we can open the file! */
-	error = git_buf_joinpath(&pack_file_path, repo->path_repository, GIT_PACKEDREFS_FILE);
-	if (error < GIT_SUCCESS)
-		goto cleanup;
-
-	if ((error = git_filebuf_open(&pack_file, pack_file_path.ptr, 0)) < GIT_SUCCESS) {
-		errmsg = "Failed to open packed references file";
+	/* committing the file frees its path */
+	if ((error = git_buf_sets(&pack_file_path, pack_file->path_original)) < GIT_SUCCESS)
 		goto cleanup;
-	}
 
 	/* Packfiles have a header... apparently
 	 * This is in fact not required, but we might as well print it
 	 * just for kicks */
 	if ((error =
-		 git_filebuf_printf(&pack_file, "%s\n", GIT_PACKEDREFS_HEADER)) < GIT_SUCCESS) {
+		 git_filebuf_printf(pack_file, "%s\n", GIT_PACKEDREFS_HEADER)) < GIT_SUCCESS) {
 		errmsg = "Failed to write packed references file header";
 		goto cleanup;
 	}
@@ -812,7 +1120,7 @@ static int packed_write(git_repository *repo)
 			goto cleanup;
 		}
 
-		if ((error = packed_write_ref(ref, &pack_file)) < GIT_SUCCESS)
+		if ((error = packed_write_ref(ref, pack_file)) < GIT_SUCCESS)
 			goto cleanup;
 	}
 
@@ -820,7 +1128,9 @@ cleanup:
 	/* if we've written all the references properly, we can commit
 	 * the packfile to make the changes effective */
 	if (error == GIT_SUCCESS) {
-		error = git_filebuf_commit(&pack_file, GIT_PACKEDREFS_FILE_MODE);
+		/* a mapped file can't be replaced everywhere */
+		packed_unmap(&repo->references);
+		error = git_filebuf_commit(pack_file, GIT_PACKEDREFS_FILE_MODE);
 
 		/* when and only when the packfile has been properly written,
 		 * we can go ahead and remove the loose refs */
@@ -833,7 +1143,7 @@ cleanup:
 				repo->references.packfile_time = st.st_mtime;
 		}
 	}
-	else git_filebuf_cleanup(&pack_file);
+	else git_filebuf_cleanup(pack_file);
 
 	git_vector_free(&packing_list);
 	git_buf_free(&pack_file_path);
@@ -844,6 +1154,20 @@ cleanup:
 	return error;
 }
 
+/*
+ * Write all the contents in the in-memory packfile to disk.
+ */
+static int packed_write(git_repository *repo)
+{
+	git_filebuf pack_file = GIT_FILEBUF_INIT;
+	int error;
+
+	if ((error = packed_lock(&pack_file, repo)) < GIT_SUCCESS)
+		return error;
+
+	return packed_write_locked(repo, &pack_file);
+}
+
 static int _reference_available_cb(const char *ref, void *data)
 {
 	const char *new, *old;
@@ -893,55 +1217,63 @@ static int reference_exists(int *exists, git_repository *repo, const char *ref_n
 {
 	int error;
 	git_buf ref_path = GIT_BUF_INIT;
-
-	error = packed_load(repo);
-	if (error < GIT_SUCCESS)
-		return git__rethrow(error, "Cannot resolve if a reference exists");
+	git_oid oid;
 
 	error = git_buf_joinpath(&ref_path, repo->path_repository, ref_name);
 	if (error < GIT_SUCCESS)
 		return git__rethrow(error, "Cannot resolve if a reference exists");
 
-	if (git_path_isfile(ref_path.ptr) == GIT_SUCCESS ||
-		git_hashtable_lookup(repo->references.packfile, ref_path.ptr) != NULL) {
-		*exists = 1;
-	} else {
-		*exists = 0;
+	*exists = 1;
+
+	if (git_path_isfile(ref_path.ptr) != GIT_SUCCESS) {
+		error = packed_find(&oid, repo, ref_name);
+
+		if (error == GIT_ENOTFOUND) {
+			*exists = 0;
+			error = GIT_SUCCESS;
+		}
 	}
 
 	git_buf_free(&ref_path);
 
-	return GIT_SUCCESS;
+	return error == GIT_SUCCESS ?
+		GIT_SUCCESS :
+		git__rethrow(error, "Cannot resolve if a reference exists");
 }
 
 static int packed_lookup(git_reference *ref)
 {
 	int error;
-	struct packref *pack_ref = NULL;
+	git_oid oid;
 
-	error = packed_load(ref->owner);
+	error = packed_map(ref->owner);
 	if (error < GIT_SUCCESS)
 		return git__rethrow(error,
 			"Failed to lookup reference from packfile");
 
 	if (ref->flags & GIT_REF_PACKED &&
-		ref->mtime == ref->owner->references.packfile_time)
+		ref->mtime == ref->owner->references.packmap_mtime) {
+		packed_release(&ref->owner->references);
 		return GIT_SUCCESS;
+	}
+
+	/* Look up on the packfile; this releases the mapping */
+	error = packed_find(&oid, ref->owner, ref->name);
+	if (error == GIT_ENOTFOUND)
+		return git__throw(GIT_ENOTFOUND,
+			"Failed to lookup reference from packfile");
+	else if (error < GIT_SUCCESS)
+		return git__rethrow(error,
+			"Failed to lookup reference from packfile");
 
 	if (ref->flags & GIT_REF_SYMBOLIC) {
 		git__free(ref->target.symbolic);
 		ref->target.symbolic = NULL;
 	}
 
-	/* Look up on the packfile */
-	pack_ref = git_hashtable_lookup(ref->owner->references.packfile, ref->name);
-	if (pack_ref == NULL)
-		return git__throw(GIT_ENOTFOUND,
-			"Failed to lookup reference from packfile");
-
 	ref->flags = GIT_REF_OID | GIT_REF_PACKED;
-	ref->mtime = ref->owner->references.packfile_time;
-	git_oid_cpy(&ref->target.oid, &pack_ref->oid);
+	ref->mtime = ref->owner->references.packmap_mtime;
+	git_oid_cpy(&ref->target.oid, &oid);
 
 	return GIT_SUCCESS;
 }
@@ -1588,6 +1920,488 @@ int git_reference_reload(git_reference *ref)
 	return GIT_SUCCESS;
 }
 
+/*
+ * Reference transactions
+ */
+struct git_reference_transaction {
+	git_repository *repo;
+	git_vector updates;
+};
+
+typedef struct {
+	/* GIT_REF_OID, GIT_REF_SYMBOLIC, or GIT_REF_INVALID to delete */
+	git_rtype type;
+	git_oid oid;
+	char *target;
+
+	git_filebuf file;
+	int locked;
+
+	char name[GIT_FLEX_ARRAY];
+} transaction_update;
+
+static int transaction_update_cmp(const void *a, const void *b)
+{
+	const transaction_update *update_a = a, *update_b = b;
+	return strcmp(update_a->name, update_b->name);
+}
+
+static int transaction_update_key_cmp(const void *key, const void *update)
+{
+	return strcmp((const char *)key, ((const transaction_update *)update)->name);
+}
+
+static void transaction_update_free(transaction_update *update)
+{
+	if (update->locked)
+		git_filebuf_cleanup(&update->file);
+
+	git__free(update->target);
+	git__free(update);
+}
+
+static void transaction_clear(git_reference_transaction *tx)
+{
+	unsigned int i;
+	transaction_update *update;
+
+	git_vector_foreach(&tx->updates, i, update)
+		transaction_update_free(update);
+
+	git_vector_clear(&tx->updates);
+}
+
+static int transaction_add(
+	transaction_update **update_out,
+	git_reference_transaction *tx,
+	const char *name,
+	git_rtype type)
+{
+	char normalized[GIT_REFNAME_MAX];
+	transaction_update *update;
+	size_t name_len;
+	int error;
+
+	error = normalize_name(normalized, sizeof(normalized), name, type == GIT_REF_OID);
+	if (error < GIT_SUCCESS)
+		return error;
+
+	name_len = strlen(normalized);
+
+	update = git__calloc(1, sizeof(transaction_update) + name_len + 1);
+	if (update == NULL)
+		return GIT_ENOMEM;
+
+	memcpy(update->name, normalized, name_len);
+	update->type = type;
+
+	if (git_vector_insert(&tx->updates, update) < GIT_SUCCESS) {
+		git__free(update);
+		return GIT_ENOMEM;
+	}
+
+	*update_out = update;
+	return GIT_SUCCESS;
+}
+
+/* Sort the updates by name, keeping only the last one for each name */
+static void transaction_sort(git_reference_transaction *tx)
+{
+	unsigned int i, j;
+
+	/* the sort is stable */
+	git_vector_sort(&tx->updates);
+
+	for (i = 0, j = 1; j < tx->updates.length; ++j) {
+		transaction_update *update = tx->updates.contents[i];
+
+		if (transaction_update_cmp(update, tx->updates.contents[j]) == 0)
+			transaction_update_free(update);
+		else
+			i++;
+
+		tx->updates.contents[i] = tx->updates.contents[j];
+	}
+
+	if (tx->updates.length > 0)
+		tx->updates.length = i + 1;
+}
+
+static transaction_update *transaction_find(git_reference_transaction *tx, const char *name)
+{
+	size_t pos;
+
+	if (git__bsearch(tx->updates.contents, tx->updates.length,
+			name, transaction_update_key_cmp, &pos) < GIT_SUCCESS)
+		return NULL;
+
+	return tx->updates.contents[pos];
+}
+
+/*
+ * Whether `name` would be written where a directory of another
+ * reference is, or the other way around, once the transaction is
+ * committed. `existing` are the sorted names of the references in
+ * the repository.
+ */
+static int transaction_name_conflicts(
+	git_reference_transaction *tx, git_vector *existing, const char *name)
+{
+	char path[GIT_REFNAME_MAX + 1];
+	size_t name_len = strlen(name), pos;
+	const char *slash;
+	transaction_update *update;
+
+	for (slash = strchr(name, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+		memcpy(path, name, slash - name);
+		path[slash - name] = '\0';
+
+		update = transaction_find(tx, path);
+		if (update != NULL) {
+			if (update->type != GIT_REF_INVALID)
+				return 1;
+		} else if (git__bsearch(existing->contents, existing->length,
+				path, git__strcmp_cb, &pos) == GIT_SUCCESS)
+			return 1;
+	}
+
+	memcpy(path, name, name_len);
+	path[name_len] = '/';
+	path[name_len + 1] = '\0';
+
+	git__bsearch(existing->contents, existing->length, path, git__strcmp_cb, &pos);
+	for (; pos < existing->length; ++pos) {
+		const char *ref_name = existing->contents[pos];
+
+		if (git__prefixcmp(ref_name, path) != 0)
+			break;
+
+		update = transaction_find(tx, ref_name);
+		if (update == NULL || update->type != GIT_REF_INVALID)
+			return 1;
+	}
+
+	git__bsearch(tx->updates.contents, tx->updates.length,
+		path, transaction_update_key_cmp, &pos);
+	for (; pos < tx->updates.length; ++pos) {
+		update = tx->updates.contents[pos];
+
+		if (git__prefixcmp(update->name, path) != 0)
+			break;
+
+		if (update->type != GIT_REF_INVALID)
+			return 1;
+	}
+
+	return 0;
+}
+
+static int transaction_check_names(git_reference_transaction *tx)
+{
+	git_vector existing;
+	unsigned int i;
+	transaction_update *update;
+	char *ref_name;
+	int error;
+
+	if (git_vector_init(&existing, 16, git__strcmp_cb) < GIT_SUCCESS)
+		return GIT_ENOMEM;
+
+	/* all of them, once, rather than once per reference like on creation */
+	error = git_reference_foreach(tx->repo, GIT_REF_LISTALL, cb__reflist_add, &existing);
+
+	if (error == GIT_SUCCESS) {
+		git_vector_sort(&existing);
+
+		git_vector_foreach(&tx->updates, i, update) {
+			if (update->type != GIT_REF_INVALID &&
+				transaction_name_conflicts(tx, &existing, update->name)) {
+				error = git__throw(GIT_EEXISTS,
+					"Reference name `%s` conflicts with existing reference", update->name);
+				break;
+			}
+		}
+	}
+
+	git_vector_foreach(&existing, i, ref_name)
+		git__free(ref_name);
+	git_vector_free(&existing);
+
+	return error;
+}
+
+/*
+ * Lock the loose file of every reference, and `packed-refs` when
+ * references are deleted. Nothing changes on disk.
+ */
+static int transaction_lock(
+	git_reference_transaction *tx, git_filebuf *pack_file, int *pack_locked)
+{
+	git_repository *repo = tx->repo;
+	git_buf path = GIT_BUF_INIT;
+	unsigned int i;
+	transaction_update *update;
+	int error = GIT_SUCCESS;
+
+	git_vector_foreach(&tx->updates, i, update) {
+		if (update->type == GIT_REF_INVALID && !*pack_locked) {
+			if ((error = packed_lock(pack_file, repo)) < GIT_SUCCESS)
+				goto cleanup;
+			*pack_locked = 1;
+		}
+	}
+
+	git_vector_foreach(&tx->updates, i, update) {
+		if ((error = git_buf_joinpath(&path, repo->path_repository, update->name)) < GIT_SUCCESS)
+			goto cleanup;
+
+		/* a packed reference has no loose file to lock */
+		if (update->type == GIT_REF_INVALID && git_path_isfile(path.ptr) != GIT_SUCCESS) {
+			git_oid oid;
+
+			error = packed_find(&oid, repo, update->name);
+			if (error == GIT_ENOTFOUND)
+				error = git__throw(GIT_ENOTFOUND,
+					"Failed to delete reference `%s`. Reference not found", update->name);
+			if (error < GIT_SUCCESS)
+				goto cleanup;
+
+			continue;
+		}
+
+		if (update->type != GIT_REF_INVALID &&
+			(error = git_futils_mkpath2file(path.ptr, GIT_REFS_DIR_MODE)) < GIT_SUCCESS)
+			goto cleanup;
+
+		if ((error = git_filebuf_open(&update->file, path.ptr, 0)) < GIT_SUCCESS) {
+			error = git__rethrow(error, "Failed to lock reference `%s`", update->name);
+			goto cleanup;
+		}
+		update->locked = 1;
+	}
+
+cleanup:
+	git_buf_free(&path);
+	return error;
+}
+
+/*
+ * Drop the deleted references from `packed-refs`, if it has any of
+ * them, and write it. This consumes the lock on `pack_file`.
+ */
+static int transaction_write_packed(git_reference_transaction *tx, git_filebuf *pack_file)
+{
+	git_refcache *ref_cache = &tx->repo->references;
+	unsigned int i;
+	transaction_update *update;
+	int error, changed = 0;
+
+	/* it can't change under us anymore */
+	if ((error = packed_load(tx->repo)) < GIT_SUCCESS) {
+		git_filebuf_cleanup(pack_file);
+		return error;
+	}
+
+	git_vector_foreach(&tx->updates, i, update) {
+		struct packref *packref;
+
+		if (update->type == GIT_REF_INVALID &&
+			git_hashtable_remove2(ref_cache->packfile, update->name, (void **)&packref) == GIT_SUCCESS) {
+			git__free(packref);
+			changed = 1;
+		}
+	}
+
+	if (!changed) {
+		git_filebuf_cleanup(pack_file);
+		return GIT_SUCCESS;
+	}
+
+	error = packed_write_locked(tx->repo, pack_file);
+
+	/* don't trust what we have in memory if it didn't make it to disk */
+	if (error < GIT_SUCCESS)
+		ref_cache->packfile_time = 0;
+
+	return error;
+}
+
+int git_reference_transaction_new(git_reference_transaction **tx_out, git_repository *repo)
+{
+	git_reference_transaction *tx;
+
+	assert(tx_out && repo);
+
+	tx = git__calloc(1, sizeof(git_reference_transaction));
+	if (tx == NULL)
+		return GIT_ENOMEM;
+
+	if (git_vector_init(&tx->updates, 16, transaction_update_cmp) < GIT_SUCCESS) {
+		git__free(tx);
+		return GIT_ENOMEM;
+	}
+
+	tx->repo = repo;
+
+	*tx_out = tx;
+	return GIT_SUCCESS;
+}
+
+int git_reference_transaction_set_oid(
+	git_reference_transaction *tx, const char *name, const git_oid *id)
+{
+	transaction_update *update;
+	git_odb *odb;
+	int error, exists;
+
+	assert(tx && name && id);
+
+	error = git_repository_odb__weakptr(&odb, tx->repo);
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to update reference in transaction");
+
+	exists = git_odb_exists(odb, id);
+	git_odb_free(odb);
+
+	/* Don't let the user create references to OIDs that
+	 * don't exist in the ODB */
+	if (!exists)
+		return git__throw(GIT_ENOTFOUND,
+			"Failed to update reference in transaction. OID doesn't exist in ODB");
+
+	if ((error = transaction_add(&update, tx, name, GIT_REF_OID)) < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to update reference in transaction");
+
+	git_oid_cpy(&update->oid, id);
+	return GIT_SUCCESS;
+}
+
+int git_reference_transaction_set_target(
+	git_reference_transaction *tx, const char *name, const char *target)
+{
+	char normalized[GIT_REFNAME_MAX];
+	transaction_update *update;
+	char *target_dup;
+	int error;
+
+	assert(tx && name && target);
+
+	error = normalize_name(normalized, sizeof(normalized), target, 0);
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error,
+			"Failed to update reference in transaction. Invalid target name");
+
+	target_dup = git__strdup(normalized);
+	if (target_dup == NULL)
+		return GIT_ENOMEM;
+
+	if ((error = transaction_add(&update, tx, name, GIT_REF_SYMBOLIC)) < GIT_SUCCESS) {
+		git__free(target_dup);
+		return git__rethrow(error, "Failed to update reference in transaction");
+	}
+
+	update->target = target_dup;
+	return GIT_SUCCESS;
+}
+
+int git_reference_transaction_delete(git_reference_transaction *tx, const char *name)
+{
+	transaction_update *update;
+	int error;
+
+	assert(tx && name);
+
+	if ((error = transaction_add(&update, tx, name, GIT_REF_INVALID)) < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to delete reference in transaction");
+
+	return GIT_SUCCESS;
+}
+
+int git_reference_transaction_commit(git_reference_transaction *tx)
+{
+	git_filebuf pack_file = GIT_FILEBUF_INIT;
+	int pack_locked = 0, error;
+	unsigned int i;
+	transaction_update *update;
+
+	assert(tx);
+
+	transaction_sort(tx);
+
+	if ((error = transaction_check_names(tx)) < GIT_SUCCESS ||
+		(error = transaction_lock(tx, &pack_file, &pack_locked)) < GIT_SUCCESS)
+		goto cleanup;
+
+	/* everything is locked: write the new references next to the old ones */
+	git_vector_foreach(&tx->updates, i, update) {
+		if (update->type == GIT_REF_OID) {
+			char oid[GIT_OID_HEXSZ + 1];
+
+			git_oid_fmt(oid, &update->oid);
+			oid[GIT_OID_HEXSZ] = '\0';
+
+			error = git_filebuf_printf(&update->file, "%s\n", oid);
+		} else if (update->type == GIT_REF_SYMBOLIC)
+			error = git_filebuf_printf(&update->file, GIT_SYMREF "%s\n", update->target);
+
+		if (error < GIT_SUCCESS)
+			goto cleanup;
+	}
+
+	/*
+	 * Deleted references go from `packed-refs` first, so they
+	 * can't show up again with an old value
+	 */
+	if (pack_locked) {
+		pack_locked = 0;
+		if ((error = transaction_write_packed(tx, &pack_file)) < GIT_SUCCESS)
+			goto cleanup;
+	}
+
+	/*
+	 * Now move everything into place; there's no going back, so
+	 * apply as many of the updates as we can
+	 */
+	git_vector_foreach(&tx->updates, i, update) {
+		int an_error = GIT_SUCCESS;
+
+		if (!update->locked)
+			continue;
+
+		if (update->type != GIT_REF_INVALID) {
+			update->locked = 0;
+			an_error = git_filebuf_commit(&update->file, GIT_REFS_FILE_MODE);
+		} else if (p_unlink(update->file.path_original) < GIT_SUCCESS)
+			an_error = git__throw(GIT_EOSERR,
+				"Failed to remove reference `%s`", update->name);
+
+		/* keep the error if we haven't seen one yet */
+		if (error == GIT_SUCCESS)
+			error = an_error;
+	}
+
+cleanup:
+	if (pack_locked)
+		git_filebuf_cleanup(&pack_file);
+
+	/* this also releases the locks we still hold */
+	transaction_clear(tx);
+
+	return error == GIT_SUCCESS ?
+		GIT_SUCCESS :
+		git__rethrow(error, "Failed to commit reference transaction");
+}
+
+void git_reference_transaction_free(git_reference_transaction *tx)
+{
+	if (tx == NULL)
+		return;
+
+	transaction_clear(tx);
+	git_vector_free(&tx->updates);
+	git__free(tx);
+}
+
 
 void git_repository__refcache_free(git_refcache *refs)
 {
@@ -1601,6 +2415,8 @@ void git_repository__refcache_free(git_refcache *refs)
 
 		git_hashtable_free(refs->packfile);
 	}
+
+	packed_unmap(refs);
 }
 
 static int is_valid_ref_char(char ch)
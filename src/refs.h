@@ -11,6 +11,7 @@
 #include "git2/oid.h"
 #include "git2/refs.h"
 #include "hashtable.h"
+#include "map.h"
 
 #define GIT_REFS_DIR "refs/"
 #define GIT_REFS_HEADS_DIR GIT_REFS_DIR "heads/"
@@ -23,7 +24,7 @@
 
 #define GIT_SYMREF "ref: "
 #define GIT_PACKEDREFS_FILE "packed-refs"
-#define GIT_PACKEDREFS_HEADER "# pack-refs with: peeled "
+#define GIT_PACKEDREFS_HEADER "# pack-refs with: peeled sorted "
 #define GIT_PACKEDREFS_FILE_MODE 0666
 
 #define GIT_HEAD_FILE "HEAD"
@@ -48,6 +49,17 @@ struct git_reference {
 typedef struct {
 	git_hashtable *packfile;
 	time_t packfile_time;
+
+	/*
+	 * packed-refs mapped as is, to look up one reference at a time;
+	 * only mapped during a lookup, while the rest stays until the
+	 * file changes
+	 */
+	git_map packmap;
+	int packmap_state;
+	time_t packmap_mtime;
+	git_off_t packmap_size;
+	unsigned int packmap_ino;
 } git_refcache;
 
 void git_repository__refcache_free(git_refcache *refs);
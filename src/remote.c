@@ -334,16 +334,16 @@ int git_remote_ls(git_remote *remote, git_headlist_cb list_cb, void *payload)
 	return remote->transport->ls(remote->transport, list_cb, payload);
 }
 
-int git_remote_download(char **filename, git_remote *remote)
+int git_remote_download(git_remote *remote, git_indexer_stats *stats)
 {
 	int error;
 
-	assert(filename && remote);
+	assert(remote && stats);
 
 	if ((error = git_fetch_negotiate(remote)) < 0)
 		return git__rethrow(error, "Error negotiating");
 
-	return git_fetch_download_pack(filename, remote);
+	return git_fetch_download_pack(remote, stats);
 }
 
 int git_remote_update_tips(git_remote *remote)
@@ -353,7 +353,7 @@ int git_remote_update_tips(git_remote *remote)
 	git_buf refname = GIT_BUF_INIT;
 	git_vector *refs = &remote->refs;
 	git_remote_head *head;
-	git_reference *ref;
+	git_reference_transaction *tx;
 	struct git_refspec *spec = &remote->fetch;
 
 	assert(remote);
@@ -361,15 +361,20 @@ int git_remote_update_tips(git_remote *remote)
 	if (refs->length == 0)
 		return GIT_SUCCESS;
 
+	/* all the tips are written at once, rather than one at a time */
+	error = git_reference_transaction_new(&tx, remote->repo);
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to update tips");
+
 	/* HEAD is only allowed to be the first in the list */
 	head = refs->contents[0];
 	if (!strcmp(head->name, GIT_HEAD_FILE)) {
-		error = git_reference_create_oid(&ref, remote->repo, GIT_FETCH_HEAD_FILE, &head->oid, 1);
+		error = git_reference_transaction_set_oid(tx, GIT_FETCH_HEAD_FILE, &head->oid);
 		i = 1;
-		if (error < GIT_SUCCESS)
+		if (error < GIT_SUCCESS) {
+			git_reference_transaction_free(tx);
 			return git__rethrow(error, "Failed to update FETCH_HEAD");
-
-		git_reference_free(ref);
+		}
 	}
 
 	for (; i < refs->length; ++i) {
@@ -379,13 +384,15 @@ int git_remote_update_tips(git_remote *remote)
 		if (error < GIT_SUCCESS)
 			break;
 
-		error = git_reference_create_oid(&ref, remote->repo, refname.ptr, &head->oid, 1);
+		error = git_reference_transaction_set_oid(tx, refname.ptr, &head->oid);
 		if (error < GIT_SUCCESS)
 			break;
-
-		git_reference_free(ref);
 	}
 
+	if (error == GIT_SUCCESS)
+		error = git_reference_transaction_commit(tx);
+
+	git_reference_transaction_free(tx);
 	git_buf_free(&refname);
 
 	return error;
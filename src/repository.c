@@ -64,6 +64,10 @@ void git_repository_free(git_repository *repo)
 	git_cache_free(&repo->objects);
 	git_repository__refcache_free(&repo->references);
 	git_attr_cache_flush(repo);
+	git_mutex_free(&repo->attrcache.lock);
+
+	if (repo->fsmonitor != NULL)
+		repo->fsmonitor->free(repo->fsmonitor);
 
 	git__free(repo->path_repository);
 	git__free(repo->workdir);
@@ -107,7 +111,7 @@ static git_repository *repository_alloc(void)
 
 	memset(repo, 0x0, sizeof(git_repository));
 
-	error = git_cache_init(&repo->objects, GIT_DEFAULT_CACHE_SIZE, &git_object__free);
+	error = git_cache_init(&repo->objects, &git_object__free);
 	if (error < GIT_SUCCESS) {
 		git__free(repo);
 		return NULL;
@@ -116,6 +120,8 @@ static git_repository *repository_alloc(void)
 	/* set all the entries in the cvar cache to `unset` */
 	git_repository__cvar_cache_clear(repo);
 
+	git_mutex_init(&repo->attrcache.lock);
+
 	return repo;
 }
 
@@ -929,3 +935,37 @@ int git_repository_is_bare(git_repository *repo)
 	assert(repo);
 	return repo->is_bare;
 }
+
+int git_repository_set_cache_limit(git_repository *repo, git_otype type, size_t max_bytes)
+{
+	assert(repo);
+	return git_cache_set_max(&repo->objects, type, max_bytes);
+}
+
+int git_repository_get_cache_limit(size_t *max_bytes, git_repository *repo, git_otype type)
+{
+	assert(max_bytes && repo);
+	return git_cache_get_max(max_bytes, &repo->objects, type);
+}
+
+void git_repository_get_cache_stats(git_cache_stats *stats, git_repository *repo)
+{
+	assert(stats && repo);
+	git_cache_get_stats(stats, &repo->objects);
+}
+
+void git_repository_set_fsmonitor(git_repository *repo, git_fsmonitor *fsmonitor)
+{
+	assert(repo);
+
+	if (repo->fsmonitor == fsmonitor)
+		return;
+
+	if (repo->fsmonitor != NULL)
+		repo->fsmonitor->free(repo->fsmonitor);
+
+	repo->fsmonitor = fsmonitor;
+
+	/* what the index knows came from another monitor, if any */
+	git_index__fsmonitor_clear(repo->_index);
+}
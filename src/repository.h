@@ -12,6 +12,7 @@
 #include "git2/odb.h"
 #include "git2/repository.h"
 #include "git2/object.h"
+#include "git2/fsmonitor.h"
 
 #include "hashtable.h"
 #include "index.h"
@@ -30,6 +31,9 @@
 typedef enum {
 	GIT_CVAR_AUTO_CRLF = 0, /* core.autocrlf */
 	GIT_CVAR_EOL, /* core.eol */
+	GIT_CVAR_SPLIT_INDEX, /* core.splitIndex */
+	GIT_CVAR_PRELOAD_INDEX, /* core.preloadIndex */
+	GIT_CVAR_UNTRACKED_CACHE, /* core.untrackedCache */
 	GIT_CVAR_CACHE_MAX
 } git_cvar_cached;
 
@@ -65,7 +69,24 @@ typedef enum {
 #else
 	GIT_EOL_NATIVE = GIT_EOL_LF,
 #endif
-	GIT_EOL_DEFAULT = GIT_EOL_NATIVE
+	GIT_EOL_DEFAULT = GIT_EOL_NATIVE,
+
+	/* core.splitIndex: unset, false, true */
+	GIT_SPLIT_INDEX_UNSET = 0,
+	GIT_SPLIT_INDEX_FALSE = 1,
+	GIT_SPLIT_INDEX_TRUE = 2,
+	GIT_SPLIT_INDEX_DEFAULT = GIT_SPLIT_INDEX_UNSET,
+
+	/* core.preloadIndex: false, true */
+	GIT_PRELOAD_INDEX_FALSE = 0,
+	GIT_PRELOAD_INDEX_TRUE = 1,
+	GIT_PRELOAD_INDEX_DEFAULT = GIT_PRELOAD_INDEX_TRUE,
+
+	/* core.untrackedCache: 'keep', false, true */
+	GIT_UNTRACKED_CACHE_KEEP = 0,
+	GIT_UNTRACKED_CACHE_FALSE = 1,
+	GIT_UNTRACKED_CACHE_TRUE = 2,
+	GIT_UNTRACKED_CACHE_DEFAULT = GIT_UNTRACKED_CACHE_KEEP
 } git_cvar_value;
 
 /** Base git object for inheritance */
@@ -84,6 +105,9 @@ struct git_repository {
 	git_refcache references;
 	git_attr_cache attrcache;
 
+	/* NULL unless the user set one */
+	git_fsmonitor *fsmonitor;
+
 	char *path_repository;
 	char *workdir;
 
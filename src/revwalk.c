@@ -7,7 +7,10 @@
 
 #include "common.h"
 #include "commit.h"
+#include "commit_graph.h"
 #include "odb.h"
+#include "fileops.h"
+#include "path.h"
 #include "hashtable.h"
 #include "pqueue.h"
 
@@ -17,15 +20,22 @@
 
 typedef struct commit_object {
 	git_oid oid;
-	uint32_t time;
+	git_time_t time;
 	unsigned int seen:1,
 			 uninteresting:1,
 			 topo_delay:1,
-			 parsed:1;
+			 parsed:1,
+			 flags:7;
 
 	unsigned short in_degree;
 	unsigned short out_degree;
 
+	/* row in the commit-graph plus one, or 0 if we don't know it yet */
+	uint32_t graph_pos;
+
+	/* generation number from the commit-graph, or 0 if it isn't in there */
+	uint32_t generation;
+
 	struct commit_object **parents;
 } commit_object;
 
@@ -38,6 +48,9 @@ struct git_revwalk {
 	git_repository *repo;
 	git_odb *odb;
 
+	/* may be NULL if the repository has no (usable) commit-graph */
+	git_commit_graph_file *graph;
+
 	git_hashtable *commits;
 
 	commit_list *iterator_topo;
@@ -97,6 +110,23 @@ static int commit_time_cmp(void *a, void *b)
 	return (commit_a->time < commit_b->time);
 }
 
+/*
+ * Commits newer than the commit-graph have no generation number and
+ * sort before every commit which has one; ties go to the newest.
+ */
+static int commit_generation_cmp(void *a, void *b)
+{
+	commit_object *commit_a = (commit_object *)a;
+	commit_object *commit_b = (commit_object *)b;
+	uint32_t gen_a = commit_a->generation ? commit_a->generation : UINT32_MAX;
+	uint32_t gen_b = commit_b->generation ? commit_b->generation : UINT32_MAX;
+
+	if (gen_a != gen_b)
+		return (gen_a < gen_b);
+
+	return (commit_a->time < commit_b->time);
+}
+
 static uint32_t object_table_hash(const void *key, int hash_id)
 {
 	uint32_t r;
@@ -175,7 +205,7 @@ static int commit_quick_parse(git_revwalk *walk, commit_object *commit, git_rawo
 	unsigned char *parents_start;
 
 	int i, parents = 0;
-	int commit_time;
+	int64_t commit_time;
 
 	buffer += strlen("tree ") + GIT_OID_HEXSZ + 1;
 
@@ -212,10 +242,42 @@ static int commit_quick_parse(git_revwalk *walk, commit_object *commit, git_rawo
 	if (buffer == NULL)
 		return git__throw(GIT_EOBJCORRUPTED, "Failed to parse commit. Can't find author");
 
-	if (git__strtol32(&commit_time, (char *)buffer + 2, NULL, 10) < GIT_SUCCESS)
+	if (git__strtol64(&commit_time, (char *)buffer + 2, NULL, 10) < GIT_SUCCESS)
 		return git__throw(GIT_EOBJCORRUPTED, "Failed to parse commit. Can't parse commit time");
 
-	commit->time = (time_t)commit_time;
+	commit->time = (git_time_t)commit_time;
+	commit->parsed = 1;
+	return GIT_SUCCESS;
+}
+
+/* Fill in the commit from its row in the commit-graph */
+static int commit_parse_graph(git_revwalk *walk, commit_object *commit, git_commit_graph_entry *e)
+{
+	size_t i;
+	int error;
+
+	commit->parents = alloc_parents(commit, e->parent_count);
+	if (commit->parents == NULL)
+		return GIT_ENOMEM;
+
+	for (i = 0; i < e->parent_count; ++i) {
+		uint32_t pos;
+
+		error = git_commit_graph_entry_parent_position(&pos, walk->graph, e, i);
+		if (error < GIT_SUCCESS)
+			return error;
+
+		commit->parents[i] = commit_lookup(walk, &walk->graph->oid_lookup[pos]);
+		if (commit->parents[i] == NULL)
+			return GIT_ENOMEM;
+
+		/* saves looking up the parent when it's its turn */
+		commit->parents[i]->graph_pos = pos + 1;
+	}
+
+	commit->out_degree = (unsigned short)e->parent_count;
+	commit->time = e->commit_time;
+	commit->generation = e->generation;
 	commit->parsed = 1;
 	return GIT_SUCCESS;
 }
@@ -228,6 +290,19 @@ static int commit_parse(git_revwalk *walk, commit_object *commit)
 	if (commit->parsed)
 		return GIT_SUCCESS;
 
+	if (walk->graph != NULL) {
+		git_commit_graph_entry e;
+
+		if (commit->graph_pos)
+			error = git_commit_graph_entry_get_byindex(&e, walk->graph, commit->graph_pos - 1);
+		else
+			error = git_commit_graph_entry_find(&e, walk->graph, &commit->oid, GIT_OID_HEXSZ);
+
+		/* commits newer than the graph are read from the odb below */
+		if (error == GIT_SUCCESS)
+			return commit_parse_graph(walk, commit, &e);
+	}
+
 	if ((error = git_odb_read(&obj, walk->odb, &commit->oid)) < GIT_SUCCESS)
 		return git__rethrow(error, "Failed to parse commit. Can't read object");
 
@@ -544,9 +619,290 @@ static int prepare_walk(git_revwalk *walk)
 	return GIT_SUCCESS;
 }
 
+/*
+ * Merge-bases and ahead/behind counts paint the history from two
+ * commits at once: every commit gets a flag for each side it can be
+ * reached from, and commits reachable from both become STALE.
+ *
+ * Commits come out of the queue by generation number, so by the time
+ * one is popped all of its descendants have been and its flags are
+ * final. Once only STALE commits are queued, nothing further down
+ * can change the answer and the walk stops there.
+ */
+#define PARENT1  (1 << 0)
+#define PARENT2  (1 << 1)
+#define STALE    (1 << 2)
+#define RESULT   (1 << 3)
+#define QUEUED   (1 << 4)
+#define COUNTED1 (1 << 5)
+#define COUNTED2 (1 << 6)
+
+typedef struct {
+	git_revwalk *walk;
+	git_pqueue queue;
+	git_vector painted;
+	size_t nonstale;
+} paint_state;
+
+static int paint_init(paint_state *p, git_revwalk *walk)
+{
+	int error;
+
+	memset(p, 0x0, sizeof(paint_state));
+	p->walk = walk;
+
+	if ((error = git_pqueue_init(&p->queue, 16, commit_generation_cmp)) < GIT_SUCCESS)
+		return error;
+
+	return git_vector_init(&p->painted, 16, NULL);
+}
+
+static void paint_free(paint_state *p)
+{
+	unsigned int i;
+	commit_object *commit;
+
+	git_vector_foreach(&p->painted, i, commit)
+		commit->flags = 0;
+
+	git_vector_free(&p->painted);
+	git_pqueue_free(&p->queue);
+}
+
+static int paint(paint_state *p, commit_object *commit, unsigned int flags)
+{
+	unsigned int old = commit->flags;
+	int error;
+
+	if ((old & flags) == flags)
+		return GIT_SUCCESS;
+
+	if (old == 0 && (error = git_vector_insert(&p->painted, commit)) < GIT_SUCCESS)
+		return error;
+
+	commit->flags |= flags;
+
+	if (old & QUEUED) {
+		if (!(old & STALE) && (flags & STALE))
+			p->nonstale--;
+		return GIT_SUCCESS;
+	}
+
+	/* the queue is ordered by generation and time */
+	if ((error = commit_parse(p->walk, commit)) < GIT_SUCCESS)
+		return error;
 
+	commit->flags |= QUEUED;
+	if (!(commit->flags & STALE))
+		p->nonstale++;
 
+	return git_pqueue_insert(&p->queue, commit);
+}
+
+static commit_object *paint_pop(paint_state *p)
+{
+	commit_object *commit = git_pqueue_pop(&p->queue);
 
+	commit->flags &= ~QUEUED;
+	if (!(commit->flags & STALE))
+		p->nonstale--;
+
+	return commit;
+}
+
+static int paint_parents(paint_state *p, commit_object *commit, unsigned int flags)
+{
+	unsigned short i;
+	int error = GIT_SUCCESS;
+
+	for (i = 0; i < commit->out_degree && error == GIT_SUCCESS; ++i)
+		error = paint(p, commit->parents[i], flags);
+
+	return error;
+}
+
+static int paint_start(paint_state *p, const git_oid *one, const git_oid *two)
+{
+	commit_object *commit;
+	int error;
+
+	if ((commit = commit_lookup(p->walk, one)) == NULL)
+		return GIT_ENOMEM;
+
+	if ((error = paint(p, commit, PARENT1)) < GIT_SUCCESS)
+		return error;
+
+	if ((commit = commit_lookup(p->walk, two)) == NULL)
+		return GIT_ENOMEM;
+
+	return paint(p, commit, PARENT2);
+}
+
+static int merge_base(commit_object **out, paint_state *p)
+{
+	git_vector result = GIT_VECTOR_INIT;
+	commit_object *commit, *best = NULL;
+	unsigned int i;
+	int error = GIT_SUCCESS;
+
+	while (p->nonstale > 0 && error == GIT_SUCCESS) {
+		unsigned int flags;
+
+		commit = paint_pop(p);
+		flags = commit->flags & (PARENT1 | PARENT2 | STALE);
+
+		if (flags == (PARENT1 | PARENT2)) {
+			/*
+			 * Every descendant has been painted already, so if
+			 * this one has a generation number it can't be an
+			 * ancestor of any other merge-base we'd find later
+			 */
+			if (commit->generation) {
+				best = commit;
+				break;
+			}
+
+			if (!(commit->flags & RESULT)) {
+				commit->flags |= RESULT;
+				if ((error = git_vector_insert(&result, commit)) < GIT_SUCCESS)
+					break;
+			}
+
+			flags |= STALE;
+		}
+
+		error = paint_parents(p, commit, flags);
+	}
+
+	/* without generation numbers, skip the ones below another merge-base */
+	if (best == NULL && error == GIT_SUCCESS) {
+		git_vector_foreach(&result, i, commit) {
+			if (!(commit->flags & STALE)) {
+				best = commit;
+				break;
+			}
+		}
+	}
+
+	git_vector_free(&result);
+
+	if (error < GIT_SUCCESS)
+		return error;
+
+	if (best == NULL)
+		return git__throw(GIT_ENOTFOUND, "The commits have no common ancestor");
+
+	*out = best;
+	return GIT_SUCCESS;
+}
+
+int git_revwalk_merge_base(git_oid *out, git_revwalk *walk, const git_oid *one, const git_oid *two)
+{
+	paint_state p;
+	commit_object *base;
+	int error;
+
+	assert(out && walk && one && two);
+
+	if (git_oid_cmp(one, two) == 0) {
+		git_oid_cpy(out, one);
+		return GIT_SUCCESS;
+	}
+
+	if ((error = paint_init(&p, walk)) == GIT_SUCCESS &&
+		(error = paint_start(&p, one, two)) == GIT_SUCCESS &&
+		(error = merge_base(&base, &p)) == GIT_SUCCESS)
+		git_oid_cpy(out, &base->oid);
+
+	paint_free(&p);
+
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to find merge-base");
+
+	return GIT_SUCCESS;
+}
+
+static int ahead_behind(size_t *ahead, size_t *behind, paint_state *p)
+{
+	commit_object *commit;
+	int error = GIT_SUCCESS;
+
+	*ahead = *behind = 0;
+
+	while (p->nonstale > 0 && error == GIT_SUCCESS) {
+		unsigned int flags;
+
+		commit = paint_pop(p);
+		flags = commit->flags & (PARENT1 | PARENT2 | STALE);
+
+		if ((flags & (PARENT1 | PARENT2)) == (PARENT1 | PARENT2)) {
+			/*
+			 * Only with skewed clocks and no generation numbers can
+			 * this commit have been counted on one side already
+			 */
+			if (commit->flags & COUNTED1)
+				(*ahead)--;
+			if (commit->flags & COUNTED2)
+				(*behind)--;
+			commit->flags &= ~(COUNTED1 | COUNTED2);
+
+			flags |= STALE;
+		} else if ((flags & PARENT1) && !(commit->flags & COUNTED1)) {
+			commit->flags |= COUNTED1;
+			(*ahead)++;
+		} else if ((flags & PARENT2) && !(commit->flags & COUNTED2)) {
+			commit->flags |= COUNTED2;
+			(*behind)++;
+		}
+
+		error = paint_parents(p, commit, flags);
+	}
+
+	return error;
+}
+
+int git_revwalk_ahead_behind(size_t *ahead, size_t *behind, git_revwalk *walk,
+	const git_oid *local, const git_oid *upstream)
+{
+	paint_state p;
+	int error;
+
+	assert(ahead && behind && walk && local && upstream);
+
+	*ahead = *behind = 0;
+
+	if (git_oid_cmp(local, upstream) == 0)
+		return GIT_SUCCESS;
+
+	if ((error = paint_init(&p, walk)) == GIT_SUCCESS &&
+		(error = paint_start(&p, local, upstream)) == GIT_SUCCESS)
+		error = ahead_behind(ahead, behind, &p);
+
+	paint_free(&p);
+
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to count commits ahead and behind");
+
+	return GIT_SUCCESS;
+}
+
+static int commit_graph_path(git_buf *path, git_repository *repo)
+{
+	return git_buf_joinpath(path, repo->path_repository,
+		GIT_OBJECTS_DIR "info/" GIT_COMMIT_GRAPH_FILE);
+}
+
+/* A missing or broken commit-graph just means reading the commits */
+static void load_commit_graph(git_revwalk *walk)
+{
+	git_buf path = GIT_BUF_INIT;
+
+	if (commit_graph_path(&path, walk->repo) == GIT_SUCCESS &&
+		git_path_exists(path.ptr) == GIT_SUCCESS)
+		git_commit_graph_open(&walk->graph, path.ptr);
+
+	git_buf_free(&path);
+}
 
 int git_revwalk_new(git_revwalk **revwalk_out, git_repository *repo)
 {
@@ -583,6 +939,8 @@ int git_revwalk_new(git_revwalk **revwalk_out, git_repository *repo)
 		return error;
 	}
 
+	load_commit_graph(walk);
+
 	*revwalk_out = walk;
 	return GIT_SUCCESS;
 }
@@ -597,6 +955,7 @@ void git_revwalk_free(git_revwalk *walk)
 
 	git_revwalk_reset(walk);
 	git_odb_free(walk->odb);
+	git_commit_graph_free(walk->graph);
 
 	/* if the parent has more than PARENTS_PER_COMMIT parents,
 	 * we had to allocate a separate array for those parents.
@@ -622,6 +981,40 @@ git_repository *git_revwalk_repository(git_revwalk *walk)
 	return walk->repo;
 }
 
+int git_revwalk_write_commit_graph(git_revwalk *walk)
+{
+	git_buf path = GIT_BUF_INIT;
+	git_vector tips = GIT_VECTOR_INIT;
+	commit_object *commit;
+	int error;
+
+	assert(walk);
+
+	if ((error = commit_graph_path(&path, walk->repo)) < GIT_SUCCESS ||
+		(error = git_futils_mkpath2file(path.ptr, GIT_OBJECT_DIR_MODE)) < GIT_SUCCESS)
+		goto cleanup;
+
+	if ((error = git_vector_init(&tips, walk->commits->key_count, NULL)) < GIT_SUCCESS)
+		goto cleanup;
+
+	/* some of these are parents of the others, which costs nothing */
+	GIT_HASHTABLE_FOREACH_VALUE(walk->commits, commit,
+		if ((error = git_vector_insert(&tips, &commit->oid)) < GIT_SUCCESS)
+			goto cleanup;
+	);
+
+	error = git_commit_graph_write(path.ptr, walk->odb, &tips);
+
+cleanup:
+	git_vector_free(&tips);
+	git_buf_free(&path);
+
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error, "Failed to write commit-graph");
+
+	return GIT_SUCCESS;
+}
+
 void git_revwalk_sorting(git_revwalk *walk, unsigned int sort_mode)
 {
 	assert(walk);
@@ -677,6 +1070,7 @@ void git_revwalk_reset(git_revwalk *walk)
 		commit->in_degree = 0;
 		commit->topo_delay = 0;
 		commit->uninteresting = 0;
+		commit->flags = 0;
 	);
 
 	git_pqueue_clear(&walk->iterator_time);
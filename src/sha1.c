@@ -112,16 +112,16 @@
 #define T_40_59(t, A, B, C, D, E) SHA_ROUND(t, SHA_MIX, ((B&C)+(D&(B^C))) , 0x8f1bbcdc, A, B, C, D, E )
 #define T_60_79(t, A, B, C, D, E) SHA_ROUND(t, SHA_MIX, (B^C^D) , 0xca62c1d6, A, B, C, D, E )
 
-static void blk_SHA1_Block(blk_SHA_CTX *ctx, const unsigned int *data)
+static void blk_SHA1_Block(unsigned int H[5], const unsigned int *data)
 {
 	unsigned int A,B,C,D,E;
 	unsigned int array[16];
 
-	A = ctx->H[0];
-	B = ctx->H[1];
-	C = ctx->H[2];
-	D = ctx->H[3];
-	E = ctx->H[4];
+	A = H[0];
+	B = H[1];
+	C = H[2];
+	D = H[3];
+	E = H[4];
 
 	/* Round 1 - iterations 0-16 take their input from 'data' */
 	T_0_15( 0, A, B, C, D, E);
@@ -213,11 +213,152 @@ static void blk_SHA1_Block(blk_SHA_CTX *ctx, const unsigned int *data)
 	T_60_79(78, C, D, E, A, B);
 	T_60_79(79, B, C, D, E, A);
 
-	ctx->H[0] += A;
-	ctx->H[1] += B;
-	ctx->H[2] += C;
-	ctx->H[3] += D;
-	ctx->H[4] += E;
+	H[0] += A;
+	H[1] += B;
+	H[2] += C;
+	H[3] += D;
+	H[4] += E;
+}
+
+static void blk_SHA1_Blocks(unsigned int H[5], const void *data, size_t blocks)
+{
+	const unsigned char *block = data;
+
+	for (; blocks > 0; --blocks, block += 64)
+		blk_SHA1_Block(H, (const unsigned int *)block);
+}
+
+const git__sha1_impl git__sha1_impls[] = {
+#ifdef GIT_SHA1_X86
+	{ "sha-ni", git__sha1_blocks_x86, git__sha1_supported_x86 },
+#endif
+#ifdef GIT_SHA1_ARMV8
+	{ "armv8-crypto", git__sha1_blocks_armv8, git__sha1_supported_armv8 },
+#endif
+	{ "portable", blk_SHA1_Blocks, NULL },
+	{ NULL, NULL, NULL }
+};
+
+/*
+ * Picked the first time something is hashed. Threads racing to pick
+ * it all pick the same one, so there's no need for a lock.
+ */
+static const git__sha1_impl * volatile sha1_impl;
+
+static const git__sha1_impl *sha1_find(const char *name)
+{
+	const git__sha1_impl *impl;
+
+	for (impl = git__sha1_impls; impl->name != NULL; ++impl) {
+		if (name != NULL && strcmp(name, impl->name) != 0)
+			continue;
+
+		if (impl->supported == NULL || impl->supported())
+			return impl;
+	}
+
+	return NULL;
+}
+
+GIT_INLINE(const git__sha1_impl *) sha1_current(void)
+{
+	const git__sha1_impl *impl = sha1_impl;
+
+	if (impl == NULL)
+		sha1_impl = impl = sha1_find(NULL);
+
+	return impl;
+}
+
+int git__sha1_select(const char *name)
+{
+	const git__sha1_impl *impl;
+
+#ifdef PPC_SHA1
+	if (name != NULL)
+		return git__throw(GIT_ENOTFOUND,
+			"Failed to select SHA-1 implementation '%s'. This build hashes with the PowerPC code", name);
+#endif
+
+	impl = sha1_find(name);
+	if (impl == NULL)
+		return git__throw(GIT_ENOTFOUND,
+			"Failed to select SHA-1 implementation '%s'. Not available", name);
+
+	sha1_impl = impl;
+	return GIT_SUCCESS;
+}
+
+const char *git__sha1_selected(void)
+{
+#ifdef PPC_SHA1
+	return "ppc";
+#else
+	return sha1_current()->name;
+#endif
+}
+
+const git__sha1_lanes_impl git__sha1_lanes_impls[] = {
+#ifdef GIT_SHA1_X86
+	{ "avx2", git__sha1_lanes_avx2, git__sha1_supported_avx2 },
+#endif
+	{ "serial", NULL, NULL },
+	{ NULL, NULL, NULL }
+};
+
+static const git__sha1_lanes_impl * volatile sha1_lanes_impl;
+
+static const git__sha1_lanes_impl *sha1_lanes_find(const char *name)
+{
+	const git__sha1_lanes_impl *impl;
+
+	for (impl = git__sha1_lanes_impls; impl->name != NULL; ++impl) {
+		if (name != NULL && strcmp(name, impl->name) != 0)
+			continue;
+
+		if (impl->supported == NULL || impl->supported())
+			return impl;
+	}
+
+	return NULL;
+}
+
+GIT_INLINE(const git__sha1_lanes_impl *) sha1_lanes_current(void)
+{
+	const git__sha1_lanes_impl *impl = sha1_lanes_impl;
+
+	if (impl == NULL)
+		sha1_lanes_impl = impl = sha1_lanes_find(NULL);
+
+	return impl;
+}
+
+int git__sha1_select_lanes(const char *name)
+{
+	const git__sha1_lanes_impl *impl;
+
+#ifdef PPC_SHA1
+	if (name != NULL)
+		return git__throw(GIT_ENOTFOUND,
+			"Failed to select multi-buffer SHA-1 implementation '%s'. This build hashes with the PowerPC code", name);
+#endif
+
+	impl = sha1_lanes_find(name);
+	if (impl == NULL)
+		return git__throw(GIT_ENOTFOUND,
+			"Failed to select multi-buffer SHA-1 implementation '%s'. Not available", name);
+
+	sha1_lanes_impl = impl;
+	return GIT_SUCCESS;
+}
+
+const char *git__sha1_selected_lanes(void)
+{
+#ifdef PPC_SHA1
+	return "ppc";
+#else
+	return sha1_lanes_current()->name;
+#endif
 }
 
 void git__blk_SHA1_Init(blk_SHA_CTX *ctx)
@@ -235,6 +376,7 @@ void git__blk_SHA1_Init(blk_SHA_CTX *ctx)
 void git__blk_SHA1_Update(blk_SHA_CTX *ctx, const void *data, unsigned long len)
 {
 	unsigned int lenW = ctx->size & 63;
+	const git__sha1_impl *impl = sha1_current();
 
 	ctx->size += len;
 
@@ -249,12 +391,12 @@ void git__blk_SHA1_Update(blk_SHA_CTX *ctx, const void *data, unsigned long len)
 		data = ((const char *)data + left);
 		if (lenW)
 			return;
-		blk_SHA1_Block(ctx, ctx->W);
+		impl->blocks(ctx->H, ctx->W, 1);
 	}
-	while (len >= 64) {
-		blk_SHA1_Block(ctx, data);
-		data = ((const char *)data + 64);
-		len -= 64;
+	if (len >= 64) {
+		impl->blocks(ctx->H, data, len / 64);
+		data = ((const char *)data + (len & ~63ul));
+		len &= 63;
 	}
 	if (len)
 		memcpy(ctx->W, data, len);
@@ -278,3 +420,177 @@ void git__blk_SHA1_Final(unsigned char hashout[20], blk_SHA_CTX *ctx)
 	for (i = 0; i < 5; i++)
 		put_be32(hashout + i*4, ctx->H[i]);
 }
+
+/*
+ * A message being hashed by git__blk_SHA1_Many(), and how far
+ * into it we are.
+ */
+typedef struct {
+	const git_buf_vec *piece, *end;
+	size_t offset; /* into `piece` */
+	unsigned long long size;
+	int padded, done;
+	unsigned char buf[64];
+} sha1_message;
+
+static const unsigned int sha1_init[5] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+static void message_init(sha1_message *msg, const git_buf_vec *vec, size_t per)
+{
+	size_t i;
+
+	msg->piece = vec;
+	msg->end = vec + per;
+	msg->offset = 0;
+	msg->size = 0;
+	msg->padded = msg->done = 0;
+
+	for (i = 0; i < per; ++i)
+		msg->size += vec[i].len;
+}
+
+/*
+ * Point `out` at the next blocks of `msg`, padding included, and
+ * return how many there are: up to `max` straight from the pieces,
+ * or one put together in `msg->buf`. Returns 0 once it's all done.
+ */
+static size_t message_blocks(const unsigned char **out, sha1_message *msg, size_t max)
+{
+	size_t got = 0, n;
+
+	if (msg->done)
+		return 0;
+
+	while (msg->piece < msg->end && msg->offset == msg->piece->len) {
+		msg->piece++;
+		msg->offset = 0;
+	}
+
+	if (msg->piece < msg->end &&
+		(n = (msg->piece->len - msg->offset) / 64) > 0) {
+		if (n > max)
+			n = max;
+
+		*out = (const unsigned char *)msg->piece->data + msg->offset;
+		msg->offset += n * 64;
+		return n;
+	}
+
+	while (got < 64 && msg->piece < msg->end) {
+		n = min(64 - got, msg->piece->len - msg->offset);
+		memcpy(msg->buf + got, (const char *)msg->piece->data + msg->offset, n);
+		got += n;
+		msg->offset += n;
+
+		if (msg->offset == msg->piece->len) {
+			msg->piece++;
+			msg->offset = 0;
+		}
+	}
+
+	if (got < 64) {
+		if (!msg->padded) {
+			msg->buf[got++] = 0x80;
+			msg->padded = 1;
+		}
+
+		memset(msg->buf + got, 0, 64 - got);
+
+		if (got <= 56) {
+			put_be32(msg->buf + 56, (unsigned int)(msg->size >> 29));
+			put_be32(msg->buf + 60, (unsigned int)(msg->size << 3));
+			msg->done = 1;
+		}
+	}
+
+	*out = msg->buf;
+	return 1;
+}
+
+static void message_finish(git_oid *out, unsigned int H[5], sha1_message *msg)
+{
+	const git__sha1_impl *impl = sha1_current();
+	const unsigned char *data;
+	size_t n, i;
+
+	while ((n = message_blocks(&data, msg, (size_t)-1)) > 0)
+		impl->blocks(H, data, n);
+
+	for (i = 0; i < 5; i++)
+		put_be32(out->id + i * 4, H[i]);
+}
+
+void git__blk_SHA1_Many(git_oid *out, const git_buf_vec *vec, size_t per, size_t n)
+{
+	static const unsigned char idle_block[64];
+	const git__sha1_lanes_impl *lanes = sha1_lanes_current();
+	sha1_message msg[GIT_SHA1_LANES];
+	unsigned int H[5][GIT_SHA1_LANES], state[5];
+	const unsigned char *data[GIT_SHA1_LANES];
+	size_t lane_of[GIT_SHA1_LANES];
+	size_t next = 0, busy = 0, i, j;
+
+	for (i = 0; i < GIT_SHA1_LANES; ++i)
+		lane_of[i] = n;
+
+	/*
+	 * Each lane hashes a message until it's done, and then takes the
+	 * next one. Once too few are left to fill half the lanes, it's
+	 * faster to finish them one at a time.
+	 */
+	while (lanes->blocks != NULL) {
+		for (i = 0; i < GIT_SHA1_LANES && next < n; ++i) {
+			if (lane_of[i] != n)
+				continue;
+
+			message_init(&msg[i], vec + next * per, per);
+			for (j = 0; j < 5; ++j)
+				H[j][i] = sha1_init[j];
+
+			lane_of[i] = next++;
+			busy++;
+		}
+
+		if (next == n && busy < GIT_SHA1_LANES / 2)
+			break;
+
+		for (i = 0; i < GIT_SHA1_LANES; ++i) {
+			if (lane_of[i] == n)
+				data[i] = idle_block;
+			else
+				message_blocks(&data[i], &msg[i], 1);
+		}
+
+		lanes->blocks(H, data);
+
+		for (i = 0; i < GIT_SHA1_LANES; ++i) {
+			if (lane_of[i] == n || !msg[i].done)
+				continue;
+
+			for (j = 0; j < 5; ++j)
+				put_be32(out[lane_of[i]].id + j * 4, H[j][i]);
+
+			lane_of[i] = n;
+			busy--;
+		}
+	}
+
+	for (i = 0; i < GIT_SHA1_LANES && busy > 0; ++i) {
+		if (lane_of[i] == n)
+			continue;
+
+		for (j = 0; j < 5; ++j)
+			state[j] = H[j][i];
+
+		message_finish(&out[lane_of[i]], state, &msg[i]);
+		busy--;
+	}
+
+	for (; next < n; ++next) {
+		memcpy(state, sha1_init, sizeof(state));
+		message_init(&msg[0], vec + next * per, per);
+		message_finish(&out[next], state, &msg[0]);
+	}
+}
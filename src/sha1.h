@@ -4,6 +4,11 @@
  * This file is part of libgit2, distributed under the GNU GPL v2 with
  * a Linking Exception. For full terms see the included COPYING file.
  */
+#ifndef INCLUDE_sha1_h__
+#define INCLUDE_sha1_h__
+
+#include <stddef.h>
+#include "hash.h"
 
 typedef struct {
 	unsigned long long size;
@@ -19,3 +24,94 @@ void git__blk_SHA1_Final(unsigned char hashout[20], blk_SHA_CTX *ctx);
 #define SHA1_Init	git__blk_SHA1_Init
 #define SHA1_Update	git__blk_SHA1_Update
 #define SHA1_Final	git__blk_SHA1_Final
+
+/*
+ * The SHA-1 instructions of x86 (SHA-NI) and of ARMv8 are used when
+ * the CPU we run on has them. The x86 ones only need a compiler that
+ * knows about them; the ARMv8 ones are only built in when compiling
+ * for a CPU with the crypto extension.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+	(defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+# define GIT_SHA1_X86
+#endif
+
+#if defined(__aarch64__) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2))
+# define GIT_SHA1_ARMV8
+#endif
+
+/*
+ * An implementation of the SHA-1 compression function: hash `blocks`
+ * 64-byte blocks of `data` into the state `H`.
+ */
+typedef struct {
+	const char *name;
+	void (*blocks)(unsigned int H[5], const void *data, size_t blocks);
+	/* whether the CPU we're running on supports it; NULL if always */
+	int (*supported)(void);
+} git__sha1_impl;
+
+/* The implementations built in, fastest first, ending with a NULL name */
+extern const git__sha1_impl git__sha1_impls[];
+
+/*
+ * Hash with the implementation called `name` from now on, or go
+ * back to the fastest supported one if `name` is NULL. Fails with
+ * GIT_ENOTFOUND if there's no such implementation, or the CPU
+ * doesn't support it.
+ *
+ * When built with PPC_SHA1, the git_hash_*() functions use the
+ * PowerPC code instead of any of these, so selecting one by name
+ * always fails.
+ */
+int git__sha1_select(const char *name);
+
+/* The name of the implementation in use, "ppc" with PPC_SHA1 */
+const char *git__sha1_selected(void);
+
+/*
+ * A multi-buffer implementation: hash one 64-byte block from each of
+ * `data` into the matching state of `H`, the one for `data[i]` being
+ * `H[0][i]` to `H[4][i]`. Each lane is slower than the implementations
+ * above, so it only pays off when most of the lanes have work.
+ */
+#define GIT_SHA1_LANES 8
+
+typedef struct {
+	const char *name;
+	/* NULL to hash one message at a time, with the selected implementation */
+	void (*blocks)(
+		unsigned int H[5][GIT_SHA1_LANES],
+		const unsigned char *const data[GIT_SHA1_LANES]);
+	int (*supported)(void);
+} git__sha1_lanes_impl;
+
+/* The ones built in, fastest first, ending with a NULL name */
+extern const git__sha1_lanes_impl git__sha1_lanes_impls[];
+
+/* Same as `git__sha1_select()` and `git__sha1_selected()` */
+int git__sha1_select_lanes(const char *name);
+const char *git__sha1_selected_lanes(void);
+
+/*
+ * Hash `n` independent messages, message `i` being made of the `per`
+ * pieces starting at `vec[i * per]`, and write its hash to `out[i]`.
+ */
+void git__blk_SHA1_Many(git_oid *out, const git_buf_vec *vec, size_t per, size_t n);
+
+#ifdef GIT_SHA1_X86
+void git__sha1_blocks_x86(unsigned int H[5], const void *data, size_t blocks);
+int git__sha1_supported_x86(void);
+
+void git__sha1_lanes_avx2(
+	unsigned int H[5][GIT_SHA1_LANES],
+	const unsigned char *const data[GIT_SHA1_LANES]);
+int git__sha1_supported_avx2(void);
+#endif
+
+#ifdef GIT_SHA1_ARMV8
+void git__sha1_blocks_armv8(unsigned int H[5], const void *data, size_t blocks);
+int git__sha1_supported_armv8(void);
+#endif
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+#include "sha1.h"
+
+#ifdef GIT_SHA1_ARMV8
+
+#include <arm_neon.h>
+
+#if defined(__linux__)
+# include <sys/auxv.h>
+# include <asm/hwcap.h>
+#endif
+
+int git__sha1_supported_armv8(void)
+{
+#if defined(__linux__) && defined(HWCAP_SHA1)
+	return (getauxval(AT_HWCAP) & HWCAP_SHA1) != 0;
+#else
+	/* we were built for a CPU that has them */
+	return 1;
+#endif
+}
+
+/*
+ * Four rounds with the message words already added to their
+ * constant in `TMP`, while the words four rounds ahead get their
+ * constant, and the ones after that are scheduled. `M0` to `M3`
+ * are the words of the last, current, next and following rounds.
+ */
+#define SHA_ROUNDS4(op, Enext, E, TMP, K, M0, M1, M2, M3) do { \
+	Enext = vsha1h_u32(vgetq_lane_u32(ABCD, 0)); \
+	ABCD = op(ABCD, E, TMP); \
+	TMP = vaddq_u32(M3, K); \
+	M0 = vsha1su1q_u32(M0, M3); \
+	M1 = vsha1su0q_u32(M1, M2, M3); } while (0)
+
+#define SHA_LOAD(i) \
+	vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(block + 16 * (i))))
+
+void git__sha1_blocks_armv8(unsigned int H[5], const void *data, size_t blocks)
+{
+	const uint32x4_t K0 = vdupq_n_u32(0x5a827999);
+	const uint32x4_t K1 = vdupq_n_u32(0x6ed9eba1);
+	const uint32x4_t K2 = vdupq_n_u32(0x8f1bbcdc);
+	const uint32x4_t K3 = vdupq_n_u32(0xca62c1d6);
+	const unsigned char *block = data;
+	uint32x4_t ABCD, ABCD_SAVE;
+	uint32x4_t TMP0, TMP1;
+	uint32x4_t MSG0, MSG1, MSG2, MSG3;
+	uint32_t E0, E0_SAVE, E1;
+
+	ABCD = vld1q_u32(H);
+	E0 = H[4];
+
+	for (; blocks > 0; --blocks, block += 64) {
+		ABCD_SAVE = ABCD;
+		E0_SAVE = E0;
+
+		MSG0 = SHA_LOAD(0);
+		MSG1 = SHA_LOAD(1);
+		MSG2 = SHA_LOAD(2);
+		MSG3 = SHA_LOAD(3);
+
+		TMP0 = vaddq_u32(MSG0, K0);
+		TMP1 = vaddq_u32(MSG1, K0);
+
+		/* Rounds 0-3 */
+		E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+		ABCD = vsha1cq_u32(ABCD, E0, TMP0);
+		TMP0 = vaddq_u32(MSG2, K0);
+		MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+
+		/* Rounds 4-63 */
+		SHA_ROUNDS4(vsha1cq_u32, E0, E1, TMP1, K0, MSG0, MSG1, MSG2, MSG3);
+		SHA_ROUNDS4(vsha1cq_u32, E1, E0, TMP0, K0, MSG1, MSG2, MSG3, MSG0);
+		SHA_ROUNDS4(vsha1cq_u32, E0, E1, TMP1, K1, MSG2, MSG3, MSG0, MSG1);
+		SHA_ROUNDS4(vsha1cq_u32, E1, E0, TMP0, K1, MSG3, MSG0, MSG1, MSG2);
+		SHA_ROUNDS4(vsha1pq_u32, E0, E1, TMP1, K1, MSG0, MSG1, MSG2, MSG3);
+		SHA_ROUNDS4(vsha1pq_u32, E1, E0, TMP0, K1, MSG1, MSG2, MSG3, MSG0);
+		SHA_ROUNDS4(vsha1pq_u32, E0, E1, TMP1, K1, MSG2, MSG3, MSG0, MSG1);
+		SHA_ROUNDS4(vsha1pq_u32, E1, E0, TMP0, K2, MSG3, MSG0, MSG1, MSG2);
+		SHA_ROUNDS4(vsha1pq_u32, E0, E1, TMP1, K2, MSG0, MSG1, MSG2, MSG3);
+		SHA_ROUNDS4(vsha1mq_u32, E1, E0, TMP0, K2, MSG1, MSG2, MSG3, MSG0);
+		SHA_ROUNDS4(vsha1mq_u32, E0, E1, TMP1, K2, MSG2, MSG3, MSG0, MSG1);
+		SHA_ROUNDS4(vsha1mq_u32, E1, E0, TMP0, K2, MSG3, MSG0, MSG1, MSG2);
+		SHA_ROUNDS4(vsha1mq_u32, E0, E1, TMP1, K3, MSG0, MSG1, MSG2, MSG3);
+		SHA_ROUNDS4(vsha1mq_u32, E1, E0, TMP0, K3, MSG1, MSG2, MSG3, MSG0);
+		SHA_ROUNDS4(vsha1pq_u32, E0, E1, TMP1, K3, MSG2, MSG3, MSG0, MSG1);
+
+		/* Rounds 64-79 only use up what has already been scheduled */
+		E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+		ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+		TMP0 = vaddq_u32(MSG2, K3);
+		MSG3 = vsha1su1q_u32(MSG3, MSG2);
+
+		E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+		ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+		TMP1 = vaddq_u32(MSG3, K3);
+
+		E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+		ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+
+		E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+		ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+
+		E0 += E0_SAVE;
+		ABCD = vaddq_u32(ABCD, ABCD_SAVE);
+	}
+
+	vst1q_u32(H, ABCD);
+	H[4] = E0;
+}
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+#include "sha1.h"
+
+#ifdef GIT_SHA1_X86
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+/* Not named in the cpuid.h of older compilers */
+#define CPUID_7_EBX_SHA (1 << 29)
+
+int git__sha1_supported_x86(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+		!(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+		return 0;
+
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx & CPUID_7_EBX_SHA) != 0;
+}
+
+/*
+ * Four rounds, with the message words in `Mi`, while the next
+ * words are being scheduled; `Mi1` to `Mi3` are the three sets of
+ * words that come after `Mi`, and the E values take turns in `Ea`
+ * and `Eb`.
+ */
+#define SHA_ROUNDS4(Ea, Eb, Mi, Mi1, Mi2, Mi3, fn) do { \
+	Ea = _mm_sha1nexte_epu32(Ea, Mi); \
+	Eb = ABCD; \
+	Mi1 = _mm_sha1msg2_epu32(Mi1, Mi); \
+	ABCD = _mm_sha1rnds4_epu32(ABCD, Ea, fn); \
+	Mi3 = _mm_sha1msg1_epu32(Mi3, Mi); \
+	Mi2 = _mm_xor_si128(Mi2, Mi); } while (0)
+
+#define SHA_LOAD(i) \
+	_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 16 * (i))), MASK)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+void git__sha1_blocks_x86(unsigned int H[5], const void *data, size_t blocks)
+{
+	const __m128i MASK = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	const unsigned char *block = data;
+	__m128i ABCD, ABCD_SAVE, E0, E0_SAVE, E1;
+	__m128i MSG0, MSG1, MSG2, MSG3;
+
+	ABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)H), 0x1B);
+	E0 = _mm_set_epi32((int)H[4], 0, 0, 0);
+
+	for (; blocks > 0; --blocks, block += 64) {
+		ABCD_SAVE = ABCD;
+		E0_SAVE = E0;
+
+		/* Rounds 0-15 take their input from the block */
+		MSG0 = SHA_LOAD(0);
+		E0 = _mm_add_epi32(E0, MSG0);
+		E1 = ABCD;
+		ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+
+		MSG1 = SHA_LOAD(1);
+		E1 = _mm_sha1nexte_epu32(E1, MSG1);
+		E0 = ABCD;
+		ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 0);
+		MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+
+		MSG2 = SHA_LOAD(2);
+		E0 = _mm_sha1nexte_epu32(E0, MSG2);
+		E1 = ABCD;
+		ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+		MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+		MSG0 = _mm_xor_si128(MSG0, MSG2);
+
+		MSG3 = SHA_LOAD(3);
+		SHA_ROUNDS4(E1, E0, MSG3, MSG0, MSG1, MSG2, 0);
+
+		/* Rounds 16-67 mix the message words as they go */
+		SHA_ROUNDS4(E0, E1, MSG0, MSG1, MSG2, MSG3, 0);
+		SHA_ROUNDS4(E1, E0, MSG1, MSG2, MSG3, MSG0, 1);
+		SHA_ROUNDS4(E0, E1, MSG2, MSG3, MSG0, MSG1, 1);
+		SHA_ROUNDS4(E1, E0, MSG3, MSG0, MSG1, MSG2, 1);
+		SHA_ROUNDS4(E0, E1, MSG0, MSG1, MSG2, MSG3, 1);
+		SHA_ROUNDS4(E1, E0, MSG1, MSG2, MSG3, MSG0, 1);
+		SHA_ROUNDS4(E0, E1, MSG2, MSG3, MSG0, MSG1, 2);
+		SHA_ROUNDS4(E1, E0, MSG3, MSG0, MSG1, MSG2, 2);
+		SHA_ROUNDS4(E0, E1, MSG0, MSG1, MSG2, MSG3, 2);
+		SHA_ROUNDS4(E1, E0, MSG1, MSG2, MSG3, MSG0, 2);
+		SHA_ROUNDS4(E0, E1, MSG2, MSG3, MSG0, MSG1, 2);
+		SHA_ROUNDS4(E1, E0, MSG3, MSG0, MSG1, MSG2, 3);
+		SHA_ROUNDS4(E0, E1, MSG0, MSG1, MSG2, MSG3, 3);
+
+		/* Rounds 68-79 only use up what has already been scheduled */
+		E1 = _mm_sha1nexte_epu32(E1, MSG1);
+		E0 = ABCD;
+		MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+		ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+		MSG3 = _mm_xor_si128(MSG3, MSG1);
+
+		E0 = _mm_sha1nexte_epu32(E0, MSG2);
+		E1 = ABCD;
+		MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+		ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 3);
+
+		E1 = _mm_sha1nexte_epu32(E1, MSG3);
+		E0 = ABCD;
+		ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+
+		E0 = _mm_sha1nexte_epu32(E0, E0_SAVE);
+		ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+	}
+
+	_mm_storeu_si128((__m128i *)H, _mm_shuffle_epi32(ABCD, 0x1B));
+	H[4] = (unsigned int)_mm_extract_epi32(E0, 3);
+}
+
+int git__sha1_supported_avx2(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	/* the CPU has AVX, and the OS saves the YMM registers */
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+		!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+		return 0;
+
+	__asm__("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+	if ((eax & 6) != 6)
+		return 0;
+
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx & bit_AVX2) != 0;
+}
+
+/*
+ * The same rounds as the portable code, on eight messages at a
+ * time: lane `i` of every vector belongs to message `i`.
+ */
+#define MB_ROL(x, n) \
+	_mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#define MB_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+
+#define MB_W(t) (W[(t) & 15])
+#define MB_MIX(t) (MB_W(t) = MB_ROL(_mm256_xor_si256( \
+	MB_XOR3(MB_W(t + 13), MB_W(t + 8), MB_W(t + 2)), MB_W(t)), 1))
+#define MB_INPUT(t) ((t) < 16 ? MB_W(t) : MB_MIX(t))
+
+#define MB_ROUND(t, fn, K, A, B, C, D, E) do { \
+	E = _mm256_add_epi32(_mm256_add_epi32(E, _mm256_add_epi32(MB_INPUT(t), K)), \
+		_mm256_add_epi32(MB_ROL(A, 5), fn)); \
+	B = MB_ROL(B, 30); } while (0)
+
+#define MB_F1(B, C, D) _mm256_xor_si256(_mm256_and_si256(_mm256_xor_si256(C, D), B), D)
+#define MB_F2(B, C, D) MB_XOR3(B, C, D)
+#define MB_F3(B, C, D) _mm256_or_si256(_mm256_and_si256(B, C), \
+	_mm256_and_si256(D, _mm256_or_si256(B, C)))
+
+#define MB_T(t, F, K, A, B, C, D, E) MB_ROUND(t, F(B, C, D), K, A, B, C, D, E)
+
+/* Five rounds bring the names back where they started */
+#define MB_ROUNDS5(t, F, K) do { \
+	MB_T(t,     F, K, A, B, C, D, E); \
+	MB_T(t + 1, F, K, E, A, B, C, D); \
+	MB_T(t + 2, F, K, D, E, A, B, C); \
+	MB_T(t + 3, F, K, C, D, E, A, B); \
+	MB_T(t + 4, F, K, B, C, D, E, A); } while (0)
+
+#define MB_LOAD(i) _mm256_loadu_si256((const __m256i *)H[i])
+#define MB_STORE(i, x) \
+	_mm256_storeu_si256((__m256i *)H[i], _mm256_add_epi32(x, MB_LOAD(i)))
+
+__attribute__((target("avx2")))
+void git__sha1_lanes_avx2(
+	unsigned int H[5][GIT_SHA1_LANES],
+	const unsigned char *const data[GIT_SHA1_LANES])
+{
+	const __m256i BSWAP = _mm256_set_epi8(
+		12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+		12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	const __m256i K1 = _mm256_set1_epi32(0x5a827999);
+	const __m256i K2 = _mm256_set1_epi32(0x6ed9eba1);
+	const __m256i K3 = _mm256_set1_epi32(0x8f1bbcdc);
+	const __m256i K4 = _mm256_set1_epi32(0xca62c1d6);
+	__m256i A, B, C, D, E, W[16];
+	unsigned int words[GIT_SHA1_LANES];
+	int t, i;
+
+	/* word `t` of every block goes in `W[t]` */
+	for (t = 0; t < 16; ++t) {
+		for (i = 0; i < GIT_SHA1_LANES; ++i)
+			memcpy(&words[i], data[i] + 4 * t, 4);
+
+		W[t] = _mm256_shuffle_epi8(
+			_mm256_loadu_si256((const __m256i *)words), BSWAP);
+	}
+
+	A = MB_LOAD(0);
+	B = MB_LOAD(1);
+	C = MB_LOAD(2);
+	D = MB_LOAD(3);
+	E = MB_LOAD(4);
+
+	MB_ROUNDS5( 0, MB_F1, K1);
+	MB_ROUNDS5( 5, MB_F1, K1);
+	MB_ROUNDS5(10, MB_F1, K1);
+	MB_ROUNDS5(15, MB_F1, K1);
+
+	MB_ROUNDS5(20, MB_F2, K2);
+	MB_ROUNDS5(25, MB_F2, K2);
+	MB_ROUNDS5(30, MB_F2, K2);
+	MB_ROUNDS5(35, MB_F2, K2);
+
+	MB_ROUNDS5(40, MB_F3, K3);
+	MB_ROUNDS5(45, MB_F3, K3);
+	MB_ROUNDS5(50, MB_F3, K3);
+	MB_ROUNDS5(55, MB_F3, K3);
+
+	MB_ROUNDS5(60, MB_F2, K4);
+	MB_ROUNDS5(65, MB_F2, K4);
+	MB_ROUNDS5(70, MB_F2, K4);
+	MB_ROUNDS5(75, MB_F2, K4);
+
+	MB_STORE(0, A);
+	MB_STORE(1, B);
+	MB_STORE(2, C);
+	MB_STORE(3, D);
+	MB_STORE(4, E);
+}
+
+#endif
@@ -14,9 +14,13 @@
 #include "git2/status.h"
 #include "repository.h"
 #include "ignore.h"
+#include "index.h"
+#include "odb.h"
+#include "iterator.h"
+#include "path.h"
 
 struct status_entry {
-	git_index_time mtime;
+	git_index_entry *index_entry;
 
 	git_oid head_oid;
 	git_oid index_oid;
@@ -48,12 +52,12 @@ GIT_INLINE(void) status_entry_update_from_tree_entry(struct status_entry *e, con
 	git_oid_cpy(&e->head_oid, &tree_entry->oid);
 }
 
-GIT_INLINE(void) status_entry_update_from_index_entry(struct status_entry *e, const git_index_entry *index_entry)
+GIT_INLINE(void) status_entry_update_from_index_entry(struct status_entry *e, git_index_entry *index_entry)
 {
 	assert(e && index_entry);
 
 	git_oid_cpy(&e->index_oid, &index_entry->oid);
-	e->mtime = index_entry->mtime;
+	e->index_entry = index_entry;
 }
 
 static void status_entry_update_from_index(struct status_entry *e, git_index *index)
@@ -72,17 +76,44 @@ static void status_entry_update_from_index(struct status_entry *e, git_index *in
 	status_entry_update_from_index_entry(e, index_entry);
 }
 
-static int status_entry_update_from_workdir(struct status_entry *e, const char* full_path)
+static int status_entry_update_from_workdir(struct status_entry *e, git_index *index, const char* full_path)
 {
 	struct stat filest;
+	git_index_entry wd;
+	int error;
+
+	/* the filesystem monitor hasn't seen it change since it was looked at */
+	if (e->index_entry != NULL &&
+		(e->index_entry->flags_extended & GIT_IDXENTRY_FSMONITOR_VALID) != 0) {
+		git_oid_cpy(&e->wt_oid, &e->index_oid);
+		return GIT_SUCCESS;
+	}
 
-	if (p_stat(full_path, &filest) < GIT_SUCCESS)
+	if (p_lstat(full_path, &filest) < GIT_SUCCESS)
 		return git__throw(GIT_EOSERR, "Failed to determine status of file '%s'. Can't read file", full_path);
 
-	if (e->mtime.seconds == (git_time_t)filest.st_mtime)
+	memset(&wd, 0x0, sizeof(wd));
+	git_index__init_entry_from_stat(&wd, &filest);
+	wd.mode = git_futils_canonical_mode(filest.st_mode);
+
+	if (e->index_entry != NULL && git_index__stat_matches(index, e->index_entry, &wd)) {
 		git_oid_cpy(&e->wt_oid, &e->index_oid);
+		git_index__fsmonitor_mark_valid(index, e->index_entry);
+		return GIT_SUCCESS;
+	}
+
+	if (S_ISLNK(filest.st_mode))
+		error = git_odb__hashlink(&e->wt_oid, full_path);
 	else
-		git_odb_hashfile(&e->wt_oid, full_path, GIT_OBJ_BLOB);
+		error = git_odb_hashfile(&e->wt_oid, full_path, GIT_OBJ_BLOB);
+
+	/* unchanged after all; remember that for next time */
+	if (error == GIT_SUCCESS && e->index_entry != NULL &&
+		e->index_entry->mode == wd.mode &&
+		git_oid_cmp(&e->wt_oid, &e->index_oid) == 0) {
+		git_index__refresh_stat(index, e->index_entry, &wd);
+		git_index__fsmonitor_mark_valid(index, e->index_entry);
+	}
 
 	return GIT_SUCCESS;
 }
@@ -136,21 +167,6 @@ static int status_entry_update_ignore(struct status_entry *e, git_ignores *ignor
 	return error;
 }
 
-struct status_st {
-	git_repository *repo;
-	git_vector *vector;
-	git_index *index;
-	git_tree *tree;
-	git_ignores *ignores;
-
-	int workdir_path_len;
-	git_buf head_tree_relative_path;
-	int head_tree_relative_path_len;
-	unsigned int tree_position;
-	unsigned int index_position;
-	int is_dir:1;
-};
-
 static int retrieve_head_tree(git_tree **tree_out, git_repository *repo)
 {
 	git_reference *resolved_head_ref;
@@ -187,295 +203,654 @@ exit:
 	return error;
 }
 
-enum path_type {
-	GIT_STATUS_PATH_NULL,
-	GIT_STATUS_PATH_IGNORE,
-	GIT_STATUS_PATH_FILE,
-	GIT_STATUS_PATH_FOLDER,
-};
-
-static int dirent_cb(void *state, git_buf *full_path);
-static int alphasorted_futils_direach(
-	git_buf *path, int (*fn)(void *, git_buf *), void *arg);
-
-static int process_folder(
-	struct status_st *st,
-	const git_tree_entry *tree_entry,
-	git_buf *full_path,
-	enum path_type path_type)
-{
-	git_object *subtree = NULL;
-	git_tree *pushed_tree = NULL;
-	int error, pushed_tree_position = 0;
-	git_otype tree_entry_type = GIT_OBJ_BAD;
-
-	if (tree_entry != NULL) {
-		tree_entry_type = git_tree_entry_type(tree_entry);
-
-		switch (tree_entry_type) {
-		case GIT_OBJ_TREE:
-			error = git_tree_entry_2object(&subtree, ((git_object *)(st->tree))->repo, tree_entry);
-			pushed_tree = st->tree;
-			pushed_tree_position = st->tree_position;
-			st->tree = (git_tree *)subtree;
-			st->tree_position = 0;
-			st->head_tree_relative_path_len += 1 + tree_entry->filename_len; /* path + '/' + name */
-			break;
+/*
+ * The working directory against the index, for the paths in a range:
+ * both are walked side by side, and the files which differ come out
+ * in order
+ */
+typedef struct {
+	git_repository *repo;
+	git_index *index;
+	git_iterator *index_iter;
+	git_iterator *wd_iter;
+	const git_index_entry *index_entry;
+	const git_index_entry *wd_entry;
 
-		case GIT_OBJ_BLOB:
-			/* No op */
-			break;
+	/* the workdir entry was given out; move past it next time */
+	int wd_given;
 
-		case GIT_OBJ_COMMIT:
-			/* TODO: proper submodule support */
-			break;
+	git_buf ignore_prefix;
+	git_buf full_path;
 
-		default:
-			return git__throw(GIT_EINVALIDTYPE, "Unexpected tree entry type");
-		}
-	}
+	/* taken to update the index, when several threads walk it */
+	git_mutex *index_lock;
+} status_wd;
 
+typedef struct {
+	const char *path; /* NULL once the walk is done */
+	unsigned int status_flags;
+	int is_ignored;
+} status_wd_item;
 
-	if (full_path != NULL && path_type == GIT_STATUS_PATH_FOLDER) {
-		git_ignores ignores, *old_ignores;
+/* Conflicts stand in for themselves once, and submodules are left alone */
+static int status_index_skip(
+	git_iterator *iter, const git_index_entry **entry, const char *prev)
+{
+	int error = GIT_SUCCESS;
 
-		if ((error = git_ignore__for_path(st->repo,
-			full_path->ptr + st->workdir_path_len, &ignores)) == GIT_SUCCESS)
-		{
-			old_ignores = st->ignores;
-			st->ignores = &ignores;
+	while (error == GIT_SUCCESS && *entry != NULL &&
+		(S_ISGITLINK((*entry)->mode) ||
+		 (prev != NULL && strcmp((*entry)->path, prev) == 0)))
+		error = git_iterator_advance(iter, entry);
 
-			error = alphasorted_futils_direach(full_path, dirent_cb, st);
+	return error;
+}
 
-			git_ignore__free(st->ignores);
-			st->ignores = old_ignores;
-		}
-	} else {
-		error = dirent_cb(st, NULL);
-	}
+static int status_index_advance(git_iterator *iter, const git_index_entry **entry)
+{
+	/* the entries belong to the index, so this outlives the advance */
+	const char *prev = (*entry)->path;
+	int error = git_iterator_advance(iter, entry);
 
-	if (tree_entry_type == GIT_OBJ_TREE) {
-		git_object_free(subtree);
-		st->head_tree_relative_path_len -= 1 + tree_entry->filename_len;
-		st->tree = pushed_tree;
-		st->tree_position = pushed_tree_position;
-		st->tree_position++;
-	}
+	if (error == GIT_SUCCESS)
+		error = status_index_skip(iter, entry, prev);
 
 	return error;
 }
 
-static int store_if_changed(struct status_st *st, struct status_entry *e)
+static int status_wd_init(
+	status_wd *wd,
+	git_repository *repo,
+	git_index *index,
+	const char *start,
+	const char *end,
+	unsigned int flags,
+	git_mutex *index_lock)
 {
 	int error;
-	if ((error = status_entry_update_flags(e)) < GIT_SUCCESS)
-		return git__throw(error, "Failed to process the file '%s'. It doesn't exist in the workdir, in the HEAD nor in the index", e->path);
 
-	if (status_entry_is_ignorable(e) &&
-		(error = status_entry_update_ignore(e, st->ignores, e->path)) < GIT_SUCCESS)
+	memset(wd, 0x0, sizeof(status_wd));
+	wd->repo = repo;
+	wd->index = index;
+	wd->index_lock = index_lock;
+	git_buf_init(&wd->ignore_prefix, 0);
+	git_buf_init(&wd->full_path, 0);
+
+	if ((error = git_iterator_for_index_range(
+			repo, start, end, &wd->index_iter)) < GIT_SUCCESS ||
+		(error = git_iterator_for_workdir_range(
+			repo, start, end, flags, &wd->wd_iter)) < GIT_SUCCESS ||
+		(error = git_iterator_current(
+			wd->index_iter, &wd->index_entry)) < GIT_SUCCESS ||
+		(error = status_index_skip(
+			wd->index_iter, &wd->index_entry, NULL)) < GIT_SUCCESS)
 		return error;
 
-	if (e->status_flags == GIT_STATUS_CURRENT) {
-		git__free(e);
+	return git_iterator_current(wd->wd_iter, &wd->wd_entry);
+}
+
+static void status_wd_free(status_wd *wd)
+{
+	if (wd->index_iter != NULL)
+		git_iterator_free(wd->index_iter);
+	if (wd->wd_iter != NULL)
+		git_iterator_free(wd->wd_iter);
+
+	wd->index_iter = wd->wd_iter = NULL;
+
+	git_buf_free(&wd->ignore_prefix);
+	git_buf_free(&wd->full_path);
+}
+
+static int status_wd_in_ignored_dir(status_wd *wd, const char *path)
+{
+	return (wd->ignore_prefix.size > 0 &&
+		git__prefixcmp(path, wd->ignore_prefix.ptr) == 0);
+}
+
+/* The file is what the index says; it needn't be read next time */
+static void status_wd_remember(
+	status_wd *wd, git_index_entry *entry, const git_index_entry *wd_entry)
+{
+	if (wd->index_lock != NULL)
+		git_mutex_lock(wd->index_lock);
+
+	if (wd_entry != NULL)
+		git_index__refresh_stat(wd->index, entry, wd_entry);
+	git_index__fsmonitor_mark_valid(wd->index, entry);
+
+	if (wd->index_lock != NULL)
+		git_mutex_unlock(wd->index_lock);
+}
+
+static int status_wd_unchanged(
+	status_wd *wd,
+	const git_index_entry *index_entry,
+	const git_index_entry *wd_entry,
+	int *unchanged)
+{
+	/* the index iterator hands out the index's own entries */
+	git_index_entry *entry = (git_index_entry *)index_entry;
+	git_oid oid;
+	int error;
+
+	*unchanged = 1;
+
+	/* the filesystem monitor hasn't seen it change since it was looked at */
+	if ((entry->flags_extended & GIT_IDXENTRY_FSMONITOR_VALID) != 0)
+		return GIT_SUCCESS;
+
+	if (git_index__stat_matches(wd->index, entry, wd_entry)) {
+		status_wd_remember(wd, entry, NULL);
 		return GIT_SUCCESS;
 	}
 
-	return git_vector_insert(st->vector, e);
+	error = git_buf_joinpath(&wd->full_path,
+		git_repository_workdir(wd->repo), wd_entry->path);
+	if (error < GIT_SUCCESS)
+		return error;
+
+	if (S_ISLNK(wd_entry->mode))
+		error = git_odb__hashlink(&oid, wd->full_path.ptr);
+	else
+		error = git_odb_hashfile(&oid, wd->full_path.ptr, GIT_OBJ_BLOB);
+
+	if (error < GIT_SUCCESS)
+		return git__rethrow(error,
+			"Failed to determine status of file '%s'", wd_entry->path);
+
+	*unchanged = (git_oid_cmp(&oid, &entry->oid) == 0);
+
+	/* unchanged after all; remember that for next time */
+	if (*unchanged && entry->mode == wd_entry->mode)
+		status_wd_remember(wd, entry, wd_entry);
+
+	return GIT_SUCCESS;
 }
 
-static int determine_status(
-	struct status_st *st,
-	int in_head, int in_index, int in_workdir,
-	const git_tree_entry *tree_entry,
-	const git_index_entry *index_entry,
-	git_buf *full_path,
-	const char *status_path,
-	enum path_type path_type)
+static int status_wd_next(status_wd *wd, status_wd_item *item)
 {
-	struct status_entry *e;
-	int error = GIT_SUCCESS;
-	git_otype tree_entry_type = GIT_OBJ_BAD;
+	const git_index_entry *ie, *we;
+	int cmp, unchanged, error = GIT_SUCCESS;
 
-	if (tree_entry != NULL)
-		tree_entry_type = git_tree_entry_type(tree_entry);
+	if (wd->wd_given) {
+		wd->wd_given = 0;
+		error = git_iterator_advance(wd->wd_iter, &wd->wd_entry);
+	}
 
-	/* If we're dealing with a directory in the workdir, let's recursively tackle it first */
-	if (path_type == GIT_STATUS_PATH_FOLDER)
-		return process_folder(st, tree_entry, full_path, path_type);
+	while (error == GIT_SUCCESS) {
+		ie = wd->index_entry;
+		we = wd->wd_entry;
+
+		/* files are all we report, so every directory is walked into */
+		if (we != NULL && S_ISDIR(we->mode)) {
+			/* what's in an ignored directory is ignored too */
+			if (git_iterator_current_is_ignored(wd->wd_iter) &&
+				!status_wd_in_ignored_dir(wd, we->path))
+				error = git_buf_sets(&wd->ignore_prefix, we->path);
+
+			if (error == GIT_SUCCESS)
+				error = git_iterator_advance_into_directory(
+					wd->wd_iter, &wd->wd_entry);
+			continue;
+		}
 
-	/* Are we dealing with a file somewhere? */
-	if (in_workdir || in_index || (in_head && tree_entry_type == GIT_OBJ_BLOB)) {
-		e = status_entry_new(NULL, status_path);
+		/* submodules and files we can't handle are left alone */
+		if (we != NULL && (we->mode == 0 || S_ISGITLINK(we->mode))) {
+			error = git_iterator_advance(wd->wd_iter, &wd->wd_entry);
+			continue;
+		}
 
-		if (in_head && tree_entry_type == GIT_OBJ_BLOB) {
-			status_entry_update_from_tree_entry(e, tree_entry);
-			st->tree_position++;
+		if (ie == NULL && we == NULL) {
+			item->path = NULL;
+			return GIT_SUCCESS;
 		}
 
-		if (in_index) {
-			status_entry_update_from_index_entry(e, index_entry);
-			st->index_position++;
+		if (ie == NULL)
+			cmp = 1;
+		else if (we == NULL)
+			cmp = -1;
+		else
+			cmp = strcmp(ie->path, we->path);
+
+		item->is_ignored = 0;
+
+		if (cmp > 0) {
+			item->path = we->path;
+			item->status_flags = GIT_STATUS_WT_NEW;
+			item->is_ignored = git_iterator_current_is_ignored(wd->wd_iter) ||
+				status_wd_in_ignored_dir(wd, we->path);
+
+			/* the path is the iterator's; keep it until next time */
+			wd->wd_given = 1;
+			return GIT_SUCCESS;
 		}
 
-		if (in_workdir)
-			if ((error = status_entry_update_from_workdir(
-					 e, full_path->ptr)) < GIT_SUCCESS)
-				return error;	/* The callee has already set the error message */
+		if (cmp < 0) {
+			item->path = ie->path;
+			item->status_flags = GIT_STATUS_WT_DELETED;
+			return status_index_advance(wd->index_iter, &wd->index_entry);
+		}
 
-		return store_if_changed(st, e);
-	}
+		error = status_wd_unchanged(wd, ie, we, &unchanged);
+		if (error == GIT_SUCCESS)
+			error = status_index_advance(wd->index_iter, &wd->index_entry);
+		if (error == GIT_SUCCESS)
+			error = git_iterator_advance(wd->wd_iter, &wd->wd_entry);
 
-	/* Are we dealing with a subtree? */
-	if (tree_entry_type == GIT_OBJ_TREE) {
-		assert(in_head && !in_index && !in_workdir);
-		return process_folder(st, tree_entry, full_path, path_type);
+		if (error == GIT_SUCCESS && !unchanged) {
+			item->path = ie->path;
+			item->status_flags = GIT_STATUS_WT_MODIFIED;
+			return GIT_SUCCESS;
+		}
 	}
 
-	/* We're dealing with something else -- most likely a submodule;
-	 * skip it for now */
-	if (in_head)
-		st->tree_position++;
-	if (in_index)
-		st->index_position++;
-	return GIT_SUCCESS;
+	return error;
 }
 
-static int path_type_from(git_buf *full_path, int is_dir)
+#ifdef GIT_THREADS
+
+/*
+ * Each part of a walk split between threads costs a look at the
+ * top-level directory, so there aren't too many of them
+ */
+#define STATUS_MAX_PARTS 64
+
+typedef struct {
+	unsigned int status_flags;
+	int is_ignored;
+	char path[GIT_FLEX_ARRAY];
+} status_part_item;
+
+/* The paths from `start` up to the next part's */
+typedef struct {
+	char *start;
+	status_wd wd;
+	git_vector items;
+	int error;
+	int done;
+} status_part;
+
+typedef struct {
+	status_part *parts;
+	unsigned int part_count;
+
+	/* the first part no thread took yet */
+	unsigned int next_part;
+
+	git_thread *workers;
+	unsigned int started;
+
+	git_mutex lock;
+	git_cond done; /* a part was walked */
+	int cancelled;
+
+	git_mutex index_lock;
+
+	/* the part the caller is at, and where in it */
+	unsigned int current, position;
+	int current_done;
+} status_parallel;
+
+static int status_part_walk(status_part *part)
 {
-	if (full_path == NULL)
-		return GIT_STATUS_PATH_NULL;
+	status_wd_item item;
+	status_part_item *copy;
+	size_t path_len;
+	int error;
 
-	if (!is_dir)
-		return GIT_STATUS_PATH_FILE;
+	while ((error = status_wd_next(&part->wd, &item)) == GIT_SUCCESS &&
+		item.path != NULL) {
+		path_len = strlen(item.path);
 
-	if (!git__suffixcmp(full_path->ptr, "/" DOT_GIT "/"))
-		return GIT_STATUS_PATH_IGNORE;
+		copy = git__malloc(sizeof(status_part_item) + path_len + 1);
+		if (copy == NULL)
+			return GIT_ENOMEM;
 
-	return GIT_STATUS_PATH_FOLDER;
+		copy->status_flags = item.status_flags;
+		copy->is_ignored = item.is_ignored;
+		memcpy(copy->path, item.path, path_len + 1);
+
+		if ((error = git_vector_insert(&part->items, copy)) < GIT_SUCCESS) {
+			git__free(copy);
+			return error;
+		}
+	}
+
+	return error;
 }
 
-static const char *status_path(const char *first, const char *second, const char *third)
+static void status_part_free(status_part *part)
 {
-	/* At least one of them can not be NULL */
-	assert(first != NULL || second != NULL || third != NULL);
+	unsigned int i;
+	status_part_item *item;
 
-	/* TODO: Fixme. Ensure that when non null, they're all equal */
-	if (first != NULL)
-		return first;
+	git_vector_foreach(&part->items, i, item)
+		git__free(item);
+	git_vector_free(&part->items);
 
-	if (second != NULL)
-		return second;
+	status_wd_free(&part->wd);
+	git__free(part->start);
+	part->start = NULL;
+}
+
+static void *status_worker(void *data)
+{
+	status_parallel *par = data;
+	status_part *part;
+	int error;
+
+	git_mutex_lock(&par->lock);
+
+	while (!par->cancelled && par->next_part < par->part_count) {
+		part = &par->parts[par->next_part++];
+		git_mutex_unlock(&par->lock);
+
+		error = status_part_walk(part);
+
+		git_mutex_lock(&par->lock);
+		part->error = error;
+		part->done = 1;
+		git_cond_broadcast(&par->done);
+	}
 
-	return third;
+	git_mutex_unlock(&par->lock);
+	return NULL;
 }
 
-static int compare(const char *left, const char *right)
+/* The top-level directories, which the parts start at */
+static int status_parallel_starts(
+	git_vector *dirs, git_repository *repo, git_vector *contents)
 {
-	if (left == NULL && right == NULL)
-		return 0;
+	git_buf path = GIT_BUF_INIT;
+	git_path_with_stat *ps;
+	unsigned int i;
+	int error;
+
+	if ((error = git_buf_sets(&path, git_repository_workdir(repo))) == GIT_SUCCESS &&
+		(error = git_path_to_dir(&path)) == GIT_SUCCESS)
+		error = git_path_dirload_with_stat(path.ptr, path.size, contents);
 
-	if (left == NULL)
-		return 1;
+	git_buf_free(&path);
 
-	if (right == NULL)
-		return -1;
+	if (error < GIT_SUCCESS)
+		return error;
 
-	return strcmp(left, right);
+	git_vector_sort(contents);
+
+	git_vector_foreach(contents, i, ps) {
+		if (S_ISDIR(ps->st.st_mode) && strcmp(ps->path, DOT_GIT "/") != 0 &&
+			(error = git_vector_insert(dirs, ps->path)) < GIT_SUCCESS)
+			return error;
+	}
+
+	return GIT_SUCCESS;
 }
 
-/* Greatly inspired from JGit IndexTreeWalker */
-/* https://github.com/spearce/jgit/blob/ed47e29c777accfa78c6f50685a5df2b8f5b8ff5/org.spearce.jgit/src/org/spearce/jgit/lib/IndexTreeWalker.java#L88 */
+static void status_parallel_free(status_parallel *par)
+{
+	unsigned int i;
+
+	git_mutex_lock(&par->lock);
+	par->cancelled = 1;
+	git_mutex_unlock(&par->lock);
+
+	for (i = 0; i < par->started; ++i)
+		git_thread_join(par->workers[i], NULL);
+
+	for (i = 0; i < par->part_count; ++i)
+		status_part_free(&par->parts[i]);
 
-static int dirent_cb(void *state, git_buf *a)
+	git_cond_free(&par->done);
+	git_mutex_free(&par->lock);
+	git_mutex_free(&par->index_lock);
+
+	git__free(par->workers);
+	git__free(par->parts);
+	git__free(par);
+}
+
+static int status_parallel_new(
+	status_parallel **out,
+	git_repository *repo,
+	git_index *index,
+	unsigned int threads,
+	unsigned int flags)
 {
-	const git_tree_entry *m;
-	const git_index_entry *entry;
-	enum path_type path_type;
-	int cmpma, cmpmi, cmpai, error;
-	const char *pm, *pa, *pi;
-	const char *m_name, *i_name, *a_name;
-	struct status_st *st = (struct status_st *)state;
+	status_parallel *par;
+	git_untracked_cache *untracked;
+	git_vector contents = GIT_VECTOR_INIT, dirs = GIT_VECTOR_INIT;
+	git_path_with_stat *ps;
+	unsigned int i, part_count;
+	int error;
 
-	path_type = path_type_from(a, st->is_dir);
+	if ((error = git_vector_init(&contents, 0, git_path_with_stat_cmp)) < GIT_SUCCESS ||
+		(error = status_parallel_starts(&dirs, repo, &contents)) < GIT_SUCCESS)
+		goto cleanup;
 
-	if (path_type == GIT_STATUS_PATH_IGNORE)
-		return GIT_SUCCESS;	/* Let's skip the ".git" directory */
+	/* the first part has the files before the first directory */
+	part_count = 1 + (dirs.length < STATUS_MAX_PARTS ? dirs.length : STATUS_MAX_PARTS);
 
-	a_name = (path_type != GIT_STATUS_PATH_NULL) ? a->ptr + st->workdir_path_len : NULL;
+	par = git__calloc(1, sizeof(status_parallel));
+	if (par == NULL) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
 
-	while (1) {
-		if (st->tree == NULL)
-			m = NULL;
-		else
-			m = git_tree_entry_byindex(st->tree, st->tree_position);
+	git_mutex_init(&par->lock);
+	git_cond_init(&par->done, NULL);
+	git_mutex_init(&par->index_lock);
 
-		entry = git_index_get(st->index, st->index_position);
+	par->parts = git__calloc(part_count, sizeof(status_part));
+	if (par->parts == NULL) {
+		status_parallel_free(par);
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
 
-		if ((m == NULL) && (a == NULL) && (entry == NULL))
-			return GIT_SUCCESS;
+	for (i = 1; i < part_count; ++i) {
+		const char *start = git_vector_get(&dirs, (i - 1) * dirs.length / (part_count - 1));
 
-		if (m != NULL) {
-			git_buf_truncate(&st->head_tree_relative_path,
-							 st->head_tree_relative_path_len);
-			git_buf_joinpath(&st->head_tree_relative_path,
-							 st->head_tree_relative_path.ptr, m->filename);
-			/* When the tree entry is a folder, append a forward slash to its name */
-			if (git_tree_entry_type(m) == GIT_OBJ_TREE)
-				git_path_to_dir(&st->head_tree_relative_path);
+		if ((par->parts[i].start = git__strdup(start)) == NULL) {
+			error = GIT_ENOMEM;
+			break;
+		}
+	}
+
+	/*
+	 * Only what changed since last time needs looking at; the parts
+	 * don't ask for themselves, nor make or drop the untracked cache,
+	 * which they use but don't record in. The threads share the
+	 * index, so nothing in it is left to do lazily.
+	 */
+	(void)git_index__fsmonitor_refresh(index);
+	if (error == GIT_SUCCESS && (flags & GIT_ITERATOR_SKIP_IGNORED))
+		error = git_index__untracked_cache(&untracked, index, 1);
+	(void)git_index_find(index, "");
+
+	for (i = 0; error == GIT_SUCCESS && i < part_count; ++i) {
+		status_part *part = &par->parts[i];
+
+		par->part_count++;
+
+		if ((error = git_vector_init(&part->items, 0, NULL)) == GIT_SUCCESS)
+			error = status_wd_init(&part->wd, repo, index, part->start,
+				(i + 1 < part_count) ? par->parts[i + 1].start : NULL,
+				flags, &par->index_lock);
+	}
+
+	/* whatever the threads don't walk, the caller will */
+	if (error == GIT_SUCCESS &&
+		(par->workers = git__malloc(threads * sizeof(git_thread))) != NULL) {
+		while (par->started < threads && par->started < part_count &&
+			git_thread_create(&par->workers[par->started], NULL, status_worker, par) == 0)
+			par->started++;
+	}
+
+	if (error == GIT_SUCCESS)
+		*out = par;
+	else {
+		/* the parts which weren't set up only have their start */
+		for (i = par->part_count; i < part_count; ++i)
+			git__free(par->parts[i].start);
+		status_parallel_free(par);
+	}
+
+cleanup:
+	git_vector_foreach(&contents, i, ps)
+		git__free(ps);
+	git_vector_free(&contents);
+	git_vector_free(&dirs);
+	return error;
+}
+
+static int status_parallel_next(status_parallel *par, status_wd_item *item)
+{
+	status_part *part;
+	status_part_item *copy;
+	int walk_here;
 
-			error = git_buf_lasterror(&st->head_tree_relative_path);
-			if (error < GIT_SUCCESS)
-				return git__rethrow(error, "An error occured while "
-					"determining the status of '%s'", a->ptr);
+	while (par->current < par->part_count) {
+		part = &par->parts[par->current];
 
-			m_name = st->head_tree_relative_path.ptr;
-		} else
-			m_name = NULL;
+		if (!par->current_done) {
+			git_mutex_lock(&par->lock);
 
-		i_name = (entry != NULL) ? entry->path : NULL;
+			/* nobody got to it yet */
+			walk_here = (par->next_part == par->current);
+			if (walk_here)
+				par->next_part++;
 
-		cmpma = compare(m_name, a_name);
-		cmpmi = compare(m_name, i_name);
-		cmpai = compare(a_name, i_name);
+			while (!walk_here && !part->done)
+				git_cond_wait(&par->done, &par->lock);
 
-		pm = ((cmpma <= 0) && (cmpmi <= 0)) ? m_name : NULL;
-		pa = ((cmpma >= 0) && (cmpai <= 0)) ? a_name : NULL;
-		pi = ((cmpmi >= 0) && (cmpai >= 0)) ? i_name : NULL;
+			git_mutex_unlock(&par->lock);
 
-		if ((error = determine_status(st, pm != NULL, pi != NULL, pa != NULL,
-				m, entry, a, status_path(pm, pi, pa), path_type)) < GIT_SUCCESS)
-			return git__rethrow(error, "An error occured while determining the status of '%s'", a->ptr);
+			if (walk_here)
+				part->error = status_part_walk(part);
 
-		if ((pa != NULL) || (path_type == GIT_STATUS_PATH_FOLDER))
+			par->current_done = 1;
+		}
+
+		if (part->error < GIT_SUCCESS)
+			return part->error;
+
+		if (par->position < part->items.length) {
+			copy = git_vector_get(&part->items, par->position++);
+			item->path = copy->path;
+			item->status_flags = copy->status_flags;
+			item->is_ignored = copy->is_ignored;
 			return GIT_SUCCESS;
+		}
+
+		/* the caller is done with the last path by now */
+		status_part_free(part);
+		par->current++;
+		par->position = 0;
+		par->current_done = 0;
 	}
+
+	item->path = NULL;
+	return GIT_SUCCESS;
 }
 
-static int status_cmp(const void *a, const void *b)
+#endif
+
+/* The working directory's side of the status, on one thread or several */
+typedef struct {
+	status_wd wd;
+#ifdef GIT_THREADS
+	status_parallel *parallel;
+#endif
+} status_walk;
+
+static int status_walk_init(
+	status_walk *walk,
+	git_repository *repo,
+	git_index *index,
+	const git_status_options *opts)
 {
-	const struct status_entry *entry_a = (const struct status_entry *)(a);
-	const struct status_entry *entry_b = (const struct status_entry *)(b);
+	unsigned int flags = 0;
+
+	memset(walk, 0x0, sizeof(status_walk));
+
+	if (opts != NULL && (opts->flags & GIT_STATUS_OPT_EXCLUDE_IGNORED))
+		flags |= GIT_ITERATOR_SKIP_IGNORED;
 
-	return strcmp(entry_a->path, entry_b->path);
+#ifdef GIT_THREADS
+	if (opts != NULL && opts->threads > 1)
+		return status_parallel_new(&walk->parallel, repo, index, opts->threads, flags);
+#endif
+
+	return status_wd_init(&walk->wd, repo, index, NULL, NULL, flags, NULL);
 }
 
-#define DEFAULT_SIZE 16
+static int status_walk_next(status_walk *walk, status_wd_item *item)
+{
+#ifdef GIT_THREADS
+	if (walk->parallel != NULL)
+		return status_parallel_next(walk->parallel, item);
+#endif
 
-int git_status_foreach(
+	return status_wd_next(&walk->wd, item);
+}
+
+static void status_walk_free(status_walk *walk)
+{
+#ifdef GIT_THREADS
+	if (walk->parallel != NULL)
+		status_parallel_free(walk->parallel);
+	walk->parallel = NULL;
+#endif
+
+	status_wd_free(&walk->wd);
+}
+
+/* Submodules are left alone */
+static int status_head_skip(git_iterator *iter, const git_index_entry **entry)
+{
+	int error = GIT_SUCCESS;
+
+	while (error == GIT_SUCCESS && *entry != NULL && S_ISGITLINK((*entry)->mode))
+		error = git_iterator_advance(iter, entry);
+
+	return error;
+}
+
+static const char *status_first_path(const char *a, const char *b, const char *c)
+{
+	const char *first = a;
+
+	if (b != NULL && (first == NULL || strcmp(b, first) < 0))
+		first = b;
+	if (c != NULL && (first == NULL || strcmp(c, first) < 0))
+		first = c;
+
+	return first;
+}
+
+/*
+ * HEAD, the index and the working directory are walked side by side,
+ * and each file comes out once it was seen in all three; nothing is
+ * held on to but the iterators.
+ */
+int git_status_foreach_ext(
 	git_repository *repo,
+	const git_status_options *opts,
 	int (*callback)(const char *, unsigned int, void *),
 	void *payload)
 {
-	git_vector entries;
-	git_ignores ignores;
 	git_index *index = NULL;
-	git_buf temp_path = GIT_BUF_INIT;
-	struct status_st dirent_st = {0};
-	int error = GIT_SUCCESS;
-	unsigned int i;
-	git_tree *tree;
-	struct status_entry *e;
-	const char *workdir;
+	git_tree *tree = NULL;
+	git_iterator *head_iter = NULL, *index_iter = NULL;
+	const git_index_entry *head, *entry;
+	status_walk walk;
+	status_wd_item wd_item;
+	const char *workdir, *path;
+	unsigned int status_flags;
+	int in_head, in_index, in_wd, error = GIT_SUCCESS;
+
+	memset(&walk, 0x0, sizeof(status_walk));
 
 	if ((workdir = git_repository_workdir(repo)) == NULL)
 		return git__throw(GIT_ERROR,
@@ -491,20 +866,6 @@ int git_status_foreach(
 		goto exit;
 	}
 
-	git_vector_init(&entries, DEFAULT_SIZE, status_cmp);
-
-	dirent_st.repo = repo;
-	dirent_st.vector = &entries;
-	dirent_st.index = index;
-	dirent_st.tree = tree;
-	dirent_st.ignores = &ignores;
-	dirent_st.workdir_path_len = strlen(workdir);
-	git_buf_init(&dirent_st.head_tree_relative_path, 0);
-	dirent_st.head_tree_relative_path_len = 0;
-	dirent_st.tree_position = 0;
-	dirent_st.index_position = 0;
-	dirent_st.is_dir = 1;
-
 	if (git_path_isdir(workdir)) {
 		error = git__throw(GIT_EINVALIDPATH,
 			"Failed to determine status of file '%s'. "
@@ -512,48 +873,97 @@ int git_status_foreach(
 		goto exit;
 	}
 
-	git_buf_sets(&temp_path, workdir);
-
-	error = git_ignore__for_path(repo, "", dirent_st.ignores);
-	if (error < GIT_SUCCESS)
+	head = NULL;
+	if (tree != NULL &&
+		((error = git_iterator_for_tree(repo, tree, &head_iter)) < GIT_SUCCESS ||
+		 (error = git_iterator_current(head_iter, &head)) < GIT_SUCCESS ||
+		 (error = status_head_skip(head_iter, &head)) < GIT_SUCCESS))
 		goto exit;
 
-	error = alphasorted_futils_direach(
-		&temp_path, dirent_cb, &dirent_st);
+	if ((error = git_iterator_for_index(repo, &index_iter)) < GIT_SUCCESS ||
+		(error = git_iterator_current(index_iter, &entry)) < GIT_SUCCESS ||
+		(error = status_index_skip(index_iter, &entry, NULL)) < GIT_SUCCESS)
+		goto exit;
 
-	if (error < GIT_SUCCESS)
+	if ((error = status_walk_init(&walk, repo, index, opts)) < GIT_SUCCESS ||
+		(error = status_walk_next(&walk, &wd_item)) < GIT_SUCCESS) {
 		error = git__rethrow(error,
 			"Failed to determine statuses. "
 			"An error occured while processing the working directory");
+		goto exit;
+	}
 
-	if ((error == GIT_SUCCESS) &&
-		((error = dirent_cb(&dirent_st, NULL)) < GIT_SUCCESS))
-		error = git__rethrow(error,
-			"Failed to determine statuses. "
-			"An error occured while post-processing the HEAD tree and the index");
+	while ((path = status_first_path(head ? head->path : NULL,
+		entry ? entry->path : NULL, wd_item.path)) != NULL) {
+
+		in_head = (head != NULL && strcmp(head->path, path) == 0);
+		in_index = (entry != NULL && strcmp(entry->path, path) == 0);
+		in_wd = (wd_item.path != NULL && strcmp(wd_item.path, path) == 0);
+
+		status_flags = GIT_STATUS_CURRENT;
+
+		if (in_head && !in_index)
+			status_flags |= GIT_STATUS_INDEX_DELETED;
+		else if (in_index && !in_head)
+			status_flags |= GIT_STATUS_INDEX_NEW;
+		else if (in_head && git_oid_cmp(&head->oid, &entry->oid) != 0)
+			status_flags |= GIT_STATUS_INDEX_MODIFIED;
+
+		/* the files the walk didn't come up with are as the index has them */
+		if (in_wd)
+			status_flags |= wd_item.status_flags;
 
-	for (i = 0; i < entries.length; ++i) {
-		e = (struct status_entry *)git_vector_get(&entries, i);
+		/* only what neither HEAD nor the index has can be ignored */
+		if (status_flags == GIT_STATUS_WT_NEW && wd_item.is_ignored)
+			status_flags = GIT_STATUS_IGNORED;
 
-		if (error == GIT_SUCCESS) {
-			error = callback(e->path, e->status_flags, payload);
-			if (error < GIT_SUCCESS)
-				error = git__rethrow(error,
-					"Failed to determine statuses. User callback failed");
+		if (status_flags != GIT_STATUS_CURRENT &&
+			(error = callback(path, status_flags, payload)) < GIT_SUCCESS) {
+			error = git__rethrow(error,
+				"Failed to determine statuses. User callback failed");
+			break;
 		}
 
-		git__free(e);
+		if (in_head &&
+			((error = git_iterator_advance(head_iter, &head)) < GIT_SUCCESS ||
+			 (error = status_head_skip(head_iter, &head)) < GIT_SUCCESS))
+			break;
+
+		if (in_index &&
+			(error = status_index_advance(index_iter, &entry)) < GIT_SUCCESS)
+			break;
+
+		if (in_wd && (error = status_walk_next(&walk, &wd_item)) < GIT_SUCCESS) {
+			error = git__rethrow(error,
+				"Failed to determine statuses. "
+				"An error occured while processing the working directory");
+			break;
+		}
 	}
 
 exit:
-	git_buf_free(&dirent_st.head_tree_relative_path);
-	git_buf_free(&temp_path);
-	git_vector_free(&entries);
-	git_ignore__free(&ignores);
+	status_walk_free(&walk);
+
+	/* keep the stat data we refreshed on the way for next time */
+	if (error == GIT_SUCCESS)
+		git_index__write_refreshed(index);
+
+	if (head_iter != NULL)
+		git_iterator_free(head_iter);
+	if (index_iter != NULL)
+		git_iterator_free(index_iter);
 	git_tree_free(tree);
 	return error;
 }
 
+int git_status_foreach(
+	git_repository *repo,
+	int (*callback)(const char *, unsigned int, void *),
+	void *payload)
+{
+	return git_status_foreach_ext(repo, NULL, callback, payload);
+}
+
 static int recurse_tree_entry(git_tree *tree, struct status_entry *e, const char *path)
 {
 	char *dir_sep;
@@ -621,12 +1031,6 @@ int git_status_file(unsigned int *status_flags, git_repository *repo, const char
 		return GIT_ENOMEM;
 	}
 
-	/* Find file in Workdir */
-	if (git_path_exists(temp_path.ptr) == GIT_SUCCESS) {
-		if ((error = status_entry_update_from_workdir(e, temp_path.ptr)) < GIT_SUCCESS)
-			goto cleanup;	/* The callee has already set the error message */
-	}
-
 	/* Find file in Index */
 	if ((error = git_repository_index__weakptr(&index, repo)) < GIT_SUCCESS) {
 		git__rethrow(error,
@@ -635,8 +1039,17 @@ int git_status_file(unsigned int *status_flags, git_repository *repo, const char
 		goto cleanup;
 	}
 
+	git_index__fsmonitor_refresh(index);
 	status_entry_update_from_index(e, index);
 
+	/* Find file in Workdir; the index entry may spare us reading it */
+	if (git_path_exists(temp_path.ptr) == GIT_SUCCESS) {
+		if ((error = status_entry_update_from_workdir(e, index, temp_path.ptr)) < GIT_SUCCESS)
+			goto cleanup;	/* The callee has already set the error message */
+
+		git_index__write_refreshed(index);
+	}
+
 	if ((error = retrieve_head_tree(&tree, repo)) < GIT_SUCCESS) {
 		git__rethrow(error,
 			"Failed to determine status of file '%s'", path);
@@ -687,98 +1100,6 @@ cleanup:
 	return error;
 }
 
-/*
- * git_path_direach is not supposed to return entries in an ordered manner.
- * alphasorted_futils_direach wraps git_path_direach and invokes the callback
- * function by passing it alphabeticcally sorted paths parameters.
- *
- */
-
-static char *alphasorted_dirent_info_new(const git_buf *path)
-{
-	char *di = git__malloc(path->size + 2);
-	if (!di)
-		return di;
-
-	git_buf_copy_cstr(di, path->size + 1, path);
-
-	if (git_path_isdir(path->ptr) == GIT_SUCCESS) {
-		/*
-		 * Append a forward slash to the name to force folders
-		 * to be ordered in a similar way than in a tree
-		 *
-		 * The file "subdir" should appear before the file "subdir.txt"
-		 * The folder "subdir" should appear after the file "subdir.txt"
-		 */
-		di[path->size] = '/';
-		di[path->size + 1] = '\0';
-	}
-
-	return di;
-}
-
-static int alphasorted_dirent_cb(void *state, git_buf *full_path)
-{
-	char *entry;
-	git_vector *entry_names;
-
-	entry_names = (git_vector *)state;
-	entry = alphasorted_dirent_info_new(full_path);
-
-	if (entry == NULL)
-		return GIT_ENOMEM;
-
-	if (git_vector_insert(entry_names, entry) < GIT_SUCCESS) {
-		git__free(entry);
-		return GIT_ENOMEM;
-	}
-
-	return GIT_SUCCESS;
-}
-
-static int alphasorted_futils_direach(
-	git_buf *path,
-	int (*fn)(void *, git_buf *),
-	void *arg)
-{
-	char *entry;
-	git_vector entry_names;
-	unsigned int idx;
-	int error = GIT_SUCCESS;
-	git_buf entry_path = GIT_BUF_INIT;
-
-	if (git_vector_init(&entry_names, 16, git__strcmp_cb) < GIT_SUCCESS)
-		return GIT_ENOMEM;
-
-	error = git_path_direach(path, alphasorted_dirent_cb, &entry_names);
-
-	git_vector_sort(&entry_names);
-
-	for (idx = 0; idx < entry_names.length; ++idx) {
-		entry = (char *)git_vector_get(&entry_names, idx);
-
-		/* We have to walk the entire vector even if there was an error,
-		 * in order to free up memory, but we stop making callbacks after
-		 * an error.
-		 */
-		if (error == GIT_SUCCESS)
-			error = git_buf_sets(&entry_path, entry);
-
-		if (error == GIT_SUCCESS) {
-			((struct status_st *)arg)->is_dir =
-				(entry[entry_path.size - 1] == '/');
-			error = fn(arg, &entry_path);
-		}
-
-		git__free(entry);
-	}
-
-	git_buf_free(&entry_path);
-	git_vector_free(&entry_names);
-	return error;
-}
-
-
 int git_status_should_ignore(git_repository *repo, const char *path, int *ignored)
 {
 	int error;
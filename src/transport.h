@@ -8,13 +8,16 @@
 #define INCLUDE_transport_h__
 
 #include "git2/net.h"
+#include "git2/indexer.h"
 #include "vector.h"
 
 #define GIT_CAP_OFS_DELTA "ofs-delta"
+#define GIT_CAP_THIN_PACK "thin-pack"
 
 typedef struct git_transport_caps {
 	int common:1,
-		ofs_delta:1;
+		ofs_delta:1,
+		thin_pack:1;
 } git_transport_caps;
 
 /*
@@ -53,6 +56,10 @@ struct git_transport {
 	 */
 	int direction : 1, /* 0 fetch, 1 push */
 		connected : 1;
+	/**
+	 * What the other end told us it can do, once connected
+	 */
+	git_transport_caps caps;
 	/**
 	 * Connect and store the remote heads
 	 */
@@ -79,9 +86,9 @@ struct git_transport {
 	 */
 	int (*send_flush)(struct git_transport *transport);
 	/**
-	 * Download the packfile
+	 * Download the packfile, indexing it as it arrives
 	 */
-	int (*download_pack)(char **out, struct git_transport *transport, git_repository *repo);
+	int (*download_pack)(struct git_transport *transport, git_repository *repo, git_indexer_stats *stats);
 	/**
 	 * Fetch the changes
 	 */
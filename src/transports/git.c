@@ -28,7 +28,6 @@ typedef struct {
 	GIT_SOCKET socket;
 	git_vector refs;
 	git_remote_head **heads;
-	git_transport_caps caps;
 	char buff[1024];
 	gitno_buffer buf;
 #ifdef GIT_WIN32
@@ -157,36 +156,6 @@ static int store_refs(transport_git *t)
 	return error;
 }
 
-static int detect_caps(transport_git *t)
-{
-	git_vector *refs = &t->refs;
-	git_pkt_ref *pkt;
-	git_transport_caps *caps = &t->caps;
-	const char *ptr;
-
-	pkt = git_vector_get(refs, 0);
-	/* No refs or capabilites, odd but not a problem */
-	if (pkt == NULL || pkt->capabilities == NULL)
-		return GIT_SUCCESS;
-
-	ptr = pkt->capabilities;
-	while (ptr != NULL && *ptr != '\0') {
-		if (*ptr == ' ')
-			ptr++;
-
-		if(!git__prefixcmp(ptr, GIT_CAP_OFS_DELTA)) {
-			caps->common = caps->ofs_delta = 1;
-			ptr += strlen(GIT_CAP_OFS_DELTA);
-			continue;
-		}
-
-		/* We don't know this capability, so skip it */
-		ptr = strchr(ptr, ' ');
-	}
-
-	return GIT_SUCCESS;
-}
-
 /*
  * Since this is a network connection, we need to parse and store the
  * pkt-lines at this stage and keep them there.
@@ -216,7 +185,7 @@ static int git_connect(git_transport *transport, int direction)
 	if (error < GIT_SUCCESS)
 		return error;
 
-	error = detect_caps(t);
+	error = git_protocol_detect_caps(&t->refs, &t->parent.caps);
 
 cleanup:
 	if (error < GIT_SUCCESS) {
@@ -260,7 +229,7 @@ static int git_negotiate_fetch(git_transport *transport, git_repository *repo, c
 	unsigned int i;
 	gitno_buffer *buf = &t->buf;
 
-	error = git_pkt_send_wants(wants, &t->caps, t->socket);
+	error = git_pkt_send_wants(wants, &t->parent.caps, t->socket);
 	if (error < GIT_SUCCESS)
 		return git__rethrow(error, "Failed to send wants list");
 
@@ -380,7 +349,7 @@ static int git_send_done(git_transport *transport)
 	return git_pkt_send_done(t->socket);
 }
 
-static int git_download_pack(char **out, git_transport *transport, git_repository *repo)
+static int git_download_pack(git_transport *transport, git_repository *repo, git_indexer_stats *stats)
 {
 	transport_git *t = (transport_git *) transport;
 	int error = GIT_SUCCESS;
@@ -408,7 +377,7 @@ static int git_download_pack(char **out, git_transport *transport, git_repositor
 
 			if (pkt->type == GIT_PKT_PACK) {
 				git__free(pkt);
-				return git_fetch__download_pack(out, buf->data, buf->offset, t->socket, repo);
+				return git_fetch__download_pack(buf->data, buf->offset, t->socket, repo, stats);
 			}
 
 			/* For now we don't care about anything */
@@ -46,7 +46,6 @@ typedef struct {
 	char *host;
 	char *port;
 	char *service;
-	git_transport_caps caps;
 #ifdef GIT_WIN32
 	WSADATA wsd;
 #endif
@@ -231,16 +230,17 @@ static int store_refs(transport_http *t)
 		gitno_consume_n(&buf, parsed);
 
 		if (error == 0 || t->transfer_finished)
-			return GIT_SUCCESS;
+			break;
 	}
 
 	pkt = git_vector_get(&t->refs, 0);
 	if (pkt == NULL || pkt->type != GIT_PKT_COMMENT)
 		return t->error = git__throw(GIT_EOBJCORRUPTED, "Not a valid smart HTTP response");
-	else
-		git_vector_remove(&t->refs, 0);
 
-	return error;
+	git_vector_remove(&t->refs, 0);
+	git_pkt_free(pkt);
+
+	return git_protocol_detect_caps(&t->refs, &t->parent.caps);
 }
 
 static int http_connect(git_transport *transport, int direction)
@@ -496,7 +496,7 @@ static int http_negotiate_fetch(git_transport *transport, git_repository *repo,
 			goto cleanup;
 		}
 
-		error =  git_pkt_buffer_wants(wants, &t->caps, &data);
+		error =  git_pkt_buffer_wants(wants, &t->parent.caps, &data);
 		if (error < GIT_SUCCESS) {
 			error = git__rethrow(error, "Failed to send wants");
 			goto cleanup;
@@ -568,7 +568,8 @@ cleanup:
 }
 
 typedef struct {
-	git_filebuf *file;
+	git_indexer_stream *idx;
+	git_indexer_stats *stats;
 	transport_http *transport;
 } download_pack_cbdata;
 
@@ -584,10 +585,8 @@ static int on_body_download_pack(http_parser *parser, const char *str, size_t le
 {
 	download_pack_cbdata *data = (download_pack_cbdata *) parser->data;
 	transport_http *t = data->transport;
-	git_filebuf *file = data->file;
-
 
-	return t->error = git_filebuf_write(file, str, len);
+	return t->error = git_indexer_stream_add(data->idx, str, len, data->stats);
 }
 
 /*
@@ -596,7 +595,7 @@ static int on_body_download_pack(http_parser *parser, const char *str, size_t le
  * the simple downloader. Furthermore, we're using keep-alive
  * connections, so the simple downloader would just hang.
  */
-static int http_download_pack(char **out, git_transport *transport, git_repository *repo)
+static int http_download_pack(git_transport *transport, git_repository *repo, git_indexer_stats *stats)
 {
 	transport_http *t = (transport_http *) transport;
 	git_buf *oldbuf = &t->buf;
@@ -605,15 +604,13 @@ static int http_download_pack(char **out, git_transport *transport, git_reposito
 	char buffer[1024];
 	gitno_buffer buf;
 	download_pack_cbdata data;
-	git_filebuf file = GIT_FILEBUF_INIT;
-	git_buf path = GIT_BUF_INIT;
-	char suff[] = "/objects/pack/pack-received\0";
+	git_indexer_stream *idx = NULL;
 
 	/*
 	 * This is part of the previous response, so we don't want to
 	 * re-init the parser, just set these two callbacks.
 	 */
-	data.file = &file;
+	data.stats = stats;
 	data.transport = t;
 	t->parser.data = &data;
 	t->transfer_finished = 0;
@@ -627,16 +624,14 @@ static int http_download_pack(char **out, git_transport *transport, git_reposito
 		return git__throw(GIT_ERROR, "The pack doesn't start with the signature");
 	}
 
-	error = git_buf_joinpath(&path, repo->path_repository, suff);
+	error = git_fetch__indexer_new(&idx, repo);
 	if (error < GIT_SUCCESS)
 		goto cleanup;
 
-	error = git_filebuf_open(&file, path.ptr, GIT_FILEBUF_TEMPORARY);
-	if (error < GIT_SUCCESS)
-		goto cleanup;
+	data.idx = idx;
 
 	/* Part of the packfile has been received, don't loose it */
-	error = git_filebuf_write(&file, oldbuf->ptr, oldbuf->size);
+	error = git_indexer_stream_add(idx, oldbuf->ptr, oldbuf->size, stats);
 	if (error < GIT_SUCCESS)
 		goto cleanup;
 
@@ -644,13 +639,17 @@ static int http_download_pack(char **out, git_transport *transport, git_reposito
 		size_t parsed;
 
 		error = gitno_recv(&buf);
-		if (error < GIT_SUCCESS)
-			return git__rethrow(error, "Error receiving data from network");
+		if (error < GIT_SUCCESS) {
+			error = git__rethrow(error, "Error receiving data from network");
+			goto cleanup;
+		}
 
 		parsed = http_parser_execute(&t->parser, &settings, buf.data, buf.offset);
 		/* Both should happen at the same time */
-		if (parsed != buf.offset || t->error < GIT_SUCCESS)
-			return git__rethrow(t->error, "Error parsing HTTP data");
+		if (parsed != buf.offset || t->error < GIT_SUCCESS) {
+			error = git__rethrow(t->error, "Error parsing HTTP data");
+			goto cleanup;
+		}
 
 		gitno_consume_n(&buf, parsed);
 
@@ -659,19 +658,10 @@ static int http_download_pack(char **out, git_transport *transport, git_reposito
 		}
 	}
 
-	*out = git__strdup(file.path_lock);
-	if (*out == NULL) {
-		error = GIT_ENOMEM;
-		goto cleanup;
-	}
-
-	/* A bit dodgy, but we need to keep the pack at the temporary path */
-	error = git_filebuf_commit_at(&file, file.path_lock, GIT_PACK_FILE_MODE);
+	error = git_indexer_stream_finalize(idx, stats);
 
 cleanup:
-	if (error < GIT_SUCCESS)
-		git_filebuf_cleanup(&file);
-	git_buf_free(&path);
+	git_indexer_stream_free(idx);
 
 	return error;
 }
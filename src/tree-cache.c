@@ -76,6 +76,24 @@ const git_tree_cache *git_tree_cache_get(const git_tree_cache *tree, const char
 	}
 }
 
+int git_tree_cache_new(git_tree_cache **out, const char *name, size_t name_len, git_tree_cache *parent)
+{
+	git_tree_cache *tree;
+
+	if ((tree = git__malloc(sizeof(git_tree_cache) + name_len + 1)) == NULL)
+		return GIT_ENOMEM;
+
+	memset(tree, 0x0, sizeof(git_tree_cache));
+	tree->parent = parent;
+	tree->entries = -1;
+
+	memcpy(tree->name, name, name_len);
+	tree->name[name_len] = '\0';
+
+	*out = tree;
+	return GIT_SUCCESS;
+}
+
 static int read_tree_internal(git_tree_cache **out,
 		const char **buffer_in, const char *buffer_end, git_tree_cache *parent)
 {
@@ -97,17 +115,11 @@ static int read_tree_internal(git_tree_cache **out,
 		goto cleanup;
 	}
 
+	/* NUL-terminated tree name */
 	name_len = strlen(name_start);
-	if ((tree = git__malloc(sizeof(git_tree_cache) + name_len + 1)) == NULL)
+	if (git_tree_cache_new(&tree, name_start, name_len, parent) < GIT_SUCCESS)
 		return GIT_ENOMEM;
 
-	memset(tree, 0x0, sizeof(git_tree_cache));
-	tree->parent = parent;
-
-	/* NUL-terminated tree name */
-	memcpy(tree->name, name_start, name_len);
-	tree->name[name_len] = '\0';
-
 	/* Blank-terminated ASCII decimal number of entries in this tree */
 	if (git__strtol32(&count, buffer, &buffer, 10) < GIT_SUCCESS || count < -1) {
 		error = GIT_EOBJCORRUPTED;
@@ -130,7 +142,7 @@ static int read_tree_internal(git_tree_cache **out,
 
 	tree->children_count = count;
 
-	if (*buffer != '\n' || ++buffer >= buffer_end) {
+	if (*buffer != '\n' || ++buffer > buffer_end) {
 		error = GIT_EOBJCORRUPTED;
 		goto cleanup;
 	}
@@ -150,16 +162,18 @@ static int read_tree_internal(git_tree_cache **out,
 	/* Parse children: */
 	if (tree->children_count > 0) {
 		unsigned int i;
-		int err;
 
-		tree->children = git__malloc(tree->children_count * sizeof(git_tree_cache *));
-		if (tree->children == NULL)
+		/* zeroed, so that a partly read tree can be freed */
+		tree->children = git__calloc(tree->children_count, sizeof(git_tree_cache *));
+		if (tree->children == NULL) {
+			error = GIT_ENOMEM;
 			goto cleanup;
+		}
 
 		for (i = 0; i < tree->children_count; ++i) {
-			err = read_tree_internal(&tree->children[i], &buffer, buffer_end, tree);
+			error = read_tree_internal(&tree->children[i], &buffer, buffer_end, tree);
 
-			if (err < GIT_SUCCESS)
+			if (error < GIT_SUCCESS)
 				goto cleanup;
 		}
 	}
@@ -186,6 +200,26 @@ int git_tree_cache_read(git_tree_cache **tree, const char *buffer, size_t buffer
 	return error;
 }
 
+static void write_tree_internal(git_buf *out, const git_tree_cache *tree)
+{
+	size_t i;
+
+	git_buf_put(out, tree->name, strlen(tree->name) + 1);
+	git_buf_printf(out, "%d %d\n", (int)tree->entries, (int)tree->children_count);
+
+	if (tree->entries >= 0)
+		git_buf_put(out, (const char *)tree->oid.id, GIT_OID_RAWSZ);
+
+	for (i = 0; i < tree->children_count; ++i)
+		write_tree_internal(out, tree->children[i]);
+}
+
+int git_tree_cache_write(git_buf *out, const git_tree_cache *tree)
+{
+	write_tree_internal(out, tree);
+	return git_buf_lasterror(out);
+}
+
 void git_tree_cache_free(git_tree_cache *tree)
 {
 	unsigned int i;
@@ -9,6 +9,7 @@
 #define INCLUDE_tree_cache_h__
 
 #include "common.h"
+#include "buffer.h"
 #include "git2/oid.h"
 
 struct git_tree_cache {
@@ -23,7 +24,11 @@ struct git_tree_cache {
 
 typedef struct git_tree_cache git_tree_cache;
 
+/* An invalid node called `name`, which isn't added to `parent` yet */
+int git_tree_cache_new(git_tree_cache **out, const char *name, size_t name_len, git_tree_cache *parent);
+
 int git_tree_cache_read(git_tree_cache **tree, const char *buffer, size_t buffer_size);
+int git_tree_cache_write(git_buf *out, const git_tree_cache *tree);
 void git_tree_cache_invalidate_path(git_tree_cache *tree, const char *path);
 const git_tree_cache *git_tree_cache_get(const git_tree_cache *tree, const char *path);
 void git_tree_cache_free(git_tree_cache *tree);
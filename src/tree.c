@@ -258,22 +258,68 @@ int git_tree__parse(git_tree *tree, git_odb_object *obj)
 	return tree_parse_buffer(tree, (char *)obj->raw.data, (char *)obj->raw.data + obj->raw.len);
 }
 
-static unsigned int find_next_dir(const char *dirname, git_index *index, unsigned int start)
+/* Whether `path` is in the directory `dirname` ("" for the root) */
+static int path_in_dir(const char *path, const char *dirname, size_t dirlen)
 {
-	unsigned int i, entries = git_index_entrycount(index);
-	size_t dirlen;
+	return strlen(path) >= dirlen &&
+		!memcmp(path, dirname, dirlen) &&
+		(dirlen == 0 || path[dirlen] == '/');
+}
 
-	dirlen = strlen(dirname);
-	for (i = start; i < entries; ++i) {
-		git_index_entry *entry = git_index_get(index, i);
-		if (strlen(entry->path) < dirlen ||
-		    memcmp(entry->path, dirname, dirlen) ||
-			(dirlen > 0 && entry->path[dirlen] != '/')) {
+/*
+ * Where the directory starting at `start` ends in the index, if its
+ * cached tree is still good; the entries must agree with the cache.
+ */
+static int cached_dir_end(git_index *index, const git_tree_cache *cache,
+	const char *dirname, unsigned int start)
+{
+	unsigned int end, entries = git_index_entrycount(index);
+	size_t dirlen = strlen(dirname);
+
+	if (cache->entries < 0 || (size_t)cache->entries > entries - start)
+		return -1;
+
+	end = start + (unsigned int)cache->entries;
+
+	if (end > start && !path_in_dir(git_index_get(index, end - 1)->path, dirname, dirlen))
+		return -1;
+
+	if (end < entries && path_in_dir(git_index_get(index, end)->path, dirname, dirlen))
+		return -1;
+
+	return (int)end;
+}
+
+/*
+ * Take the node for subtree `name` out of `children`, or make a new
+ * one, and add it to the children of `tree`.
+ */
+static git_tree_cache *reuse_child(git_tree_cache *tree,
+	git_tree_cache **children, size_t children_count, const char *name)
+{
+	git_tree_cache *child = NULL, **grown;
+	size_t i;
+
+	for (i = 0; i < children_count; ++i) {
+		if (children[i] != NULL && !strcmp(children[i]->name, name)) {
+			child = children[i];
+			children[i] = NULL;
 			break;
 		}
 	}
 
-	return i;
+	if (child == NULL && git_tree_cache_new(&child, name, strlen(name), tree) < GIT_SUCCESS)
+		return NULL;
+
+	grown = git__realloc(tree->children, (tree->children_count + 1) * sizeof(git_tree_cache *));
+	if (grown == NULL) {
+		git_tree_cache_free(child);
+		return NULL;
+	}
+
+	tree->children = grown;
+	tree->children[tree->children_count++] = child;
+	return child;
 }
 
 static int append_entry(git_treebuilder *bld, const char *filename, const git_oid *id, unsigned int attributes)
@@ -296,24 +342,31 @@ static int append_entry(git_treebuilder *bld, const char *filename, const git_oi
 	return GIT_SUCCESS;
 }
 
+/*
+ * Write the tree of `dirname`, whose entries start at `start` in the
+ * index, and return where they end. `cache` is the directory's node
+ * in the tree cache: if it's valid, its tree is taken as is, and if
+ * not, it's filled in along with the nodes of the subdirectories.
+ */
 static int write_tree(
 	git_oid *oid,
 	git_repository *repo,
 	git_index *index,
 	const char *dirname,
-	unsigned int start)
+	unsigned int start,
+	git_tree_cache *cache)
 {
 	git_treebuilder *bld = NULL;
 
 	unsigned int i, entries = git_index_entrycount(index);
-	int error;
+	int error, end;
 	size_t dirname_len = strlen(dirname);
-	const git_tree_cache *cache;
+	git_tree_cache **old_children;
+	size_t old_children_count;
 
-	cache = git_tree_cache_get(index->tree, dirname);
-	if (cache != NULL && cache->entries >= 0){
+	if ((end = cached_dir_end(index, cache, dirname, start)) >= 0) {
 		git_oid_cpy(oid, &cache->oid);
-		return find_next_dir(dirname, index, start);
+		return end;
 	}
 
 	error = git_treebuilder_create(&bld, NULL);
@@ -321,6 +374,13 @@ static int write_tree(
 		return GIT_ENOMEM;
 	}
 
+	/* the subdirectories we come across are put back */
+	cache->entries = -1;
+	old_children = cache->children;
+	old_children_count = cache->children_count;
+	cache->children = NULL;
+	cache->children_count = 0;
+
 	/*
 	 * This loop is unfortunate, but necessary. The index doesn't have
 	 * any directores, so we need to handle that manually, and we
@@ -352,6 +412,7 @@ static int write_tree(
 			git_oid sub_oid;
 			int written;
 			char *subdir, *last_comp;
+			git_tree_cache *subcache;
 
 			subdir = git__strndup(entry->path, next_slash - entry->path);
 			if (subdir == NULL) {
@@ -359,15 +420,6 @@ static int write_tree(
 				goto cleanup;
 			}
 
-			/* Write out the subtree */
-			written = write_tree(&sub_oid, repo, index, subdir, i);
-			if (written < 0) {
-				error = git__rethrow(written, "Failed to write subtree %s", subdir);
-				goto cleanup;
-			} else {
-				i = written - 1; /* -1 because of the loop increment */
-			}
-
 			/*
 			 * We need to figure out what we want toinsert
 			 * into this tree. If we're traversing
@@ -380,6 +432,24 @@ static int write_tree(
 			} else {
 				last_comp = subdir;
 			}
+
+			subcache = reuse_child(cache, old_children, old_children_count, last_comp);
+			if (subcache == NULL) {
+				git__free(subdir);
+				error = GIT_ENOMEM;
+				goto cleanup;
+			}
+
+			/* Write out the subtree */
+			written = write_tree(&sub_oid, repo, index, subdir, i, subcache);
+			if (written < 0) {
+				error = git__rethrow(written, "Failed to write subtree %s", subdir);
+				git__free(subdir);
+				goto cleanup;
+			} else {
+				i = written - 1; /* -1 because of the loop increment */
+			}
+
 			error = append_entry(bld, last_comp, &sub_oid, S_IFDIR);
 			git__free(subdir);
 			if (error < GIT_SUCCESS) {
@@ -397,10 +467,19 @@ static int write_tree(
 	error = git_treebuilder_write(oid, repo, bld);
 	if (error < GIT_SUCCESS)
 		error = git__rethrow(error, "Failed to write tree to db");
+	else {
+		cache->entries = i - start;
+		git_oid_cpy(&cache->oid, oid);
+	}
 
  cleanup:
 	git_treebuilder_free(bld);
 
+	/* whatever wasn't put back is gone from the index */
+	while (old_children_count > 0)
+		git_tree_cache_free(old_children[--old_children_count]);
+	git__free(old_children);
+
 	if (error < GIT_SUCCESS)
 		return error;
 	else
@@ -419,13 +498,12 @@ int git_tree_create_fromindex(git_oid *oid, git_index *index)
 			"Failed to create tree. "
 			"The index file is not backed up by an existing repository");
 
-	if (index->tree != NULL && index->tree->entries >= 0) {
-		git_oid_cpy(oid, &index->tree->oid);
-		return GIT_SUCCESS;
-	}
+	if (index->tree == NULL &&
+		(error = git_tree_cache_new(&index->tree, "", 0, NULL)) < GIT_SUCCESS)
+		return error;
 
-	/* The tree cache didn't help us */
-	error = write_tree(oid, repo, index, "", 0);
+	/* Only the trees the cache doesn't have are written */
+	error = write_tree(oid, repo, index, "", 0, index->tree);
 	return (error < GIT_SUCCESS) ? git__rethrow(error, "Failed to create tree") : GIT_SUCCESS;
 }
 
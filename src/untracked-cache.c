@@ -0,0 +1,669 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "untracked-cache.h"
+#include "ewah.h"
+#include "varint.h"
+#include "posix.h"
+#include "git2/odb.h"
+
+#ifndef GIT_WIN32
+# include <sys/utsname.h>
+#endif
+
+/*
+ * The extension starts with the ident, the stat data and hashes of
+ * the global exclude files, git's directory walk flags and the name
+ * of the per-directory exclude file. Then come the directories, depth
+ * first: the number of untracked entries and subdirectories, the name
+ * and the untracked entries. Last are bitmaps of which directories are
+ * valid, check-only and have a .gitignore, followed by the stat data
+ * of the valid ones and the .gitignore hashes.
+ */
+#define STAT_DISK_SIZE (9 * 4)
+
+static void dir_free(git_untracked_dir *dir)
+{
+	unsigned int i;
+	char *name;
+	git_untracked_dir *child;
+
+	if (dir == NULL)
+		return;
+
+	git_vector_foreach(&dir->untracked, i, name)
+		git__free(name);
+	git_vector_free(&dir->untracked);
+
+	git_vector_foreach(&dir->dirs, i, child)
+		dir_free(child);
+	git_vector_free(&dir->dirs);
+
+	git__free(dir->name);
+	git__free(dir);
+}
+
+static git_untracked_dir *dir_new(const char *name, size_t untracked, size_t dirs)
+{
+	git_untracked_dir *dir = git__calloc(1, sizeof(git_untracked_dir));
+
+	if (dir == NULL)
+		return NULL;
+
+	if ((dir->name = git__strdup(name)) == NULL ||
+		git_vector_init(&dir->untracked, (unsigned int)untracked, NULL) < GIT_SUCCESS ||
+		git_vector_init(&dir->dirs, (unsigned int)dirs, NULL) < GIT_SUCCESS) {
+		dir_free(dir);
+		return NULL;
+	}
+
+	return dir;
+}
+
+static uint32_t get_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void read_stat(git_untracked_stat *st, const unsigned char *buffer)
+{
+	st->ctime_seconds = get_be32(buffer);
+	st->ctime_nanoseconds = get_be32(buffer + 4);
+	st->mtime_seconds = get_be32(buffer + 8);
+	st->mtime_nanoseconds = get_be32(buffer + 12);
+	st->dev = get_be32(buffer + 16);
+	st->ino = get_be32(buffer + 20);
+	st->uid = get_be32(buffer + 24);
+	st->gid = get_be32(buffer + 28);
+	st->size = get_be32(buffer + 32);
+}
+
+static int write_stat(git_buf *out, const git_untracked_stat *st)
+{
+	uint32_t disk[9];
+
+	disk[0] = htonl(st->ctime_seconds);
+	disk[1] = htonl(st->ctime_nanoseconds);
+	disk[2] = htonl(st->mtime_seconds);
+	disk[3] = htonl(st->mtime_nanoseconds);
+	disk[4] = htonl(st->dev);
+	disk[5] = htonl(st->ino);
+	disk[6] = htonl(st->uid);
+	disk[7] = htonl(st->gid);
+	disk[8] = htonl(st->size);
+
+	return git_buf_put(out, (const char *)disk, sizeof(disk));
+}
+
+static int read_varint(size_t *out, const unsigned char **buffer, const unsigned char *end)
+{
+	size_t len;
+	uintmax_t value = git_decode_varint(*buffer, end - *buffer, &len);
+
+	/* every count is of things which take at least a byte each */
+	if (len == 0 || value > (uintmax_t)(end - *buffer))
+		return GIT_EOBJCORRUPTED;
+
+	*buffer += len;
+	*out = (size_t)value;
+	return GIT_SUCCESS;
+}
+
+static int write_varint(git_buf *out, size_t value)
+{
+	unsigned char buf[16];
+	int len = git_encode_varint(buf, sizeof(buf), value);
+
+	return git_buf_put(out, (const char *)buf, len);
+}
+
+static const char *read_string(const unsigned char **buffer, const unsigned char *end)
+{
+	const char *str = (const char *)*buffer;
+	const unsigned char *nul = memchr(*buffer, '\0', end - *buffer);
+
+	if (nul == NULL)
+		return NULL;
+
+	*buffer = nul + 1;
+	return str;
+}
+
+struct read_data {
+	const unsigned char *buffer;
+	const unsigned char *end;
+
+	/* every directory, in the order of the bitmaps */
+	git_vector dirs;
+};
+
+static int read_one_dir(git_untracked_dir **out, struct read_data *rd)
+{
+	git_untracked_dir *dir;
+	size_t untracked_nr, dirs_nr, i;
+	const char *name;
+	int error;
+
+	if (read_varint(&untracked_nr, &rd->buffer, rd->end) < GIT_SUCCESS ||
+		read_varint(&dirs_nr, &rd->buffer, rd->end) < GIT_SUCCESS ||
+		(name = read_string(&rd->buffer, rd->end)) == NULL)
+		return GIT_EOBJCORRUPTED;
+
+	if ((*out = dir = dir_new(name, untracked_nr, dirs_nr)) == NULL ||
+		git_vector_insert(&rd->dirs, dir) < GIT_SUCCESS)
+		return GIT_ENOMEM;
+
+	for (i = 0; i < untracked_nr; ++i) {
+		char *entry;
+
+		if ((name = read_string(&rd->buffer, rd->end)) == NULL)
+			return GIT_EOBJCORRUPTED;
+
+		if ((entry = git__strdup(name)) == NULL ||
+			git_vector_insert(&dir->untracked, entry) < GIT_SUCCESS) {
+			git__free(entry);
+			return GIT_ENOMEM;
+		}
+	}
+
+	for (i = 0; i < dirs_nr; ++i) {
+		git_untracked_dir *child = NULL;
+
+		error = read_one_dir(&child, rd);
+
+		if (child != NULL && git_vector_insert(&dir->dirs, child) < GIT_SUCCESS) {
+			dir_free(child);
+			return GIT_ENOMEM;
+		}
+
+		if (error < GIT_SUCCESS)
+			return error;
+	}
+
+	return GIT_SUCCESS;
+}
+
+static int read_dirs(git_untracked_cache *cache, struct read_data *rd)
+{
+	git_ewah valid = GIT_EWAH_INIT, check_only = GIT_EWAH_INIT, oid_valid = GIT_EWAH_INIT;
+	git_untracked_dir *dir;
+	size_t dir_count, len;
+	unsigned int i;
+	int error;
+
+	if (read_varint(&dir_count, &rd->buffer, rd->end) < GIT_SUCCESS)
+		return GIT_EOBJCORRUPTED;
+
+	if (dir_count == 0)
+		return GIT_SUCCESS;
+
+	if ((error = read_one_dir(&cache->root, rd)) < GIT_SUCCESS)
+		return error;
+
+	if (rd->dirs.length != dir_count)
+		return GIT_EOBJCORRUPTED;
+
+	if ((error = git_ewah_read(&valid, &len, rd->buffer, rd->end - rd->buffer, dir_count)) < GIT_SUCCESS)
+		goto cleanup;
+	rd->buffer += len;
+
+	if ((error = git_ewah_read(&check_only, &len, rd->buffer, rd->end - rd->buffer, dir_count)) < GIT_SUCCESS)
+		goto cleanup;
+	rd->buffer += len;
+
+	if ((error = git_ewah_read(&oid_valid, &len, rd->buffer, rd->end - rd->buffer, dir_count)) < GIT_SUCCESS)
+		goto cleanup;
+	rd->buffer += len;
+
+	git_vector_foreach(&rd->dirs, i, dir) {
+		dir->check_only = git_ewah_get(&check_only, i);
+
+		if (git_ewah_get(&valid, i)) {
+			if (rd->end - rd->buffer < STAT_DISK_SIZE) {
+				error = GIT_EOBJCORRUPTED;
+				goto cleanup;
+			}
+
+			read_stat(&dir->stat, rd->buffer);
+			rd->buffer += STAT_DISK_SIZE;
+			dir->valid = 1;
+		}
+	}
+
+	git_vector_foreach(&rd->dirs, i, dir) {
+		if (git_ewah_get(&oid_valid, i)) {
+			if (rd->end - rd->buffer < GIT_OID_RAWSZ) {
+				error = GIT_EOBJCORRUPTED;
+				goto cleanup;
+			}
+
+			git_oid_fromraw(&dir->exclude_oid, rd->buffer);
+			rd->buffer += GIT_OID_RAWSZ;
+		}
+	}
+
+	/* the terminating NUL */
+	if (rd->buffer == rd->end || *rd->buffer != '\0')
+		error = GIT_EOBJCORRUPTED;
+	else
+		rd->buffer++;
+
+cleanup:
+	git_ewah_free(&valid);
+	git_ewah_free(&check_only);
+	git_ewah_free(&oid_valid);
+	return error;
+}
+
+int git_untracked_cache_read(git_untracked_cache **out, const char *buffer, size_t buffer_size)
+{
+	git_untracked_cache *cache;
+	struct read_data rd;
+	size_t ident_len;
+	const char *exclude_per_dir;
+	int error = GIT_EOBJCORRUPTED;
+
+	rd.buffer = (const unsigned char *)buffer;
+	rd.end = rd.buffer + buffer_size;
+
+	if ((cache = git__calloc(1, sizeof(git_untracked_cache))) == NULL)
+		return GIT_ENOMEM;
+
+	if (git_vector_init(&rd.dirs, 16, NULL) < GIT_SUCCESS) {
+		git__free(cache);
+		return GIT_ENOMEM;
+	}
+
+	if (read_varint(&ident_len, &rd.buffer, rd.end) < GIT_SUCCESS)
+		goto cleanup;
+
+	if (git_buf_put(&cache->ident, (const char *)rd.buffer, ident_len) < GIT_SUCCESS) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
+	rd.buffer += ident_len;
+
+	if (rd.end - rd.buffer < 2 * STAT_DISK_SIZE + 4 + 2 * GIT_OID_RAWSZ)
+		goto cleanup;
+
+	read_stat(&cache->info_exclude_stat, rd.buffer);
+	read_stat(&cache->excludes_file_stat, rd.buffer + STAT_DISK_SIZE);
+	cache->dir_flags = get_be32(rd.buffer + 2 * STAT_DISK_SIZE);
+	rd.buffer += 2 * STAT_DISK_SIZE + 4;
+
+	git_oid_fromraw(&cache->info_exclude_oid, rd.buffer);
+	git_oid_fromraw(&cache->excludes_file_oid, rd.buffer + GIT_OID_RAWSZ);
+	rd.buffer += 2 * GIT_OID_RAWSZ;
+
+	if ((exclude_per_dir = read_string(&rd.buffer, rd.end)) == NULL)
+		goto cleanup;
+
+	if ((cache->exclude_per_dir = git__strdup(exclude_per_dir)) == NULL) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
+
+	if ((error = read_dirs(cache, &rd)) < GIT_SUCCESS)
+		goto cleanup;
+
+	if (rd.buffer != rd.end)
+		error = GIT_EOBJCORRUPTED;
+
+cleanup:
+	git_vector_free(&rd.dirs);
+
+	if (error < GIT_SUCCESS) {
+		git_untracked_cache_free(cache);
+		return git__throw(error, "Failed to read the untracked cache");
+	}
+
+	*out = cache;
+	return GIT_SUCCESS;
+}
+
+struct write_data {
+	git_buf *out;
+	size_t index;
+
+	git_ewah valid;
+	git_ewah check_only;
+	git_ewah oid_valid;
+
+	git_buf stat;
+	git_buf oids;
+};
+
+static int write_one_dir(struct write_data *wd, const git_untracked_dir *dir)
+{
+	size_t i = wd->index++;
+	unsigned int n;
+	const char *name;
+	const git_untracked_dir *child;
+	int error;
+
+	if (dir->valid) {
+		if ((error = git_ewah_set(&wd->valid, i)) < GIT_SUCCESS ||
+			(error = write_stat(&wd->stat, &dir->stat)) < GIT_SUCCESS)
+			return error;
+
+		if (dir->check_only && (error = git_ewah_set(&wd->check_only, i)) < GIT_SUCCESS)
+			return error;
+	}
+
+	if (!git_oid_iszero(&dir->exclude_oid)) {
+		if ((error = git_ewah_set(&wd->oid_valid, i)) < GIT_SUCCESS ||
+			(error = git_buf_put(&wd->oids, (const char *)dir->exclude_oid.id, GIT_OID_RAWSZ)) < GIT_SUCCESS)
+			return error;
+	}
+
+	/* an invalid directory has nothing to say about its files */
+	if ((error = write_varint(wd->out, dir->valid ? dir->untracked.length : 0)) < GIT_SUCCESS ||
+		(error = write_varint(wd->out, dir->dirs.length)) < GIT_SUCCESS ||
+		(error = git_buf_put(wd->out, dir->name, strlen(dir->name) + 1)) < GIT_SUCCESS)
+		return error;
+
+	if (dir->valid) {
+		git_vector_foreach(&dir->untracked, n, name)
+			if ((error = git_buf_put(wd->out, name, strlen(name) + 1)) < GIT_SUCCESS)
+				return error;
+	}
+
+	git_vector_foreach(&dir->dirs, n, child)
+		if ((error = write_one_dir(wd, child)) < GIT_SUCCESS)
+			return error;
+
+	return GIT_SUCCESS;
+}
+
+static size_t count_dirs(const git_untracked_dir *dir)
+{
+	size_t count = 1;
+	unsigned int i;
+	git_untracked_dir *child;
+
+	git_vector_foreach(&dir->dirs, i, child)
+		count += count_dirs(child);
+
+	return count;
+}
+
+int git_untracked_cache_write(git_buf *out, const git_untracked_cache *cache)
+{
+	struct write_data wd;
+	uint32_t dir_flags = htonl(cache->dir_flags);
+	int error;
+
+	if ((error = write_varint(out, cache->ident.size)) < GIT_SUCCESS ||
+		(error = git_buf_put(out, cache->ident.ptr, cache->ident.size)) < GIT_SUCCESS ||
+		(error = write_stat(out, &cache->info_exclude_stat)) < GIT_SUCCESS ||
+		(error = write_stat(out, &cache->excludes_file_stat)) < GIT_SUCCESS ||
+		(error = git_buf_put(out, (const char *)&dir_flags, sizeof(dir_flags))) < GIT_SUCCESS ||
+		(error = git_buf_put(out, (const char *)cache->info_exclude_oid.id, GIT_OID_RAWSZ)) < GIT_SUCCESS ||
+		(error = git_buf_put(out, (const char *)cache->excludes_file_oid.id, GIT_OID_RAWSZ)) < GIT_SUCCESS ||
+		(error = git_buf_put(out, cache->exclude_per_dir, strlen(cache->exclude_per_dir) + 1)) < GIT_SUCCESS)
+		return error;
+
+	if (cache->root == NULL)
+		return write_varint(out, 0);
+
+	if ((error = write_varint(out, count_dirs(cache->root))) < GIT_SUCCESS)
+		return error;
+
+	memset(&wd, 0x0, sizeof(wd));
+	wd.out = out;
+	git_buf_init(&wd.stat, 0);
+	git_buf_init(&wd.oids, 0);
+
+	if ((error = write_one_dir(&wd, cache->root)) == GIT_SUCCESS &&
+		(error = git_ewah_write(out, &wd.valid)) == GIT_SUCCESS &&
+		(error = git_ewah_write(out, &wd.check_only)) == GIT_SUCCESS &&
+		(error = git_ewah_write(out, &wd.oid_valid)) == GIT_SUCCESS &&
+		(error = git_buf_put(out, wd.stat.ptr, wd.stat.size)) == GIT_SUCCESS &&
+		(error = git_buf_put(out, wd.oids.ptr, wd.oids.size)) == GIT_SUCCESS)
+		error = git_buf_putc(out, '\0');
+
+	git_ewah_free(&wd.valid);
+	git_ewah_free(&wd.check_only);
+	git_ewah_free(&wd.oid_valid);
+	git_buf_free(&wd.stat);
+	git_buf_free(&wd.oids);
+
+	return error;
+}
+
+static git_untracked_dir *find_child(const git_untracked_dir *dir, const char *name, size_t len)
+{
+	unsigned int i;
+	git_untracked_dir *child;
+
+	git_vector_foreach(&dir->dirs, i, child) {
+		if (strlen(child->name) == len && !memcmp(child->name, name, len))
+			return child;
+	}
+
+	return NULL;
+}
+
+static void invalidate_dir(git_untracked_dir *dir)
+{
+	unsigned int i;
+	char *name;
+
+	git_vector_foreach(&dir->untracked, i, name)
+		git__free(name);
+	git_vector_clear(&dir->untracked);
+
+	dir->valid = 0;
+}
+
+/*
+ * The directory holding the path always changes. When the cache lists
+ * untracked directories, the ones above may have listed it as one
+ * before, so they go too.
+ */
+static void invalidate_path(git_untracked_cache *cache, git_untracked_dir *dir, const char *path)
+{
+	const char *end = strchr(path, '/');
+	git_untracked_dir *child;
+
+	if (end != NULL && (child = find_child(dir, path, end - path)) != NULL) {
+		invalidate_path(cache, child, end + 1);
+
+		if (!(cache->dir_flags & GIT_UNTRACKED_SHOW_OTHER_DIRECTORIES))
+			return;
+	}
+
+	invalidate_dir(dir);
+}
+
+void git_untracked_cache_invalidate_path(git_untracked_cache *cache, const char *path)
+{
+	if (cache == NULL || cache->root == NULL)
+		return;
+
+	invalidate_path(cache, cache->root, path);
+}
+
+void git_untracked_cache_invalidate_all(git_untracked_cache *cache)
+{
+	if (cache != NULL && cache->root != NULL)
+		git_untracked_dir_invalidate(cache->root);
+}
+
+git_untracked_dir *git_untracked_cache_find(
+	git_untracked_cache *cache, const char *path, int create)
+{
+	git_untracked_dir *dir, *child;
+	const char *end;
+	char *name;
+
+	if (cache->root == NULL &&
+		(!create || (cache->root = dir_new("", 0, 0)) == NULL))
+		return NULL;
+
+	dir = cache->root;
+
+	while (*path != '\0' && dir != NULL) {
+		if ((end = strchr(path, '/')) == NULL)
+			end = path + strlen(path);
+
+		if ((child = find_child(dir, path, end - path)) == NULL && create) {
+			if ((name = git__strndup(path, end - path)) == NULL)
+				return NULL;
+
+			if ((child = dir_new(name, 0, 0)) != NULL &&
+				git_vector_insert(&dir->dirs, child) < GIT_SUCCESS) {
+				dir_free(child);
+				child = NULL;
+			}
+
+			git__free(name);
+		}
+
+		dir = child;
+		path = *end ? end + 1 : end;
+	}
+
+	return dir;
+}
+
+/* The parts of `st` git records; we have no nanoseconds to give it */
+static void stat_from(git_untracked_stat *out, const struct stat *st)
+{
+	memset(out, 0x0, sizeof(git_untracked_stat));
+	out->ctime_seconds = (uint32_t)st->st_ctime;
+	out->mtime_seconds = (uint32_t)st->st_mtime;
+	out->dev = (uint32_t)st->st_dev;
+	out->ino = (uint32_t)st->st_ino;
+	out->uid = (uint32_t)st->st_uid;
+	out->gid = (uint32_t)st->st_gid;
+	out->size = (uint32_t)st->st_size;
+}
+
+int git_untracked_dir_uptodate(const git_untracked_dir *dir, const struct stat *st)
+{
+	return dir != NULL && dir->valid && !dir->check_only &&
+		dir->stat.mtime_seconds == (uint32_t)st->st_mtime &&
+		dir->stat.ctime_seconds == (uint32_t)st->st_ctime &&
+		dir->stat.ino == (uint32_t)st->st_ino &&
+		dir->stat.size == (uint32_t)st->st_size;
+}
+
+void git_untracked_dir_invalidate(git_untracked_dir *dir)
+{
+	unsigned int i;
+	git_untracked_dir *child;
+
+	git_vector_foreach(&dir->dirs, i, child)
+		git_untracked_dir_invalidate(child);
+
+	invalidate_dir(dir);
+}
+
+void git_untracked_dir_set(git_untracked_dir *dir, const struct stat *st, git_vector *untracked)
+{
+	invalidate_dir(dir);
+	git_vector_swap(&dir->untracked, untracked);
+
+	stat_from(&dir->stat, st);
+	dir->valid = 1;
+	dir->check_only = 0;
+}
+
+/* What git calls the place a cache is good for: where the working directory is, and the system */
+static int make_ident(git_buf *out, const char *workdir)
+{
+	size_t len = strlen(workdir);
+	const char *system;
+#ifdef GIT_WIN32
+	system = "Windows";
+#else
+	struct utsname uts;
+
+	if (uname(&uts) < 0)
+		return git__throw(GIT_EOSERR, "Failed to get the name of the system");
+	system = uts.sysname;
+#endif
+
+	/* git has no trailing slash on the working directory */
+	if (len > 1 && workdir[len - 1] == '/')
+		len--;
+
+	git_buf_clear(out);
+	return git_buf_printf(out, "Location %.*s, system %s", (int)len, workdir, system);
+}
+
+int git_untracked_cache_new(
+	git_untracked_cache **out,
+	const char *workdir,
+	const git_oid *info_exclude,
+	const git_oid *excludes_file)
+{
+	git_untracked_cache *cache;
+	int error;
+
+	if ((cache = git__calloc(1, sizeof(git_untracked_cache))) == NULL)
+		return GIT_ENOMEM;
+
+	/* git keeps the NUL, which once separated several of them */
+	if ((error = make_ident(&cache->ident, workdir)) < GIT_SUCCESS ||
+		(error = git_buf_putc(&cache->ident, '\0')) < GIT_SUCCESS ||
+		(cache->exclude_per_dir = git__strdup(".gitignore")) == NULL ||
+		(cache->root = dir_new("", 0, 0)) == NULL) {
+		git_untracked_cache_free(cache);
+		return error < GIT_SUCCESS ? error : GIT_ENOMEM;
+	}
+
+	cache->dir_flags = GIT_UNTRACKED_DIR_FLAGS;
+	git_oid_cpy(&cache->info_exclude_oid, info_exclude);
+	git_oid_cpy(&cache->excludes_file_oid, excludes_file);
+
+	*out = cache;
+	return GIT_SUCCESS;
+}
+
+int git_untracked_cache_is_for(const git_untracked_cache *cache, const char *workdir)
+{
+	git_buf ident = GIT_BUF_INIT;
+	int is_for = 0;
+
+	if (make_ident(&ident, workdir) == GIT_SUCCESS && cache->ident.size > 0)
+		is_for = (strcmp(cache->ident.ptr, ident.ptr) == 0);
+	else
+		git_clearerror();
+
+	git_buf_free(&ident);
+	return is_for;
+}
+
+void git_untracked_cache_hash_exclude(git_oid *out, const char *path)
+{
+	struct stat st;
+
+	memset(out, 0x0, sizeof(git_oid));
+
+	if (path == NULL || p_stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+		return;
+
+	/* unreadable is as good as missing; the directories will be read */
+	if (git_odb_hashfile(out, path, GIT_OBJ_BLOB) < GIT_SUCCESS) {
+		memset(out, 0x0, sizeof(git_oid));
+		git_clearerror();
+	}
+}
+
+void git_untracked_cache_free(git_untracked_cache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	dir_free(cache->root);
+	git_buf_free(&cache->ident);
+	git__free(cache->exclude_per_dir);
+	git__free(cache);
+}
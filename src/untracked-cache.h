@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#ifndef INCLUDE_untracked_cache_h__
+#define INCLUDE_untracked_cache_h__
+
+#include "common.h"
+#include "buffer.h"
+#include "vector.h"
+#include "git2/oid.h"
+
+/*
+ * The untracked cache (the `UNTR` index extension) remembers the
+ * untracked files of each directory in the working tree along with
+ * the directory's stat data, so that a directory which hasn't been
+ * touched since needn't be read again to find them.
+ */
+
+/* The part of `struct stat` git records, as 32-bit values */
+typedef struct {
+	uint32_t ctime_seconds;
+	uint32_t ctime_nanoseconds;
+	uint32_t mtime_seconds;
+	uint32_t mtime_nanoseconds;
+	uint32_t dev;
+	uint32_t ino;
+	uint32_t uid;
+	uint32_t gid;
+	uint32_t size;
+} git_untracked_stat;
+
+typedef struct git_untracked_dir {
+	char *name;
+
+	/* untracked files, and directories with a trailing slash */
+	git_vector untracked;
+	git_vector dirs;
+
+	/* when not valid, the directory must be read again */
+	unsigned int valid:1,
+		check_only:1;
+
+	/* the stat data of the directory, if valid */
+	git_untracked_stat stat;
+
+	/* hash of the directory's .gitignore, zero if it has none */
+	git_oid exclude_oid;
+} git_untracked_dir;
+
+typedef struct {
+	/* where the cache is good for; git checks this before using it */
+	git_buf ident;
+
+	git_untracked_stat info_exclude_stat;
+	git_untracked_stat excludes_file_stat;
+	git_oid info_exclude_oid;
+	git_oid excludes_file_oid;
+
+	/* flags of git's directory walk the cache was built with */
+	uint32_t dir_flags;
+	char *exclude_per_dir;
+
+	/* NULL if no directory has been cached yet */
+	git_untracked_dir *root;
+} git_untracked_cache;
+
+/*
+ * `dir_flags` bits of caches which list untracked directories as a
+ * whole (with a trailing slash) rather than their files, and leave
+ * out the ones with nothing untracked in them. These are the flags
+ * `git status` uses, and the only ones we use caches made with.
+ */
+#define GIT_UNTRACKED_SHOW_OTHER_DIRECTORIES (1 << 1)
+#define GIT_UNTRACKED_HIDE_EMPTY_DIRECTORIES (1 << 2)
+
+#define GIT_UNTRACKED_DIR_FLAGS \
+	(GIT_UNTRACKED_SHOW_OTHER_DIRECTORIES | GIT_UNTRACKED_HIDE_EMPTY_DIRECTORIES)
+
+int git_untracked_cache_read(git_untracked_cache **out, const char *buffer, size_t buffer_size);
+int git_untracked_cache_write(git_buf *out, const git_untracked_cache *cache);
+
+/*
+ * An empty cache for the working directory `workdir`, with the
+ * hashes of the global exclude files in `info_exclude` and
+ * `excludes_file`
+ */
+int git_untracked_cache_new(
+	git_untracked_cache **out,
+	const char *workdir,
+	const git_oid *info_exclude,
+	const git_oid *excludes_file);
+
+/* Whether the cache was made for the working directory `workdir`, on this system */
+int git_untracked_cache_is_for(const git_untracked_cache *cache, const char *workdir);
+
+/* The hash of the exclude file at `path`, as git records it; zero if there's none */
+void git_untracked_cache_hash_exclude(git_oid *out, const char *path);
+
+/*
+ * Something was added to or removed from the index at `path`: the
+ * directory it is in no longer knows what's untracked in it.
+ */
+void git_untracked_cache_invalidate_path(git_untracked_cache *cache, const char *path);
+
+/* Forget what's untracked everywhere; the exclude files changed */
+void git_untracked_cache_invalidate_all(git_untracked_cache *cache);
+
+/*
+ * The directory at `path` ("" for the top of the working tree), or
+ * NULL if the cache has nothing for it. With `create`, it's added,
+ * along with the directories above it, knowing nothing yet.
+ */
+git_untracked_dir *git_untracked_cache_find(
+	git_untracked_cache *cache, const char *path, int create);
+
+/*
+ * Whether `dir` lists the untracked files of the directory it's for,
+ * which looks like `st` now. Only a cache we use has its directories
+ * listed in full; git leaves some of them `check_only`.
+ */
+int git_untracked_dir_uptodate(const git_untracked_dir *dir, const struct stat *st);
+
+/* Forget what's untracked in `dir` and in the directories below it */
+void git_untracked_dir_invalidate(git_untracked_dir *dir);
+
+/*
+ * Remember `untracked` as what's untracked in `dir`, which looked like
+ * `st` before it was read; `dir` takes over the names
+ */
+void git_untracked_dir_set(git_untracked_dir *dir, const struct stat *st, git_vector *untracked);
+
+void git_untracked_cache_free(git_untracked_cache *cache);
+
+#endif
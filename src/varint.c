@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+#include "varint.h"
+
+#define VARINT_SHIFT 7
+#define VARINT_MASK 0x7f
+
+int git_encode_varint(unsigned char *buf, size_t bufsize, uintmax_t value)
+{
+	unsigned char varint[16];
+	unsigned pos = sizeof(varint) - 1;
+
+	varint[pos] = value & VARINT_MASK;
+
+	while (value >>= VARINT_SHIFT)
+		varint[--pos] = 0x80 | (--value & VARINT_MASK);
+
+	if (buf) {
+		if (bufsize < sizeof(varint) - pos)
+			return -1;
+
+		memcpy(buf, varint + pos, sizeof(varint) - pos);
+	}
+
+	return sizeof(varint) - pos;
+}
+
+uintmax_t git_decode_varint(const unsigned char *bufp, size_t bufsize, size_t *varint_len)
+{
+	const unsigned char *buf = bufp, *end = bufp + bufsize;
+	unsigned char c;
+	uintmax_t val;
+
+	*varint_len = 0;
+
+	if (buf == end)
+		return 0;
+
+	c = *buf++;
+	val = c & VARINT_MASK;
+
+	while (c & 0x80) {
+		val += 1;
+		if (!val || MSB(val, VARINT_SHIFT) || buf == end)
+			return 0; /* overflow or truncated */
+
+		c = *buf++;
+		val = (val << VARINT_SHIFT) + (c & VARINT_MASK);
+	}
+
+	*varint_len = buf - bufp;
+	return val;
+}
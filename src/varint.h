@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_varint_h__
+#define INCLUDE_varint_h__
+
+#include "common.h"
+
+/*
+ * The variable width integers of the index extensions: seven bits
+ * per byte, most significant first, with the high bit set on all
+ * but the last byte and one subtracted at each continuation (the
+ * same as the offsets of ofs-deltas in packs).
+ */
+
+/* Returns the number of bytes written to `buf`, at most 16 */
+extern int git_encode_varint(unsigned char *buf, size_t bufsize, uintmax_t value);
+
+/*
+ * Reads an integer from the `bufsize` bytes at `buf` and sets
+ * `*varint_len` to its length, or to 0 if it is truncated or
+ * doesn't fit.
+ */
+extern uintmax_t git_decode_varint(const unsigned char *buf, size_t bufsize, size_t *varint_len);
+
+#endif
@@ -10,6 +10,7 @@
 #include "common.h"
 #include "fnmatch.h"
 #include "utf-conv.h"
+#include <sys/utime.h>
 
 GIT_INLINE(int) p_link(const char *old, const char *new)
 {
@@ -31,6 +32,7 @@ GIT_INLINE(int) p_mkdir(const char *path, mode_t mode)
 }
 
 extern int p_unlink(const char *path);
+extern int p_utime(const char *path, const struct utimbuf *times);
 extern int p_lstat(const char *file_name, struct stat *buf);
 extern int p_readlink(const char *link, char *target, size_t target_len);
 extern int p_hide_directory__w32(const char *path);
@@ -277,6 +277,15 @@ int p_chmod(const char* path, mode_t mode)
 	return ret;
 }
 
+int p_utime(const char *path, const struct utimbuf *times)
+{
+	wchar_t* buf = gitwin_to_utf16(path);
+	int ret = _wutime(buf, (struct _utimbuf *)times);
+
+	git__free(buf);
+	return ret;
+}
+
 int p_rmdir(const char* path)
 {
 	wchar_t* buf = gitwin_to_utf16(path);
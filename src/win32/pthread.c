@@ -51,6 +51,38 @@ int pthread_mutex_unlock(pthread_mutex_t *mutex)
 	return 0;
 }
 
+int pthread_cond_init(pthread_cond_t *GIT_RESTRICT cond,
+						const pthread_condattr_t *GIT_RESTRICT condattr)
+{
+	GIT_UNUSED(condattr);
+	InitializeConditionVariable(cond);
+	return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *cond)
+{
+	/* condition variables don't hold any resources on Windows */
+	GIT_UNUSED(cond);
+	return 0;
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+	return SleepConditionVariableCS(cond, mutex, INFINITE) ? 0 : -1;
+}
+
+int pthread_cond_signal(pthread_cond_t *cond)
+{
+	WakeConditionVariable(cond);
+	return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cond)
+{
+	WakeAllConditionVariable(cond);
+	return 0;
+}
+
 int pthread_num_processors_np(void)
 {
 	DWORD_PTR p, s;
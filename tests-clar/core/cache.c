@@ -0,0 +1,217 @@
+#include "clar_libgit2.h"
+#include "cache.h"
+
+typedef struct {
+	git_cached_obj cached;
+	unsigned int __dummy;
+} ttest_obj;
+
+static git_cache cache;
+static int freed;
+
+static void free_obj(void *obj)
+{
+	freed++;
+	git__free(obj);
+}
+
+/* all these objects land on the same stripe */
+static ttest_obj *new_obj(unsigned char id, size_t size)
+{
+	ttest_obj *obj = git__calloc(1, sizeof(ttest_obj));
+	cl_assert(obj != NULL);
+
+	obj->cached.oid.id[0] = id;
+	obj->cached.type = GIT_OBJ_BLOB;
+	obj->cached.size = size;
+
+	return obj;
+}
+
+static int is_cached(unsigned char id)
+{
+	git_oid oid;
+	ttest_obj *obj;
+
+	memset(&oid, 0x0, sizeof(oid));
+	oid.id[0] = id;
+
+	if ((obj = git_cache_get(&cache, &oid)) == NULL)
+		return 0;
+
+	git_cached_obj_decref(obj, free_obj);
+	return 1;
+}
+
+static void store(unsigned char id, size_t size)
+{
+	ttest_obj *obj = git_cache_try_store(&cache, new_obj(id, size));
+	git_cached_obj_decref(obj, free_obj);
+}
+
+static int is_cached_in(unsigned char id, unsigned char stripe)
+{
+	git_oid oid;
+	ttest_obj *obj;
+
+	memset(&oid, 0x0, sizeof(oid));
+	oid.id[0] = id;
+	oid.id[4] = stripe;
+
+	if ((obj = git_cache_get(&cache, &oid)) == NULL)
+		return 0;
+
+	git_cached_obj_decref(obj, free_obj);
+	return 1;
+}
+
+static void store_in(unsigned char id, unsigned char stripe, size_t size)
+{
+	ttest_obj *obj = new_obj(id, size);
+
+	obj->cached.oid.id[4] = stripe;
+	git_cached_obj_decref(git_cache_try_store(&cache, obj), free_obj);
+}
+
+void test_core_cache__initialize(void)
+{
+	freed = 0;
+	cl_git_pass(git_cache_init(&cache, free_obj));
+
+	/* 100 bytes of blobs per stripe */
+	git_cache_set_max(&cache, GIT_OBJ_BLOB, 100 * GIT_CACHE_STRIPES);
+}
+
+void test_core_cache__cleanup(void)
+{
+	git_cache_free(&cache);
+}
+
+void test_core_cache__store_and_get(void)
+{
+	git_cache_stats stats;
+
+	store(1, 40);
+	cl_assert(is_cached(1));
+	cl_assert(!is_cached(2));
+
+	git_cache_get_stats(&stats, &cache);
+	cl_assert(stats.hits == 1);
+	cl_assert(stats.misses == 1);
+	cl_assert(stats.count == 1);
+	cl_assert(stats.size == 40);
+	cl_assert(freed == 0);
+}
+
+void test_core_cache__returns_first_stored_copy(void)
+{
+	ttest_obj *first, *second;
+
+	first = git_cache_try_store(&cache, new_obj(1, 10));
+	second = git_cache_try_store(&cache, new_obj(1, 10));
+
+	cl_assert(first == second);
+	cl_assert(freed == 1);
+
+	git_cached_obj_decref(first, free_obj);
+	git_cached_obj_decref(second, free_obj);
+}
+
+void test_core_cache__evicts_over_budget(void)
+{
+	git_cache_stats stats;
+
+	store(1, 40);
+	store(2, 40);
+	store(3, 40);
+
+	cl_assert(!is_cached(1));
+	cl_assert(is_cached(2));
+	cl_assert(is_cached(3));
+
+	git_cache_get_stats(&stats, &cache);
+	cl_assert(stats.evictions == 1);
+	cl_assert(stats.size == 80);
+	cl_assert(freed == 1);
+}
+
+void test_core_cache__referenced_objects_get_a_second_chance(void)
+{
+	store(1, 40);
+	store(2, 40);
+
+	cl_assert(is_cached(1));
+	store(3, 40);
+
+	cl_assert(is_cached(1));
+	cl_assert(!is_cached(2));
+	cl_assert(is_cached(3));
+}
+
+void test_core_cache__budgets_are_per_type(void)
+{
+	ttest_obj *commit = new_obj(1, 90);
+
+	commit->cached.type = GIT_OBJ_COMMIT;
+	git_cached_obj_decref(git_cache_try_store(&cache, commit), free_obj);
+
+	store(2, 90);
+
+	cl_assert(is_cached(1));
+	cl_assert(is_cached(2));
+}
+
+void test_core_cache__objects_over_budget_are_not_cached(void)
+{
+	store(1, 100 * GIT_CACHE_STRIPES + 1);
+	cl_assert(!is_cached(1));
+	cl_assert(freed == 1);
+}
+
+void test_core_cache__objects_over_the_share_of_a_stripe_are_cached(void)
+{
+	git_cache_stats stats;
+
+	store(1, 40);
+	store(2, 1000);
+
+	/* it took the whole stripe */
+	cl_assert(is_cached(2));
+	cl_assert(!is_cached(1));
+
+	git_cache_get_stats(&stats, &cache);
+	cl_assert(stats.size == 1000);
+}
+
+void test_core_cache__borrowing_stays_within_the_budget(void)
+{
+	git_cache_stats stats;
+	unsigned char i;
+	int cached = 0;
+
+	for (i = 1; i < GIT_CACHE_STRIPES; ++i)
+		store_in(i, i, 90);
+
+	/* 15 * 90 + 400 is over 1600; two of the others have to go */
+	store_in(100, 0, 400);
+	cl_assert(is_cached_in(100, 0));
+
+	for (i = 1; i < GIT_CACHE_STRIPES; ++i)
+		cached += is_cached_in(i, i);
+	cl_assert(cached == GIT_CACHE_STRIPES - 3);
+
+	git_cache_get_stats(&stats, &cache);
+	cl_assert(stats.size <= 100 * GIT_CACHE_STRIPES);
+	cl_assert(stats.evictions == 2);
+}
+
+void test_core_cache__shrinking_the_budget_evicts(void)
+{
+	store(1, 40);
+	store(2, 40);
+
+	git_cache_set_max(&cache, GIT_OBJ_BLOB, 50 * GIT_CACHE_STRIPES);
+
+	cl_assert(!is_cached(1));
+	cl_assert(is_cached(2));
+}
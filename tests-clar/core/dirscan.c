@@ -0,0 +1,89 @@
+#include "clar_libgit2.h"
+#include "fileops.h"
+#include "dirscan.h"
+
+#define NUM_DIRS 8
+#define NUM_FILES 64
+
+static char g_dirs[NUM_DIRS][32];
+static const char *g_paths[NUM_DIRS];
+
+void test_core_dirscan__initialize(void)
+{
+	git_buf path = GIT_BUF_INIT;
+	int i, j;
+
+	for (i = 0; i < NUM_DIRS; ++i) {
+		sprintf(g_dirs[i], "dirscan/dir-%d", i);
+		g_paths[i] = g_dirs[i];
+		cl_git_pass(git_futils_mkdir_r(g_dirs[i], NULL, 0777));
+
+		for (j = 0; j < NUM_FILES; ++j) {
+			git_buf_clear(&path);
+			cl_git_pass(git_buf_printf(&path, "%s/file-%d", g_dirs[i], j));
+			cl_git_mkfile(path.ptr, "");
+		}
+	}
+
+	git_buf_free(&path);
+}
+
+void test_core_dirscan__cleanup(void)
+{
+	cl_git_pass(git_futils_rmdir_r("dirscan", 1));
+}
+
+/* Load every directory, queueing them all first; returns how many entries */
+static size_t scan_all(git_dirscan *scan)
+{
+	git_vector contents;
+	git_path_with_stat *ps;
+	size_t total = 0;
+	unsigned int i, j;
+
+	cl_git_pass(git_dirscan_queue(scan, g_paths, NUM_DIRS));
+
+	for (i = 0; i < NUM_DIRS; ++i) {
+		cl_git_pass(git_vector_init(&contents, 0, git_path_with_stat_cmp));
+		cl_git_pass(git_dirscan_load(scan, g_paths[i], &contents));
+
+		cl_assert(contents.length == NUM_FILES);
+		total += contents.length;
+
+		git_vector_foreach(&contents, j, ps)
+			git__free(ps);
+		git_vector_free(&contents);
+	}
+
+	return total;
+}
+
+void test_core_dirscan__no_threads_when_the_directories_are_cached(void)
+{
+	git_dirscan *scan;
+
+	cl_git_pass(git_dirscan_new(&scan, strlen("dirscan/"), 0));
+
+	/* twice, so that more than the sample is loaded */
+	cl_assert(scan_all(scan) == NUM_DIRS * NUM_FILES);
+	cl_assert(scan_all(scan) == NUM_DIRS * NUM_FILES);
+	cl_assert(git_dirscan_threads(scan) == 0);
+
+	git_dirscan_free(scan);
+}
+
+void test_core_dirscan__no_more_threads_than_directories(void)
+{
+	git_dirscan *scan;
+
+	cl_git_pass(git_dirscan_new(&scan, strlen("dirscan/"), NUM_DIRS * 2));
+
+	cl_assert(scan_all(scan) == NUM_DIRS * NUM_FILES);
+#ifdef GIT_THREADS
+	cl_assert(git_dirscan_threads(scan) == NUM_DIRS);
+#else
+	cl_assert(git_dirscan_threads(scan) == 0);
+#endif
+
+	git_dirscan_free(scan);
+}
@@ -0,0 +1,187 @@
+#include "clar_libgit2.h"
+#include "hash.h"
+#include "sha1.h"
+
+void test_core_sha1__cleanup(void)
+{
+	cl_git_pass(git__sha1_select(NULL));
+	cl_git_pass(git__sha1_select_lanes(NULL));
+}
+
+static void assert_hash(const char *expected, const void *data, size_t len)
+{
+	git_oid id, oid;
+
+	cl_git_pass(git_oid_fromstr(&id, expected));
+	git_hash_buf(&oid, data, len);
+	cl_assert(git_oid_cmp(&id, &oid) == 0);
+}
+
+/* Hash `len` bytes in pieces of every size, to cross block boundaries */
+static void hash_in_pieces(git_oid *out, const unsigned char *data, size_t len)
+{
+	git_hash_ctx *ctx = git_hash_new_ctx();
+	size_t done = 0, piece = 1;
+
+	cl_assert(ctx != NULL);
+
+	while (done < len) {
+		size_t n = min(piece, len - done);
+
+		git_hash_update(ctx, data + done, n);
+		done += n;
+		piece = (piece * 7 + 3) % 300;
+	}
+
+	git_hash_final(out, ctx);
+	git_hash_free_ctx(ctx);
+}
+
+static void assert_same_as_portable(const char *name, size_t len)
+{
+	unsigned char *data;
+	git_oid expected, oid;
+	size_t i;
+
+	data = git__malloc(len);
+	cl_assert(data != NULL);
+
+	for (i = 0; i < len; ++i)
+		data[i] = (unsigned char)(i * 31 + (i >> 8));
+
+	cl_git_pass(git__sha1_select("portable"));
+	git_hash_buf(&expected, data, len);
+	cl_git_pass(git__sha1_select(name));
+
+	hash_in_pieces(&oid, data, len);
+	cl_assert(git_oid_cmp(&expected, &oid) == 0);
+
+	git_hash_buf(&oid, data, len);
+	cl_assert(git_oid_cmp(&expected, &oid) == 0);
+
+	git__free(data);
+}
+
+static void assert_known_hashes(void)
+{
+	const char *long_input = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	char *a_million;
+
+	assert_hash("da39a3ee5e6b4b0d3255bfef95601890afd80709", "", 0);
+	assert_hash("a9993e364706816aba3e25717850c26c9cd0d89d", "abc", 3);
+	assert_hash("84983e441c3bd26ebaae4aa1f95129e5e54670f1", long_input, strlen(long_input));
+
+	a_million = git__malloc(1000000);
+	cl_assert(a_million != NULL);
+	memset(a_million, 'a', 1000000);
+	assert_hash("34aa973cd4c4daa4f61eeb2bdbad27316534016f", a_million, 1000000);
+	git__free(a_million);
+}
+
+void test_core_sha1__every_implementation_hashes_the_same(void)
+{
+	const git__sha1_impl *impl;
+	size_t lengths[] = { 0, 1, 55, 56, 63, 64, 65, 127, 128, 1000, 65537 };
+	size_t i;
+
+#ifdef PPC_SHA1
+	/* none of them are used */
+	assert_known_hashes();
+	return;
+#endif
+
+	for (impl = git__sha1_impls; impl->name != NULL; ++impl) {
+		if (impl->supported != NULL && !impl->supported())
+			continue;
+
+		cl_git_pass(git__sha1_select(impl->name));
+		cl_assert_strequal(impl->name, git__sha1_selected());
+
+		assert_known_hashes();
+
+		for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i)
+			assert_same_as_portable(impl->name, lengths[i]);
+	}
+}
+
+void test_core_sha1__the_portable_one_is_always_there(void)
+{
+#ifdef PPC_SHA1
+	cl_assert(git__sha1_select("portable") == GIT_ENOTFOUND);
+	cl_assert_strequal("ppc", git__sha1_selected());
+	return;
+#endif
+
+	cl_git_pass(git__sha1_select("portable"));
+	cl_assert(git__sha1_select("no-such-thing") == GIT_ENOTFOUND);
+	cl_assert_strequal("portable", git__sha1_selected());
+}
+
+#define MANY 150
+
+/* Messages of all sizes, in two pieces split anywhere */
+static void assert_many_same_as_one_by_one(const unsigned char *data)
+{
+	git_buf_vec vec[MANY * 2];
+	git_oid expected, oids[MANY];
+	size_t i, len;
+
+	for (i = 0; i < MANY; ++i) {
+		len = (i * 37) % 300 + (i % 10 == 9 ? 5000 : 0);
+
+		vec[2 * i].data = (void *)(data + i);
+		vec[2 * i].len = (i * 13) % (len + 1);
+		vec[2 * i + 1].data = (void *)(data + i + vec[2 * i].len);
+		vec[2 * i + 1].len = len - vec[2 * i].len;
+	}
+
+	/* fewer than fill the lanes, and then all of them */
+	git_hash_many(oids, vec, 2, 3);
+	git_hash_many(oids + 3, vec + 6, 2, MANY - 3);
+
+	for (i = 0; i < MANY; ++i) {
+		git_hash_vec(&expected, vec + 2 * i, 2);
+		cl_assert(git_oid_cmp(&expected, &oids[i]) == 0);
+	}
+}
+
+void test_core_sha1__many_at_once_hash_the_same(void)
+{
+	const git__sha1_lanes_impl *lanes;
+	const git__sha1_impl *impl;
+	unsigned char *data;
+	size_t i;
+
+	data = git__malloc(MANY + 6000);
+	cl_assert(data != NULL);
+
+	for (i = 0; i < MANY + 6000; ++i)
+		data[i] = (unsigned char)(i * 7 + (i >> 5));
+
+#ifdef PPC_SHA1
+	assert_many_same_as_one_by_one(data);
+	git__free(data);
+	return;
+#endif
+
+	for (lanes = git__sha1_lanes_impls; lanes->name != NULL; ++lanes) {
+		if (lanes->supported != NULL && !lanes->supported())
+			continue;
+
+		cl_git_pass(git__sha1_select_lanes(lanes->name));
+
+		for (impl = git__sha1_impls; impl->name != NULL; ++impl) {
+			if (impl->supported != NULL && !impl->supported())
+				continue;
+
+			cl_git_pass(git__sha1_select(impl->name));
+			assert_many_same_as_one_by_one(data);
+		}
+	}
+
+	git__free(data);
+
+	cl_git_pass(git__sha1_select_lanes("serial"));
+	cl_assert(git__sha1_select_lanes("no-such-thing") == GIT_ENOTFOUND);
+	cl_assert_strequal("serial", git__sha1_selected_lanes());
+}
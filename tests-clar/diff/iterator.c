@@ -1,6 +1,7 @@
 #include "clar_libgit2.h"
 #include "diff_helpers.h"
 #include "iterator.h"
+#include "posix.h"
 
 void test_diff_iterator__initialize(void)
 {
@@ -139,6 +140,48 @@ void test_diff_iterator__tree_3(void)
 	tree_iterator_test("status", "0017bd4ab1e", 8, expected_tree_3);
 }
 
+void test_diff_iterator__tree_nested(void)
+{
+	static const char *paths[] = {
+		"a/b/c/file", "a/b/file", "a/d/file", "a/file", "e/f/file", "file"
+	};
+	git_repository *repo = cl_git_sandbox_init("status");
+	git_index *index;
+	git_index_entry entry;
+	git_tree *tree;
+	git_oid oid;
+	git_iterator *i;
+	const git_index_entry *item;
+	unsigned int count = 0;
+
+	cl_git_pass(git_repository_index(&index, repo));
+	memcpy(&entry, git_index_get(index, 0), sizeof(entry));
+	git_index_clear(index);
+
+	for (count = 0; count < 6; ++count) {
+		entry.path = (char *)paths[count];
+		cl_git_pass(git_index_add2(index, &entry));
+	}
+
+	cl_git_pass(git_tree_create_fromindex(&oid, index));
+	cl_git_pass(git_tree_lookup(&tree, repo, &oid));
+
+	/* leaving a subtree goes back to where it was in its parent */
+	cl_git_pass(git_iterator_for_tree(repo, tree, &i));
+	cl_git_pass(git_iterator_current(i, &item));
+
+	for (count = 0; item != NULL; ++count) {
+		cl_assert(count < 6);
+		cl_assert_strequal(paths[count], item->path);
+		cl_git_pass(git_iterator_advance(i, &item));
+	}
+	cl_assert(count == 6);
+
+	git_iterator_free(i);
+	git_tree_free(tree);
+	git_index_free(index);
+}
+
 
 /* -- INDEX ITERATOR TESTS -- */
 
@@ -328,3 +371,183 @@ void test_diff_iterator__workdir_1(void)
 {
 	workdir_iterator_test("status", 12, 1, status_paths, "ignored_file");
 }
+
+/* Walk the workdir, going into the directories `descend` says yes to */
+static void workdir_iterator_walk(
+	git_repository *repo, git_buf *out, int (*descend)(const char *path))
+{
+	git_iterator *i;
+	const git_index_entry *entry;
+
+	cl_git_pass(git_iterator_for_workdir(repo, &i));
+	cl_git_pass(git_iterator_current(i, &entry));
+
+	while (entry != NULL) {
+		cl_git_pass(git_buf_printf(out, "%s %o\n", entry->path, entry->mode));
+
+		if (S_ISDIR(entry->mode) && descend(entry->path))
+			cl_git_pass(git_iterator_advance_into_directory(i, &entry));
+		else
+			cl_git_pass(git_iterator_advance(i, &entry));
+	}
+
+	git_iterator_free(i);
+}
+
+static int descend_always(const char *path)
+{
+	GIT_UNUSED(path);
+	return 1;
+}
+
+static int descend_some(const char *path)
+{
+	return git__suffixcmp(path, "1/") != 0 && git__suffixcmp(path, "3/") != 0;
+}
+
+static void set_preload(git_repository **repo, int value)
+{
+	git_config *cfg;
+
+	cl_git_pass(git_repository_config(&cfg, *repo));
+	cl_git_pass(git_config_set_bool(cfg, "core.preloadIndex", value));
+	git_config_free(cfg);
+
+	/* the config cache doesn't see the change until we reopen */
+	git_repository_free(*repo);
+	cl_git_pass(git_repository_open(repo, "status"));
+}
+
+void test_diff_iterator__workdir_preloading_gives_the_same_entries(void)
+{
+	git_repository *repo;
+	git_buf path = GIT_BUF_INIT;
+	git_buf one = GIT_BUF_INIT, other = GIT_BUF_INIT;
+	int a, b;
+
+	cl_git_sandbox_init("status");
+
+	for (a = 0; a < 5; ++a) {
+		cl_git_pass(git_buf_printf(&path, "status/dir%d", a));
+		cl_git_pass(p_mkdir(path.ptr, 0777));
+
+		for (b = 0; b < 5; ++b) {
+			git_buf_clear(&path);
+			cl_git_pass(git_buf_printf(&path, "status/dir%d/sub%d", a, b));
+			cl_git_pass(p_mkdir(path.ptr, 0777));
+
+			cl_git_pass(git_buf_puts(&path, "/file"));
+			cl_git_mkfile(path.ptr, "content\n");
+		}
+
+		git_buf_clear(&path);
+	}
+
+	cl_git_pass(git_repository_open(&repo, "status"));
+
+	set_preload(&repo, 1);
+	workdir_iterator_walk(repo, &one, descend_always);
+	set_preload(&repo, 0);
+	workdir_iterator_walk(repo, &other, descend_always);
+
+	cl_assert(strstr(one.ptr, "dir4/sub4/file ") != NULL);
+	cl_assert_strequal(other.ptr, one.ptr);
+
+	/* directories we don't go into are skipped by the scanner too */
+	git_buf_clear(&one);
+	git_buf_clear(&other);
+
+	set_preload(&repo, 1);
+	workdir_iterator_walk(repo, &one, descend_some);
+	set_preload(&repo, 0);
+	workdir_iterator_walk(repo, &other, descend_some);
+
+	cl_assert(strstr(one.ptr, "dir1/sub0/") == NULL);
+	cl_assert(strstr(one.ptr, "dir2/sub3/file ") == NULL);
+	cl_assert(strstr(one.ptr, "dir2/sub4/file ") != NULL);
+	cl_assert_strequal(other.ptr, one.ptr);
+
+	git_repository_free(repo);
+	git_buf_free(&path);
+	git_buf_free(&one);
+	git_buf_free(&other);
+}
+
+/* -- RANGES -- */
+
+static void iterator_range_walk(git_iterator *i, git_buf *out)
+{
+	const git_index_entry *entry;
+
+	cl_git_pass(git_iterator_current(i, &entry));
+
+	while (entry != NULL) {
+		if (S_ISDIR(entry->mode)) {
+			cl_git_pass(git_iterator_advance_into_directory(i, &entry));
+			continue;
+		}
+
+		cl_git_pass(git_buf_printf(out, "%s\n", entry->path));
+		cl_git_pass(git_iterator_advance(i, &entry));
+	}
+
+	git_iterator_free(i);
+}
+
+void test_diff_iterator__index_range(void)
+{
+	git_iterator *i;
+	git_buf paths = GIT_BUF_INIT;
+	git_repository *repo = cl_git_sandbox_init("status");
+
+	cl_git_pass(git_iterator_for_index_range(repo, "staged_new", "subdir/", &i));
+	iterator_range_walk(i, &paths);
+	cl_assert_strequal(
+		"staged_new_file\n"
+		"staged_new_file_deleted_file\n"
+		"staged_new_file_modified_file\n"
+		"subdir.txt\n", paths.ptr);
+
+	git_buf_clear(&paths);
+	cl_git_pass(git_iterator_for_index_range(repo, "subdir/", NULL, &i));
+	iterator_range_walk(i, &paths);
+	cl_assert_strequal(
+		"subdir/current_file\n"
+		"subdir/deleted_file\n"
+		"subdir/modified_file\n", paths.ptr);
+
+	git_buf_clear(&paths);
+	cl_git_pass(git_iterator_for_index_range(repo, "zzz", NULL, &i));
+	iterator_range_walk(i, &paths);
+	cl_assert(paths.size == 0);
+
+	git_buf_free(&paths);
+}
+
+void test_diff_iterator__workdir_range(void)
+{
+	git_iterator *i;
+	git_buf paths = GIT_BUF_INIT;
+	git_repository *repo = cl_git_sandbox_init("status");
+
+	cl_git_pass(git_iterator_for_workdir_range(repo, "staged_new", "subdir/", 0, &i));
+	iterator_range_walk(i, &paths);
+	cl_assert_strequal(
+		"staged_new_file\n"
+		"staged_new_file_modified_file\n"
+		"subdir.txt\n", paths.ptr);
+
+	/* the range can start and end inside a directory */
+	git_buf_clear(&paths);
+	cl_git_pass(git_iterator_for_workdir_range(
+		repo, "subdir/modified_file", "subdir/new_file", 0, &i));
+	iterator_range_walk(i, &paths);
+	cl_assert_strequal("subdir/modified_file\n", paths.ptr);
+
+	git_buf_clear(&paths);
+	cl_git_pass(git_iterator_for_workdir_range(repo, "zzz", NULL, 0, &i));
+	iterator_range_walk(i, &paths);
+	cl_assert(paths.size == 0);
+
+	git_buf_free(&paths);
+}
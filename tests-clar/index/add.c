@@ -0,0 +1,145 @@
+#include "clar_libgit2.h"
+#include "index.h"
+
+#define INDEX_PATH "testrepo.git/index"
+
+static git_index *_index;
+
+void test_index_add__initialize(void)
+{
+	cl_fixture_sandbox("testrepo.git");
+	cl_git_pass(git_index_open(&_index, INDEX_PATH));
+}
+
+void test_index_add__cleanup(void)
+{
+	git_index_free(_index);
+	cl_fixture_cleanup("testrepo.git");
+}
+
+static void assert_sorted_and_findable(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < git_index_entrycount(_index); ++i) {
+		git_index_entry *entry = git_index_get(_index, i);
+
+		if (i > 0)
+			cl_assert(strcmp(git_index_get(_index, i - 1)->path, entry->path) < 0);
+
+		cl_assert(git_index_find(_index, entry->path) == (int)i);
+	}
+}
+
+void test_index_add__entries_in_one_go(void)
+{
+	git_index_entry entries[20];
+	char paths[20][128];
+	unsigned int i;
+
+	memcpy(&entries[0], git_index_get(_index, 0), sizeof(git_index_entry));
+
+	for (i = 0; i < 20; ++i) {
+		memcpy(&entries[i], &entries[0], sizeof(git_index_entry));
+		entries[i].file_size = i;
+
+		/* half of them are new, and some of those come twice */
+		if (i % 2)
+			sprintf(paths[i], "new/%02u", i % 7);
+		else
+			strcpy(paths[i], git_index_get(_index, i * 5)->path);
+
+		entries[i].path = paths[i];
+	}
+
+	cl_git_pass(git_index_add_entries(_index, entries, 20));
+	cl_assert(git_index_entrycount(_index) == 109 + 7);
+	assert_sorted_and_findable();
+
+	/* the last one wins */
+	cl_assert(git_index_get(_index, git_index_find(_index, "new/01"))->file_size == 15);
+	cl_assert(git_index_get(_index, git_index_find(_index, paths[4]))->file_size == 4);
+	cl_assert(git_index_find(_index, "new/07") == GIT_ENOTFOUND);
+}
+
+void test_index_add__lookups_after_removing(void)
+{
+	git_index_entry entry;
+	int pos;
+
+	memcpy(&entry, git_index_get(_index, 0), sizeof(git_index_entry));
+
+	/* the other entries move up */
+	cl_git_pass(git_index_remove(_index, 3));
+	cl_git_pass(git_index_remove(_index, 0));
+	cl_assert(git_index_entrycount(_index) == 107);
+	assert_sorted_and_findable();
+
+	cl_assert(git_index_find(_index, entry.path) == GIT_ENOTFOUND);
+
+	/* replacing and adding in between */
+	entry.path = "zzz";
+	cl_git_pass(git_index_add2(_index, &entry));
+	entry.path = "aaa";
+	cl_git_pass(git_index_add2(_index, &entry));
+
+	pos = git_index_find(_index, "src/index.c");
+	cl_assert(pos >= 0);
+	cl_git_pass(git_index_remove(_index, pos));
+
+	entry.path = "zzz";
+	entry.file_size = 42;
+	cl_git_pass(git_index_add2(_index, &entry));
+
+	cl_assert(git_index_entrycount(_index) == 108);
+	assert_sorted_and_findable();
+	cl_assert(git_index_get(_index, git_index_find(_index, "zzz"))->file_size == 42);
+	cl_assert(git_index_find(_index, "src/index.c") == GIT_ENOTFOUND);
+}
+
+void test_index_add__files_in_one_go(void)
+{
+	const char *paths[] = {
+		"current_file", "modified_file", "new_file", "subdir/new_file",
+		"subdir.txt", "ignored_file", "new_file"
+	};
+	const char *broken[] = { "current_file", "no_such_file" };
+	git_repository *repo;
+	git_index *index;
+	git_index_entry *entry;
+	git_buf path = GIT_BUF_INIT;
+	git_oid oid;
+	unsigned int i, count;
+	struct stat st;
+
+	repo = cl_git_sandbox_init("status");
+	cl_git_pass(git_repository_index(&index, repo));
+	count = git_index_entrycount(index);
+
+	cl_git_pass(git_index_add_all(index, paths, 7, 0));
+
+	for (i = 0; i < 7; ++i) {
+		cl_git_pass(git_buf_joinpath(&path, "status", paths[i]));
+		cl_git_pass(git_odb_hashfile(&oid, path.ptr, GIT_OBJ_BLOB));
+		cl_git_pass(p_lstat(path.ptr, &st));
+
+		entry = git_index_get(index, git_index_find(index, paths[i]));
+		cl_assert(entry != NULL);
+		cl_assert(git_oid_cmp(&oid, &entry->oid) == 0);
+		cl_assert(entry->file_size == (git_off_t)st.st_size);
+	}
+
+	for (i = 1; i < git_index_entrycount(index); ++i)
+		cl_assert(strcmp(git_index_get(index, i - 1)->path,
+			git_index_get(index, i)->path) < 0);
+
+	/* only new_file, subdir/new_file and ignored_file are new */
+	cl_assert(git_index_entrycount(index) == count + 3);
+
+	cl_git_fail(git_index_add_all(index, broken, 2, 0));
+	cl_assert(git_index_entrycount(index) == count + 3);
+
+	git_buf_free(&path);
+	git_index_free(index);
+	cl_git_sandbox_cleanup();
+}
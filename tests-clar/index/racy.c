@@ -0,0 +1,160 @@
+#include "clar_libgit2.h"
+#include "index.h"
+#include "posix.h"
+
+static git_repository *_repo;
+static git_index *_index;
+
+void test_index_racy__initialize(void)
+{
+	_repo = cl_git_sandbox_init("status");
+	cl_git_pass(git_repository_index(&_index, _repo));
+}
+
+void test_index_racy__cleanup(void)
+{
+	git_index_free(_index);
+	cl_git_sandbox_cleanup();
+}
+
+static git_index_entry *entry_for(git_index *index, const char *path)
+{
+	int pos = git_index_find(index, path);
+
+	cl_assert(pos >= 0);
+	return git_index_get(index, pos);
+}
+
+void test_index_racy__entries_as_new_as_the_index_are_not_trusted(void)
+{
+	git_index_entry *entry = entry_for(_index, "current_file");
+	git_index_entry wd;
+
+	memcpy(&wd, entry, sizeof(wd));
+
+	_index->last_modified = (time_t)entry->mtime.seconds + 1;
+	cl_assert(git_index__stat_matches(_index, entry, &wd));
+
+	_index->last_modified = (time_t)entry->mtime.seconds;
+	cl_assert(!git_index__stat_matches(_index, entry, &wd));
+
+	_index->last_modified = (time_t)entry->mtime.seconds + 1;
+	wd.file_size++;
+	cl_assert(!git_index__stat_matches(_index, entry, &wd));
+}
+
+void test_index_racy__racy_entries_are_written_smudged(void)
+{
+	git_index *index;
+	git_off_t size;
+
+	/* as if the file had been written while we write the index */
+	entry_for(_index, "current_file")->mtime.seconds = (git_time_t)time(NULL) + 1000;
+	size = entry_for(_index, "modified_file")->file_size;
+	entry_for(_index, "modified_file")->mtime.seconds = 1;
+
+	cl_git_pass(git_index_write(_index));
+
+	cl_git_pass(git_index_open(&index, "status/.git/index"));
+	cl_assert(entry_for(index, "current_file")->file_size == 0);
+	cl_assert(entry_for(index, "modified_file")->file_size == size);
+	git_index_free(index);
+}
+
+void test_index_racy__smudged_entries_are_not_trusted(void)
+{
+	git_index_entry *entry = entry_for(_index, "current_file");
+	git_index_entry wd;
+
+	/* as if the file had been emptied right after a racy write */
+	entry->file_size = 0;
+	memcpy(&wd, entry, sizeof(wd));
+
+	_index->last_modified = (time_t)entry->mtime.seconds + 1;
+	cl_assert(!git_index__stat_matches(_index, entry, &wd));
+
+	/* unless the file is meant to be empty */
+	cl_git_pass(git_oid_fromstr(&entry->oid, "e69de29bb2d1d6434b8b29ae775ad8c2e48c5391"));
+	cl_assert(git_index__stat_matches(_index, entry, &wd));
+}
+
+static int count_cb(const char *path, unsigned int status_flags, void *payload)
+{
+	GIT_UNUSED(path);
+	GIT_UNUSED(status_flags);
+
+	(*(int *)payload)++;
+	return 0;
+}
+
+static void assert_refreshed(const char *path)
+{
+	git_index *index;
+	git_index_entry *entry;
+	struct stat st;
+	git_buf full = GIT_BUF_INIT;
+
+	cl_git_pass(git_buf_joinpath(&full, "status", path));
+	cl_git_pass(p_lstat(full.ptr, &st));
+	git_buf_free(&full);
+
+	/* what's on disk, not what's in memory */
+	cl_git_pass(git_index_open(&index, "status/.git/index"));
+	entry = entry_for(index, path);
+
+	cl_assert(entry->mtime.seconds == (git_time_t)st.st_mtime);
+	cl_assert(entry->ino == (unsigned int)st.st_ino);
+
+	git_index_free(index);
+}
+
+void test_index_racy__status_refreshes_stat_data(void)
+{
+	int before = 0, after = 0;
+
+	/* the file is the same, its stat data isn't */
+	entry_for(_index, "current_file")->mtime.seconds -= 100;
+	entry_for(_index, "current_file")->ino++;
+	cl_git_pass(git_index_write(_index));
+
+	cl_git_pass(git_status_foreach(_repo, count_cb, &before));
+	assert_refreshed("current_file");
+	cl_assert(!_index->stat_refreshed);
+
+	cl_git_pass(git_status_foreach(_repo, count_cb, &after));
+	cl_assert(before == after);
+}
+
+void test_index_racy__diff_refreshes_stat_data(void)
+{
+	git_diff_list *diff;
+
+	entry_for(_index, "subdir/current_file")->ino++;
+	cl_git_pass(git_index_write(_index));
+
+	cl_git_pass(git_diff_workdir_to_index(_repo, NULL, &diff));
+	git_diff_list_free(diff);
+
+	assert_refreshed("subdir/current_file");
+}
+
+void test_index_racy__changes_in_memory_are_not_written_behind_our_back(void)
+{
+	git_index *index;
+	int count = 0;
+	git_index_entry entry;
+
+	entry_for(_index, "current_file")->ino++;
+	cl_git_pass(git_index_write(_index));
+
+	/* not written yet */
+	memcpy(&entry, entry_for(_index, "current_file"), sizeof(entry));
+	entry.path = "zzz_new_entry";
+	cl_git_pass(git_index_add2(_index, &entry));
+
+	cl_git_pass(git_status_foreach(_repo, count_cb, &count));
+
+	cl_git_pass(git_index_open(&index, "status/.git/index"));
+	cl_assert(git_index_find(index, "zzz_new_entry") == GIT_ENOTFOUND);
+	git_index_free(index);
+}
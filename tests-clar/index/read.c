@@ -0,0 +1,61 @@
+#include "clar_libgit2.h"
+#include "index.h"
+
+#define INDEX_PATH "testrepo.git/index"
+
+void test_index_read__initialize(void)
+{
+	cl_fixture_sandbox("testrepo.git");
+}
+
+void test_index_read__cleanup(void)
+{
+	cl_fixture_cleanup("testrepo.git");
+}
+
+/* The entries read from disk can be replaced and removed like any other */
+void test_index_read__change_entries_read_from_disk(void)
+{
+	git_index *index;
+	git_index_entry entry, *e;
+	int pos;
+
+	cl_git_pass(git_index_open(&index, INDEX_PATH));
+	cl_assert(git_index_entrycount(index) == 109);
+
+	pos = git_index_find(index, "Makefile");
+	cl_assert(pos >= 0);
+	memcpy(&entry, git_index_get(index, pos), sizeof(git_index_entry));
+	cl_assert(entry.file_size == 5064);
+
+	/* replace it with a copy of itself */
+	entry.file_size = 42;
+	cl_git_pass(git_index_add2(index, &entry));
+	cl_assert(git_index_entrycount(index) == 109);
+
+	pos = git_index_find(index, "src/index.c");
+	cl_assert(pos >= 0);
+	cl_git_pass(git_index_remove(index, pos));
+
+	entry.path = "zzz/new-file";
+	cl_git_pass(git_index_add2(index, &entry));
+	cl_assert(git_index_entrycount(index) == 109);
+
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	cl_git_pass(git_index_open(&index, INDEX_PATH));
+	cl_assert(git_index_entrycount(index) == 109);
+	cl_assert(git_index_find(index, "src/index.c") == GIT_ENOTFOUND);
+
+	e = git_index_get(index, git_index_find(index, "Makefile"));
+	cl_assert(e->file_size == 42);
+	e = git_index_get(index, git_index_find(index, "zzz/new-file"));
+	cl_assert(e->file_size == 42);
+
+	/* a clear drops whatever was read along with the rest */
+	git_index_clear(index);
+	cl_assert(git_index_entrycount(index) == 0);
+
+	git_index_free(index);
+}
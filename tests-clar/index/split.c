@@ -0,0 +1,288 @@
+#include "clar_libgit2.h"
+#include "index.h"
+#include "posix.h"
+
+static git_repository *_repo;
+
+void test_index_split__initialize(void)
+{
+	cl_fixture_sandbox("testrepo.git");
+	cl_git_pass(git_repository_open(&_repo, "testrepo.git"));
+}
+
+void test_index_split__cleanup(void)
+{
+	git_repository_free(_repo);
+	cl_fixture_cleanup("testrepo.git");
+}
+
+static void set_split_index(int value)
+{
+	git_config *cfg;
+
+	cl_git_pass(git_repository_config(&cfg, _repo));
+	cl_git_pass(git_config_set_bool(cfg, "core.splitIndex", value));
+	git_config_free(cfg);
+}
+
+static git_index *open_index(void)
+{
+	git_index *index;
+
+	cl_git_pass(git_index_open(&index, "testrepo.git/index"));
+	return index;
+}
+
+static git_index *write_split_index(void)
+{
+	git_index *index;
+
+	set_split_index(1);
+
+	cl_git_pass(git_repository_index(&index, _repo));
+	cl_git_pass(git_index_write(index));
+	cl_assert(index->split != NULL);
+
+	return index;
+}
+
+static void assert_shared_index_exists(const git_oid *oid, int expected)
+{
+	git_buf path = GIT_BUF_INIT;
+	char hex[GIT_OID_HEXSZ + 1];
+
+	git_oid_fmt(hex, oid);
+	hex[GIT_OID_HEXSZ] = '\0';
+
+	cl_git_pass(git_buf_printf(&path, "testrepo.git/sharedindex.%s", hex));
+	cl_assert((git_path_exists(path.ptr) == GIT_SUCCESS) == expected);
+
+	git_buf_free(&path);
+}
+
+void test_index_split__write_and_read(void)
+{
+	git_index *index, *read;
+	unsigned int i;
+
+	index = write_split_index();
+	assert_shared_index_exists(&index->split->base_oid, 1);
+
+	/* everything is in the shared index */
+	read = open_index();
+	cl_assert(read->split != NULL);
+	cl_assert(read->split->base_entry_count == 109);
+	cl_assert(git_index_entrycount(read) == git_index_entrycount(index));
+
+	for (i = 0; i < git_index_entrycount(index); ++i) {
+		git_index_entry *a = git_index_get(index, i), *b = git_index_get(read, i);
+
+		cl_assert(strcmp(a->path, b->path) == 0);
+		cl_assert(git_oid_cmp(&a->oid, &b->oid) == 0);
+		cl_assert(a->mode == b->mode);
+	}
+
+	git_index_free(read);
+	git_index_free(index);
+}
+
+void test_index_split__only_changes_are_written(void)
+{
+	git_index *index;
+	git_index_entry entry, *e;
+	git_oid base_oid;
+	struct stat st;
+
+	index = write_split_index();
+	git_oid_cpy(&base_oid, &index->split->base_oid);
+
+	memcpy(&entry, git_index_get(index, git_index_find(index, "Makefile")), sizeof(git_index_entry));
+	entry.file_size = 42;
+	cl_git_pass(git_index_add2(index, &entry));
+
+	entry.path = "zzz/new-file";
+	cl_git_pass(git_index_add2(index, &entry));
+
+	cl_git_pass(git_index_remove(index, git_index_find(index, "src/index.c")));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	/* one replaced and one new entry: the shared index stays */
+	cl_git_pass(p_stat("testrepo.git/index", &st));
+	cl_assert(st.st_size < 400);
+
+	index = open_index();
+	cl_assert(git_oid_cmp(&index->split->base_oid, &base_oid) == 0);
+	cl_assert(git_index_entrycount(index) == 109);
+	cl_assert(git_index_find(index, "src/index.c") == GIT_ENOTFOUND);
+
+	e = git_index_get(index, git_index_find(index, "Makefile"));
+	cl_assert(e->file_size == 42);
+	e = git_index_get(index, git_index_find(index, "zzz/new-file"));
+	cl_assert(e->file_size == 42);
+
+	git_index_free(index);
+}
+
+void test_index_split__many_changes_share_the_index_again(void)
+{
+	git_index *index;
+	git_index_entry entry;
+	git_oid base_oid;
+	unsigned int i;
+
+	index = write_split_index();
+	git_oid_cpy(&base_oid, &index->split->base_oid);
+
+	for (i = 0; i < 30; ++i) {
+		memcpy(&entry, git_index_get(index, i), sizeof(git_index_entry));
+		entry.file_size++;
+		cl_git_pass(git_index_add2(index, &entry));
+	}
+
+	cl_git_pass(git_index_write(index));
+	cl_assert(git_oid_cmp(&index->split->base_oid, &base_oid) != 0);
+	assert_shared_index_exists(&index->split->base_oid, 1);
+
+	git_index_free(index);
+}
+
+void test_index_split__can_be_turned_off(void)
+{
+	git_index *index;
+
+	git_index_free(write_split_index());
+
+	set_split_index(0);
+	git_repository_free(_repo);
+	cl_git_pass(git_repository_open(&_repo, "testrepo.git"));
+
+	cl_git_pass(git_repository_index(&index, _repo));
+	cl_assert(index->split != NULL);
+	cl_git_pass(git_index_write(index));
+	cl_assert(index->split == NULL);
+	git_index_free(index);
+
+	index = open_index();
+	cl_assert(index->split == NULL);
+	cl_assert(git_index_entrycount(index) == 109);
+	git_index_free(index);
+}
+
+void test_index_split__missing_shared_index_is_an_error(void)
+{
+	git_index *index;
+	git_buf path = GIT_BUF_INIT;
+	char hex[GIT_OID_HEXSZ + 1];
+
+	index = write_split_index();
+
+	git_oid_fmt(hex, &index->split->base_oid);
+	hex[GIT_OID_HEXSZ] = '\0';
+	git_index_free(index);
+
+	cl_git_pass(git_buf_printf(&path, "testrepo.git/sharedindex.%s", hex));
+	cl_git_pass(p_unlink(path.ptr));
+	git_buf_free(&path);
+
+	cl_git_fail(git_index_open(&index, "testrepo.git/index"));
+	git_index_free(index);
+}
+
+static void set_shared_index_expire(const char *value)
+{
+	git_config *cfg;
+
+	cl_git_pass(git_repository_config(&cfg, _repo));
+	cl_git_pass(git_config_set_string(cfg, "splitIndex.sharedIndexExpire", value));
+	git_config_free(cfg);
+}
+
+/* Change enough entries for the next write to share the index again */
+static int reshare(git_index *index, unsigned int offset)
+{
+	git_index_entry entry;
+	unsigned int i;
+
+	for (i = offset; i < offset + 30; ++i) {
+		memcpy(&entry, git_index_get(index, i), sizeof(git_index_entry));
+		entry.file_size++;
+		cl_git_pass(git_index_add2(index, &entry));
+	}
+
+	return git_index_write(index);
+}
+
+static void age_shared_index(const git_oid *oid, time_t seconds)
+{
+	git_buf path = GIT_BUF_INIT;
+	struct utimbuf times;
+	char hex[GIT_OID_HEXSZ + 1];
+
+	git_oid_fmt(hex, oid);
+	hex[GIT_OID_HEXSZ] = '\0';
+
+	times.actime = times.modtime = time(NULL) - seconds;
+
+	cl_git_pass(git_buf_printf(&path, "testrepo.git/sharedindex.%s", hex));
+	cl_must_pass(p_utime(path.ptr, &times));
+	git_buf_free(&path);
+}
+
+void test_index_split__unused_shared_indexes_expire(void)
+{
+	git_index *index;
+	git_oid first, second;
+
+	index = write_split_index();
+	git_oid_cpy(&first, &index->split->base_oid);
+
+	/* two weeks by default */
+	cl_git_pass(reshare(index, 0));
+	git_oid_cpy(&second, &index->split->base_oid);
+	assert_shared_index_exists(&first, 1);
+
+	age_shared_index(&first, 15 * 24 * 60 * 60);
+	cl_git_pass(reshare(index, 30));
+	assert_shared_index_exists(&first, 0);
+	assert_shared_index_exists(&second, 1);
+	git_oid_cpy(&second, &index->split->base_oid);
+
+	set_shared_index_expire("never");
+	cl_git_pass(reshare(index, 60));
+	assert_shared_index_exists(&second, 1);
+
+	set_shared_index_expire("now");
+	cl_git_pass(reshare(index, 0));
+	assert_shared_index_exists(&second, 0);
+	assert_shared_index_exists(&index->split->base_oid, 1);
+
+	git_index_free(index);
+}
+
+void test_index_split__the_shared_index_in_use_is_kept(void)
+{
+	git_index *index;
+	git_oid base;
+
+	index = write_split_index();
+	git_oid_cpy(&base, &index->split->base_oid);
+
+	/* writing without sharing again marks it as used */
+	age_shared_index(&base, 15 * 24 * 60 * 60);
+	cl_git_pass(git_index_write(index));
+	cl_assert(git_oid_cmp(&index->split->base_oid, &base) == 0);
+
+	cl_git_pass(reshare(index, 0));
+	assert_shared_index_exists(&base, 1);
+
+	set_shared_index_expire("1.week.ago");
+	age_shared_index(&base, 8 * 24 * 60 * 60);
+	cl_git_pass(reshare(index, 30));
+	assert_shared_index_exists(&base, 0);
+
+	set_shared_index_expire("soon");
+	cl_git_fail(reshare(index, 60));
+
+	git_index_free(index);
+}
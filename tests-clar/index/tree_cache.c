@@ -0,0 +1,110 @@
+#include "clar_libgit2.h"
+#include "index.h"
+#include "tree-cache.h"
+#include "posix.h"
+
+static git_repository *_repo;
+static git_index *_index;
+
+void test_index_tree_cache__initialize(void)
+{
+	_repo = cl_git_sandbox_init("status");
+	cl_git_pass(git_repository_index(&_index, _repo));
+}
+
+void test_index_tree_cache__cleanup(void)
+{
+	git_index_free(_index);
+	cl_git_sandbox_cleanup();
+}
+
+/* The tree the index would have without any help from the cache */
+static void tree_from_scratch(git_oid *out)
+{
+	git_tree_cache_free(_index->tree);
+	_index->tree = NULL;
+
+	cl_git_pass(git_tree_create_fromindex(out, _index));
+}
+
+void test_index_tree_cache__writing_fills_the_cache(void)
+{
+	git_oid oid;
+	const git_tree_cache *subdir;
+
+	cl_git_pass(git_tree_create_fromindex(&oid, _index));
+
+	cl_assert(_index->tree != NULL);
+	cl_assert(_index->tree->entries == (ssize_t)git_index_entrycount(_index));
+	cl_assert(git_oid_cmp(&_index->tree->oid, &oid) == 0);
+
+	subdir = git_tree_cache_get(_index->tree, "subdir");
+	cl_assert(subdir != NULL);
+	cl_assert(subdir->entries == 3);
+}
+
+void test_index_tree_cache__only_changed_trees_are_written_again(void)
+{
+	git_oid before, after, expected;
+	git_oid subdir_oid;
+
+	cl_git_pass(git_tree_create_fromindex(&before, _index));
+	git_oid_cpy(&subdir_oid, &git_tree_cache_get(_index->tree, "subdir")->oid);
+
+	cl_git_mkfile("status/current_file", "changed\n");
+	cl_git_pass(git_index_add(_index, "current_file", 0));
+
+	/* the root is stale, the subdirectory is not */
+	cl_assert(_index->tree->entries == -1);
+	cl_assert(git_tree_cache_get(_index->tree, "subdir")->entries == 3);
+
+	cl_git_pass(git_tree_create_fromindex(&after, _index));
+	cl_assert(git_oid_cmp(&before, &after) != 0);
+	cl_assert(_index->tree->entries == (ssize_t)git_index_entrycount(_index));
+	cl_assert(git_oid_cmp(&git_tree_cache_get(_index->tree, "subdir")->oid, &subdir_oid) == 0);
+
+	tree_from_scratch(&expected);
+	cl_assert(git_oid_cmp(&after, &expected) == 0);
+}
+
+void test_index_tree_cache__new_and_removed_directories(void)
+{
+	git_oid oid, expected;
+	int pos;
+
+	cl_git_pass(git_tree_create_fromindex(&oid, _index));
+
+	cl_git_pass(p_mkdir("status/newdir", 0777));
+	cl_git_mkfile("status/newdir/file", "new\n");
+	cl_git_pass(git_index_add(_index, "newdir/file", 0));
+
+	while ((pos = git_index_find(_index, "subdir/current_file")) >= 0 ||
+		(pos = git_index_find(_index, "subdir/deleted_file")) >= 0 ||
+		(pos = git_index_find(_index, "subdir/modified_file")) >= 0)
+		cl_git_pass(git_index_remove(_index, pos));
+
+	cl_git_pass(git_tree_create_fromindex(&oid, _index));
+	cl_assert(git_tree_cache_get(_index->tree, "subdir") == NULL);
+	cl_assert(git_tree_cache_get(_index->tree, "newdir")->entries == 1);
+	cl_assert(_index->tree->children_count == 1);
+
+	tree_from_scratch(&expected);
+	cl_assert(git_oid_cmp(&oid, &expected) == 0);
+}
+
+void test_index_tree_cache__cache_is_written_with_the_index(void)
+{
+	git_oid oid;
+	git_index *index;
+
+	cl_git_pass(git_tree_create_fromindex(&oid, _index));
+	cl_git_pass(git_index_write(_index));
+
+	cl_git_pass(git_index_open(&index, "status/.git/index"));
+	cl_assert(index->tree != NULL);
+	cl_assert(index->tree->entries == (ssize_t)git_index_entrycount(index));
+	cl_assert(git_oid_cmp(&index->tree->oid, &oid) == 0);
+	cl_assert(git_tree_cache_get(index->tree, "subdir")->entries == 3);
+
+	git_index_free(index);
+}
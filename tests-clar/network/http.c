@@ -0,0 +1,115 @@
+#ifndef _WIN32
+#	include <sys/socket.h>
+#	include <sys/wait.h>
+#	include <netinet/in.h>
+#	include <arpa/inet.h>
+#endif
+
+#include "clar_libgit2.h"
+#include "transport.h"
+#include "buffer.h"
+
+#ifndef GIT_WIN32
+
+/* What a smart HTTP server says to GET /info/refs?service=git-upload-pack */
+static const char advertisement[] =
+	"001e# service=git-upload-pack\n"
+	"0000"
+	"005a" "a65fedf39aefe402d3bb6e24df4d4f5fe4547750 HEAD" "\0" "multi_ack thin-pack side-band ofs-delta\n"
+	"003f" "a65fedf39aefe402d3bb6e24df4d4f5fe4547750 refs/heads/master\n"
+	"0000";
+
+static pid_t g_server;
+static int g_port;
+
+/* Answer a single request with the advertisement above */
+static void serve(int listener)
+{
+	git_buf response = GIT_BUF_INIT;
+	char request[4096];
+	size_t got = 0;
+	ssize_t n;
+	int fd;
+
+	if ((fd = accept(listener, NULL, NULL)) < 0)
+		_exit(1);
+
+	/* the request has no body */
+	while (got < sizeof(request) - 1 &&
+		(n = read(fd, request + got, sizeof(request) - 1 - got)) > 0) {
+		got += n;
+		request[got] = '\0';
+		if (strstr(request, "\r\n\r\n") != NULL)
+			break;
+	}
+
+	git_buf_printf(&response,
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type: application/x-git-upload-pack-advertisement\r\n"
+		"Content-Length: %u\r\n\r\n", (unsigned int)(sizeof(advertisement) - 1));
+	git_buf_put(&response, advertisement, sizeof(advertisement) - 1);
+
+	if (write(fd, response.ptr, response.size) != (ssize_t)response.size)
+		_exit(1);
+
+	close(fd);
+	_exit(0);
+}
+
+void test_network_http__initialize(void)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int listener;
+
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	cl_assert(listener >= 0);
+
+	memset(&addr, 0x0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	cl_assert(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	cl_assert(listen(listener, 1) == 0);
+	cl_assert(getsockname(listener, (struct sockaddr *)&addr, &len) == 0);
+	g_port = ntohs(addr.sin_port);
+
+	g_server = fork();
+	cl_assert(g_server >= 0);
+	if (g_server == 0)
+		serve(listener);
+
+	close(listener);
+}
+
+void test_network_http__cleanup(void)
+{
+	int status;
+
+	waitpid(g_server, &status, 0);
+}
+
+void test_network_http__capabilities_are_detected(void)
+{
+	git_buf url = GIT_BUF_INIT;
+	git_transport *t;
+
+	cl_git_pass(git_buf_printf(&url, "http://127.0.0.1:%d/testrepo.git", g_port));
+	cl_git_pass(git_transport_new(&t, url.ptr));
+	cl_git_pass(t->connect(t, GIT_DIR_FETCH));
+
+	cl_assert(t->caps.common);
+	cl_assert(t->caps.ofs_delta);
+	cl_assert(t->caps.thin_pack);
+
+	t->close(t);
+	t->free(t);
+	git_buf_free(&url);
+}
+
+#else
+
+void test_network_http__capabilities_are_detected(void)
+{
+}
+
+#endif
@@ -0,0 +1,376 @@
+#include "clar_libgit2.h"
+#include "buffer.h"
+#include "fileops.h"
+#include "path.h"
+#include "hash.h"
+#include "posix.h"
+#include <zlib.h>
+
+#define PACK_DIR "testrepo.git/objects/pack/"
+
+static const char *packs[] = {
+	"pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695",
+	"pack-d7c6adf9f61318f041845b01440d09aa7a91e1b5",
+	"pack-d85f5d483273108c9d8dd0e4728ccf0b2982423a",
+};
+
+void test_network_indexer__initialize(void)
+{
+	cl_fixture_sandbox("testrepo.git");
+}
+
+void test_network_indexer__cleanup(void)
+{
+	cl_fixture_cleanup("testrepo.git");
+}
+
+/*
+ * Index every pack in the fixture again and make sure we come
+ * up with exactly the same .idx git wrote for it
+ */
+static void reindex_all(unsigned int threads)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(packs); ++i) {
+		git_buf pack_path = GIT_BUF_INIT, idx_path = GIT_BUF_INIT;
+		git_buf expected = GIT_BUF_INIT, actual = GIT_BUF_INIT;
+		git_indexer *idx;
+		git_indexer_stats stats;
+		char hash[GIT_OID_HEXSZ + 1];
+
+		/* the indexer wants an absolute path */
+		cl_git_pass(git_buf_printf(&idx_path, PACK_DIR "%s.pack", packs[i]));
+		cl_git_pass(git_path_prettify(&pack_path, idx_path.ptr, NULL));
+
+		git_buf_clear(&idx_path);
+		cl_git_pass(git_buf_printf(&idx_path, PACK_DIR "%s.idx", packs[i]));
+
+		cl_git_pass(git_futils_readbuffer(&expected, idx_path.ptr));
+		cl_git_pass(p_unlink(idx_path.ptr));
+
+		cl_git_pass(git_indexer_new(&idx, pack_path.ptr));
+		git_indexer_set_threads(idx, threads);
+		cl_git_pass(git_indexer_run(idx, &stats));
+		cl_assert(stats.total > 0);
+		cl_assert(stats.processed == stats.total);
+		cl_git_pass(git_indexer_write(idx));
+
+		git_oid_fmt(hash, git_indexer_hash(idx));
+		hash[GIT_OID_HEXSZ] = '\0';
+		cl_assert(strcmp(hash, packs[i] + strlen("pack-")) == 0);
+		git_indexer_free(idx);
+
+		cl_git_pass(git_futils_readbuffer(&actual, idx_path.ptr));
+		cl_assert(actual.size == expected.size);
+		cl_assert(memcmp(actual.ptr, expected.ptr, actual.size) == 0);
+
+		git_buf_free(&pack_path);
+		git_buf_free(&idx_path);
+		git_buf_free(&expected);
+		git_buf_free(&actual);
+	}
+}
+
+void test_network_indexer__single_thread(void)
+{
+	reindex_all(1);
+}
+
+void test_network_indexer__many_threads(void)
+{
+	reindex_all(4);
+}
+
+void test_network_indexer__default_threads(void)
+{
+	reindex_all(0);
+}
+
+/*
+ * Feed a pack to the streaming indexer a few bytes at a time, the
+ * way it would come off the network
+ */
+static int stream_pack(git_indexer_stream **out, const char *dir,
+	const git_buf *pack, size_t chunk, git_odb *odb, git_indexer_stats *stats)
+{
+	git_indexer_stream *s;
+	size_t off;
+	int error;
+
+	cl_git_pass(git_indexer_stream_new(&s, dir));
+	if (odb != NULL)
+		git_indexer_stream_set_odb(s, odb);
+
+	for (off = 0; off < pack->size; off += chunk) {
+		size_t len = min(chunk, pack->size - off);
+
+		if ((error = git_indexer_stream_add(s, pack->ptr + off, len, stats)) < GIT_SUCCESS)
+			break;
+	}
+
+	*out = s;
+	return git_indexer_stream_finalize(s, stats);
+}
+
+void test_network_indexer__stream(void)
+{
+	size_t i;
+
+	cl_git_pass(p_mkdir("received", 0777));
+
+	for (i = 0; i < ARRAY_SIZE(packs); ++i) {
+		git_buf path = GIT_BUF_INIT, pack = GIT_BUF_INIT;
+		git_buf expected = GIT_BUF_INIT, actual = GIT_BUF_INIT;
+		git_indexer_stream *s;
+		git_indexer_stats stats;
+		char hash[GIT_OID_HEXSZ + 1];
+
+		cl_git_pass(git_buf_printf(&path, PACK_DIR "%s.pack", packs[i]));
+		cl_git_pass(git_futils_readbuffer(&pack, path.ptr));
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, PACK_DIR "%s.idx", packs[i]));
+		cl_git_pass(git_futils_readbuffer(&expected, path.ptr));
+
+		cl_git_pass(stream_pack(&s, "received", &pack, 7, NULL, &stats));
+		cl_assert(stats.total > 0);
+		cl_assert(stats.processed == stats.total);
+
+		git_oid_fmt(hash, git_indexer_stream_hash(s));
+		hash[GIT_OID_HEXSZ] = '\0';
+		cl_assert(strcmp(hash, packs[i] + strlen("pack-")) == 0);
+		git_indexer_stream_free(s);
+
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "received/%s.pack", packs[i]));
+		cl_git_pass(git_futils_readbuffer(&actual, path.ptr));
+		cl_assert(actual.size == pack.size);
+		cl_assert(memcmp(actual.ptr, pack.ptr, pack.size) == 0);
+
+		git_buf_clear(&path);
+		git_buf_free(&actual);
+		cl_git_pass(git_buf_printf(&path, "received/%s.idx", packs[i]));
+		cl_git_pass(git_futils_readbuffer(&actual, path.ptr));
+		cl_assert(actual.size == expected.size);
+		cl_assert(memcmp(actual.ptr, expected.ptr, actual.size) == 0);
+
+		git_buf_free(&path);
+		git_buf_free(&pack);
+		git_buf_free(&expected);
+		git_buf_free(&actual);
+	}
+
+	cl_git_pass(git_futils_rmdir_r("received", 1));
+}
+
+void test_network_indexer__stream_rejects_bad_packs(void)
+{
+	git_buf pack = GIT_BUF_INIT;
+	git_indexer_stream *s;
+	git_indexer_stats stats;
+	size_t size;
+
+	cl_git_pass(p_mkdir("received", 0777));
+	cl_git_pass(git_futils_readbuffer(&pack, PACK_DIR "pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.pack"));
+
+	/* truncated in the middle of the trailer */
+	size = pack.size;
+	pack.size -= 5;
+	cl_git_fail(stream_pack(&s, "received", &pack, 64, NULL, &stats));
+	git_indexer_stream_free(s);
+	pack.size = size;
+
+	/* the checksum doesn't match the data */
+	pack.ptr[pack.size - 1] ^= 0xff;
+	cl_git_fail(stream_pack(&s, "received", &pack, 64, NULL, &stats));
+	git_indexer_stream_free(s);
+
+	git_buf_free(&pack);
+
+	/* nothing may be left behind */
+	cl_git_pass(p_rmdir("received"));
+}
+
+void test_network_indexer__stream_cleans_up_when_the_index_cant_be_written(void)
+{
+	git_buf pack = GIT_BUF_INIT;
+	git_indexer_stream *s;
+	git_indexer_stats stats;
+
+	cl_git_pass(git_futils_readbuffer(&pack, PACK_DIR "pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.pack"));
+
+	/* somebody else is writing the index */
+	cl_git_pass(git_futils_mkdir_r("received/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.idx.lock", NULL, 0777));
+
+	cl_git_fail(stream_pack(&s, "received", &pack, 64, NULL, &stats));
+	git_indexer_stream_free(s);
+	git_buf_free(&pack);
+
+	/* neither the pack nor the temporary file are left behind */
+	cl_assert(git_path_exists("received/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.pack") < 0);
+	cl_git_pass(p_rmdir("received/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.idx.lock"));
+	cl_git_pass(p_rmdir("received"));
+}
+
+void test_network_indexer__thin_pack_is_completed(void)
+{
+	git_buf pack = GIT_BUF_INIT;
+	git_indexer_stream *s;
+	git_indexer_stats stats;
+	git_odb *odb;
+	git_odb_object *obj;
+	git_oid id;
+
+	/* one commit on top of objects which are only in testrepo.git */
+	cl_git_pass(git_futils_readbuffer(&pack, cl_fixture("thin.pack")));
+
+	/* on its own, the pack is missing a base */
+	cl_git_pass(p_mkdir("received", 0777));
+	cl_git_fail(stream_pack(&s, "received", &pack, 64, NULL, &stats));
+	git_indexer_stream_free(s);
+	cl_git_pass(p_rmdir("received"));
+
+	cl_git_pass(git_odb_open(&odb, "testrepo.git/objects"));
+	cl_git_pass(stream_pack(&s, PACK_DIR, &pack, 64, odb, &stats));
+	cl_assert(stats.total == 4);
+	cl_assert(stats.processed == 4);
+	git_indexer_stream_free(s);
+	git_odb_free(odb);
+	git_buf_free(&pack);
+
+	/* the stored pack stands on its own */
+	cl_git_pass(git_odb_open(&odb, "testrepo.git/objects"));
+
+	cl_git_pass(git_oid_fromstr(&id, "0732a5969dd0342805544288231fd8156d6d78e8"));
+	cl_git_pass(git_odb_read(&obj, odb, &id));
+	cl_assert(git_odb_object_type(obj) == GIT_OBJ_BLOB);
+	cl_assert(git_odb_object_size(obj) == 32618 + strlen("A new first line\n"));
+	git_odb_object_free(obj);
+
+	cl_git_pass(git_oid_fromstr(&id, "95224f071677efafa739100bd43eb5db51267b14"));
+	cl_git_pass(git_odb_read(&obj, odb, &id));
+	cl_assert(git_odb_object_type(obj) == GIT_OBJ_COMMIT);
+	git_odb_object_free(obj);
+
+	git_odb_free(odb);
+}
+
+/* Append an object to `pack`; `base` is the distance to its base, for an ofs-delta */
+static void append_entry(git_buf *pack, git_otype type, size_t base, const void *data, size_t len)
+{
+	unsigned char hdr[10], *out;
+	size_t n = 0, size = len;
+	uLong out_len = compressBound((uLong)len);
+
+	hdr[n] = (unsigned char)((type << 4) | (size & 15));
+	for (size >>= 4; size; size >>= 7) {
+		hdr[n++] |= 0x80;
+		hdr[n] = size & 0x7f;
+	}
+	cl_git_pass(git_buf_put(pack, (const char *)hdr, n + 1));
+
+	/* small distances fit in one byte */
+	if (type == GIT_OBJ_OFS_DELTA) {
+		cl_assert(base < 0x80);
+		cl_git_pass(git_buf_putc(pack, (char)base));
+	}
+
+	out = git__malloc(out_len);
+	cl_assert(out != NULL);
+	cl_assert(compress(out, &out_len, data, (uLong)len) == Z_OK);
+	cl_git_pass(git_buf_put(pack, (const char *)out, out_len));
+	git__free(out);
+}
+
+void test_network_indexer__errors_on_worker_threads_are_reported(void)
+{
+	static const char header[] = { 'P', 'A', 'C', 'K', 0, 0, 0, 2, 0, 0, 0, 2 * 32 };
+	/* a delta on a base of 99 bytes, when the bases have 9 */
+	static const unsigned char delta[] = { 99, 7, 0x80 | 0x10, 6, 0x01, '!' };
+	git_buf pack = GIT_BUF_INIT, path = GIT_BUF_INIT;
+	git_indexer *idx;
+	git_indexer_stats stats;
+	git_oid checksum;
+	size_t i, base;
+	int fd;
+
+	/* enough broken deltas to keep every thread busy */
+	cl_git_pass(git_buf_put(&pack, header, sizeof(header)));
+	for (i = 0; i < 32; ++i) {
+		char blob[10];
+
+		sprintf(blob, "hello %02u\n", (unsigned int)i);
+		base = pack.size;
+		append_entry(&pack, GIT_OBJ_BLOB, 0, blob, 9);
+		append_entry(&pack, GIT_OBJ_OFS_DELTA, pack.size - base, delta, sizeof(delta));
+	}
+
+	git_hash_buf(&checksum, pack.ptr, pack.size);
+	cl_git_pass(git_buf_put(&pack, (const char *)checksum.id, GIT_OID_RAWSZ));
+
+	fd = p_creat("bad.pack", 0644);
+	cl_assert(fd >= 0);
+	cl_git_pass(p_write(fd, pack.ptr, pack.size));
+	p_close(fd);
+	git_buf_free(&pack);
+
+	/* whichever thread fails, its message makes it back here */
+	cl_git_pass(git_path_prettify(&path, "bad.pack", NULL));
+	cl_git_pass(git_indexer_new(&idx, path.ptr));
+	git_indexer_set_threads(idx, 4);
+
+	git_clearerror();
+	cl_git_fail(git_indexer_run(idx, &stats));
+	cl_assert(strstr(git_lasterror(), "Base size does not match") != NULL);
+
+	git_indexer_free(idx);
+	git_buf_free(&path);
+	cl_git_pass(p_unlink("bad.pack"));
+}
+
+void test_network_indexer__deep_delta_chains(void)
+{
+	static const char header[] = { 'P', 'A', 'C', 'K', 0, 0, 0, 2, 0, 0x01, 0x86, 0xa1 };
+	/* each object is its base shifted by three bytes */
+	unsigned char delta[] = { 20, 20, 0x80 | 0x10 | 0x01, 3, 17, 3, 0, 0, 0 };
+	git_buf pack = GIT_BUF_INIT, path = GIT_BUF_INIT;
+	git_indexer *idx;
+	git_indexer_stats stats;
+	git_oid checksum;
+	size_t i, base;
+	int fd;
+
+	/* 100000 deltas, each on the one before */
+	cl_git_pass(git_buf_put(&pack, header, sizeof(header)));
+	base = pack.size;
+	append_entry(&pack, GIT_OBJ_BLOB, 0, "a blob of 20 bytes.\n", 20);
+
+	for (i = 0; i < 100000; ++i) {
+		size_t start = pack.size;
+
+		delta[6] = (unsigned char)i;
+		delta[7] = (unsigned char)(i >> 8);
+		delta[8] = (unsigned char)(i >> 16);
+		append_entry(&pack, GIT_OBJ_OFS_DELTA, start - base, delta, sizeof(delta));
+		base = start;
+	}
+
+	git_hash_buf(&checksum, pack.ptr, pack.size);
+	cl_git_pass(git_buf_put(&pack, (const char *)checksum.id, GIT_OID_RAWSZ));
+
+	fd = p_creat("deep.pack", 0644);
+	cl_assert(fd >= 0);
+	cl_git_pass(p_write(fd, pack.ptr, pack.size));
+	p_close(fd);
+	git_buf_free(&pack);
+
+	cl_git_pass(git_path_prettify(&path, "deep.pack", NULL));
+	cl_git_pass(git_indexer_new(&idx, path.ptr));
+	cl_git_pass(git_indexer_run(idx, &stats));
+	cl_assert(stats.total == 100001);
+	cl_assert(stats.processed == 100001);
+
+	git_indexer_free(idx);
+	git_buf_free(&path);
+	cl_git_pass(p_unlink("deep.pack"));
+}
@@ -0,0 +1,109 @@
+#include "clar_libgit2.h"
+#include "posix.h"
+#include "buffer.h"
+
+static git_repository *g_repo;
+
+#define NUM_FILES 40
+
+/* small files, a big one, a filtered one and a link */
+static const char *g_paths[NUM_FILES + 3];
+static char g_names[NUM_FILES][32];
+static size_t g_count;
+
+static void write_file(const char *path, const char *data, size_t len)
+{
+	git_buf full = GIT_BUF_INIT;
+	int fd;
+
+	cl_git_pass(git_buf_joinpath(&full, "empty_standard_repo", path));
+
+	fd = p_creat(full.ptr, 0644);
+	cl_assert(fd >= 0);
+	cl_git_pass(p_write(fd, data, len));
+	p_close(fd);
+
+	git_buf_free(&full);
+}
+
+void test_object_blob_fromfiles__initialize(void)
+{
+	char *data;
+	size_t i, len = 2 * 1024 * 1024;
+
+	cl_fixture_sandbox("empty_standard_repo");
+	cl_git_pass(p_rename(
+		"empty_standard_repo/.gitted", "empty_standard_repo/.git"));
+	cl_git_pass(git_repository_open(&g_repo, "empty_standard_repo"));
+
+	data = git__malloc(len);
+	cl_assert(data != NULL);
+
+	for (i = 0; i < len; ++i)
+		data[i] = (char)(i * 11 + (i >> 9));
+
+	g_count = 0;
+
+	for (i = 0; i < NUM_FILES; ++i) {
+		sprintf(g_names[i], "file-%02u", (unsigned int)i);
+		write_file(g_names[i], data + i, i * 53);
+		g_paths[g_count++] = g_names[i];
+	}
+
+	write_file("big", data, len);
+	g_paths[g_count++] = "big";
+
+	write_file(".gitattributes", "*.txt text\n", 11);
+	write_file("crlf.txt", "foo\r\nbar\r\n", 10);
+	g_paths[g_count++] = "crlf.txt";
+
+#ifndef GIT_WIN32
+	cl_git_pass(symlink("file-07", "empty_standard_repo/link"));
+	g_paths[g_count++] = "link";
+#endif
+
+	git__free(data);
+}
+
+void test_object_blob_fromfiles__cleanup(void)
+{
+	git_repository_free(g_repo);
+	g_repo = NULL;
+	cl_fixture_cleanup("empty_standard_repo");
+}
+
+void test_object_blob_fromfiles__same_as_one_at_a_time(void)
+{
+	git_oid oids[NUM_FILES + 3], oid;
+	git_odb *odb;
+	size_t i;
+
+	/* some of them are there already */
+	cl_git_pass(git_blob_create_fromfile(&oid, g_repo, g_paths[3]));
+	cl_git_pass(git_blob_create_fromfile(&oid, g_repo, "crlf.txt"));
+
+	cl_git_pass(git_blob_create_fromfiles(oids, g_repo, g_paths, g_count));
+	cl_git_pass(git_repository_odb(&odb, g_repo));
+
+	for (i = 0; i < g_count; ++i) {
+		cl_assert(git_odb_exists(odb, &oids[i]));
+
+		cl_git_pass(git_blob_create_fromfile(&oid, g_repo, g_paths[i]));
+		cl_assert(git_oid_cmp(&oid, &oids[i]) == 0);
+	}
+
+	/* the line endings were filtered */
+	cl_git_pass(git_odb_hash(&oid, "foo\nbar\n", 8, GIT_OBJ_BLOB));
+	cl_assert(git_oid_cmp(&oid, &oids[NUM_FILES + 1]) == 0);
+
+	git_odb_free(odb);
+}
+
+void test_object_blob_fromfiles__fails_on_a_missing_file(void)
+{
+	const char *paths[] = { "file-01", "nope", "file-02" };
+	git_oid oids[3];
+
+	cl_git_fail(git_blob_create_fromfiles(oids, g_repo, paths, 3));
+	cl_git_pass(git_blob_create_fromfiles(oids, g_repo, paths, 0));
+}
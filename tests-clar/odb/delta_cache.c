@@ -0,0 +1,68 @@
+#include "clar_libgit2.h"
+#include "odb.h"
+
+static git_odb *_odb;
+
+/* 4730b72 is a delta on top of 04c9c16, which is itself a delta */
+static const char *deep_delta = "4730b7224276579fcc8fc7fdb9bf796ef158fde4";
+static const char *delta_base = "04c9c16e55c53fc12c2eed43e3d7e42f78fe7005";
+
+void test_odb_delta_cache__initialize(void)
+{
+	cl_git_pass(git_odb_open(&_odb, cl_fixture("testrepo.git/objects")));
+}
+
+void test_odb_delta_cache__cleanup(void)
+{
+	git_odb_free(_odb);
+	git_odb_set_delta_cache_limit(16 * 1024 * 1024);
+}
+
+static void read_object(const char *sha)
+{
+	git_oid id;
+	git_odb_object *obj;
+
+	cl_git_pass(git_oid_fromstr(&id, sha));
+	cl_git_pass(git_odb_read(&obj, _odb, &id));
+	git_odb_object_free(obj);
+}
+
+void test_odb_delta_cache__default_limit(void)
+{
+	git_odb_delta_cache_stats stats;
+
+	git_odb_get_delta_cache_stats(&stats);
+	cl_assert(stats.limit == 16 * 1024 * 1024);
+}
+
+void test_odb_delta_cache__shared_base_is_reused(void)
+{
+	git_odb_delta_cache_stats before, after;
+
+	read_object(deep_delta);
+
+	git_odb_get_delta_cache_stats(&before);
+	read_object(delta_base);
+	git_odb_get_delta_cache_stats(&after);
+
+	cl_assert(after.hits == before.hits + 1);
+	cl_assert(after.misses == before.misses);
+}
+
+void test_odb_delta_cache__can_be_disabled(void)
+{
+	git_odb_delta_cache_stats before, after;
+
+	git_odb_set_delta_cache_limit(0);
+
+	read_object(deep_delta);
+
+	git_odb_get_delta_cache_stats(&before);
+	read_object(delta_base);
+	git_odb_get_delta_cache_stats(&after);
+
+	cl_assert(after.limit == 0);
+	cl_assert(after.hits == before.hits);
+	cl_assert(after.misses == before.misses + 1);
+}
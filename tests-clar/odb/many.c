@@ -0,0 +1,122 @@
+#include "clar_libgit2.h"
+#include "odb.h"
+
+static git_odb *_odb;
+
+/* packed, some of them deltas, and loose, in no particular order */
+static const char *ids[] = {
+	"4730b7224276579fcc8fc7fdb9bf796ef158fde4",
+	"a65fedf39aefe402d3bb6e24df4d4f5fe4547750",
+	"acf362a92101202f5f09c9b51db352be27b5bf7e",
+	"0000000000000000000000000000000000000001",
+	"e34dee0c7f0ac8abf228369e1016eb6016c40758",
+	"944c0f6e4dfa41595e6eb3ceecdb14f50fe18162",
+	"04c9c16e55c53fc12c2eed43e3d7e42f78fe7005",
+	"4730b7224276579fcc8fc7fdb9bf796ef158fde4",
+	"ffffffffffffffffffffffffffffffffffffffff",
+	"5fdc7166eac68b0b0923439b8685a29ff4c2be27",
+};
+
+#define ID_COUNT (sizeof(ids) / sizeof(ids[0]))
+
+static int is_missing(size_t i)
+{
+	return i == 3 || i == 8;
+}
+
+static git_oid _oids[ID_COUNT];
+
+void test_odb_many__initialize(void)
+{
+	size_t i;
+
+	cl_git_pass(git_odb_open(&_odb, cl_fixture("testrepo.git/objects")));
+
+	for (i = 0; i < ID_COUNT; ++i)
+		cl_git_pass(git_oid_fromstr(&_oids[i], ids[i]));
+}
+
+void test_odb_many__cleanup(void)
+{
+	git_odb_free(_odb);
+}
+
+static void assert_same_as_read(git_odb_object *obj, const git_oid *id)
+{
+	git_odb_object *expected;
+
+	cl_git_pass(git_odb_read(&expected, _odb, id));
+
+	cl_assert(git_oid_cmp(git_odb_object_id(obj), id) == 0);
+	cl_assert(git_odb_object_type(obj) == git_odb_object_type(expected));
+	cl_assert(git_odb_object_size(obj) == git_odb_object_size(expected));
+	cl_assert(memcmp(git_odb_object_data(obj), git_odb_object_data(expected),
+		git_odb_object_size(obj)) == 0);
+
+	git_odb_object_free(expected);
+}
+
+void test_odb_many__read_everything_there_is(void)
+{
+	git_odb_object *objs[ID_COUNT];
+	size_t i;
+
+	cl_assert(git_odb_read_many(objs, _odb, _oids, ID_COUNT) == GIT_ENOTFOUND);
+
+	for (i = 0; i < ID_COUNT; ++i) {
+		if (is_missing(i)) {
+			cl_assert(objs[i] == NULL);
+			continue;
+		}
+
+		cl_assert(objs[i] != NULL);
+		assert_same_as_read(objs[i], &_oids[i]);
+		git_odb_object_free(objs[i]);
+	}
+}
+
+void test_odb_many__read_from_the_cache_and_the_backends(void)
+{
+	git_odb_object *cached, *objs[3];
+	git_oid some[3];
+
+	/* the first one is in the cache now */
+	cl_git_pass(git_odb_read(&cached, _odb, &_oids[2]));
+
+	git_oid_cpy(&some[0], &_oids[2]);
+	git_oid_cpy(&some[1], &_oids[1]);
+	git_oid_cpy(&some[2], &_oids[0]);
+
+	cl_git_pass(git_odb_read_many(objs, _odb, some, 3));
+
+	cl_assert(objs[0] == cached);
+	assert_same_as_read(objs[1], &some[1]);
+	assert_same_as_read(objs[2], &some[2]);
+
+	git_odb_object_free(cached);
+	git_odb_object_free(objs[0]);
+	git_odb_object_free(objs[1]);
+	git_odb_object_free(objs[2]);
+}
+
+void test_odb_many__nothing_to_read(void)
+{
+	git_odb_object *obj = NULL;
+
+	cl_git_pass(git_odb_read_many(&obj, _odb, _oids, 0));
+	cl_assert(obj == NULL);
+}
+
+void test_odb_many__exists(void)
+{
+	int found[ID_COUNT];
+	size_t i;
+
+	memset(found, 0x7, sizeof(found));
+	cl_git_pass(git_odb_exists_many(found, _odb, _oids, ID_COUNT));
+
+	for (i = 0; i < ID_COUNT; ++i) {
+		cl_assert(found[i] == !is_missing(i));
+		cl_assert(found[i] == git_odb_exists(_odb, &_oids[i]));
+	}
+}
@@ -0,0 +1,202 @@
+#include "clar_libgit2.h"
+#include "odb.h"
+#include "midx.h"
+#include "pack_data.h"
+#include "hash.h"
+#include "buffer.h"
+#include "fileops.h"
+#include "posix.h"
+
+#define MIDX_PATH "testrepo.git/objects/pack/multi-pack-index"
+
+static git_odb *_odb;
+
+void test_odb_midx__initialize(void)
+{
+	cl_fixture_sandbox("testrepo.git");
+	cl_git_pass(git_odb_open(&_odb, "testrepo.git/objects"));
+}
+
+void test_odb_midx__cleanup(void)
+{
+	git_odb_free(_odb);
+	cl_fixture_cleanup("testrepo.git");
+}
+
+static void read_all_packed(git_odb *odb)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(packed_objects); ++i) {
+		git_oid id;
+		git_odb_object *obj;
+
+		cl_git_pass(git_oid_fromstr(&id, packed_objects[i]));
+		cl_assert(git_odb_exists(odb, &id) == 1);
+		cl_git_pass(git_odb_read(&obj, odb, &id));
+		cl_assert(git_oid_cmp(&id, git_odb_object_id(obj)) == 0);
+
+		git_odb_object_free(obj);
+	}
+}
+
+void test_odb_midx__write_indexes_every_packed_object(void)
+{
+	git_midx_file *midx;
+	git_midx_entry e;
+	unsigned int i;
+
+	cl_git_pass(git_odb_write_multi_pack_index(_odb));
+	cl_git_pass(git_midx_open(&midx, MIDX_PATH));
+
+	cl_assert(midx->packfile_names.length == 3);
+	cl_assert(strcmp(git_vector_get(&midx->packfile_names, 0),
+		"pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.idx") == 0);
+
+	for (i = 0; i < ARRAY_SIZE(packed_objects); ++i) {
+		git_oid id;
+
+		cl_git_pass(git_oid_fromstr(&id, packed_objects[i]));
+		cl_git_pass(git_midx_entry_find(&e, midx, &id, GIT_OID_HEXSZ));
+		cl_assert(git_oid_cmp(&id, &e.sha1) == 0);
+		cl_assert(e.offset > 0);
+	}
+
+	git_midx_free(midx);
+}
+
+void test_odb_midx__lookups_go_through_the_index(void)
+{
+	git_odb *odb;
+
+	cl_git_pass(git_odb_write_multi_pack_index(_odb));
+
+	/* both the writer and a fresh odb must find everything */
+	read_all_packed(_odb);
+
+	cl_git_pass(git_odb_open(&odb, "testrepo.git/objects"));
+	read_all_packed(odb);
+	git_odb_free(odb);
+}
+
+void test_odb_midx__prefix_lookups(void)
+{
+	git_oid id, short_id;
+	git_odb_object *obj;
+
+	cl_git_pass(git_odb_write_multi_pack_index(_odb));
+
+	cl_git_pass(git_oid_fromstr(&id, packed_objects[0]));
+	cl_git_pass(git_oid_fromstrn(&short_id, packed_objects[0], 8));
+
+	cl_git_pass(git_odb_read_prefix(&obj, _odb, &short_id, 8));
+	cl_assert(git_oid_cmp(&id, git_odb_object_id(obj)) == 0);
+	git_odb_object_free(obj);
+}
+
+void test_odb_midx__rewriting_is_stable(void)
+{
+	git_midx_file *midx;
+	git_oid checksum;
+
+	cl_git_pass(git_odb_write_multi_pack_index(_odb));
+	cl_git_pass(git_midx_open(&midx, MIDX_PATH));
+	git_oid_cpy(&checksum, &midx->checksum);
+	git_midx_free(midx);
+
+	cl_git_pass(git_odb_write_multi_pack_index(_odb));
+	cl_git_pass(git_midx_open(&midx, MIDX_PATH));
+	cl_assert(git_oid_cmp(&checksum, &midx->checksum) == 0);
+	git_midx_free(midx);
+}
+
+void test_odb_midx__corrupted_index_is_ignored(void)
+{
+	git_odb *odb;
+	git_midx_file *midx;
+
+	cl_git_mkfile(MIDX_PATH, "MIDX this is not a multi-pack-index");
+	cl_git_fail(git_midx_open(&midx, MIDX_PATH));
+
+	cl_git_pass(git_odb_open(&odb, "testrepo.git/objects"));
+	read_all_packed(odb);
+	git_odb_free(odb);
+}
+
+/* Change the written index with `fn`, and fix up its checksum if asked */
+static void rewrite_midx(void (*fn)(unsigned char *, size_t), int fix_checksum)
+{
+	git_buf buf = GIT_BUF_INIT;
+	git_oid checksum;
+	int fd;
+
+	cl_git_pass(git_odb_write_multi_pack_index(_odb));
+	cl_git_pass(git_futils_readbuffer(&buf, MIDX_PATH));
+
+	fn((unsigned char *)buf.ptr, buf.size);
+
+	if (fix_checksum) {
+		git_hash_buf(&checksum, buf.ptr, buf.size - GIT_OID_RAWSZ);
+		memcpy(buf.ptr + buf.size - GIT_OID_RAWSZ, checksum.id, GIT_OID_RAWSZ);
+	}
+
+	cl_git_pass(p_unlink(MIDX_PATH));
+	fd = p_creat(MIDX_PATH, 0644);
+	cl_assert(fd >= 0);
+	cl_git_pass(p_write(fd, buf.ptr, buf.size));
+	p_close(fd);
+
+	git_buf_free(&buf);
+}
+
+static void flip_a_byte(unsigned char *data, size_t size)
+{
+	data[size / 2] ^= 0x40;
+}
+
+/* Add 2^30 to the object count: times 8 or 20, it wraps back */
+static void wrap_object_count(unsigned char *data, size_t size)
+{
+	unsigned int i, num_chunks = data[6];
+	uint32_t n;
+
+	GIT_UNUSED(size);
+
+	for (i = 0; i < num_chunks; ++i) {
+		const unsigned char *toc = data + 12 + i * 12;
+		unsigned char *fanout;
+
+		if (memcmp(toc, "OIDF", 4) != 0)
+			continue;
+
+		/* the offsets are all small enough for the low half */
+		memcpy(&n, toc + 8, 4);
+		fanout = data + ntohl(n);
+
+		memcpy(&n, fanout + 255 * 4, 4);
+		n = htonl(ntohl(n) + (1u << 30));
+		memcpy(fanout + 255 * 4, &n, 4);
+		return;
+	}
+
+	cl_fail("No fanout chunk");
+}
+
+void test_odb_midx__checksum_mismatch_is_refused(void)
+{
+	git_midx_file *midx;
+
+	rewrite_midx(flip_a_byte, 0);
+	cl_git_fail(git_midx_open(&midx, MIDX_PATH));
+}
+
+void test_odb_midx__object_count_that_wraps_is_refused(void)
+{
+	git_midx_file *midx;
+
+	rewrite_midx(wrap_object_count, 1);
+	cl_git_fail(git_midx_open(&midx, MIDX_PATH));
+
+	/* before reading a single object id past the chunk */
+	cl_assert(strstr(git_lasterror(), "Wrong OID lookup size") != NULL);
+}
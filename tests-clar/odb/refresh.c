@@ -0,0 +1,129 @@
+#include "clar_libgit2.h"
+#include "odb.h"
+#include "posix.h"
+#include "buffer.h"
+#include "git2/odb_backend.h"
+
+#define PACK_FOLDER "testrepo.git/objects/pack"
+#define MOVED_PACK "pack-d85f5d483273108c9d8dd0e4728ccf0b2982423a"
+
+static git_odb *_odb;
+
+/* one from each of the other packs, and one from the moved one */
+static const char *known_id = "41bc8c69075bbdb46c5c6f0566cc8cc5b46e8bd9";
+static const char *other_id = "fb20a5a4b6185d9188d82c874db3d9729ef31f3b";
+static const char *moved_id = "e90810b8df3e80c413d903f631643c716887138d";
+
+static void move_pack(const char *from, const char *to)
+{
+	git_buf src = GIT_BUF_INIT, dst = GIT_BUF_INIT;
+
+	cl_git_pass(git_buf_printf(&src, "%s/" MOVED_PACK ".pack", from));
+	cl_git_pass(git_buf_printf(&dst, "%s/" MOVED_PACK ".pack", to));
+	cl_git_pass(p_rename(src.ptr, dst.ptr));
+
+	git_buf_clear(&src);
+	git_buf_clear(&dst);
+
+	cl_git_pass(git_buf_printf(&src, "%s/" MOVED_PACK ".idx", from));
+	cl_git_pass(git_buf_printf(&dst, "%s/" MOVED_PACK ".idx", to));
+	cl_git_pass(p_rename(src.ptr, dst.ptr));
+
+	git_buf_free(&src);
+	git_buf_free(&dst);
+}
+
+void test_odb_refresh__initialize(void)
+{
+	git_odb_backend *backend;
+
+	cl_fixture_sandbox("testrepo.git");
+	move_pack(PACK_FOLDER, "testrepo.git");
+
+	/* only the packs, so nothing is found as a loose object */
+	cl_git_pass(git_odb_new(&_odb));
+	cl_git_pass(git_odb_backend_pack(&backend, "testrepo.git/objects"));
+	cl_git_pass(git_odb_add_backend(_odb, backend, 1));
+
+	/* never on its own, in these tests */
+	git_odb_set_pack_refresh_interval(3600);
+}
+
+void test_odb_refresh__cleanup(void)
+{
+	git_odb_free(_odb);
+	git_odb_set_pack_refresh_interval(0);
+	cl_fixture_cleanup("testrepo.git");
+}
+
+static int exists(const char *sha)
+{
+	git_oid id;
+
+	cl_git_pass(git_oid_fromstr(&id, sha));
+	return git_odb_exists(_odb, &id);
+}
+
+void test_odb_refresh__new_packs_are_seen_once_refreshed(void)
+{
+	cl_assert(exists(known_id));
+	cl_assert(!exists(moved_id));
+
+	move_pack("testrepo.git", PACK_FOLDER);
+	cl_assert(!exists(moved_id));
+
+	cl_git_pass(git_odb_refresh(_odb));
+	cl_assert(exists(moved_id));
+	cl_assert(exists(known_id));
+}
+
+void test_odb_refresh__batches_see_them_too(void)
+{
+	git_oid ids[2];
+	int found[2];
+
+	cl_git_pass(git_oid_fromstr(&ids[0], known_id));
+	cl_git_pass(git_oid_fromstr(&ids[1], moved_id));
+
+	move_pack("testrepo.git", PACK_FOLDER);
+	cl_git_pass(git_odb_refresh(_odb));
+
+	cl_git_pass(git_odb_exists_many(found, _odb, ids, 2));
+	cl_assert(found[0] && found[1]);
+}
+
+void test_odb_refresh__finding_an_object_does_not_look_at_the_folder(void)
+{
+	git_odb_object *obj;
+	git_oid id;
+
+	cl_assert(exists(known_id));
+	cl_assert(exists(other_id));
+
+	/* the packs we know about are still open */
+	cl_git_pass(p_rename(PACK_FOLDER, "testrepo.git/objects/elsewhere"));
+
+	cl_assert(exists(known_id));
+	cl_assert(exists(other_id));
+
+	cl_git_pass(git_oid_fromstr(&id, known_id));
+	cl_git_pass(git_odb_read(&obj, _odb, &id));
+	git_odb_object_free(obj);
+
+	cl_git_pass(p_rename("testrepo.git/objects/elsewhere", PACK_FOLDER));
+}
+
+void test_odb_refresh__misses_look_for_new_packs_by_default(void)
+{
+	struct utimbuf times;
+
+	git_odb_set_pack_refresh_interval(0);
+	cl_assert(!exists(moved_id));
+
+	/* in another second than the last look, for the folder to tell */
+	move_pack("testrepo.git", PACK_FOLDER);
+	times.actime = times.modtime = time(NULL) + 10;
+	cl_must_pass(p_utime(PACK_FOLDER, &times));
+
+	cl_assert(exists(moved_id));
+}
@@ -0,0 +1,141 @@
+#include "clar_libgit2.h"
+#include "odb.h"
+#include "buffer.h"
+#include "git2/odb_backend.h"
+
+static git_odb *_odb;
+
+/* e34dee0 is packed whole, acf362a is a delta on top of it */
+static const char *packed_whole = "e34dee0c7f0ac8abf228369e1016eb6016c40758";
+static const char *packed_delta = "acf362a92101202f5f09c9b51db352be27b5bf7e";
+static const char *deep_delta = "4730b7224276579fcc8fc7fdb9bf796ef158fde4";
+
+static const char *loose_commit = "a65fedf39aefe402d3bb6e24df4d4f5fe4547750";
+static const char *loose_tree = "944c0f6e4dfa41595e6eb3ceecdb14f50fe18162";
+
+void test_odb_streams__initialize(void)
+{
+	cl_fixture_sandbox("testrepo.git");
+	cl_git_pass(git_odb_open(&_odb, "testrepo.git/objects"));
+}
+
+void test_odb_streams__cleanup(void)
+{
+	git_odb_free(_odb);
+	cl_fixture_cleanup("testrepo.git");
+}
+
+static void open_backend_only(int (*open_backend)(git_odb_backend **, const char *))
+{
+	git_odb_backend *backend;
+
+	git_odb_free(_odb);
+	cl_git_pass(git_odb_new(&_odb));
+	cl_git_pass(open_backend(&backend, "testrepo.git/objects"));
+	cl_git_pass(git_odb_add_backend(_odb, backend, 1));
+}
+
+static int open_loose(git_odb_backend **backend, const char *objects_dir)
+{
+	return git_odb_backend_loose(backend, objects_dir, -1, 0);
+}
+
+/* Stream `id` in chunks of `chunk` bytes and check it against a full read */
+static void assert_streams_as_read(const git_oid *id, size_t chunk)
+{
+	git_odb_object *obj;
+	git_odb_stream *stream;
+	git_buf streamed = GIT_BUF_INIT;
+	char *buffer;
+	size_t len;
+	git_otype type;
+	int read_bytes;
+
+	cl_git_pass(git_odb_read(&obj, _odb, id));
+	cl_git_pass(git_odb_read_header(&len, &type, _odb, id));
+	cl_assert(len == git_odb_object_size(obj));
+	cl_assert(type == git_odb_object_type(obj));
+
+	buffer = git__malloc(chunk);
+	cl_assert(buffer != NULL);
+
+	cl_git_pass(git_odb_open_rstream(&stream, _odb, id));
+	cl_assert(stream->mode == GIT_STREAM_RDONLY);
+
+	while ((read_bytes = stream->read(stream, buffer, chunk)) > 0) {
+		cl_assert((size_t)read_bytes <= chunk);
+		cl_git_pass(git_buf_put(&streamed, buffer, read_bytes));
+	}
+
+	cl_assert(read_bytes == 0);
+	cl_assert(streamed.size == git_odb_object_size(obj));
+	cl_assert(memcmp(streamed.ptr, git_odb_object_data(obj), streamed.size) == 0);
+
+	/* the end stays the end */
+	cl_assert(stream->read(stream, buffer, chunk) == 0);
+
+	stream->free(stream);
+	git__free(buffer);
+	git_buf_free(&streamed);
+	git_odb_object_free(obj);
+}
+
+static void assert_streams(const char *sha)
+{
+	git_oid id;
+
+	cl_git_pass(git_oid_fromstr(&id, sha));
+
+	assert_streams_as_read(&id, 1);
+	assert_streams_as_read(&id, 7);
+	assert_streams_as_read(&id, 4096);
+}
+
+void test_odb_streams__packed_objects(void)
+{
+	open_backend_only(git_odb_backend_pack);
+
+	assert_streams(packed_whole);
+	assert_streams(packed_delta);
+	assert_streams(deep_delta);
+}
+
+void test_odb_streams__loose_objects(void)
+{
+	open_backend_only(open_loose);
+
+	assert_streams(loose_commit);
+	assert_streams(loose_tree);
+}
+
+void test_odb_streams__large_loose_objects(void)
+{
+	git_oid id;
+	char *data;
+	size_t i, len = 300 * 1024;
+
+	data = git__malloc(len);
+	cl_assert(data != NULL);
+
+	/* something that doesn't compress down to nothing */
+	for (i = 0; i < len; ++i)
+		data[i] = (char)((i * 7919) ^ (i >> 5));
+
+	cl_git_pass(git_odb_write(&id, _odb, data, len, GIT_OBJ_BLOB));
+	git__free(data);
+
+	open_backend_only(open_loose);
+
+	assert_streams_as_read(&id, 1000);
+	assert_streams_as_read(&id, 64 * 1024);
+	assert_streams_as_read(&id, 1024 * 1024);
+}
+
+void test_odb_streams__missing_objects(void)
+{
+	git_odb_stream *stream;
+	git_oid id;
+
+	cl_git_pass(git_oid_fromstr(&id, "0000000000000000000000000000000000000001"));
+	cl_git_fail(git_odb_open_rstream(&stream, _odb, &id));
+}
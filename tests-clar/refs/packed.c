@@ -0,0 +1,165 @@
+#include "clar_libgit2.h"
+#include "fileops.h"
+#include "refs.h"
+#include "repository.h"
+
+#define PACKED_REFS "testrepo.git/packed-refs"
+#define COMMIT_ID "a65fedf39aefe402d3bb6e24df4d4f5fe4547750"
+#define OTHER_ID "be3563ae3f795b2b4353bcce3a527ad0a4f7f644"
+
+static git_repository *_repo;
+
+void test_refs_packed__initialize(void)
+{
+	cl_fixture_sandbox("testrepo.git");
+	cl_git_pass(git_repository_open(&_repo, "testrepo.git"));
+}
+
+void test_refs_packed__cleanup(void)
+{
+	git_repository_free(_repo);
+	cl_fixture_cleanup("testrepo.git");
+}
+
+/* Tags t000 to t<count - 1>, every third one peeled, and some branches */
+static void write_packed_refs(const char *header, int count, int reversed)
+{
+	git_buf contents = GIT_BUF_INIT;
+	int i;
+
+	cl_git_pass(git_buf_puts(&contents, header));
+	cl_git_pass(git_buf_printf(&contents, "%s refs/heads/packed\n", COMMIT_ID));
+
+	for (i = 0; i < count; ++i) {
+		int n = reversed ? count - 1 - i : i;
+
+		cl_git_pass(git_buf_printf(&contents, "%s refs/tags/t%03d\n",
+			(n % 2) ? OTHER_ID : COMMIT_ID, n));
+
+		if (n % 3 == 0)
+			cl_git_pass(git_buf_printf(&contents, "^%s\r\n", COMMIT_ID));
+	}
+
+	cl_git_pass(git_buf_printf(&contents, "%s refs/tags/u\n", OTHER_ID));
+
+	cl_git_mkfile(PACKED_REFS, contents.ptr);
+	git_buf_free(&contents);
+}
+
+static void assert_packed(const char *name, const char *id)
+{
+	git_reference *ref;
+	git_oid oid;
+
+	cl_git_pass(git_oid_fromstr(&oid, id));
+	cl_git_pass(git_reference_lookup(&ref, _repo, name));
+
+	cl_assert(git_reference_type(ref) == GIT_REF_OID);
+	cl_assert(git_reference_is_packed(ref));
+	cl_assert(git_oid_cmp(&oid, git_reference_oid(ref)) == 0);
+
+	git_reference_free(ref);
+}
+
+static void assert_not_found(const char *name)
+{
+	git_reference *ref;
+
+	cl_assert(git_reference_lookup(&ref, _repo, name) == GIT_ENOTFOUND);
+}
+
+static void assert_all_found(int count)
+{
+	char name[32];
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		sprintf(name, "refs/tags/t%03d", i);
+		assert_packed(name, (i % 2) ? OTHER_ID : COMMIT_ID);
+	}
+
+	assert_packed("refs/heads/packed", COMMIT_ID);
+	assert_packed("refs/tags/u", OTHER_ID);
+
+	assert_not_found("refs/heads/pack");
+	assert_not_found("refs/tags/t00");
+	assert_not_found("refs/tags/t0000");
+	assert_not_found("refs/tags/t999");
+	assert_not_found("refs/tags/a");
+	assert_not_found("refs/tags/v");
+}
+
+void test_refs_packed__single_lookups_leave_the_rest_on_disk(void)
+{
+	write_packed_refs("# pack-refs with: peeled sorted \n", 500, 0);
+
+	assert_all_found(500);
+	cl_assert(_repo->references.packfile == NULL);
+}
+
+void test_refs_packed__files_which_are_sorted_without_saying_so(void)
+{
+	write_packed_refs("# pack-refs with: peeled \n", 77, 0);
+
+	assert_all_found(77);
+	cl_assert(_repo->references.packfile == NULL);
+}
+
+void test_refs_packed__unsorted_files_are_loaded_whole(void)
+{
+	write_packed_refs("", 77, 1);
+
+	assert_all_found(77);
+	cl_assert(_repo->references.packfile != NULL);
+}
+
+void test_refs_packed__the_file_is_only_mapped_during_a_lookup(void)
+{
+	write_packed_refs("# pack-refs with: peeled sorted \n", 10, 0);
+
+	assert_packed("refs/tags/t004", COMMIT_ID);
+	cl_assert(_repo->references.packmap.data == NULL);
+	assert_not_found("refs/tags/t999");
+	cl_assert(_repo->references.packmap.data == NULL);
+
+	/* it can be replaced while the repository is open */
+	write_packed_refs("# pack-refs with: peeled sorted \n", 20, 0);
+	assert_packed("refs/tags/t015", OTHER_ID);
+	cl_assert(_repo->references.packmap.data == NULL);
+}
+
+void test_refs_packed__existing_references_are_not_overwritten(void)
+{
+	git_reference *ref;
+	git_oid oid;
+
+	write_packed_refs("# pack-refs with: peeled sorted \n", 10, 0);
+	cl_git_pass(git_oid_fromstr(&oid, OTHER_ID));
+
+	cl_assert(git_reference_create_oid(
+		&ref, _repo, "refs/tags/t004", &oid, 0) == GIT_EEXISTS);
+	cl_git_pass(git_reference_create_oid(
+		&ref, _repo, "refs/tags/t004", &oid, 1));
+	git_reference_free(ref);
+
+	assert_packed("refs/tags/t005", OTHER_ID);
+}
+
+void test_refs_packed__lookups_see_a_repacked_file(void)
+{
+	git_reference *ref;
+	git_oid oid;
+
+	assert_packed("refs/heads/packed", "41bc8c69075bbdb46c5c6f0566cc8cc5b46e8bd9");
+	assert_not_found("refs/heads/new-packed");
+
+	cl_git_pass(git_oid_fromstr(&oid, COMMIT_ID));
+	cl_git_pass(git_reference_create_oid(
+		&ref, _repo, "refs/heads/new-packed", &oid, 0));
+	git_reference_free(ref);
+
+	cl_git_pass(git_reference_packall(_repo));
+
+	assert_packed("refs/heads/new-packed", COMMIT_ID);
+	assert_packed("refs/heads/packed", "41bc8c69075bbdb46c5c6f0566cc8cc5b46e8bd9");
+}
@@ -0,0 +1,194 @@
+#include "clar_libgit2.h"
+#include "fileops.h"
+#include "refs.h"
+
+#define PACKED_REFS "testrepo.git/packed-refs"
+#define PACKED_ID "41bc8c69075bbdb46c5c6f0566cc8cc5b46e8bd9"
+#define MASTER_ID "a65fedf39aefe402d3bb6e24df4d4f5fe4547750"
+#define OTHER_ID "be3563ae3f795b2b4353bcce3a527ad0a4f7f644"
+
+static git_repository *_repo;
+static git_reference_transaction *_tx;
+static git_oid _master_id, _other_id;
+
+void test_refs_transaction__initialize(void)
+{
+	cl_fixture_sandbox("testrepo.git");
+	cl_git_pass(git_repository_open(&_repo, "testrepo.git"));
+	cl_git_pass(git_reference_transaction_new(&_tx, _repo));
+
+	cl_git_pass(git_oid_fromstr(&_master_id, MASTER_ID));
+	cl_git_pass(git_oid_fromstr(&_other_id, OTHER_ID));
+}
+
+void test_refs_transaction__cleanup(void)
+{
+	git_reference_transaction_free(_tx);
+	git_repository_free(_repo);
+	cl_fixture_cleanup("testrepo.git");
+}
+
+static void assert_points_to(const char *name, const char *id)
+{
+	git_reference *ref;
+	git_oid oid;
+
+	cl_git_pass(git_oid_fromstr(&oid, id));
+	cl_git_pass(git_reference_lookup(&ref, _repo, name));
+	cl_assert(git_reference_type(ref) == GIT_REF_OID);
+	cl_assert(git_oid_cmp(&oid, git_reference_oid(ref)) == 0);
+	git_reference_free(ref);
+}
+
+static void assert_missing(const char *name)
+{
+	git_reference *ref;
+
+	cl_assert(git_reference_lookup(&ref, _repo, name) == GIT_ENOTFOUND);
+}
+
+static void read_packed_refs(git_buf *contents)
+{
+	cl_git_pass(git_futils_readbuffer(contents, PACKED_REFS));
+}
+
+void test_refs_transaction__applies_every_update(void)
+{
+	git_reference *ref;
+	git_buf before = GIT_BUF_INIT, after = GIT_BUF_INIT;
+	char name[64];
+	int i;
+
+	read_packed_refs(&before);
+
+	for (i = 0; i < 100; ++i) {
+		sprintf(name, "refs/remotes/mirror/branch-%02d", i);
+		cl_git_pass(git_reference_transaction_set_oid(_tx, name, &_other_id));
+	}
+
+	cl_git_pass(git_reference_transaction_set_oid(_tx, "refs/heads/master", &_other_id));
+	cl_git_pass(git_reference_transaction_set_oid(_tx, "refs/heads/packed", &_master_id));
+	cl_git_pass(git_reference_transaction_set_target(_tx, "refs/heads/alias", "refs/heads/master"));
+
+	/* nothing happens until it's committed */
+	assert_points_to("refs/heads/master", MASTER_ID);
+	assert_missing("refs/remotes/mirror/branch-00");
+
+	cl_git_pass(git_reference_transaction_commit(_tx));
+
+	assert_points_to("refs/heads/master", OTHER_ID);
+	assert_points_to("refs/heads/packed", MASTER_ID);
+	assert_points_to("refs/remotes/mirror/branch-00", OTHER_ID);
+	assert_points_to("refs/remotes/mirror/branch-99", OTHER_ID);
+
+	cl_git_pass(git_reference_lookup(&ref, _repo, "refs/heads/alias"));
+	cl_assert(git_reference_type(ref) == GIT_REF_SYMBOLIC);
+	cl_assert_strequal("refs/heads/master", git_reference_target(ref));
+	git_reference_free(ref);
+
+	/* updates don't need packed-refs to be rewritten */
+	read_packed_refs(&after);
+	cl_assert_strequal(before.ptr, after.ptr);
+	cl_git_pass(git_path_exists("testrepo.git/refs/remotes/mirror/branch-42"));
+
+	git_buf_free(&before);
+	git_buf_free(&after);
+}
+
+void test_refs_transaction__deletes_packed_references_at_once(void)
+{
+	git_buf contents = GIT_BUF_INIT;
+
+	cl_git_pass(git_reference_transaction_delete(_tx, "refs/heads/packed"));
+	cl_git_pass(git_reference_transaction_delete(_tx, "refs/heads/packed-test"));
+	cl_git_pass(git_reference_transaction_delete(_tx, "refs/heads/br2"));
+	cl_git_pass(git_reference_transaction_commit(_tx));
+
+	assert_missing("refs/heads/packed");
+	assert_missing("refs/heads/packed-test");
+	assert_missing("refs/heads/br2");
+	assert_points_to("refs/heads/master", MASTER_ID);
+
+	/* the loose and packed versions are both gone */
+	cl_git_fail(git_path_exists("testrepo.git/refs/heads/packed-test"));
+	read_packed_refs(&contents);
+	cl_assert(strstr(contents.ptr, "refs/heads/packed") == NULL);
+	git_buf_free(&contents);
+}
+
+void test_refs_transaction__the_last_update_wins(void)
+{
+	cl_git_pass(git_reference_transaction_set_oid(_tx, "refs/heads/br2", &_master_id));
+	cl_git_pass(git_reference_transaction_delete(_tx, "refs/heads/br2"));
+	cl_git_pass(git_reference_transaction_set_oid(_tx, "refs/heads/br2", &_other_id));
+	cl_git_pass(git_reference_transaction_set_oid(_tx, "refs/heads/test", &_master_id));
+	cl_git_pass(git_reference_transaction_delete(_tx, "refs/heads/test"));
+	cl_git_pass(git_reference_transaction_commit(_tx));
+
+	assert_points_to("refs/heads/br2", OTHER_ID);
+	assert_missing("refs/heads/test");
+}
+
+void test_refs_transaction__nothing_changes_when_a_lock_is_taken(void)
+{
+	cl_git_mkfile("testrepo.git/refs/heads/br2.lock", "someone else's\n");
+
+	cl_git_pass(git_reference_transaction_set_oid(_tx, "refs/heads/master", &_other_id));
+	cl_git_pass(git_reference_transaction_set_oid(_tx, "refs/heads/br2", &_other_id));
+	cl_git_pass(git_reference_transaction_delete(_tx, "refs/heads/packed"));
+	cl_git_fail(git_reference_transaction_commit(_tx));
+
+	assert_points_to("refs/heads/master", MASTER_ID);
+	assert_points_to("refs/heads/packed", PACKED_ID);
+
+	/* ours are released, theirs is left alone */
+	cl_git_fail(git_path_exists("testrepo.git/refs/heads/master.lock"));
+	cl_git_fail(git_path_exists(PACKED_REFS ".lock"));
+	cl_git_pass(git_path_exists("testrepo.git/refs/heads/br2.lock"));
+}
+
+void test_refs_transaction__nothing_changes_when_a_reference_is_missing(void)
+{
+	cl_git_pass(git_reference_transaction_set_oid(_tx, "refs/heads/master", &_other_id));
+	cl_git_pass(git_reference_transaction_delete(_tx, "refs/heads/nope"));
+	cl_assert(git_reference_transaction_commit(_tx) == GIT_ENOTFOUND);
+
+	assert_points_to("refs/heads/master", MASTER_ID);
+}
+
+void test_refs_transaction__names_cannot_conflict(void)
+{
+	cl_git_pass(git_reference_transaction_set_oid(_tx, "refs/heads/master/sub", &_other_id));
+	cl_assert(git_reference_transaction_commit(_tx) == GIT_EEXISTS);
+
+	cl_git_pass(git_reference_transaction_set_oid(_tx, "refs/heads/packed/sub", &_other_id));
+	cl_assert(git_reference_transaction_commit(_tx) == GIT_EEXISTS);
+
+	cl_git_pass(git_reference_transaction_set_oid(_tx, "refs/heads/new", &_other_id));
+	cl_git_pass(git_reference_transaction_set_oid(_tx, "refs/heads/new/sub", &_other_id));
+	cl_assert(git_reference_transaction_commit(_tx) == GIT_EEXISTS);
+
+	cl_git_pass(git_reference_transaction_set_oid(_tx, "refs/heads", &_other_id));
+	cl_assert(git_reference_transaction_commit(_tx) == GIT_EEXISTS);
+
+	assert_points_to("refs/heads/master", MASTER_ID);
+	assert_missing("refs/heads/new");
+}
+
+void test_refs_transaction__a_deleted_reference_makes_room(void)
+{
+	cl_git_pass(git_reference_transaction_delete(_tx, "refs/heads/packed"));
+	cl_git_pass(git_reference_transaction_set_oid(_tx, "refs/heads/packed/sub", &_other_id));
+	cl_git_pass(git_reference_transaction_commit(_tx));
+
+	assert_missing("refs/heads/packed");
+	assert_points_to("refs/heads/packed/sub", OTHER_ID);
+}
+
+void test_refs_transaction__the_objects_must_exist(void)
+{
+	git_oid oid;
+
+	cl_git_pass(git_oid_fromstr(&oid, "0000000000000000000000000000000000000001"));
+	cl_assert(git_reference_transaction_set_oid(_tx, "refs/heads/master", &oid) == GIT_ENOTFOUND);
+}
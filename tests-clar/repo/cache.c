@@ -0,0 +1,107 @@
+#include "clar_libgit2.h"
+
+static git_repository *_repo;
+
+static const char *commit_id = "a65fedf39aefe402d3bb6e24df4d4f5fe4547750";
+static const char *blob_id = "a8233120f6ad708f843d861ce2b7228ec4e3dec6";
+
+void test_repo_cache__initialize(void)
+{
+	cl_git_pass(git_repository_open(&_repo, cl_fixture("testrepo.git")));
+}
+
+void test_repo_cache__cleanup(void)
+{
+	git_repository_free(_repo);
+}
+
+static void lookup_twice(const char *sha, git_otype type)
+{
+	git_oid id;
+	git_object *obj;
+	int i;
+
+	cl_git_pass(git_oid_fromstr(&id, sha));
+
+	for (i = 0; i < 2; ++i) {
+		cl_git_pass(git_object_lookup(&obj, _repo, &id, type));
+		git_object_free(obj);
+	}
+}
+
+void test_repo_cache__default_limits(void)
+{
+	size_t limit;
+
+	cl_git_pass(git_repository_get_cache_limit(&limit, _repo, GIT_OBJ_COMMIT));
+	cl_assert(limit == 8 * 1024 * 1024);
+	cl_git_pass(git_repository_get_cache_limit(&limit, _repo, GIT_OBJ_BLOB));
+	cl_assert(limit == 2 * 1024 * 1024);
+}
+
+void test_repo_cache__invalid_type(void)
+{
+	size_t limit;
+
+	cl_assert(git_repository_set_cache_limit(_repo, GIT_OBJ_ANY, 0) == GIT_EINVALIDTYPE);
+	cl_assert(git_repository_get_cache_limit(&limit, _repo, GIT_OBJ_OFS_DELTA) == GIT_EINVALIDTYPE);
+}
+
+void test_repo_cache__objects_are_cached(void)
+{
+	git_cache_stats stats;
+
+	lookup_twice(commit_id, GIT_OBJ_COMMIT);
+	lookup_twice(blob_id, GIT_OBJ_BLOB);
+
+	git_repository_get_cache_stats(&stats, _repo);
+	cl_assert(stats.hits == 2);
+	cl_assert(stats.misses == 2);
+	cl_assert(stats.count == 2);
+	cl_assert(stats.size > 0);
+}
+
+void test_repo_cache__a_zero_limit_keeps_the_type_out(void)
+{
+	git_cache_stats stats;
+	size_t limit;
+
+	cl_git_pass(git_repository_set_cache_limit(_repo, GIT_OBJ_BLOB, 0));
+	cl_git_pass(git_repository_get_cache_limit(&limit, _repo, GIT_OBJ_BLOB));
+	cl_assert(limit == 0);
+
+	lookup_twice(commit_id, GIT_OBJ_COMMIT);
+	lookup_twice(blob_id, GIT_OBJ_BLOB);
+
+	git_repository_get_cache_stats(&stats, _repo);
+	cl_assert(stats.hits == 1);
+	cl_assert(stats.misses == 3);
+	cl_assert(stats.count == 1);
+}
+
+void test_repo_cache__lowering_a_limit_evicts(void)
+{
+	git_cache_stats stats;
+
+	lookup_twice(commit_id, GIT_OBJ_COMMIT);
+	cl_git_pass(git_repository_set_cache_limit(_repo, GIT_OBJ_COMMIT, 0));
+
+	git_repository_get_cache_stats(&stats, _repo);
+	cl_assert(stats.count == 0);
+	cl_assert(stats.evictions == 1);
+}
+
+void test_repo_cache__odb_limits(void)
+{
+	git_odb *odb;
+	size_t limit;
+
+	cl_git_pass(git_repository_odb(&odb, _repo));
+
+	cl_git_pass(git_odb_set_cache_limit(odb, GIT_OBJ_TREE, 1024));
+	cl_git_pass(git_odb_get_cache_limit(&limit, odb, GIT_OBJ_TREE));
+	cl_assert(limit == 1024);
+	cl_assert(git_odb_set_cache_limit(odb, GIT_OBJ_BAD, 0) == GIT_EINVALIDTYPE);
+
+	git_odb_free(odb);
+}
@@ -0,0 +1,160 @@
+#include "clar_libgit2.h"
+#include "commit_graph.h"
+#include "fileops.h"
+#include "path.h"
+
+#define GRAPH_PATH "testrepo.git/objects/info/commit-graph"
+
+static git_repository *_repo;
+
+void test_revwalk_commit_graph__initialize(void)
+{
+	cl_fixture_sandbox("testrepo.git");
+	cl_git_pass(git_repository_open(&_repo, "testrepo.git"));
+}
+
+void test_revwalk_commit_graph__cleanup(void)
+{
+	git_repository_free(_repo);
+	cl_fixture_cleanup("testrepo.git");
+}
+
+static void write_graph(void)
+{
+	git_revwalk *walk;
+
+	cl_git_pass(git_revwalk_new(&walk, _repo));
+	cl_git_pass(git_revwalk_push_glob(walk, "heads"));
+	cl_git_pass(git_revwalk_write_commit_graph(walk));
+	git_revwalk_free(walk);
+}
+
+/* Walk everything under the branches; returns the number of commits */
+static size_t walk_branches(git_oid *out, size_t max, unsigned int sorting)
+{
+	git_revwalk *walk;
+	git_oid id;
+	size_t n = 0;
+
+	cl_git_pass(git_revwalk_new(&walk, _repo));
+	git_revwalk_sorting(walk, sorting);
+	cl_git_pass(git_revwalk_push_glob(walk, "heads"));
+
+	while (git_revwalk_next(&id, walk) == GIT_SUCCESS) {
+		cl_assert(n < max);
+		git_oid_cpy(&out[n++], &id);
+	}
+
+	git_revwalk_free(walk);
+	return n;
+}
+
+void test_revwalk_commit_graph__write_and_read(void)
+{
+	git_commit_graph_file *graph;
+	git_commit_graph_entry e, parent;
+	git_oid id;
+	uint32_t pos;
+
+	write_graph();
+	cl_git_pass(git_commit_graph_open(&graph, GRAPH_PATH));
+	cl_assert(graph->num_commits == 13);
+
+	/* a merge */
+	cl_git_pass(git_oid_fromstr(&id, "a4a7dce85cf63874e984719f4fdd239f5145052f"));
+	cl_git_pass(git_commit_graph_entry_find(&e, graph, &id, GIT_OID_HEXSZ));
+	cl_assert(git_oid_cmp(&e.sha1, &id) == 0);
+	cl_assert(git_oid_streq(&e.tree_oid, "1810dff58d8a660512d4832e740f692884338ccd") == GIT_SUCCESS);
+	cl_assert(e.commit_time == 1274814023);
+	cl_assert(e.parent_count == 2);
+
+	cl_git_pass(git_commit_graph_entry_parent_position(&pos, graph, &e, 0));
+	cl_git_pass(git_commit_graph_entry_get_byindex(&parent, graph, pos));
+	cl_assert(git_oid_streq(&parent.sha1, "c47800c7266a2be04c571c04d5a6614691ea99bd") == GIT_SUCCESS);
+	cl_assert(parent.generation < e.generation);
+
+	cl_git_pass(git_commit_graph_entry_parent_position(&pos, graph, &e, 1));
+	cl_git_pass(git_commit_graph_entry_get_byindex(&parent, graph, pos));
+	cl_assert(git_oid_streq(&parent.sha1, "9fd738e8f7967c078dceed8190330fc8648ee56a") == GIT_SUCCESS);
+	cl_git_fail(git_commit_graph_entry_parent_position(&pos, graph, &e, 2));
+
+	/* a root commit, found by prefix */
+	cl_git_pass(git_oid_fromstrn(&id, "8496071c", 8));
+	cl_git_pass(git_commit_graph_entry_find(&e, graph, &id, 8));
+	cl_assert(e.parent_count == 0);
+	cl_assert(e.generation == 1);
+
+	git_commit_graph_free(graph);
+}
+
+void test_revwalk_commit_graph__walks_are_unchanged(void)
+{
+	static const unsigned int sortings[] = {
+		GIT_SORT_TIME, GIT_SORT_TOPOLOGICAL, GIT_SORT_TIME | GIT_SORT_REVERSE,
+	};
+	git_oid expected[16], actual[16];
+	size_t i, j, n;
+
+	for (i = 0; i < ARRAY_SIZE(sortings); ++i) {
+		if (git_path_exists(GRAPH_PATH) == GIT_SUCCESS)
+			cl_git_pass(p_unlink(GRAPH_PATH));
+
+		n = walk_branches(expected, ARRAY_SIZE(expected), sortings[i]);
+		cl_assert(n == 13);
+
+		write_graph();
+		cl_assert(walk_branches(actual, ARRAY_SIZE(actual), sortings[i]) == n);
+
+		for (j = 0; j < n; ++j)
+			cl_assert(git_oid_cmp(&expected[j], &actual[j]) == 0);
+	}
+}
+
+void test_revwalk_commit_graph__corrupted_graph_is_ignored(void)
+{
+	git_commit_graph_file *graph;
+	git_oid ids[16];
+
+	cl_git_pass(git_futils_mkpath2file(GRAPH_PATH, 0777));
+	cl_git_mkfile(GRAPH_PATH, "CGPH this is not a commit-graph");
+	cl_git_fail(git_commit_graph_open(&graph, GRAPH_PATH));
+
+	cl_assert(walk_branches(ids, ARRAY_SIZE(ids), GIT_SORT_TIME) == 13);
+}
+
+/* Commit times take 34 bits, the top two sharing a word with the generation */
+void test_revwalk_commit_graph__times_past_32_bits(void)
+{
+	/* 2^33 + 42, written by hand as git_signature only writes 32 bits */
+	static const char future[] =
+		"tree 1810dff58d8a660512d4832e740f692884338ccd\n"
+		"parent a65fedf39aefe402d3bb6e24df4d4f5fe4547750\n"
+		"author Future <future@example.com> 8589934634 +0000\n"
+		"committer Future <future@example.com> 8589934634 +0000\n"
+		"\n"
+		"From the future\n";
+	git_commit_graph_file *graph;
+	git_commit_graph_entry e;
+	git_reference *ref;
+	git_odb *odb;
+	git_oid id, ids[16];
+
+	cl_git_pass(git_repository_odb(&odb, _repo));
+	cl_git_pass(git_odb_write(&id, odb, future, strlen(future), GIT_OBJ_COMMIT));
+	cl_git_pass(git_reference_create_oid(&ref, _repo, "refs/heads/future", &id, 0));
+	git_reference_free(ref);
+	git_odb_free(odb);
+
+	cl_assert(walk_branches(ids, ARRAY_SIZE(ids), GIT_SORT_TIME) == 14);
+	cl_assert(git_oid_cmp(&ids[0], &id) == 0);
+
+	write_graph();
+	cl_git_pass(git_commit_graph_open(&graph, GRAPH_PATH));
+	cl_git_pass(git_commit_graph_entry_find(&e, graph, &id, GIT_OID_HEXSZ));
+	cl_assert(e.commit_time == ((git_time_t)1 << 33) + 42);
+	cl_assert(e.generation > 1);
+	git_commit_graph_free(graph);
+
+	cl_assert(walk_branches(ids, ARRAY_SIZE(ids), GIT_SORT_TIME) == 14);
+	cl_assert(git_oid_cmp(&ids[0], &id) == 0);
+}
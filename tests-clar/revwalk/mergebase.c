@@ -0,0 +1,155 @@
+#include "clar_libgit2.h"
+
+static git_repository *_repo;
+static git_revwalk *_walk;
+
+void test_revwalk_mergebase__initialize(void)
+{
+	cl_fixture_sandbox("testrepo.git");
+	cl_git_pass(git_repository_open(&_repo, "testrepo.git"));
+	cl_git_pass(git_revwalk_new(&_walk, _repo));
+}
+
+void test_revwalk_mergebase__cleanup(void)
+{
+	git_revwalk_free(_walk);
+	git_repository_free(_repo);
+	cl_fixture_cleanup("testrepo.git");
+}
+
+/* Run the remaining checks again, this time with generation numbers */
+static void use_commit_graph(void)
+{
+	cl_git_pass(git_revwalk_push_glob(_walk, "heads"));
+	cl_git_pass(git_revwalk_write_commit_graph(_walk));
+	git_revwalk_free(_walk);
+
+	cl_git_pass(git_revwalk_new(&_walk, _repo));
+}
+
+static void assert_merge_base(const char *one, const char *two, const char *expected)
+{
+	git_oid one_id, two_id, base;
+
+	cl_git_pass(git_oid_fromstr(&one_id, one));
+	cl_git_pass(git_oid_fromstr(&two_id, two));
+
+	cl_git_pass(git_revwalk_merge_base(&base, _walk, &one_id, &two_id));
+	cl_assert(git_oid_streq(&base, expected) == GIT_SUCCESS);
+
+	cl_git_pass(git_revwalk_merge_base(&base, _walk, &two_id, &one_id));
+	cl_assert(git_oid_streq(&base, expected) == GIT_SUCCESS);
+}
+
+static void assert_ahead_behind(const char *local, const char *upstream,
+	size_t expected_ahead, size_t expected_behind)
+{
+	git_oid local_id, upstream_id;
+	size_t ahead, behind;
+
+	cl_git_pass(git_oid_fromstr(&local_id, local));
+	cl_git_pass(git_oid_fromstr(&upstream_id, upstream));
+
+	cl_git_pass(git_revwalk_ahead_behind(&ahead, &behind, _walk, &local_id, &upstream_id));
+	cl_assert(ahead == expected_ahead);
+	cl_assert(behind == expected_behind);
+}
+
+static void check_merge_bases(void)
+{
+	git_oid one, two, base;
+
+	/* br2 and packed-test */
+	assert_merge_base("a4a7dce85cf63874e984719f4fdd239f5145052f",
+		"4a202b346bb0fb0db7eff3cffeb3c70babbd2045",
+		"4a202b346bb0fb0db7eff3cffeb3c70babbd2045");
+
+	/* master and its root */
+	assert_merge_base("a65fedf39aefe402d3bb6e24df4d4f5fe4547750",
+		"8496071c1b46c854b31185ea97743be6a8774479",
+		"8496071c1b46c854b31185ea97743be6a8774479");
+
+	assert_merge_base("a65fedf39aefe402d3bb6e24df4d4f5fe4547750",
+		"a65fedf39aefe402d3bb6e24df4d4f5fe4547750",
+		"a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+
+	/* master and br2 have been merged into each other: either is fine */
+	cl_git_pass(git_oid_fromstr(&one, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750"));
+	cl_git_pass(git_oid_fromstr(&two, "a4a7dce85cf63874e984719f4fdd239f5145052f"));
+	cl_git_pass(git_revwalk_merge_base(&base, _walk, &one, &two));
+	cl_assert(git_oid_streq(&base, "c47800c7266a2be04c571c04d5a6614691ea99bd") == GIT_SUCCESS ||
+		git_oid_streq(&base, "9fd738e8f7967c078dceed8190330fc8648ee56a") == GIT_SUCCESS);
+
+	/* master and packed have nothing in common */
+	cl_git_pass(git_oid_fromstr(&two, "41bc8c69075bbdb46c5c6f0566cc8cc5b46e8bd9"));
+	cl_assert(git_revwalk_merge_base(&base, _walk, &one, &two) == GIT_ENOTFOUND);
+}
+
+static void check_ahead_behind(void)
+{
+	/* master and br2 */
+	assert_ahead_behind("a65fedf39aefe402d3bb6e24df4d4f5fe4547750",
+		"a4a7dce85cf63874e984719f4fdd239f5145052f", 2, 1);
+	assert_ahead_behind("a4a7dce85cf63874e984719f4fdd239f5145052f",
+		"a65fedf39aefe402d3bb6e24df4d4f5fe4547750", 1, 2);
+
+	/* packed-test is part of master */
+	assert_ahead_behind("4a202b346bb0fb0db7eff3cffeb3c70babbd2045",
+		"a65fedf39aefe402d3bb6e24df4d4f5fe4547750", 0, 4);
+
+	/* unrelated histories count everything */
+	assert_ahead_behind("a65fedf39aefe402d3bb6e24df4d4f5fe4547750",
+		"41bc8c69075bbdb46c5c6f0566cc8cc5b46e8bd9", 7, 2);
+	assert_ahead_behind("e90810b8df3e80c413d903f631643c716887138d",
+		"763d71aadf09a7951596c9746c024e7eece7c7af", 2, 4);
+
+	assert_ahead_behind("a65fedf39aefe402d3bb6e24df4d4f5fe4547750",
+		"a65fedf39aefe402d3bb6e24df4d4f5fe4547750", 0, 0);
+}
+
+void test_revwalk_mergebase__merge_base(void)
+{
+	check_merge_bases();
+	use_commit_graph();
+	check_merge_bases();
+}
+
+void test_revwalk_mergebase__ahead_behind(void)
+{
+	check_ahead_behind();
+	use_commit_graph();
+	check_ahead_behind();
+}
+
+void test_revwalk_mergebase__walks_are_left_alone(void)
+{
+	git_oid one, two, base, id;
+	size_t ahead, behind, n = 0;
+
+	cl_git_pass(git_oid_fromstr(&one, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750"));
+	cl_git_pass(git_oid_fromstr(&two, "a4a7dce85cf63874e984719f4fdd239f5145052f"));
+
+	git_revwalk_sorting(_walk, GIT_SORT_TIME);
+	cl_git_pass(git_revwalk_push(_walk, &two));
+	cl_git_pass(git_revwalk_hide(_walk, &one));
+
+	cl_git_pass(git_revwalk_merge_base(&base, _walk, &one, &two));
+	cl_git_pass(git_revwalk_ahead_behind(&ahead, &behind, _walk, &one, &two));
+
+	while (git_revwalk_next(&id, _walk) == GIT_SUCCESS)
+		n++;
+
+	cl_assert(n == behind);
+}
+
+void test_revwalk_mergebase__non_commits_are_rejected(void)
+{
+	git_oid one, tree, base;
+	size_t ahead, behind;
+
+	cl_git_pass(git_oid_fromstr(&one, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750"));
+	cl_git_pass(git_oid_fromstr(&tree, "1810dff58d8a660512d4832e740f692884338ccd"));
+
+	cl_git_fail(git_revwalk_merge_base(&base, _walk, &one, &tree));
+	cl_git_fail(git_revwalk_ahead_behind(&ahead, &behind, _walk, &tree, &one));
+}
@@ -0,0 +1,316 @@
+#include "clar_libgit2.h"
+#include "fileops.h"
+#include "index.h"
+
+/*
+ * A stand-in for a filesystem monitor: what changed is whatever the
+ * test listed in a file, one path per line, since the last query
+ */
+#define CHANGES_FILE "fsmonitor-changes"
+
+typedef struct {
+	git_fsmonitor parent;
+	unsigned int queries;
+	char last_token[32];
+} list_fsmonitor;
+
+static int list_fsmonitor__query(
+	git_fsmonitor *fsm,
+	const char *token,
+	git_fsmonitor_changed_cb changed,
+	void *payload,
+	char **new_token)
+{
+	list_fsmonitor *lf = (list_fsmonitor *)fsm;
+	git_buf list = GIT_BUF_INIT;
+	char *line, *end;
+
+	strcpy(lf->last_token, token ? token : "");
+
+	if (git_path_exists(CHANGES_FILE) == GIT_SUCCESS) {
+		cl_git_pass(git_futils_readbuffer(&list, CHANGES_FILE));
+		cl_git_pass(p_unlink(CHANGES_FILE));
+
+		for (line = list.ptr; *line != '\0'; line = end + 1) {
+			end = strchr(line, '\n');
+			cl_assert(end != NULL);
+			*end = '\0';
+			cl_git_pass(changed(line, payload));
+		}
+
+		git_buf_free(&list);
+	}
+
+	*new_token = malloc(32);
+	cl_assert(*new_token != NULL);
+	sprintf(*new_token, "query-%u", ++lf->queries);
+
+	return GIT_SUCCESS;
+}
+
+static void list_fsmonitor__free(git_fsmonitor *fsm)
+{
+	git__free(fsm);
+}
+
+static git_repository *_repo;
+static list_fsmonitor *_fsmonitor;
+
+static void use_fsmonitor(void)
+{
+	_fsmonitor = git__calloc(1, sizeof(list_fsmonitor));
+	cl_assert(_fsmonitor != NULL);
+
+	_fsmonitor->parent.query = list_fsmonitor__query;
+	_fsmonitor->parent.free = list_fsmonitor__free;
+
+	git_repository_set_fsmonitor(_repo, &_fsmonitor->parent);
+}
+
+static int count_cb(const char *path, unsigned int status_flags, void *payload)
+{
+	GIT_UNUSED(path);
+	GIT_UNUSED(status_flags);
+
+	(*(int *)payload)++;
+	return 0;
+}
+
+/* Look at the whole working directory once, which the monitor remembers */
+static int status_count(void)
+{
+	int count = 0;
+
+	cl_git_pass(git_status_foreach(_repo, count_cb, &count));
+	return count;
+}
+
+static int status_count_on_threads(unsigned int threads)
+{
+	git_status_options opts;
+	int count = 0;
+
+	memset(&opts, 0x0, sizeof(opts));
+	opts.threads = threads;
+
+	cl_git_pass(git_status_foreach_ext(_repo, &opts, count_cb, &count));
+	return count;
+}
+
+static unsigned int status_of(const char *path)
+{
+	unsigned int status_flags;
+
+	cl_git_pass(git_status_file(&status_flags, _repo, path));
+	return status_flags;
+}
+
+static int untracked_cb(const char *path, unsigned int status_flags, void *payload)
+{
+	if (status_flags == GIT_STATUS_WT_NEW)
+		git_buf_printf(payload, "%s\n", path);
+	return 0;
+}
+
+/* The untracked files, with the untracked cache */
+static const char *status_untracked(git_buf *out)
+{
+	git_status_options opts;
+
+	memset(&opts, 0x0, sizeof(opts));
+	opts.flags = GIT_STATUS_OPT_EXCLUDE_IGNORED;
+
+	git_buf_clear(out);
+	cl_git_pass(git_status_foreach_ext(_repo, &opts, untracked_cb, out));
+	return out->ptr;
+}
+
+static void report(const char *path)
+{
+	cl_git_append2file(CHANGES_FILE, path);
+	cl_git_append2file(CHANGES_FILE, "\n");
+}
+
+void test_status_fsmonitor__initialize(void)
+{
+	_repo = cl_git_sandbox_init("status");
+	use_fsmonitor();
+}
+
+void test_status_fsmonitor__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+
+	if (git_path_exists(CHANGES_FILE) == GIT_SUCCESS)
+		cl_git_pass(p_unlink(CHANGES_FILE));
+}
+
+void test_status_fsmonitor__unreported_changes_are_not_looked_at(void)
+{
+	int count = status_count();
+
+	cl_git_mkfile("status/current_file", "not so current anymore\n");
+
+	cl_assert(status_count() == count);
+	cl_assert(status_of("current_file") == GIT_STATUS_CURRENT);
+
+	report("current_file");
+	cl_assert(status_of("current_file") == GIT_STATUS_WT_MODIFIED);
+	cl_assert(status_count() == count + 1);
+}
+
+void test_status_fsmonitor__threads_use_it_too(void)
+{
+	int count = status_count_on_threads(4);
+
+	cl_git_mkfile("status/current_file", "not so current anymore\n");
+	cl_git_mkfile("status/subdir/current_file", "not so current anymore\n");
+	cl_assert(status_count_on_threads(4) == count);
+
+	report("subdir/current_file");
+	cl_assert(status_count_on_threads(4) == count + 1);
+	cl_assert(_fsmonitor->queries == 3);
+}
+
+void test_status_fsmonitor__new_files_are_seen(void)
+{
+	int count = status_count();
+
+	cl_git_mkfile("status/subdir/brand_new_file", "hello\n");
+	report("subdir/brand_new_file");
+
+	cl_assert(status_count() == count + 1);
+	cl_assert(status_of("subdir/brand_new_file") == GIT_STATUS_WT_NEW);
+}
+
+void test_status_fsmonitor__a_directory_stands_for_everything_in_it(void)
+{
+	status_count();
+
+	cl_git_mkfile("status/current_file", "not so current anymore\n");
+	cl_git_mkfile("status/subdir/current_file", "not so current anymore\n");
+
+	report("subdir/");
+	cl_assert(status_of("subdir/current_file") == GIT_STATUS_WT_MODIFIED);
+	cl_assert(status_of("current_file") == GIT_STATUS_CURRENT);
+
+	report("");
+	cl_assert(status_of("current_file") == GIT_STATUS_WT_MODIFIED);
+}
+
+void test_status_fsmonitor__is_only_trusted_while_in_use(void)
+{
+	int count = status_count();
+
+	cl_git_mkfile("status/current_file", "not so current anymore\n");
+	cl_assert(status_count() == count);
+
+	git_repository_set_fsmonitor(_repo, NULL);
+	cl_assert(status_count() == count + 1);
+}
+
+void test_status_fsmonitor__the_index_remembers_where_the_monitor_was(void)
+{
+	git_repository *sandbox = _repo;
+	git_index *index;
+	int count = status_count();
+
+	cl_assert(_fsmonitor->queries == 1);
+
+	/* a fresh look at the repository only asks what changed since */
+	cl_git_pass(git_repository_open(&_repo, "status/.git"));
+	use_fsmonitor();
+
+	cl_git_mkfile("status/current_file", "not so current anymore\n");
+	cl_assert(status_count() == count);
+	cl_assert_strequal("query-1", _fsmonitor->last_token);
+
+	git_repository_free(_repo);
+	_repo = sandbox;
+
+	/* nothing changed since then, so the token is still good */
+	cl_git_pass(git_index_open(&index, "status/.git/index"));
+	cl_assert_strequal("query-1", index->fsmonitor_token);
+	cl_assert(git_index_get(index, git_index_find(index, "current_file"))->flags_extended == 0);
+	git_index_free(index);
+}
+
+static int find_modified_cb(void *payload, git_diff_delta *delta, float progress)
+{
+	GIT_UNUSED(progress);
+
+	if (delta->status == GIT_DELTA_MODIFIED &&
+		strcmp(delta->old.path, "subdir/current_file") == 0)
+		*(int *)payload = 1;
+
+	return 0;
+}
+
+static int subdir_file_is_modified(void)
+{
+	git_diff_list *diff;
+	int found = 0;
+
+	cl_git_pass(git_diff_workdir_to_index(_repo, NULL, &diff));
+	cl_git_pass(git_diff_foreach(diff, &found, find_modified_cb, NULL, NULL));
+	git_diff_list_free(diff);
+
+	return found;
+}
+
+void test_status_fsmonitor__diffs_use_it_too(void)
+{
+	cl_assert(!subdir_file_is_modified());
+
+	cl_git_mkfile("status/subdir/current_file", "not so current anymore\n");
+	cl_assert(!subdir_file_is_modified());
+
+	report("subdir/current_file");
+	cl_assert(subdir_file_is_modified());
+}
+
+/* A directory changed within the last second isn't recorded in the cache */
+static void age(const char *path)
+{
+	struct utimbuf times;
+
+	times.actime = times.modtime = time(NULL) - 60;
+	cl_must_pass(p_utime(path, &times));
+}
+
+void test_status_fsmonitor__unreported_directories_are_not_read(void)
+{
+	git_buf untracked = GIT_BUF_INIT;
+	git_config *cfg;
+
+	cl_git_pass(git_repository_config(&cfg, _repo));
+	cl_git_pass(git_config_set_bool(cfg, "core.untrackedCache", 1));
+	git_config_free(cfg);
+
+	age("status");
+	age("status/subdir");
+
+	/* the first query has everything changed, so it's all read */
+	cl_assert(strstr(status_untracked(&untracked), "subdir/new_file") != NULL);
+
+	cl_git_mkfile("status/subdir/brand_new_file", "hello\n");
+	cl_assert(strstr(status_untracked(&untracked), "subdir/brand_new_file") == NULL);
+
+	report("subdir");
+	cl_assert(strstr(status_untracked(&untracked), "subdir/brand_new_file") != NULL);
+
+	/* a directory stands for what's below it */
+	cl_git_pass(p_mkdir("status/subdir/deeper", 0777));
+	cl_git_mkfile("status/subdir/deeper/file", "hello\n");
+	age("status/subdir/deeper");
+	age("status/subdir");
+	report("subdir/deeper");
+	cl_assert(strstr(status_untracked(&untracked), "subdir/deeper/") != NULL);
+
+	/* and an empty path for everything */
+	cl_git_mkfile("status/yet_another_file", "hello\n");
+	report("");
+	cl_assert(strstr(status_untracked(&untracked), "yet_another_file") != NULL);
+
+	git_buf_free(&untracked);
+}
@@ -0,0 +1,252 @@
+#include "clar_libgit2.h"
+#include "fileops.h"
+#include "index.h"
+#include "repository.h"
+#include "untracked-cache.h"
+
+static git_repository *_repo;
+
+/*
+ * A directory changed within the last second isn't recorded, so age
+ * it; each time to another second, for the change to show
+ */
+static void age(const char *path)
+{
+	static int aged;
+	struct utimbuf times;
+
+	times.actime = times.modtime = time(NULL) - 60 - (++aged);
+	cl_must_pass(p_utime(path, &times));
+}
+
+static int collect_cb(const char *path, unsigned int status_flags, void *payload)
+{
+	git_buf_printf(payload, "%s %u\n", path, status_flags);
+	return 0;
+}
+
+static void status_with(git_buf *out, unsigned int flags, unsigned int threads)
+{
+	git_status_options opts;
+
+	memset(&opts, 0x0, sizeof(opts));
+	opts.flags = flags;
+	opts.threads = threads;
+
+	git_buf_clear(out);
+	cl_git_pass(git_status_foreach_ext(_repo, &opts, collect_cb, out));
+}
+
+static git_untracked_dir *cached_dir(const char *path)
+{
+	git_index *index;
+
+	cl_git_pass(git_repository_index__weakptr(&index, _repo));
+	cl_assert(index->untracked != NULL);
+
+	return git_untracked_cache_find(index->untracked, path, 0);
+}
+
+/* Whether the directory is in the cache, and `name` is untracked in it */
+static int cached_as_untracked(const char *path, const char *name)
+{
+	git_untracked_dir *dir = cached_dir(path);
+	unsigned int i;
+
+	if (dir == NULL || !dir->valid)
+		return 0;
+
+	for (i = 0; i < dir->untracked.length; ++i)
+		if (strcmp(git_vector_get(&dir->untracked, i), name) == 0)
+			return 1;
+
+	return 0;
+}
+
+void test_status_untracked_cache__initialize(void)
+{
+	git_config *cfg;
+
+	_repo = cl_git_sandbox_init("status");
+
+	cl_git_pass(git_repository_config(&cfg, _repo));
+	cl_git_pass(git_config_set_bool(cfg, "core.untrackedCache", 1));
+	git_config_free(cfg);
+
+	age("status");
+	age("status/subdir");
+}
+
+void test_status_untracked_cache__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+void test_status_untracked_cache__gives_the_same_statuses(void)
+{
+	git_buf all = GIT_BUF_INIT, expected = GIT_BUF_INIT, actual = GIT_BUF_INIT;
+	char *line, *end;
+
+	/* everything but the ignored files */
+	status_with(&all, 0, 0);
+	for (line = all.ptr; *line != '\0'; line = end + 1) {
+		end = strchr(line, '\n');
+		if (strtoul(strchr(line, ' ') + 1, NULL, 10) != GIT_STATUS_IGNORED)
+			git_buf_put(&expected, line, end - line + 1);
+	}
+	cl_assert(strstr(all.ptr, "ignored_file") != NULL);
+
+	/* once to record, then from the cache */
+	status_with(&actual, GIT_STATUS_OPT_EXCLUDE_IGNORED, 0);
+	cl_assert_strequal(expected.ptr, actual.ptr);
+	cl_assert(cached_as_untracked("", "new_file"));
+	cl_assert(cached_as_untracked("subdir", "new_file"));
+	cl_assert(!cached_as_untracked("", "ignored_file"));
+
+	status_with(&actual, GIT_STATUS_OPT_EXCLUDE_IGNORED, 0);
+	cl_assert_strequal(expected.ptr, actual.ptr);
+
+	status_with(&actual, GIT_STATUS_OPT_EXCLUDE_IGNORED, 4);
+	cl_assert_strequal(expected.ptr, actual.ptr);
+
+	/* which doesn't change what's reported without the flag */
+	status_with(&actual, 0, 0);
+	cl_assert_strequal(all.ptr, actual.ptr);
+
+	git_buf_free(&all);
+	git_buf_free(&expected);
+	git_buf_free(&actual);
+}
+
+void test_status_untracked_cache__unchanged_directories_are_not_read(void)
+{
+	git_untracked_dir *dir;
+	git_buf statuses = GIT_BUF_INIT;
+	unsigned int i;
+
+	status_with(&statuses, GIT_STATUS_OPT_EXCLUDE_IGNORED, 0);
+	cl_assert(strstr(statuses.ptr, "subdir/new_file") != NULL);
+
+	/* were the directory read, the file would still be found */
+	dir = cached_dir("subdir");
+	for (i = 0; i < dir->untracked.length; ++i)
+		git__free(git_vector_get(&dir->untracked, i));
+	git_vector_clear(&dir->untracked);
+
+	status_with(&statuses, GIT_STATUS_OPT_EXCLUDE_IGNORED, 0);
+	cl_assert(strstr(statuses.ptr, "subdir/new_file") == NULL);
+	cl_assert(strstr(statuses.ptr, "subdir/modified_file") != NULL);
+
+	/* a new file changes the directory */
+	cl_git_mkfile("status/subdir/another_file", "hello\n");
+
+	status_with(&statuses, GIT_STATUS_OPT_EXCLUDE_IGNORED, 0);
+	cl_assert(strstr(statuses.ptr, "subdir/new_file") != NULL);
+	cl_assert(strstr(statuses.ptr, "subdir/another_file") != NULL);
+
+	git_buf_free(&statuses);
+}
+
+void test_status_untracked_cache__new_directories_are_walked_into(void)
+{
+	git_buf statuses = GIT_BUF_INIT;
+
+	status_with(&statuses, GIT_STATUS_OPT_EXCLUDE_IGNORED, 0);
+
+	cl_git_pass(p_mkdir("status/newdir", 0777));
+	cl_git_pass(p_mkdir("status/newdir/empty", 0777));
+	age("status/newdir/empty");
+	age("status/newdir");
+	age("status");
+
+	status_with(&statuses, GIT_STATUS_OPT_EXCLUDE_IGNORED, 0);
+	cl_assert(strstr(statuses.ptr, "newdir") == NULL);
+
+	/* only the empty directory changes */
+	cl_git_mkfile("status/newdir/empty/file", "hello\n");
+	cl_assert(cached_dir("newdir/empty") != NULL);
+
+	status_with(&statuses, GIT_STATUS_OPT_EXCLUDE_IGNORED, 0);
+	cl_assert(strstr(statuses.ptr, "newdir/empty/file") != NULL);
+
+	git_buf_free(&statuses);
+}
+
+/* The ignore files are read once per repository, so look with a new one */
+static void status_reopened(git_buf *out)
+{
+	git_repository *sandbox = _repo;
+
+	cl_git_pass(git_repository_open(&_repo, "status/.git"));
+	status_with(out, GIT_STATUS_OPT_EXCLUDE_IGNORED, 0);
+	git_repository_free(_repo);
+
+	_repo = sandbox;
+}
+
+void test_status_untracked_cache__changed_ignore_files_are_seen(void)
+{
+	git_buf statuses = GIT_BUF_INIT;
+
+	cl_git_mkfile("status/subdir/.gitignore", "new_file\n");
+	age("status/subdir");
+
+	status_reopened(&statuses);
+	cl_assert(strstr(statuses.ptr, "subdir/new_file") == NULL);
+
+	/* rewriting the file leaves the directory as it was */
+	cl_git_mkfile("status/subdir/.gitignore", "nothing\n");
+	status_reopened(&statuses);
+	cl_assert(strstr(statuses.ptr, "subdir/new_file") != NULL);
+	cl_assert(strstr(statuses.ptr, "ignored_file") == NULL);
+
+	cl_git_mkfile("status/.git/info/exclude", "nothing\n");
+	status_reopened(&statuses);
+	cl_assert(strstr(statuses.ptr, "ignored_file") != NULL);
+
+	git_buf_free(&statuses);
+}
+
+void test_status_untracked_cache__changes_to_the_index_are_seen(void)
+{
+	git_buf statuses = GIT_BUF_INIT;
+	git_index *index;
+
+	status_with(&statuses, GIT_STATUS_OPT_EXCLUDE_IGNORED, 0);
+	cl_assert(strstr(statuses.ptr, "subdir/current_file") == NULL);
+
+	cl_git_pass(git_repository_index__weakptr(&index, _repo));
+	cl_git_pass(git_index_remove(index, git_index_find(index, "subdir/current_file")));
+
+	status_with(&statuses, GIT_STATUS_OPT_EXCLUDE_IGNORED, 0);
+	cl_assert(strstr(statuses.ptr, "subdir/current_file") != NULL);
+
+	git_buf_free(&statuses);
+}
+
+void test_status_untracked_cache__is_kept_in_the_index(void)
+{
+	git_repository *sandbox = _repo;
+	git_buf statuses = GIT_BUF_INIT;
+	git_config *cfg;
+	git_index *index;
+
+	status_with(&statuses, GIT_STATUS_OPT_EXCLUDE_IGNORED, 0);
+
+	cl_git_pass(git_repository_open(&_repo, "status/.git"));
+	cl_assert(cached_as_untracked("subdir", "new_file"));
+
+	/* until it's turned off */
+	cl_git_pass(git_repository_config(&cfg, _repo));
+	cl_git_pass(git_config_set_bool(cfg, "core.untrackedCache", 0));
+	git_config_free(cfg);
+
+	status_with(&statuses, GIT_STATUS_OPT_EXCLUDE_IGNORED, 0);
+	cl_git_pass(git_repository_index__weakptr(&index, _repo));
+	cl_assert(index->untracked == NULL);
+
+	git_repository_free(_repo);
+	_repo = sandbox;
+
+	git_buf_free(&statuses);
+}
@@ -133,3 +133,99 @@ void test_status_worktree__ignores(void)
 	);
 	cl_assert(ignored);
 }
+
+void test_status_worktree__whole_repository_on_several_threads(void)
+{
+	struct status_entry_counts counts;
+	git_status_options opts;
+	git_repository *repo = cl_git_sandbox_init("status");
+
+	memset(&opts, 0x0, sizeof(opts));
+	opts.threads = 4;
+
+	memset(&counts, 0x0, sizeof(struct status_entry_counts));
+	counts.expected_entry_count = entry_count0;
+	counts.expected_paths = entry_paths0;
+	counts.expected_statuses = entry_statuses0;
+
+	cl_git_pass(
+		git_status_foreach_ext(repo, &opts, cb_status__normal, &counts)
+	);
+
+	cl_assert(counts.entry_count == counts.expected_entry_count);
+	cl_assert(counts.wrong_status_flags_count == 0);
+	cl_assert(counts.wrong_sorted_path == 0);
+}
+
+static int
+cb_status__list(const char *path, unsigned int status_flags, void *payload)
+{
+	return git_buf_printf(payload, "%s %u\n", path, status_flags);
+}
+
+static void list_statuses(git_repository *repo, unsigned int threads, git_buf *out)
+{
+	git_status_options opts;
+
+	memset(&opts, 0x0, sizeof(opts));
+	opts.threads = threads;
+
+	cl_git_pass(git_status_foreach_ext(repo, &opts, cb_status__list, out));
+}
+
+void test_status_worktree__threads_see_what_one_thread_sees(void)
+{
+	git_buf one = GIT_BUF_INIT, many = GIT_BUF_INIT;
+	git_repository *repo = cl_git_sandbox_init("status");
+	char path[64];
+	int i;
+
+	/* top-level files and directories, in between the tracked ones */
+	for (i = 0; i < 10; ++i) {
+		sprintf(path, "status/dir%02d", i);
+		cl_git_pass(p_mkdir(path, 0777));
+		sprintf(path, "status/dir%02d/file", i);
+		cl_git_mkfile(path, "new\n");
+		sprintf(path, "status/file%02d", i);
+		cl_git_mkfile(path, "new\n");
+	}
+
+	cl_git_pass(p_mkdir("status/subdir/deeper", 0777));
+	cl_git_mkfile("status/subdir/deeper/file", "new\n");
+	cl_git_mkfile("status/subdir/current_file", "changed\n");
+	cl_git_pass(p_unlink("status/subdir/modified_file"));
+	cl_git_mkfile("status/subdir.txt.new", "new\n");
+
+	list_statuses(repo, 0, &one);
+	list_statuses(repo, 3, &many);
+	cl_assert_strequal(one.ptr, many.ptr);
+
+	git_buf_clear(&many);
+	list_statuses(repo, 64, &many);
+	cl_assert_strequal(one.ptr, many.ptr);
+
+	git_buf_free(&one);
+	git_buf_free(&many);
+}
+
+static int
+cb_status__stop(const char *path, unsigned int status_flags, void *payload)
+{
+	GIT_UNUSED(path);
+	GIT_UNUSED(status_flags);
+
+	return (--(*(int *)payload) == 0) ? GIT_ERROR : GIT_SUCCESS;
+}
+
+void test_status_worktree__threads_stop_with_the_callback(void)
+{
+	git_status_options opts;
+	int count = 3;
+	git_repository *repo = cl_git_sandbox_init("status");
+
+	memset(&opts, 0x0, sizeof(opts));
+	opts.threads = 4;
+
+	cl_assert(git_status_foreach_ext(repo, &opts, cb_status__stop, &count) == GIT_ERROR);
+	cl_assert(count == 0);
+}